@@ -23,6 +23,8 @@
  */
 #include "glab.h"
 #include "print.c"
+#include "stats.c"
+#include "pool.c"
 #include <arpa/inet.h>
 
 /**
@@ -121,7 +123,7 @@ struct Interface {
     char *name;
 
     /**
-     * Interface number.
+     * Interface number, 0 if this slot is unused.
      */
     uint16_t ifc_num;
 
@@ -133,18 +135,20 @@ struct Interface {
 
 
 /**
- * Number of available contexts.
+ * Length of gifc (some slots may be unused).
  */
 static unsigned int num_ifc;
 
 /**
- * All the contexts.
+ * All the contexts, indexed by interface number - 1.
  */
 static struct Interface *gifc;
 
 ////////////////////////////////////   added for work   ////////////////////////////////////
 #include <time.h>
+#ifndef ARP_CACHE_SIZE
 #define ARP_CACHE_SIZE 10
+#endif
 struct ArpEntry {
     struct in_addr ip;
     struct MacAddress mac;
@@ -174,18 +178,24 @@ int ipcomp (struct in_addr *ip1, struct in_addr *ip2 ){
 }
 ////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Append @a mac to the output buffer (see print_flush()).
+ */
 static void
 print_mac (const struct MacAddress *mac)
 {
-    print ("%02x:%02x:%02x:%02x:%02x:%02x",
+    print_append ("%02x:%02x:%02x:%02x:%02x:%02x",
            mac->mac[0], mac->mac[1], mac->mac[2], mac->mac[3], mac->mac[4], mac->mac[5]);
 }
 
+/**
+ * Append @a ip to the output buffer (see print_flush()).
+ */
 static void
 print_ip (const struct in_addr *ip)
 {
     char buf[INET_ADDRSTRLEN];
-    print ("%s", inet_ntop(AF_INET, ip, buf, sizeof (buf)));
+    print_append ("%s", inet_ntop(AF_INET, ip, buf, sizeof (buf)));
 }
 
 /**
@@ -197,15 +207,17 @@ print_ip (const struct in_addr *ip)
  */
 static void
 forward_to(struct Interface *dst, const void *frame, size_t frame_size) {
-    char iob[frame_size + sizeof(struct GLAB_MessageHeader)];
+    struct PoolBuffer *pb = pool_get();
     struct GLAB_MessageHeader hdr;
 
     if (frame_size > dst->mtu) abort();
-    hdr.size = htons(sizeof(iob));
+    memcpy(pool_put(pb, frame_size), frame, frame_size);
+    hdr.size = htons(frame_size + sizeof(hdr));
     hdr.type = htons(dst->ifc_num);
-    memcpy(iob, &hdr, sizeof(hdr));
-    memcpy(&iob[sizeof(hdr)], frame, frame_size);
-    write_all(STDOUT_FILENO, iob, sizeof(iob));
+    memcpy(pool_push(pb, sizeof(hdr)), &hdr, sizeof(hdr)); //into the headroom, a single write
+    write_all(STDOUT_FILENO, pool_data(pb), pb->size);
+    pool_release(pb);
+    stats_tx(dst->ifc_num, frame_size);
 }
 
 /**
@@ -243,6 +255,11 @@ lookup_and_add(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc) {
                 }
             }
 
+            if (0 <= MAC_inCache || 0 <= IP_inCache) {
+                stats.table_hits++;
+            } else {
+                stats.table_misses++;
+            }
             if (0 <= MAC_inCache && 0 <= IP_inCache) { //there is an entry for the mac and the IP!
                 arpCache[MAC_inCache].ip = arpRequest.sender_pa;
                 arpCache[MAC_inCache].ifc = ifc;
@@ -263,8 +280,10 @@ lookup_and_add(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc) {
                 size_t addPosition = 0;
                 if (ARP_CACHE_SIZE > arpCacheSize) {
                     addPosition = arpCacheSize;
+                    arpCacheSize++;
                 } else {
                     addPosition = (size_t) search_oldest_entry();
+                    stats.table_evictions++;
                 }
                 struct ArpEntry newEntry;
                 newEntry.ip = arpRequest.sender_pa;
@@ -272,7 +291,6 @@ lookup_and_add(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc) {
                 newEntry.ifc = ifc;
                 newEntry.timestamp = time(NULL);
                 arpCache[addPosition] = newEntry;
-                arpCacheSize++;
             }
         } else {
             fprintf(stderr, "Odd, received ARP reply that is not for me!");
@@ -284,7 +302,7 @@ static void
 send_response(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc) {
 
     for (int i = 0; i < num_ifc; i++) {
-        if (0 == ipcomp(&arpRequest.target_pa, &gifc[i].ip)) {
+        if (0 != gifc[i].ifc_num && 0 == ipcomp(&arpRequest.target_pa, &gifc[i].ip)) {
 
             struct EthernetHeader ethHeader;
             ethHeader.src = ifc.mac;
@@ -330,6 +348,7 @@ parse_frame(struct Interface *ifc, const void *frame, size_t frame_size) {
 
     if (frame_size < sizeof(eh)) {
         fprintf(stderr, "Malformed frame\n");
+        stats_drop(DROP_MALFORMED);
         return;
     }
     memcpy(&eh, frame, sizeof(eh));
@@ -337,7 +356,12 @@ parse_frame(struct Interface *ifc, const void *frame, size_t frame_size) {
     /////////   check if the header is a arp header /////////
     if (0x0806 == ntohs(eh.tag)){
         struct ArpHeaderEthernetIPv4 arpRequest;
-        memcpy(&arpRequest, &cframe[sizeof(eh)], frame_size - sizeof(eh));
+        if (frame_size < sizeof(eh) + sizeof(arpRequest)) {
+            fprintf(stderr, "Malformed frame\n");
+            stats_drop(DROP_MALFORMED);
+            return;
+        }
+        memcpy(&arpRequest, &cframe[sizeof(eh)], sizeof(arpRequest));
 
         struct Interface interface = *ifc;
 
@@ -350,6 +374,7 @@ parse_frame(struct Interface *ifc, const void *frame, size_t frame_size) {
 
     } else {
         fprintf(stderr,"Unsupported Ethernet tag %04x\n", (eh.tag));
+        stats_drop(DROP_UNSUPPORTED);
     }
 }
 
@@ -365,6 +390,8 @@ parse_frame(struct Interface *ifc, const void *frame, size_t frame_size) {
 static void
 handle_frame(uint16_t interface, const void *frame, size_t frame_size) {
     if (interface > num_ifc) abort();
+    if (0 == gifc[interface - 1].ifc_num) return; /* removed, or its configuration was rejected */
+    stats_rx(interface, frame_size);
     parse_frame(&gifc[interface - 1], frame, frame_size);
 }
 
@@ -372,29 +399,41 @@ static void
 print_arp_cache(){
     for (int i=0; i < arpCacheSize; i++) {
         print_ip(&arpCache[i].ip);
-        print(" -> ");
+        print_append(" -> ");
         print_mac(&arpCache[i].mac);
-        print(" (");
-        char *name = arpCache[i].ifc.name;
-        for (int j = 0; arpCache[i].ifc.name[j] != NULL; j++) {
-            print("%c", name[j]);
-        }
-        print(")\n");
+        print_append(" (%s)\n", arpCache[i].ifc.name);
     }
+    print_flush();
 }
 
+/**
+ * Find @a ip4 in the ARP cache.
+ *
+ * @param ip4 address to look up
+ * @return index into arpCache, -1 if @a ip4 is not in the cache
+ */
 static int
-ipv4_lookup(struct in_addr ip4){
+arp_cache_find(struct in_addr ip4){
     for (int i = 0; i < arpCacheSize; i++) {
         if (0== ipcomp(&ip4, &arpCache[i].ip)) {
-            print_mac(&arpCache[i].mac);
-            print("\n");
-            return 0;
+            return i;
         }
     }
     return -1;
 }
 
+static int
+ipv4_lookup(struct in_addr ip4){
+    int i = arp_cache_find(ip4);
+
+    if (-1 == i) {
+        return -1;
+    }
+    print_mac(&arpCache[i].mac);
+    print("\n");
+    return 0;
+}
+
 
 /**
  * The user entered an "arp" command.  The remaining
@@ -422,7 +461,7 @@ process_cmd_arp() {
     }
     ifc = NULL;
     for (unsigned int i = 0; i < num_ifc; i++) {
-        if (0 == strcasecmp(tok, gifc[i].name)) {
+        if (0 != gifc[i].ifc_num && 0 == strcasecmp(tok, gifc[i].name)) {
             ifc = &gifc[i];
             break;
         }
@@ -565,7 +604,9 @@ handle_control(char *cmd, size_t cmd_len) {
 
     cmd[cmd_len - 1] = '\0';
     tok = strtok(cmd, " ");
+    if (NULL == tok) return;
     if (0 == strcasecmp(tok, "arp")) process_cmd_arp();
+    else if (0 == strcasecmp(tok, "stats")) stats_command();
     else fprintf(stderr, "Unsupported command `%s'\n", tok);
 }
 
@@ -583,6 +624,55 @@ handle_mac(uint16_t ifc_num, const struct MacAddress *mac) {
 }
 
 
+/**
+ * Handle interface @a ifc_num with @a mac and configuration @a arg
+ * added at runtime.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg interface specification (as on the command line)
+ */
+static void
+handle_ifc_add(uint16_t ifc_num, const struct MacAddress *mac, const char *arg) {
+    struct Interface ifc;
+
+    memset(&ifc, 0, sizeof(ifc));
+    if (0 != parse_cmd_arg(&ifc, arg)) {
+        fprintf(stderr, "Ignoring interface %u\n", (unsigned int) ifc_num);
+        free(ifc.name);
+        return;
+    }
+    ifc.ifc_num = ifc_num;
+    ifc.mac = *mac;
+    grow_array(&gifc, sizeof(struct Interface), &num_ifc, ifc_num);
+    stats_init("arp", num_ifc);
+    free(gifc[ifc_num - 1].name);
+    gifc[ifc_num - 1] = ifc;
+    stats_set_name(ifc_num, gifc[ifc_num - 1].name);
+}
+
+
+/**
+ * Handle interface @a ifc_num being removed at runtime: drop the ARP
+ * cache entries learned on it.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del(uint16_t ifc_num) {
+    if (ifc_num > num_ifc) return;
+    for (int i = arpCacheSize - 1; i >= 0; i--) {
+        if (arpCache[i].ifc.ifc_num == ifc_num) {
+            arpCache[i] = arpCache[arpCacheSize - 1];
+            arpCacheSize--;
+        }
+    }
+    stats_clear(ifc_num);
+    free(gifc[ifc_num - 1].name);
+    memset(&gifc[ifc_num - 1], 0, sizeof(struct Interface));
+}
+
+
 #include "loop.c"
 
 /**
@@ -594,19 +684,18 @@ handle_mac(uint16_t ifc_num, const struct MacAddress *mac) {
  */
 int
 main(int argc, char **argv) {
-    struct Interface ifc[argc];
-
-    memset(ifc, 0, sizeof(ifc));
-    num_ifc = argc - 1;
-    gifc = ifc;
+    grow_array(&gifc, sizeof(struct Interface), &num_ifc, argc - 1);
+    stats_init("arp", num_ifc);
     for (unsigned int i = 1; i < argc; i++) {
-        struct Interface *p = &ifc[i - 1];
+        struct Interface *p = &gifc[i - 1];
 
-        ifc[i - 1].ifc_num = i;
+        p->ifc_num = i;
         if (0 != parse_cmd_arg(p, argv[i])) abort();
+        stats_set_name(i, p->name);
     }
     loop();
-    for (unsigned int i = 1; i < argc; i++)
-        free(ifc[i - 1].name);
+    for (unsigned int i = 0; i < num_ifc; i++)
+        free(gifc[i].name);
+    free(gifc);
     return 0;
 }
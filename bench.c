@@ -0,0 +1,1260 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file bench.c
+ * @brief Microbenchmarks for the table lookups and checksums
+ *
+ * Compiled once per target with -DBENCH_TARGET_switch, -DBENCH_TARGET_arp,
+ * -DBENCH_TARGET_router or -DBENCH_TARGET_crc.  The program source is
+ * included directly (with its main() renamed), so the benchmark calls
+ * the very same static functions the program uses.  The tables are
+ * filled synthetically with 16 to 1M entries and queried with a given
+ * ratio of hits to misses.
+ *
+ * Usage: bench-TARGET [-m MAX_ENTRIES] [-o FILE]
+ *
+ * Results are written as JSON (to stdout unless -o is given), one
+ * object per run with ns/op, cycles/op and cache misses/op.
+ */
+
+/* make the fixed-size tables large enough for the synthetic sizes */
+#define SWITCHING_TABLE_SIZE (1 << 20)
+#define ARP_CACHE_SIZE (1 << 20)
+/* benchmark a single VRF, each has an ARP_CACHE_SIZE neighbor table */
+#define NUM_VRFS 1
+
+#define main glab_program_main
+#if defined (BENCH_TARGET_switch)
+#include "switch.c"
+#elif defined (BENCH_TARGET_arp)
+#include "arp.c"
+#elif defined (BENCH_TARGET_router)
+#include "router.c"
+#elif defined (BENCH_TARGET_crc)
+#include "glab.h"
+#include "crc.c"
+#else
+#error "define one of BENCH_TARGET_switch, _arp, _router or _crc"
+#endif
+#undef main
+
+/* the neighbor table filled by bench_fill_arp() */
+#if defined (BENCH_TARGET_arp)
+#define bench_arp_cache arpCache
+#define bench_arp_cache_size arpCacheSize
+#elif defined (BENCH_TARGET_router)
+#define bench_arp_cache vrfs[0].arp_cache
+#define bench_arp_cache_size vrfs[0].arp_cache_size
+#endif
+
+#include <getopt.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#endif
+
+
+/**
+ * Number of (pre-generated) queries we cycle through.
+ */
+#define BENCH_QUERIES 4096
+
+/**
+ * Roughly how many table entries each run should touch, used
+ * to pick the number of operations per run.
+ */
+#define BENCH_WORK (1 << 25)
+
+
+/**
+ * Hardware counters for one run.
+ */
+struct BenchCounters
+{
+  /**
+   * perf_event file descriptors (-1 if unavailable).
+   */
+  int cycles_fd;
+
+  int misses_fd;
+};
+
+
+/**
+ * Where the JSON goes.
+ */
+static FILE *bench_out;
+
+/**
+ * Separator before the next JSON object.
+ */
+static const char *bench_sep = "";
+
+/**
+ * Results of the benchmarked calls go here so that they are not
+ * optimized away.
+ */
+static volatile uintptr_t bench_sink;
+
+static uint64_t bench_rng = 88172645463325252LLU;
+
+static struct BenchCounters counters;
+
+
+static uint64_t
+bench_rnd ()
+{
+  bench_rng ^= bench_rng << 13;
+  bench_rng ^= bench_rng >> 7;
+  bench_rng ^= bench_rng << 17;
+  return bench_rng;
+}
+
+
+static uint64_t
+bench_now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC,
+		 &ts);
+  return (uint64_t) ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+
+static int
+perf_open (uint64_t config)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr,
+	  0,
+	  sizeof (attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof (attr);
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall (SYS_perf_event_open,
+			&attr,
+			0,
+			-1,
+			-1,
+			0);
+}
+
+
+static void
+counters_start ()
+{
+  if (-1 != counters.cycles_fd)
+    {
+      ioctl (counters.cycles_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (counters.cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  if (-1 != counters.misses_fd)
+    {
+      ioctl (counters.misses_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (counters.misses_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+
+static int64_t
+counter_read (int fd)
+{
+  uint64_t val;
+
+  if (-1 == fd)
+    return -1;
+  ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (sizeof (val) != read (fd,
+			    &val,
+			    sizeof (val)))
+    return -1;
+  return (int64_t) val;
+}
+
+
+static uint64_t
+tsc ()
+{
+#if defined (__x86_64__) || defined (__i386__)
+  return __rdtsc ();
+#else
+  return 0;
+#endif
+}
+
+
+/**
+ * Signature of a benchmarked operation: run query @a i.
+ */
+typedef uintptr_t
+(*BenchOperation) (unsigned int i);
+
+
+/**
+ * Run @a op @a ops times and emit a JSON object.
+ *
+ * @param component name of the benchmarked function
+ * @param size number of entries in the table (0 for none)
+ * @param hit_ratio fraction of queries that hit
+ * @param bytes bytes processed per operation (0 if not applicable)
+ * @param ops number of operations to run
+ * @param op the operation
+ */
+static void
+bench_run (const char *component,
+	   unsigned long size,
+	   double hit_ratio,
+	   size_t bytes,
+	   unsigned long ops,
+	   BenchOperation op)
+{
+  uint64_t start;
+  uint64_t end;
+  uint64_t tsc_start;
+  uint64_t tsc_end;
+  int64_t cycles;
+  int64_t misses;
+  uintptr_t sink = 0;
+  double ns;
+
+  /* warm up caches and branch predictors */
+  for (unsigned int i = 0; i < BENCH_QUERIES && i < ops; i++)
+    sink += op (i);
+  counters_start ();
+  tsc_start = tsc ();
+  start = bench_now ();
+  for (unsigned long i = 0; i < ops; i++)
+    sink += op (i % BENCH_QUERIES);
+  end = bench_now ();
+  tsc_end = tsc ();
+  cycles = counter_read (counters.cycles_fd);
+  misses = counter_read (counters.misses_fd);
+  bench_sink = sink;
+  ns = (double) (end - start) / ops;
+  fprintf (bench_out,
+	   "%s  {\"component\": \"%s\", \"size\": %lu, \"hit_ratio\": %.2f, \"ops\": %lu, \"ns_per_op\": %.2f",
+	   bench_sep,
+	   component,
+	   size,
+	   hit_ratio,
+	   ops,
+	   ns);
+  if (cycles >= 0)
+    fprintf (bench_out,
+	     ", \"cycles_per_op\": %.2f, \"cycles_source\": \"perf\"",
+	     (double) cycles / ops);
+  else if (tsc_end > tsc_start)
+    fprintf (bench_out,
+	     ", \"cycles_per_op\": %.2f, \"cycles_source\": \"tsc\"",
+	     (double) (tsc_end - tsc_start) / ops);
+  else
+    fprintf (bench_out,
+	     ", \"cycles_per_op\": null, \"cycles_source\": null");
+  if (misses >= 0)
+    fprintf (bench_out,
+	     ", \"cache_misses_per_op\": %.4f",
+	     (double) misses / ops);
+  else
+    fprintf (bench_out,
+	     ", \"cache_misses_per_op\": null");
+  if (bytes > 0)
+    fprintf (bench_out,
+	     ", \"bytes\": %lu, \"gbit_per_s\": %.3f",
+	     (unsigned long) bytes,
+	     bytes * 8 / ns);
+  fprintf (bench_out,
+	   "}");
+  bench_sep = ",\n";
+}
+
+
+/**
+ * Number of operations for a run over a table with @a size entries.
+ */
+static unsigned long
+bench_ops (unsigned long size)
+{
+  unsigned long ops = BENCH_WORK / (size + 1);
+
+  if (ops < 64)
+    ops = 64;
+  if (ops > (1 << 22))
+    ops = 1 << 22;
+  return ops;
+}
+
+
+#if defined (BENCH_TARGET_switch) || defined (BENCH_TARGET_arp) || defined (BENCH_TARGET_router)
+
+/**
+ * Decide whether query @a i should hit given @a hit_ratio.
+ */
+static int
+bench_is_hit (double hit_ratio)
+{
+  return (bench_rnd () % 1000) < (uint64_t) (hit_ratio * 1000);
+}
+
+#endif
+
+
+/* ************************ checksums ********************** */
+
+#if defined (BENCH_TARGET_crc)
+
+static char *crc_buf;
+
+static size_t crc_len;
+
+static uintptr_t
+op_crc16 (unsigned int i)
+{
+  /* vary the alignment to not only measure the best case */
+  return GNUNET_CRYPTO_crc16_n (&crc_buf[i & 7],
+				crc_len);
+}
+
+
+static uintptr_t
+op_crc32 (unsigned int i)
+{
+  return GNUNET_CRYPTO_crc32_n (&crc_buf[i & 7],
+				crc_len);
+}
+
+
+static uintptr_t
+op_crc32c (unsigned int i)
+{
+  return GNUNET_CRYPTO_crc32c_n (&crc_buf[i & 7],
+				 crc_len);
+}
+
+
+static uintptr_t
+op_crc16_update (unsigned int i)
+{
+  /* one 16-bit field changed, independent of crc_len */
+  return GNUNET_CRYPTO_crc16_update ((uint16_t) i,
+				     &crc_buf[2 * (i & 7)],
+				     &crc_buf[2 * (i & 7) + 16],
+				     2);
+}
+
+
+static void
+bench_crc ()
+{
+  static const size_t lens[] = { 20, 64, 576, 1500, 9000, 65507 };
+
+  crc_buf = malloc (65536 + 8);
+  if (NULL == crc_buf)
+    abort ();
+  for (size_t i = 0; i < 65536 + 8; i++)
+    crc_buf[i] = (char) bench_rnd ();
+  for (unsigned int j = 0; j < sizeof (lens) / sizeof (lens[0]); j++)
+    {
+      crc_len = lens[j];
+      bench_run ("crc.GNUNET_CRYPTO_crc16_n",
+		 0,
+		 1.0,
+		 crc_len,
+		 bench_ops (crc_len),
+		 &op_crc16);
+      bench_run ("crc.GNUNET_CRYPTO_crc32_n",
+		 0,
+		 1.0,
+		 crc_len,
+		 bench_ops (crc_len),
+		 &op_crc32);
+      bench_run ("crc.GNUNET_CRYPTO_crc32c_n",
+		 0,
+		 1.0,
+		 crc_len,
+		 bench_ops (crc_len),
+		 &op_crc32c);
+    }
+  bench_run ("crc.GNUNET_CRYPTO_crc16_update",
+	     0,
+	     1.0,
+	     2,
+	     bench_ops (2),
+	     &op_crc16_update);
+  free (crc_buf);
+}
+
+
+static void
+bench_target (unsigned long max_size)
+{
+  (void) max_size;
+  bench_crc ();
+}
+
+#endif
+
+
+/* ************************ switch ********************** */
+
+#if defined (BENCH_TARGET_switch)
+
+static struct Interface bench_ifc[4];
+
+static struct MacAddress *bench_macs;
+
+static struct MacAddress
+bench_mac (uint32_t k,
+	   int miss)
+{
+  struct MacAddress mac = {
+    { 0x02, miss ? 0x80 : 0x00, k >> 24, k >> 16, k >> 8, k }
+  };
+
+  return mac;
+}
+
+
+static void
+bench_fill_switch (unsigned long size)
+{
+  time_t now = time (NULL);
+
+  num_table_entries = size;
+  for (unsigned long i = 0; i < size; i++)
+    {
+      switching_table[i].device_mac = bench_mac (i, 0);
+      switching_table[i].switch_ifc = bench_ifc[i % 4];
+      switching_table[i].timestamp = now;
+    }
+}
+
+
+static void
+bench_queries_switch (unsigned long size,
+		      double hit_ratio)
+{
+  for (unsigned int i = 0; i < BENCH_QUERIES; i++)
+    bench_macs[i] = bench_mac (bench_rnd () % size,
+			       ! bench_is_hit (hit_ratio));
+}
+
+
+static uintptr_t
+op_switch_get_dst_ifc (unsigned int i)
+{
+  return (uintptr_t) get_dst_ifc (&bench_macs[i]);
+}
+
+
+static uintptr_t
+op_switch_lookup (unsigned int i)
+{
+  return (uintptr_t) lookup (&bench_macs[i],
+			     &bench_ifc[i % 4]);
+}
+
+
+static void
+bench_target (unsigned long max_size)
+{
+  bench_macs = calloc (BENCH_QUERIES,
+		       sizeof (struct MacAddress));
+  if (NULL == bench_macs)
+    abort ();
+  for (unsigned int i = 0; i < 4; i++)
+    {
+      bench_ifc[i].ifc_num = i + 1;
+      bench_ifc[i].mac = bench_mac (i, 1);
+      bench_ifc[i].mac.mac[0] = 0x06;
+    }
+  gifc = bench_ifc;
+  num_ifc = 4;
+  for (unsigned long size = 16; size <= max_size; size *= 16)
+    {
+      static const double ratios[] = { 1.0, 0.5, 0.0 };
+
+      bench_fill_switch (size);
+      for (unsigned int r = 0; r < 3; r++)
+	{
+	  bench_queries_switch (size,
+				ratios[r]);
+	  bench_run ("switch.get_dst_ifc",
+		     size,
+		     ratios[r],
+		     0,
+		     bench_ops (size),
+		     &op_switch_get_dst_ifc);
+	  bench_run ("switch.lookup",
+		     size,
+		     ratios[r],
+		     0,
+		     bench_ops (size),
+		     &op_switch_lookup);
+	}
+    }
+  free (bench_macs);
+}
+
+#endif
+
+
+/* ************************ ARP caches ********************** */
+
+#if defined (BENCH_TARGET_arp) || defined (BENCH_TARGET_router)
+
+static struct Interface bench_ifc[4];
+
+static struct in_addr *bench_ips;
+
+
+static struct in_addr
+bench_ip (uint32_t k,
+	  int miss)
+{
+  struct in_addr ip;
+
+  /* hits are in 10.0.0.0/8, misses in 11.0.0.0/8 */
+  ip.s_addr = htonl ((miss ? 0x0B000000 : 0x0A000000) | (k & 0x00FFFFFF));
+  return ip;
+}
+
+
+static void
+bench_fill_arp (unsigned long size)
+{
+  time_t now = time (NULL);
+
+  bench_arp_cache_size = size;
+  for (unsigned long i = 0; i < size; i++)
+    {
+      struct MacAddress mac = {
+	{ 0x02, 0x00, 0x00, i >> 16, i >> 8, i }
+      };
+
+      bench_arp_cache[i].ip = bench_ip (i, 0);
+      bench_arp_cache[i].mac = mac;
+      bench_arp_cache[i].ifc = bench_ifc[i % 4];
+      bench_arp_cache[i].timestamp = now;
+    }
+}
+
+
+static void
+bench_queries_ip (unsigned long size,
+		  double hit_ratio)
+{
+  for (unsigned int i = 0; i < BENCH_QUERIES; i++)
+    bench_ips[i] = bench_ip (bench_rnd () % size,
+			     ! bench_is_hit (hit_ratio));
+}
+
+
+static void
+bench_init_ifcs ()
+{
+  bench_ips = calloc (BENCH_QUERIES,
+		      sizeof (struct in_addr));
+  if (NULL == bench_ips)
+    abort ();
+  for (unsigned int i = 0; i < 4; i++)
+    {
+      bench_ifc[i].ifc_num = i + 1;
+      bench_ifc[i].mtu = 1514;
+      bench_ifc[i].ip.s_addr = htonl (0xC0A80001 + (i << 8));
+      bench_ifc[i].netmask.s_addr = htonl (0xFFFFFF00);
+    }
+  gifc = bench_ifc;
+  num_ifc = 4;
+}
+
+#endif
+
+
+#if defined (BENCH_TARGET_arp)
+
+static uintptr_t
+op_arp_cache_find (unsigned int i)
+{
+  return (uintptr_t) arp_cache_find (bench_ips[i]);
+}
+
+
+static void
+bench_target (unsigned long max_size)
+{
+  bench_init_ifcs ();
+  for (unsigned long size = 16; size <= max_size; size *= 16)
+    {
+      static const double ratios[] = { 1.0, 0.5, 0.0 };
+
+      bench_fill_arp (size);
+      for (unsigned int r = 0; r < 3; r++)
+	{
+	  bench_queries_ip (size,
+			    ratios[r]);
+	  bench_run ("arp.arp_cache_find",
+		     size,
+		     ratios[r],
+		     0,
+		     bench_ops (size),
+		     &op_arp_cache_find);
+	}
+    }
+  free (bench_ips);
+}
+
+#endif
+
+
+/* ************************ router ********************** */
+
+#if defined (BENCH_TARGET_router)
+
+/**
+ * Build a routing table with @a size consecutive /24 routes from
+ * 10.0.0.0 on directly, without the (quadratic) sorted insertion.
+ * Each goes to one of the four next hops at random.
+ */
+static void
+bench_fill_routes (unsigned long size)
+{
+  struct Routing_entry **tail = &vrfs[0].routing_table;
+
+  slab_destroy (&route_slab);
+  for (unsigned long i = 0; i < size; i++)
+    {
+      struct Routing_entry *re = slab_alloc (&route_slab);
+      unsigned int nh = bench_rnd () % 4;
+
+      re->network_target.s_addr = htonl (0x0A000000 + (i << 8));
+      re->network_mask.s_addr = htonl (0xFFFFFF00);
+      re->gateway.s_addr = htonl (0xC0A80002 + (nh << 8));
+      re->ifc_num = bench_ifc[nh].ifc_num;
+      re->nhg = NULL;
+      *tail = re;
+      tail = &re->next;
+    }
+  *tail = NULL;
+  vrfs[0].fib.dirty = 1;
+}
+
+
+/**
+ * Queries are destination addresses as route() passes them to lookup_rt().
+ */
+static void
+bench_queries_routes (unsigned long size,
+		      double hit_ratio)
+{
+  for (unsigned int i = 0; i < BENCH_QUERIES; i++)
+    {
+      uint32_t k = bench_rnd () % size;
+
+      /* misses go to 138.0.0.0 and up, beyond the last route */
+      bench_ips[i].s_addr = htonl ((bench_is_hit (hit_ratio)
+				    ? 0x0A000000
+				    : 0x8A000000) + (k << 8) + (i & 0xFF));
+    }
+}
+
+
+static uintptr_t
+op_router_lookup_rt (unsigned int i)
+{
+  return (uintptr_t) lookup_rt (0,
+			       &bench_ips[i]);
+}
+
+
+static uintptr_t
+op_router_fib_build (unsigned int i)
+{
+  (void) i;
+  fib_build (0);
+  return vrfs[0].fib.num_nodes;
+}
+
+
+/**
+ * Emit a JSON object with the memory used by the routes and the FIB,
+ * built with aggregation as set.
+ */
+static void
+bench_fib_memory (unsigned long nroutes)
+{
+  const struct Fib *fib = &vrfs[0].fib;
+  size_t rib_bytes;
+  size_t fib_bytes;
+
+  fib_build (0);
+  fib_memory (0,
+	      &rib_bytes,
+	      &fib_bytes);
+  fprintf (bench_out,
+	   "%s  {\"component\": \"router.fib_memory\", \"size\": %lu, \"aggregate\": %d, \"entries\": %u, \"nodes\": %u, \"fib_bytes\": %lu, \"rib_bytes\": %lu, \"bytes_per_prefix\": %.2f}",
+	   bench_sep,
+	   nroutes,
+	   fib_aggregate,
+	   fib->num_entries,
+	   fib->num_nodes,
+	   (unsigned long) fib_bytes,
+	   (unsigned long) rib_bytes,
+	   (double) (fib_bytes + rib_bytes) / nroutes);
+  bench_sep = ",\n";
+}
+
+
+static uintptr_t
+op_router_lookup_ipv4_inARP (unsigned int i)
+{
+  struct MacAddress mac = lookup_ipv4_inARP (0,
+					      bench_ips[i]);
+
+  return mac.mac[5];
+}
+
+
+/**
+ * Number of hot destinations for the flow cache.
+ */
+#define BENCH_HOT 4096
+
+
+/**
+ * Destination @a k, the first #BENCH_HOT are the hot ones.
+ */
+static struct in_addr
+bench_hot_ip (uint32_t k,
+	      unsigned long nroutes)
+{
+  struct in_addr ip;
+
+  ip.s_addr = htonl (0x0A000000
+		     + ((k % nroutes) << 8)
+		     + ((k / nroutes) & 0xFF));
+  return ip;
+}
+
+
+/**
+ * Route and next hop lookup as in route(), through the flow cache.
+ */
+static uintptr_t
+bench_flow_cache_resolve (const struct in_addr *dst)
+{
+  struct FlowCacheEntry *fce = flow_cache_slot (dst,
+						1);
+  struct Routing_entry *re;
+  struct MacAddress mac;
+
+  if (flow_cache_hit (fce,
+		      dst,
+		      1))
+    return fce->mac.mac[5];
+  re = lookup_rt (0,
+		  (struct in_addr *) dst);
+  if (NULL == re)
+    return 0;
+  mac = lookup_ipv4_inARP (0,
+			   re->gateway);
+  flow_cache_put (fce,
+		  dst,
+		  1,
+		  re,
+		  &mac);
+  return mac.mac[5];
+}
+
+
+/**
+ * Queries for the flow cache: a share @a hot_ratio of them goes to the
+ * hot destinations (which are cached), the rest is spread over the
+ * whole address space.
+ */
+static void
+bench_queries_hot (unsigned long nroutes,
+		   double hot_ratio)
+{
+  fib_generation++; /* tables were filled behind the cache's back */
+  for (uint32_t k = 0; k < BENCH_HOT; k++)
+    {
+      struct in_addr ip = bench_hot_ip (k,
+					nroutes);
+
+      bench_flow_cache_resolve (&ip);
+    }
+  for (unsigned int i = 0; i < BENCH_QUERIES; i++)
+    bench_ips[i] = bench_hot_ip (bench_is_hit (hot_ratio)
+				 ? bench_rnd () % BENCH_HOT
+				 : BENCH_HOT + bench_rnd () % (1 << 24),
+				 nroutes);
+}
+
+
+static uintptr_t
+op_router_flow_cache (unsigned int i)
+{
+  return bench_flow_cache_resolve (&bench_ips[i]);
+}
+
+
+/**
+ * UDP packets of different flows for flow_hash().
+ */
+static struct IPv4Header bench_flow_ip;
+
+static uint8_t bench_flow_payload[8];
+
+
+static uintptr_t
+op_router_flow_hash (unsigned int i)
+{
+  bench_flow_ip.destination_address = bench_ips[i];
+  memcpy (bench_flow_payload,
+	  &i,
+	  sizeof (uint16_t));
+  return flow_hash (&bench_flow_ip,
+		    bench_flow_payload,
+		    sizeof (bench_flow_payload));
+}
+
+
+/**
+ * ACL with @e size UDP/53 rules for single hosts (one tuple) behind
+ * a few rules in other tuples that do not match the queries.
+ */
+static struct Acl bench_acl;
+
+
+static void
+bench_fill_acl (unsigned long size)
+{
+  struct AclRule r;
+
+  acl_clear (&bench_acl);
+  memset (&r,
+	  0,
+	  sizeof (r));
+  r.any_protocol = 1;
+  r.sport_hi = UINT16_MAX;
+  r.dport_hi = UINT16_MAX;
+  r.seq = 1;
+  r.src_len = 16;
+  r.key.src.s_addr = htonl (0xC0A80000);
+  acl_add (&bench_acl,
+	   &r);
+  r.seq = 2;
+  r.src_len = 0;
+  r.dst_len = 12;
+  r.key.dst.s_addr = htonl (0xAC100000);
+  acl_add (&bench_acl,
+	   &r);
+  r.seq = 3;
+  r.dst_len = 0;
+  r.any_protocol = 0;
+  r.key.protocol = IPPROTO_TCP;
+  r.dport_hi = 1023;
+  acl_add (&bench_acl,
+	   &r);
+  r.key.protocol = IPPROTO_UDP;
+  r.dport_lo = 53;
+  r.dport_hi = 53;
+  r.src_len = 32;
+  r.allow = 1;
+  for (unsigned long i = 0; i < size; i++)
+    {
+      r.seq = 10 * (i + 1);
+      r.key.src = bench_ip (i, 0);
+      acl_add (&bench_acl,
+	       &r);
+    }
+}
+
+
+static uintptr_t
+op_router_acl_classify (unsigned int i)
+{
+  struct AclKey key;
+  int have_ports;
+
+  bench_flow_ip.source_address = bench_ips[i];
+  have_ports = acl_key_init (&key,
+			     &bench_flow_ip,
+			     bench_flow_payload,
+			     sizeof (bench_flow_payload));
+  return (uintptr_t) acl_classify (&bench_acl,
+				   &key,
+				   have_ports);
+}
+
+
+/**
+ * NAT sessions from 10.0.0.0/8 hosts (port 4000) to 256 DNS servers
+ * in 198.51.100.0/24, the server is given by the host's last byte.
+ */
+static void
+bench_fill_nat (unsigned long size)
+{
+  struct NatInsideKey key;
+  uint32_t now = nat_now ();
+
+  nat_enable (4);
+  memset (&key,
+	  0,
+	  sizeof (key));
+  key.protocol = IPPROTO_UDP;
+  key.inside_port = htons (4000);
+  key.remote_port = htons (53);
+  for (unsigned long i = 0; i < size; i++)
+    {
+      key.inside_ip = bench_ip (i, 0);
+      key.remote_ip.s_addr = htonl (0xC6336400 | (ntohl (key.inside_ip.s_addr) & 0xFF));
+      if (NULL == nat_create (&key,
+			      now))
+	abort ();
+    }
+}
+
+
+static uintptr_t
+op_router_nat_outbound (unsigned int i)
+{
+  struct IPv4Header ip = bench_flow_ip;
+  uint8_t udp[8] = { 0x0F, 0xA0, 0x00, 0x35, 0x00, 0x08, 0x12, 0x34 };
+
+  ip.source_address = bench_ips[i];
+  ip.destination_address.s_addr = htonl (0xC6336400 | (ntohl (bench_ips[i].s_addr) & 0xFF));
+  return nat_outbound (&ip,
+		       udp,
+		       sizeof (udp)) + ip.checksum;
+}
+
+
+static uintptr_t
+op_router_local_addr_lookup (unsigned int i)
+{
+  return local_addr_lookup (0,
+			    &bench_ips[i]);
+}
+
+
+/**
+ * A 98-byte ping (as sent by ping(8)), turned into the reply and back.
+ */
+static uint8_t bench_echo[sizeof (struct EthernetHeader)
+			  + sizeof (struct IPv4Header)
+			  + sizeof (struct IcmpHeader) + 56];
+
+
+static void
+bench_init_echo ()
+{
+  struct IPv4Header *ip = (struct IPv4Header *) &bench_echo[sizeof (struct EthernetHeader)];
+  struct IcmpHeader *icmp = (struct IcmpHeader *) &ip[1];
+
+  memset (bench_echo,
+	  0,
+	  sizeof (bench_echo));
+  ip->version = 4;
+  ip->header_length = sizeof (struct IPv4Header) / 4;
+  ip->total_length = htons (sizeof (bench_echo) - sizeof (struct EthernetHeader));
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_ICMP;
+  ip->source_address.s_addr = htonl (0x0A000001);
+  ip->destination_address = bench_ifc[0].ip;
+  ip->checksum = GNUNET_CRYPTO_crc16_n (ip,
+					sizeof (*ip));
+  icmp->type = ICMPTYPE_ECHO_REQUEST;
+  icmp->crc = GNUNET_CRYPTO_crc16_n (icmp,
+				     sizeof (bench_echo) - sizeof (struct EthernetHeader) - sizeof (*ip));
+}
+
+
+static uintptr_t
+op_router_echo_reply (unsigned int i)
+{
+  struct IcmpHeader *icmp = (struct IcmpHeader *) &bench_echo[sizeof (struct EthernetHeader) + sizeof (struct IPv4Header)];
+
+  (void) i;
+  icmp->type = ICMPTYPE_ECHO_REQUEST; /* undo the previous run */
+  return icmp_echo_reply_in_place (bench_echo,
+				   sizeof (bench_echo));
+}
+
+
+/**
+ * Copy a frame into a packet buffer as route() does, and release it.
+ */
+static uintptr_t
+op_router_pool_frame (unsigned int i)
+{
+  struct PoolBuffer *pb = pool_get ();
+  uintptr_t ret;
+
+  (void) i;
+  memcpy (pool_put (pb,
+		    sizeof (bench_echo)),
+	  bench_echo,
+	  sizeof (bench_echo));
+  ret = pb->size;
+  pool_release (pb);
+  return ret;
+}
+
+
+/**
+ * Allocate and free a routing table entry as create_entry() and
+ * delete_entry() do.
+ */
+static uintptr_t
+op_router_slab_route (unsigned int i)
+{
+  struct Routing_entry *re = slab_alloc (&route_slab);
+
+  (void) i;
+  slab_free (&route_slab,
+	     re);
+  return (uintptr_t) re;
+}
+
+
+static void
+bench_target (unsigned long max_size)
+{
+  static const double ratios[] = { 1.0, 0.5, 0.0 };
+
+  bench_init_ifcs ();
+  for (unsigned long size = 16; size <= max_size; size *= 16)
+    {
+      unsigned long nroutes = size;
+
+      bench_fill_routes (nroutes);
+      for (fib_aggregate = 0; fib_aggregate < 2; fib_aggregate++)
+	{
+	  bench_run (fib_aggregate
+		     ? "router.fib_build"
+		     : "router.fib_build.exact",
+		     nroutes,
+		     1.0,
+		     0,
+		     1,
+		     &op_router_fib_build);
+	  bench_fib_memory (nroutes);
+	  for (unsigned int r = 0; r < 3; r++)
+	    {
+	      bench_queries_routes (nroutes,
+				    ratios[r]);
+	      bench_run (fib_aggregate
+			 ? "router.lookup_rt"
+			 : "router.lookup_rt.exact",
+			 nroutes,
+			 ratios[r],
+			 0,
+			 bench_ops (32),
+			 &op_router_lookup_rt);
+	    }
+	}
+      fib_aggregate = FIB_AGGREGATE;
+      bench_fill_arp (size);
+      for (unsigned int r = 0; r < 3; r++)
+	{
+	  bench_queries_ip (size,
+			    ratios[r]);
+	  bench_run ("router.lookup_ipv4_inARP",
+		     size,
+		     ratios[r],
+		     0,
+		     bench_ops (size),
+		     &op_router_lookup_ipv4_inARP);
+	}
+      for (unsigned int r = 0; r < 3; r++)
+	{
+	  bench_queries_hot (nroutes,
+			     ratios[r]);
+	  bench_run ("router.flow_cache",
+		     nroutes,
+		     ratios[r],
+		     0,
+		     bench_ops (nroutes),
+		     &op_router_flow_cache);
+	}
+    }
+  /* local addresses: our 4 interfaces, hits are their addresses */
+  local_addr_rebuild ();
+  for (unsigned int r = 0; r < 3; r++)
+    {
+      for (unsigned int i = 0; i < BENCH_QUERIES; i++)
+	bench_ips[i] = bench_is_hit (ratios[r])
+	  ? bench_ifc[i % 4].ip
+	  : bench_ip (i, 1);
+      bench_run ("router.local_addr_lookup",
+		 4,
+		 ratios[r],
+		 0,
+		 bench_ops (4),
+		 &op_router_local_addr_lookup);
+    }
+  bench_flow_ip.version = 4;
+  bench_flow_ip.header_length = sizeof (struct IPv4Header) / 4;
+  bench_flow_ip.protocol = IPPROTO_UDP;
+  bench_flow_ip.source_address.s_addr = htonl (0x0A000001);
+  bench_run ("router.flow_hash",
+	     0,
+	     1.0,
+	     0,
+	     bench_ops (0),
+	     &op_router_flow_hash);
+  bench_flow_payload[2] = 0;
+  bench_flow_payload[3] = 53; /* destination port */
+  for (unsigned long size = 16; size <= max_size; size *= 16)
+    {
+      bench_fill_acl (size);
+      for (unsigned int r = 0; r < 3; r++)
+	{
+	  bench_queries_ip (size,
+			    ratios[r]);
+	  bench_run ("router.acl_classify",
+		     size,
+		     ratios[r],
+		     0,
+		     bench_ops (size),
+		     &op_router_acl_classify);
+	}
+    }
+  acl_clear (&bench_acl);
+  /* NAT sessions exist for all queries */
+  for (unsigned long size = 16; size <= max_size && size <= NAT_MAX_SESSIONS; size *= 16)
+    {
+      bench_fill_nat (size);
+      bench_queries_ip (size,
+			1.0);
+      bench_run ("router.nat_outbound",
+		 size,
+		 1.0,
+		 0,
+		 bench_ops (size),
+		 &op_router_nat_outbound);
+    }
+  nat_disable ();
+  bench_init_echo ();
+  bench_run ("router.icmp_echo_reply_in_place",
+	     0,
+	     1.0,
+	     sizeof (bench_echo),
+	     bench_ops (sizeof (bench_echo)),
+	     &op_router_echo_reply);
+  bench_run ("router.pool_frame",
+	     0,
+	     1.0,
+	     sizeof (bench_echo),
+	     bench_ops (sizeof (bench_echo)),
+	     &op_router_pool_frame);
+  bench_run ("router.slab_route",
+	     0,
+	     1.0,
+	     0,
+	     bench_ops (0),
+	     &op_router_slab_route);
+  vrfs[0].routing_table = NULL;
+  slab_destroy (&route_slab);
+  free (bench_ips);
+  free (local_addrs);
+}
+
+#endif
+
+
+int
+main (int argc,
+      char **argv)
+{
+  unsigned long max_size = 1 << 20;
+  const char *fn = NULL;
+  int opt;
+  int out_fd;
+
+  while (-1 != (opt = getopt (argc, argv, "m:o:")))
+    {
+      switch (opt)
+	{
+	case 'm':
+	  max_size = strtoul (optarg, NULL, 10);
+	  break;
+	case 'o':
+	  fn = optarg;
+	  break;
+	default:
+	  fprintf (stderr,
+		   "Usage: %s [-m MAX_ENTRIES] [-o FILE]\n",
+		   argv[0]);
+	  return 1;
+	}
+    }
+  if (max_size > (1 << 20))
+    max_size = 1 << 20;
+  if (NULL != fn)
+    bench_out = fopen (fn, "w");
+  else if (-1 != (out_fd = dup (STDOUT_FILENO)))
+    bench_out = fdopen (out_fd, "w");
+  if (NULL == bench_out)
+    {
+      fprintf (stderr,
+	       "Failed to open output: %s\n",
+	       strerror (errno));
+      return 1;
+    }
+  /* the programs print() to stdout, keep that out of the results */
+  out_fd = open ("/dev/null", O_WRONLY);
+  if (-1 != out_fd)
+    {
+      dup2 (out_fd, STDOUT_FILENO);
+      close (out_fd);
+    }
+  counters.cycles_fd = perf_open (PERF_COUNT_HW_CPU_CYCLES);
+  counters.misses_fd = perf_open (PERF_COUNT_HW_CACHE_MISSES);
+  fprintf (bench_out,
+	   "{\"target\": \"%s\", \"results\": [\n",
+#if defined (BENCH_TARGET_switch)
+	   "switch"
+#elif defined (BENCH_TARGET_arp)
+	   "arp"
+#elif defined (BENCH_TARGET_router)
+	   "router"
+#else
+	   "crc"
+#endif
+	   );
+  bench_target (max_size);
+  fprintf (bench_out,
+	   "\n]}\n");
+  fclose (bench_out);
+  if (-1 != counters.cycles_fd)
+    close (counters.cycles_fd);
+  if (-1 != counters.misses_fd)
+    close (counters.misses_fd);
+  return 0;
+}
+
+/* end of bench.c */
@@ -27,6 +27,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
 
 /* Avoid wasting space on 8-byte longs. */
@@ -109,23 +110,276 @@ GNUNET_CRYPTO_crc32_n (const void *buf, size_t len)
 }
 
 
+#define POLYNOMIAL_C (GNUNET_uLong)0x82f63b78
+static GNUNET_uLong crc32c_table[256];
+
+
+/**
+ * Software CRC32-C (Castagnoli), for CPUs without SSE4.2.
+ *
+ * @param crc chaining value (inverted)
+ * @param buf data
+ * @param len number of bytes in @a buf
+ * @return new chaining value
+ */
+static GNUNET_uLong
+crc32c_sw (GNUNET_uLong crc, const uint8_t *buf, size_t len)
+{
+  if (0 == crc32c_table[1])
+  {
+    for (unsigned int i = 0; i < 256; i++)
+    {
+      GNUNET_uLong h = i;
+
+      for (unsigned int j = 0; j < 8; j++)
+        h = (h >> 1) ^ ((h & 1) ? POLYNOMIAL_C : 0);
+      crc32c_table[i] = h;
+    }
+  }
+  while (len--)
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ *buf++) & 0xff];
+  return crc;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * CRC32-C using the SSE4.2 crc32 instruction.
+ *
+ * @param crc chaining value (inverted)
+ * @param buf data, no alignment requirements
+ * @param len number of bytes in @a buf
+ * @return new chaining value
+ */
+__attribute__ ((target ("sse4.2"))) static GNUNET_uLong
+crc32c_sse42 (GNUNET_uLong crc, const uint8_t *buf, size_t len)
+{
+  for (; len >= 4; len -= 4, buf += 4)
+  {
+    uint32_t w;
+
+    memcpy (&w, buf, sizeof (w));
+    crc = __builtin_ia32_crc32si (crc, w);
+  }
+  while (len--)
+    crc = __builtin_ia32_crc32qi (crc, *buf++);
+  return crc;
+}
+#endif
+
+
+/**
+ * Compute the CRC32-C (Castagnoli, as used by iSCSI, SCTP and for
+ * flow hashing by NICs) of the first len bytes of the buffer.  Uses
+ * the SSE4.2 instruction where available.
+ *
+ * @param buf the data over which we're taking the CRC
+ * @param len the length of the buffer
+ * @return the resulting CRC32-C checksum
+ */
+uint32_t
+GNUNET_CRYPTO_crc32c_n (const void *buf, size_t len)
+{
+  GNUNET_uLong crc = 0xffffffff;
+
+#if defined(__x86_64__) || defined(__i386__)
+  static int have_sse42 = -1;
+
+  if (-1 == have_sse42)
+    have_sse42 = __builtin_cpu_supports ("sse4.2");
+  if (have_sse42)
+    return crc32c_sse42 (crc, buf, len) ^ 0xffffffff;
+#endif
+  return crc32c_sw (crc, buf, len) ^ 0xffffffff;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/**
+ * Number of vector iterations after which the 32-bit lanes of the
+ * SIMD accumulators must be folded into the 64-bit sum.  Each lane
+ * receives at most two 16-bit words per iteration, so 16384 iterations
+ * stay well below 2^32.
+ */
+#define CRC16_SIMD_BLOCK 16384
+
+
+/**
+ * Sum the 16-bit words of @a buf using SSE2, 16 bytes per iteration.
+ * Only whole 16-byte chunks are consumed, so the remaining tail starts
+ * at an even offset.
+ *
+ * @param buf data to sum, no alignment requirements
+ * @param len number of bytes in @a buf
+ * @param[out] done set to the number of bytes consumed
+ * @return sum of the consumed 16-bit words (not folded)
+ */
+__attribute__ ((target ("sse2"))) static uint64_t
+crc16_sum_sse2 (const uint8_t *buf, size_t len, size_t *done)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  uint64_t sum = 0;
+  size_t off = 0;
+
+  while (len - off >= 16)
+  {
+    __m128i acc = _mm_setzero_si128 ();
+    uint32_t lanes[4];
+
+    for (unsigned int i = 0; (i < CRC16_SIMD_BLOCK) && (len - off >= 16); i++)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) &buf[off]);
+
+      acc = _mm_add_epi32 (acc, _mm_unpacklo_epi16 (v, zero));
+      acc = _mm_add_epi32 (acc, _mm_unpackhi_epi16 (v, zero));
+      off += 16;
+    }
+    _mm_storeu_si128 ((__m128i *) lanes, acc);
+    sum += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  *done = off;
+  return sum;
+}
+
+
+/**
+ * Sum the 16-bit words of @a buf using AVX2, 32 bytes per iteration.
+ *
+ * @param buf data to sum, no alignment requirements
+ * @param len number of bytes in @a buf
+ * @param[out] done set to the number of bytes consumed
+ * @return sum of the consumed 16-bit words (not folded)
+ */
+__attribute__ ((target ("avx2"))) static uint64_t
+crc16_sum_avx2 (const uint8_t *buf, size_t len, size_t *done)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  uint64_t sum = 0;
+  size_t off = 0;
+
+  while (len - off >= 32)
+  {
+    __m256i acc = _mm256_setzero_si256 ();
+    uint32_t lanes[8];
+
+    for (unsigned int i = 0; (i < CRC16_SIMD_BLOCK) && (len - off >= 32); i++)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) &buf[off]);
+
+      acc = _mm256_add_epi32 (acc, _mm256_unpacklo_epi16 (v, zero));
+      acc = _mm256_add_epi32 (acc, _mm256_unpackhi_epi16 (v, zero));
+      off += 32;
+    }
+    _mm256_storeu_si256 ((__m256i *) lanes, acc);
+    for (unsigned int i = 0; i < 8; i++)
+      sum += lanes[i];
+  }
+  *done = off;
+  return sum;
+}
+#endif
+
+
+/**
+ * Fold a 64-bit one's complement accumulator into 32 bits, preserving
+ * the sum modulo 0xFFFF (2^32 and 2^16 are both congruent to 1).
+ *
+ * @param sum accumulator to fold
+ * @return folded accumulator
+ */
+static uint32_t
+crc16_fold (uint64_t sum)
+{
+  sum = (sum >> 32) + (sum & 0xFFFFFFFFLLU);
+  sum = (sum >> 32) + (sum & 0xFFFFFFFFLLU);
+  return (uint32_t) sum;
+}
+
+
 /**
  * Perform an incremental step in a CRC16 (for TCP/IP) calculation.
+ * Uses AVX2 or SSE2 where available; works on unaligned buffers (for
+ * example, fields of packed structs) and on odd lengths.
  *
  * @param sum current sum, initially 0
- * @param buf buffer to calculate CRC over (must be 16-bit aligned)
- * @param len number of bytes in hdr, must be multiple of 2
+ * @param buf buffer to calculate CRC over (no alignment requirements)
+ * @param len number of bytes in @a buf; if odd, the last byte is padded
+ *        with zero as required by RFC 1071.  To continue the sum with a
+ *        buffer starting at an odd offset, use #GNUNET_CRYPTO_crc16_combine().
  * @return updated crc sum (must be subjected to #GNUNET_CRYPTO_crc16_finish() to get actual crc16)
  */
 uint32_t
 GNUNET_CRYPTO_crc16_step (uint32_t sum, const void *buf, size_t len)
 {
-  const uint16_t *hdr = buf;
-  for (; len >= 2; len -= 2)
-    sum += *(hdr++);
+  const uint8_t *p = buf;
+  uint64_t acc = sum;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if (len >= 64)
+  {
+    static int have_avx2 = -1;
+    size_t done;
+
+    if (-1 == have_avx2)
+      have_avx2 = __builtin_cpu_supports ("avx2");
+    if (have_avx2)
+      acc += crc16_sum_avx2 (p, len, &done);
+    else
+      acc += crc16_sum_sse2 (p, len, &done);
+    p += done;
+    len -= done;
+  }
+#endif
+  for (; len >= 4; len -= 4, p += 4)
+  {
+    uint32_t w;
+
+    memcpy (&w, p, sizeof (w));
+    acc += w;
+  }
+  if (len >= 2)
+  {
+    uint16_t w;
+
+    memcpy (&w, p, sizeof (w));
+    acc += w;
+    len -= 2;
+    p += 2;
+  }
   if (len == 1)
-    sum += (*hdr) & ntohs(0xFF00);
-  return sum;
+  {
+    uint8_t last[2] = { *p, 0 };
+    uint16_t w;
+
+    memcpy (&w, last, sizeof (w));
+    acc += w;
+  }
+  return crc16_fold (acc);
+}
+
+
+/**
+ * Combine two partial sums from #GNUNET_CRYPTO_crc16_step(), for
+ * example when the data is spread over several buffers.
+ *
+ * @param sum sum over the data preceding @a partial
+ * @param partial sum over a buffer computed independently (starting from 0)
+ * @param offset byte offset of the buffer of @a partial within the whole data
+ * @return combined crc sum (must be subjected to #GNUNET_CRYPTO_crc16_finish() to get actual crc16)
+ */
+uint32_t
+GNUNET_CRYPTO_crc16_combine (uint32_t sum, uint32_t partial, size_t offset)
+{
+  if (0 != (offset & 1))
+  {
+    /* buffer started in the middle of a 16-bit word: swap bytes (RFC 1071) */
+    partial = (partial >> 16) + (partial & 0xFFFF);
+    partial = (partial >> 16) + (partial & 0xFFFF);
+    partial = ((partial & 0xFF) << 8) | (partial >> 8);
+  }
+  return crc16_fold ((uint64_t) sum + partial);
 }
 
 
@@ -145,18 +399,65 @@ GNUNET_CRYPTO_crc16_finish (uint32_t sum)
 }
 
 
+/**
+ * Update a checksum after some of the data it covers changed, without
+ * summing over all of the data again (RFC 1624, eqn. 3:
+ * HC' = ~(~HC + ~m + m')).  Errors in the original data stay detectable.
+ *
+ * @param crc checksum as stored in the header (over the old data)
+ * @param old_data the changed bytes before the change, must start at an
+ *        even offset within the checksummed data
+ * @param new_data the same bytes after the change
+ * @param len number of bytes in @a old_data and @a new_data
+ * @return the new checksum
+ */
+uint16_t
+GNUNET_CRYPTO_crc16_update (uint16_t crc,
+                            const void *old_data,
+                            const void *new_data,
+                            size_t len)
+{
+  const uint8_t *o = old_data;
+  const uint8_t *n = new_data;
+  uint64_t acc = (uint16_t) ~crc;
+
+  for (; len >= 2; len -= 2, o += 2, n += 2)
+  {
+    uint16_t ow;
+    uint16_t nw;
+
+    memcpy (&ow, o, sizeof (ow));
+    memcpy (&nw, n, sizeof (nw));
+    acc += (uint16_t) ~ow;
+    acc += nw;
+  }
+  if (len == 1)
+  {
+    uint8_t olast[2] = { *o, 0 };
+    uint8_t nlast[2] = { *n, 0 };
+    uint16_t ow;
+    uint16_t nw;
+
+    memcpy (&ow, olast, sizeof (ow));
+    memcpy (&nw, nlast, sizeof (nw));
+    acc += (uint16_t) ~ow;
+    acc += nw;
+  }
+  return GNUNET_CRYPTO_crc16_finish (crc16_fold (acc));
+}
+
+
 /**
  * Calculate the checksum of a buffer in one step.
  *
- * @param buf buffer to  calculate CRC over (must be 16-bit aligned)
- * @param len number of bytes in hdr, must be multiple of 2
+ * @param buf buffer to calculate CRC over (no alignment requirements)
+ * @param len number of bytes in @a buf
  * @return crc16 value
  */
 uint16_t
 GNUNET_CRYPTO_crc16_n (const void *buf, size_t len)
 {
-  const uint16_t *hdr = buf;
-  uint32_t sum = GNUNET_CRYPTO_crc16_step (0, hdr, len);
+  uint32_t sum = GNUNET_CRYPTO_crc16_step (0, buf, len);
 
   return GNUNET_CRYPTO_crc16_finish (sum);
 }
@@ -0,0 +1,1599 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file glab-pktgen.c
+ * @brief Load generator that drives hub, switch, vswitch, arp or router
+ *        through the GLAB stdin/stdout protocol at maximum rate and
+ *        reports throughput, drops and latency.
+ *
+ * Usage: glab-pktgen [-m MIX] [-n COUNT] [-t SECONDS] [-r PPS] [-s SIZE]
+ *                    [-f MAXSIZE] [-S SEED] [-v] PROGRAM [ARGS...]
+ *
+ * MIX is a comma-separated list of "NAME[:WEIGHT]" with NAME one of
+ * "unicast", "broadcast", "random", "ipv4" and "frag".  Every
+ * generated frame carries a stamp (magic, sequence number, time sent)
+ * which is searched for in the frames the program emits.
+ *
+ * The simulated hosts are spread over the interfaces such that they
+ * fit into the tables of switch and router, see #MAX_HOSTS and
+ * #MAX_IP_HOSTS.
+ */
+#include "glab.h"
+#include "crc.c"
+#include <getopt.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+/**
+ * EtherType we use for the layer-2 mixes (IEEE local experimental).
+ */
+#define ETH_P_PKTGEN 0x88B5
+
+#define ETH_P_IPV4 0x0800
+
+#define ETH_P_ARP 0x0806
+
+#define ETH_802_1Q_TAG 0x8100
+
+/**
+ * Magic number at the beginning of each stamp ("GLAB").
+ */
+#define PKTGEN_MAGIC 0x474c4142
+
+/**
+ * Number of simulated hosts, over all interfaces.  switch learns at
+ * most SWITCHING_TABLE_SIZE (16) addresses, more hosts would only
+ * measure how it copes with a full table.
+ */
+#define MAX_HOSTS 16
+
+/**
+ * Number of simulated hosts with IPv4 addresses, over all interfaces.
+ * arp and router cache at most ARP_CACHE_SIZE (10) neighbors.
+ */
+#define MAX_IP_HOSTS 10
+
+/**
+ * Generate more frames while fewer than this many bytes are pending
+ * for the program.  Small enough to keep the queueing delay that we
+ * add ourselves low.
+ */
+#define SEND_WATERMARK 16384
+
+/**
+ * Maximum number of latency samples kept (reservoir sampling beyond).
+ */
+#define MAX_SAMPLES (1 << 20)
+
+/**
+ * How long (in ms) the program must be quiet before we consider
+ * all output received.
+ */
+#define DRAIN_MS 500
+
+
+_Pragma("pack(push)") _Pragma("pack(1)")
+
+struct EthernetHeader
+{
+  struct MacAddress dst;
+  struct MacAddress src;
+  uint16_t tag;
+};
+
+
+/**
+ * ARP header for Ethernet-IPv4.
+ */
+struct ArpHeaderEthernetIPv4
+{
+  uint16_t htype;
+  uint16_t ptype;
+  uint8_t hlen;
+  uint8_t plen;
+  uint16_t oper;
+  struct MacAddress sender_ha;
+  struct in_addr sender_pa;
+  struct MacAddress target_ha;
+  struct in_addr target_pa;
+};
+
+
+/**
+ * IPv4 header, without bitfields.
+ */
+struct IPv4Header
+{
+  uint8_t version_ihl;
+  uint8_t diff_serv;
+  uint16_t total_length;
+  uint16_t identification;
+  uint16_t fragmentation_info;
+  uint8_t ttl;
+  uint8_t protocol;
+  uint16_t checksum;
+  struct in_addr source_address;
+  struct in_addr destination_address;
+};
+
+
+struct UdpHeader
+{
+  uint16_t source_port;
+  uint16_t destination_port;
+  uint16_t length;
+  uint16_t checksum;
+};
+
+
+/**
+ * Stamp we put into every generated frame.
+ */
+struct Stamp
+{
+  uint32_t magic;
+  uint32_t seq;
+  uint64_t tx_time;
+};
+
+_Pragma("pack(pop)")
+
+
+/**
+ * A frame of the frag mix.  Only its first fragment carries the
+ * stamp, so we find the others by their IPv4 identification.
+ */
+struct FragFrame
+{
+  /**
+   * Time the frame was sent.
+   */
+  uint64_t tx_time;
+
+  /**
+   * Addresses of the frame, to recognize its fragments.
+   */
+  struct in_addr source_address;
+
+  struct in_addr destination_address;
+
+  /**
+   * Sequence number of the frame.
+   */
+  uint32_t seq;
+
+  /**
+   * Bytes of IPv4 payload for which no fragment arrived yet, 0 if
+   * the frame is complete or was not fragmented.
+   */
+  uint32_t missing;
+};
+
+
+/**
+ * Offset of the stamp in IPv4 frames.
+ */
+#define IPV4_STAMP_OFFSET (sizeof (struct EthernetHeader) + sizeof (struct IPv4Header) + sizeof (struct UdpHeader))
+
+
+/**
+ * Traffic mixes we can generate.
+ */
+enum Mix
+{
+  MIX_UNICAST,
+  MIX_BROADCAST,
+  MIX_RANDOM,
+  MIX_IPV4,
+  MIX_FRAG,
+  MIX_MAX
+};
+
+
+static const char *mix_names[MIX_MAX] = {
+  "unicast", "broadcast", "random", "ipv4", "frag"
+};
+
+
+/**
+ * What we know about an interface of the program.
+ */
+struct Interface
+{
+  /**
+   * MAC address we assigned to the interface.
+   */
+  struct MacAddress mac;
+
+  /**
+   * IPv4 address of the program on this interface (if @e have_ip).
+   */
+  struct in_addr ip;
+
+  /**
+   * Netmask of the network at this interface (if @e have_ip).
+   */
+  struct in_addr netmask;
+
+  /**
+   * Did the arguments give an IPv4 network for this interface?
+   */
+  int have_ip;
+
+  /**
+   * Number of hosts with IPv4 addresses behind this interface.
+   */
+  unsigned int num_ip_hosts;
+};
+
+
+static struct Interface *gifc;
+
+static unsigned int num_ifc;
+
+/**
+ * Interfaces with IPv4 hosts behind them (indices into @e gifc).
+ */
+static unsigned int *ip_ifcs;
+
+static unsigned int num_ip_ifcs;
+
+/**
+ * Number of simulated hosts behind each interface.
+ */
+static unsigned int num_hosts;
+
+static unsigned int mix_weight[MIX_MAX];
+
+static unsigned int mix_total;
+
+static int verbose;
+
+/**
+ * Frame size for the layer-2 and ipv4 mixes.
+ */
+static size_t frame_size = 64;
+
+/**
+ * Maximum frame size for the frag mix.
+ */
+static size_t frag_max = 4000;
+
+static uint64_t rng_state;
+
+/**
+ * Pipes to and from the program.
+ */
+static int to_child;
+
+static int from_child;
+
+/**
+ * Pending output for the program.
+ */
+static char sbuf[SEND_WATERMARK + 4 * (UINT16_MAX + 1)];
+
+static size_t sbuf_off;
+
+static size_t sbuf_len;
+
+/**
+ * Next sequence number to stamp.
+ */
+static uint32_t next_seq;
+
+/**
+ * Bitmap of sequence numbers we have seen again.
+ */
+static uint8_t *seen;
+
+static size_t seen_size;
+
+static uint64_t *samples;
+
+static size_t num_samples;
+
+static uint64_t num_latencies;
+
+static uint64_t sent_frames;
+
+static uint64_t sent_bytes;
+
+static uint64_t recv_frames;
+
+static uint64_t recv_bytes;
+
+static uint64_t recv_unstamped;
+
+static uint64_t recv_control;
+
+static uint64_t recv_fragments;
+
+/**
+ * Frames of the frag mix all of whose fragments arrived.
+ */
+static uint64_t frag_complete;
+
+/**
+ * Frames of the frag mix, by IPv4 identification (the lower 16 bits of
+ * the sequence number).  A frame still in flight after another 65536
+ * were sent counts as lost.
+ */
+static struct FragFrame frags[UINT16_MAX + 1];
+
+static uint64_t delivered;
+
+static uint64_t arp_replies;
+
+static uint64_t arp_dropped;
+
+static uint64_t start_time;
+
+static uint64_t last_send_time;
+
+static uint64_t last_recv_time;
+
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static uint64_t
+now_ns ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC,
+		 &ts);
+  return (uint64_t) ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+
+/**
+ * Pseudo random number (xorshift64*).
+ */
+static uint64_t
+rnd ()
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717LLU;
+}
+
+
+/**
+ * Return a random number in [0,@a n).
+ */
+static unsigned int
+rnd_below (unsigned int n)
+{
+  return (unsigned int) (rnd () % n);
+}
+
+
+/**
+ * MAC address of host @a k behind interface @a ifc_num.
+ */
+static struct MacAddress
+host_mac (unsigned int ifc_num,
+	  unsigned int k)
+{
+  struct MacAddress mac = {
+    { 0x02, 0x00, 0x00, 0x01, (uint8_t) ifc_num, (uint8_t) k }
+  };
+
+  return mac;
+}
+
+
+/**
+ * IPv4 address of host @a k behind interface @a ifc_num.  Hosts are
+ * numbered from the beginning of the network, skipping the network
+ * address and the address of the program itself.
+ */
+static struct in_addr
+host_ip (unsigned int ifc_num,
+	 unsigned int k)
+{
+  const struct Interface *ifc = &gifc[ifc_num - 1];
+  uint32_t net = ntohl (ifc->ip.s_addr & ifc->netmask.s_addr);
+  uint32_t self = ntohl (ifc->ip.s_addr);
+  uint32_t host = net + 1;
+  struct in_addr ip;
+
+  for (unsigned int i = 0; ; host++)
+    {
+      if (host == self)
+	continue;
+      if (i++ == k)
+	break;
+    }
+  ip.s_addr = htonl (host);
+  return ip;
+}
+
+
+/**
+ * Append a message of @a type carrying @a size bytes of @a data to
+ * the output for the program.
+ *
+ * @return 0 on success, -1 if there is no space left
+ */
+static int
+queue_message (uint16_t type,
+	       const void *data,
+	       size_t size)
+{
+  struct GLAB_MessageHeader hdr;
+
+  if (sizeof (sbuf) - sbuf_len < sizeof (hdr) + size)
+    {
+      memmove (sbuf,
+	       &sbuf[sbuf_off],
+	       sbuf_len - sbuf_off);
+      sbuf_len -= sbuf_off;
+      sbuf_off = 0;
+      if (sizeof (sbuf) - sbuf_len < sizeof (hdr) + size)
+	return -1;
+    }
+  hdr.size = htons (sizeof (hdr) + size);
+  hdr.type = htons (type);
+  memcpy (&sbuf[sbuf_len],
+	  &hdr,
+	  sizeof (hdr));
+  memcpy (&sbuf[sbuf_len + sizeof (hdr)],
+	  data,
+	  size);
+  sbuf_len += sizeof (hdr) + size;
+  return 0;
+}
+
+
+/**
+ * Write as much pending output to the program as it accepts.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+flush_output ()
+{
+  while (sbuf_off < sbuf_len)
+    {
+      ssize_t ret = write (to_child,
+			   &sbuf[sbuf_off],
+			   sbuf_len - sbuf_off);
+
+      if (ret < 0)
+	{
+	  if ( (EAGAIN == errno) ||
+	       (EINTR == errno) )
+	    return 0;
+	  return -1;
+	}
+      sbuf_off += ret;
+    }
+  sbuf_off = 0;
+  sbuf_len = 0;
+  return 0;
+}
+
+
+/**
+ * Build an ARP frame in @a buf.
+ *
+ * @return size of the frame
+ */
+static size_t
+build_arp (char *buf,
+	   uint16_t oper,
+	   const struct MacAddress *eth_dst,
+	   const struct MacAddress *sender_ha,
+	   struct in_addr sender_pa,
+	   const struct MacAddress *target_ha,
+	   struct in_addr target_pa)
+{
+  struct EthernetHeader eh;
+  struct ArpHeaderEthernetIPv4 ah;
+
+  eh.dst = *eth_dst;
+  eh.src = *sender_ha;
+  eh.tag = htons (ETH_P_ARP);
+  ah.htype = htons (1);
+  ah.ptype = htons (ETH_P_IPV4);
+  ah.hlen = MAC_ADDR_SIZE;
+  ah.plen = sizeof (struct in_addr);
+  ah.oper = htons (oper);
+  ah.sender_ha = *sender_ha;
+  ah.sender_pa = sender_pa;
+  ah.target_ha = *target_ha;
+  ah.target_pa = target_pa;
+  memcpy (buf,
+	  &eh,
+	  sizeof (eh));
+  memcpy (&buf[sizeof (eh)],
+	  &ah,
+	  sizeof (ah));
+  return sizeof (eh) + sizeof (ah);
+}
+
+
+/**
+ * Build an IPv4/UDP frame of @a size bytes from host @a src_host on
+ * interface @a src_ifc to host @a dst_host on interface @a dst_ifc.
+ * The frame is addressed to the program's MAC on @a src_ifc.
+ */
+static void
+build_ipv4 (char *buf,
+	    size_t size,
+	    unsigned int src_ifc,
+	    unsigned int src_host,
+	    unsigned int dst_ifc,
+	    unsigned int dst_host)
+{
+  struct EthernetHeader eh;
+  struct IPv4Header ip;
+  struct UdpHeader udp;
+
+  eh.dst = gifc[src_ifc - 1].mac;
+  eh.src = host_mac (src_ifc,
+		     src_host);
+  eh.tag = htons (ETH_P_IPV4);
+  memset (&ip,
+	  0,
+	  sizeof (ip));
+  ip.version_ihl = 0x45;
+  ip.total_length = htons (size - sizeof (eh));
+  ip.identification = htons ((uint16_t) next_seq);
+  ip.ttl = 64;
+  ip.protocol = IPPROTO_UDP;
+  ip.source_address = host_ip (src_ifc,
+			       src_host);
+  ip.destination_address = host_ip (dst_ifc,
+				    dst_host);
+  ip.checksum = GNUNET_CRYPTO_crc16_n (&ip,
+				       sizeof (ip));
+  udp.source_port = htons (49152 + (next_seq & 0x3FFF));
+  udp.destination_port = htons (9);
+  udp.length = htons (size - sizeof (eh) - sizeof (ip));
+  udp.checksum = 0;
+  memcpy (buf,
+	  &eh,
+	  sizeof (eh));
+  memcpy (&buf[sizeof (eh)],
+	  &ip,
+	  sizeof (ip));
+  memcpy (&buf[sizeof (eh) + sizeof (ip)],
+	  &udp,
+	  sizeof (udp));
+}
+
+
+/**
+ * Pick a mix according to the configured weights.
+ */
+static enum Mix
+pick_mix ()
+{
+  unsigned int r = rnd_below (mix_total);
+
+  for (enum Mix m = 0; m < MIX_MAX; m++)
+    {
+      if (r < mix_weight[m])
+	return m;
+      r -= mix_weight[m];
+    }
+  abort ();
+}
+
+
+/**
+ * Generate the next stamped frame and queue it for the program.
+ *
+ * @return 0 on success, -1 if there was no space
+ */
+static int
+generate_frame ()
+{
+  static char buf[UINT16_MAX];
+  struct EthernetHeader eh;
+  struct Stamp stamp;
+  size_t size = frame_size;
+  size_t stamp_off = sizeof (eh);
+  unsigned int ifc_num;
+  enum Mix mix = pick_mix ();
+
+  ifc_num = 1 + rnd_below (num_ifc);
+  eh.tag = htons (ETH_P_PKTGEN);
+  switch (mix)
+    {
+    case MIX_UNICAST:
+      {
+	unsigned int dst = 1 + rnd_below (num_ifc - 1);
+
+	if (dst >= ifc_num)
+	  dst++;
+	eh.dst = host_mac (dst,
+			   rnd_below (num_hosts));
+	eh.src = host_mac (ifc_num,
+			   rnd_below (num_hosts));
+	break;
+      }
+    case MIX_BROADCAST:
+      memset (&eh.dst,
+	      0xFF,
+	      sizeof (eh.dst));
+      eh.src = host_mac (ifc_num,
+			 rnd_below (num_hosts));
+      break;
+    case MIX_RANDOM:
+      {
+	uint64_t r = rnd ();
+
+	memcpy (&eh.dst,
+		&r,
+		sizeof (eh.dst));
+	r = rnd ();
+	memcpy (&eh.src,
+		&r,
+		sizeof (eh.src));
+	/* unicast, locally administered */
+	eh.dst.mac[0] = (eh.dst.mac[0] & 0xFC) | 0x02;
+	eh.src.mac[0] = (eh.src.mac[0] & 0xFC) | 0x02;
+	break;
+      }
+    case MIX_IPV4:
+    case MIX_FRAG:
+      {
+	unsigned int si = rnd_below (num_ip_ifcs);
+	unsigned int di = rnd_below (num_ip_ifcs - 1);
+
+	if (di >= si)
+	  di++;
+	ifc_num = ip_ifcs[si];
+	if (MIX_FRAG == mix)
+	  size = 1515 + rnd_below (frag_max - 1514);
+	if (size < IPV4_STAMP_OFFSET + sizeof (stamp))
+	  size = IPV4_STAMP_OFFSET + sizeof (stamp);
+	stamp_off = IPV4_STAMP_OFFSET;
+	memset (&buf[stamp_off],
+		0,
+		size - stamp_off);
+	build_ipv4 (buf,
+		    size,
+		    ifc_num,
+		    rnd_below (gifc[ifc_num - 1].num_ip_hosts),
+		    ip_ifcs[di],
+		    rnd_below (gifc[ip_ifcs[di] - 1].num_ip_hosts));
+	break;
+      }
+    default:
+      abort ();
+    }
+  if (stamp_off == sizeof (eh))
+    {
+      memset (&buf[stamp_off],
+	      0,
+	      size - stamp_off);
+      memcpy (buf,
+	      &eh,
+	      sizeof (eh));
+    }
+  stamp.magic = htonl (PKTGEN_MAGIC);
+  stamp.seq = htonl (next_seq);
+  stamp.tx_time = now_ns ();
+  memcpy (&buf[stamp_off],
+	  &stamp,
+	  sizeof (stamp));
+  if (0 != queue_message (ifc_num,
+			  buf,
+			  size))
+    return -1;
+  if (MIX_FRAG == mix)
+    {
+      struct FragFrame *ff = &frags[(uint16_t) next_seq];
+      struct IPv4Header ip;
+
+      memcpy (&ip,
+	      &buf[sizeof (eh)],
+	      sizeof (ip));
+      ff->tx_time = stamp.tx_time;
+      ff->source_address = ip.source_address;
+      ff->destination_address = ip.destination_address;
+      ff->seq = next_seq;
+      ff->missing = size - sizeof (eh) - sizeof (ip);
+    }
+  next_seq++;
+  sent_frames++;
+  sent_bytes += size;
+  last_send_time = stamp.tx_time;
+  return 0;
+}
+
+
+/**
+ * Remember that we got @a seq back.
+ *
+ * @return 1 if this is the first copy we got
+ */
+static int
+mark_seen (uint32_t seq)
+{
+  size_t byte = seq / 8;
+
+  if (byte >= seen_size)
+    {
+      size_t nsize = seen_size ? seen_size : 4096;
+
+      while (nsize <= byte)
+	nsize *= 2;
+      seen = realloc (seen,
+		      nsize);
+      if (NULL == seen)
+	abort ();
+      memset (&seen[seen_size],
+	      0,
+	      nsize - seen_size);
+      seen_size = nsize;
+    }
+  if (seen[byte] & (1 << (seq % 8)))
+    return 0;
+  seen[byte] |= 1 << (seq % 8);
+  return 1;
+}
+
+
+/**
+ * Record a latency sample (reservoir sampling once we have
+ * #MAX_SAMPLES).
+ */
+static void
+record_latency (uint64_t lat)
+{
+  num_latencies++;
+  if (num_samples < MAX_SAMPLES)
+    {
+      samples[num_samples++] = lat;
+      return;
+    }
+  uint64_t j = rnd () % num_latencies;
+  if (j < MAX_SAMPLES)
+    samples[j] = lat;
+}
+
+
+/**
+ * The program sent an IPv4 fragment.  Account for it with the frame
+ * of the frag mix it belongs to.
+ *
+ * @param ip IPv4 header of the fragment
+ * @param size number of bytes from @a ip to the end of the frame
+ */
+static void
+handle_fragment (const struct IPv4Header *ip,
+		 size_t size)
+{
+  struct FragFrame *ff = &frags[ntohs (ip->identification)];
+  size_t hlen = 4 * (ip->version_ihl & 0x0F);
+  size_t len = ntohs (ip->total_length);
+
+  recv_fragments++;
+  if (len > size)
+    len = size;
+  if ( (len < hlen) ||
+       (ff->source_address.s_addr != ip->source_address.s_addr) ||
+       (ff->destination_address.s_addr != ip->destination_address.s_addr) ||
+       (len - hlen > ff->missing) )
+    {
+      recv_unstamped++;
+      return;
+    }
+  ff->missing -= len - hlen;
+  if (0 != ff->missing)
+    return;
+  frag_complete++;
+  if (! mark_seen (ff->seq))
+    return;
+  delivered++;
+  record_latency (last_recv_time - ff->tx_time);
+}
+
+
+/**
+ * Answer an ARP request from the program for one of our hosts.
+ */
+static void
+handle_arp_request (uint16_t ifc_num,
+		    const struct ArpHeaderEthernetIPv4 *ah)
+{
+  const struct Interface *ifc = &gifc[ifc_num - 1];
+  char buf[sizeof (struct EthernetHeader)
+	   + sizeof (struct ArpHeaderEthernetIPv4)];
+  size_t size;
+
+  if (1 != ntohs (ah->oper))
+    return;
+  for (unsigned int k = 0; k < ifc->num_ip_hosts; k++)
+    {
+      struct in_addr ip = host_ip (ifc_num,
+				   k);
+      struct MacAddress mac;
+
+      if (ip.s_addr != ah->target_pa.s_addr)
+	continue;
+      mac = host_mac (ifc_num,
+		      k);
+      size = build_arp (buf,
+			2,
+			&ah->sender_ha,
+			&mac,
+			ip,
+			&ah->sender_ha,
+			ah->sender_pa);
+      if (0 == queue_message (ifc_num,
+			      buf,
+			      size))
+	arp_replies++;
+      else
+	arp_dropped++;
+      return;
+    }
+}
+
+
+/**
+ * The program has been given its MAC addresses by us, it never sends
+ * any to us.
+ */
+static void
+handle_mac (uint16_t ifc_num,
+	    const struct MacAddress *mac)
+{
+  (void) ifc_num;
+  (void) mac;
+}
+
+
+/**
+ * Only drivers announce interfaces, the program never does.
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+		const struct MacAddress *mac,
+		const char *arg)
+{
+  (void) ifc_num;
+  (void) mac;
+  (void) arg;
+}
+
+
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+  (void) ifc_num;
+}
+
+
+/**
+ * Output of the program for the user.
+ */
+static void
+handle_control (char *cmd,
+		size_t cmd_len)
+{
+  recv_control++;
+  if (verbose)
+    fprintf (stderr,
+	     "%.*s",
+	     (int) cmd_len,
+	     cmd);
+}
+
+
+/**
+ * The program sent @a frame on @a ifc_num.  Look for our stamp.
+ */
+static void
+handle_frame (uint16_t ifc_num,
+	      const void *frame,
+	      size_t size)
+{
+  const char *cframe = frame;
+  struct EthernetHeader eh;
+  struct Stamp stamp;
+  size_t off = 0;
+  size_t stamp_off;
+  uint16_t tag;
+
+  recv_frames++;
+  recv_bytes += size;
+  last_recv_time = now_ns ();
+  if ( (0 == ifc_num) ||
+       (ifc_num > num_ifc) ||
+       (size < sizeof (eh)) )
+    {
+      recv_unstamped++;
+      return;
+    }
+  memcpy (&eh,
+	  frame,
+	  sizeof (eh));
+  tag = ntohs (eh.tag);
+  if ( (ETH_802_1Q_TAG == tag) &&
+       (size >= sizeof (eh) + 4) )
+    {
+      off = 4;
+      memcpy (&tag,
+	      &cframe[sizeof (eh) + 2],
+	      sizeof (tag));
+      tag = ntohs (tag);
+    }
+  switch (tag)
+    {
+    case ETH_P_PKTGEN:
+      stamp_off = off + sizeof (eh);
+      break;
+    case ETH_P_IPV4:
+      {
+	struct IPv4Header ip;
+
+	if (size < off + sizeof (eh) + sizeof (ip))
+	  {
+	    recv_unstamped++;
+	    return;
+	  }
+	memcpy (&ip,
+		&cframe[off + sizeof (eh)],
+		sizeof (ip));
+	if (0 != (ntohs (ip.fragmentation_info) & 0x3FFF))
+	  {
+	    /* more fragments or not the first one */
+	    handle_fragment (&ip,
+			     size - off - sizeof (eh));
+	    return;
+	  }
+	stamp_off = off + sizeof (eh) + 4 * (ip.version_ihl & 0x0F)
+	  + sizeof (struct UdpHeader);
+	break;
+      }
+    case ETH_P_ARP:
+      if (size >= off + sizeof (eh) + sizeof (struct ArpHeaderEthernetIPv4))
+	{
+	  struct ArpHeaderEthernetIPv4 ah;
+
+	  memcpy (&ah,
+		  &cframe[off + sizeof (eh)],
+		  sizeof (ah));
+	  handle_arp_request (ifc_num,
+			      &ah);
+	}
+      recv_unstamped++;
+      return;
+    default:
+      recv_unstamped++;
+      return;
+    }
+  if (size < stamp_off + sizeof (stamp))
+    {
+      recv_unstamped++;
+      return;
+    }
+  memcpy (&stamp,
+	  &cframe[stamp_off],
+	  sizeof (stamp));
+  if ( (PKTGEN_MAGIC != ntohl (stamp.magic)) ||
+       (ntohl (stamp.seq) >= next_seq) )
+    {
+      recv_unstamped++;
+      return;
+    }
+  if (! mark_seen (ntohl (stamp.seq)))
+    return;
+  delivered++;
+  record_latency (last_recv_time - stamp.tx_time);
+}
+
+
+/* we only need dispatch_messages() from loop.c */
+static void
+loop () __attribute__ ((unused));
+
+#include "loop.c"
+
+
+/**
+ * Read whatever the program has for us and process it.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+read_input ()
+{
+  static char rbuf[2 * UINT16_MAX];
+  static size_t roff;
+  static int have_mac = 1;
+  ssize_t ret;
+
+  ret = read (from_child,
+	      &rbuf[roff],
+	      sizeof (rbuf) - roff);
+  if (ret < 0)
+    {
+      if ( (EAGAIN == errno) ||
+	   (EINTR == errno) )
+	return 0;
+      return -1;
+    }
+  if (0 == ret)
+    return -1;
+  roff += ret;
+  dispatch_messages (rbuf,
+		     &roff,
+		     &have_mac);
+  return 0;
+}
+
+
+/**
+ * Wait up to @a timeout_ms for the program to become readable or
+ * (if we have pending output) writable, and service it.
+ *
+ * @return -1 if the program is gone, 0 if nothing happened, 1 otherwise
+ */
+static int
+service (unsigned int timeout_ms)
+{
+  fd_set rs;
+  fd_set ws;
+  struct timeval tv;
+  int ret;
+
+  FD_ZERO (&rs);
+  FD_ZERO (&ws);
+  FD_SET (from_child, &rs);
+  if (sbuf_off < sbuf_len)
+    FD_SET (to_child, &ws);
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  ret = select (1 + (from_child > to_child ? from_child : to_child),
+		&rs,
+		&ws,
+		NULL,
+		&tv);
+  if (ret < 0)
+    return (EINTR == errno) ? 0 : -1;
+  if (0 == ret)
+    return 0;
+  if ( FD_ISSET (from_child, &rs) &&
+       (0 != read_input ()) )
+    return -1;
+  if ( FD_ISSET (to_child, &ws) &&
+       (0 != flush_output ()) )
+    return -1;
+  return 1;
+}
+
+
+/**
+ * Service the program until it has been quiet for #DRAIN_MS.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+drain ()
+{
+  int ret;
+
+  while (0 != (ret = service (DRAIN_MS)))
+    if (ret < 0)
+      return -1;
+  return 0;
+}
+
+
+/**
+ * Tell the program about our hosts before we start measuring: let
+ * switches learn where each host is, and fill the ARP cache of routers.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+warm_up ()
+{
+  char buf[sizeof (struct EthernetHeader)
+	   + sizeof (struct ArpHeaderEthernetIPv4)];
+  struct MacAddress bcast;
+
+  memset (&bcast,
+	  0xFF,
+	  sizeof (bcast));
+  for (unsigned int i = 1; i <= num_ifc; i++)
+    for (unsigned int k = 0; (k < num_hosts) || (k < gifc[i - 1].num_ip_hosts); k++)
+      {
+	struct MacAddress mac = host_mac (i,
+					  k);
+
+	if ( (k < num_hosts) &&
+	     (mix_weight[MIX_UNICAST] > 0) )
+	  {
+	    struct EthernetHeader eh;
+
+	    memset (buf,
+		    0,
+		    sizeof (buf));
+	    eh.dst = bcast;
+	    eh.src = mac;
+	    eh.tag = htons (ETH_P_PKTGEN);
+	    memcpy (buf,
+		    &eh,
+		    sizeof (eh));
+	    while (0 != queue_message (i,
+				       buf,
+				       sizeof (buf)))
+	      if (service (DRAIN_MS) < 0)
+		return -1;
+	  }
+	if (k < gifc[i - 1].num_ip_hosts)
+	  {
+	    size_t size = build_arp (buf,
+				     2,
+				     &gifc[i - 1].mac,
+				     &mac,
+				     host_ip (i, k),
+				     &gifc[i - 1].mac,
+				     gifc[i - 1].ip);
+
+	    while (0 != queue_message (i,
+				       buf,
+				       size))
+	      if (service (DRAIN_MS) < 0)
+		return -1;
+	  }
+      }
+  return drain ();
+}
+
+
+/**
+ * Parse the mix specification @a spec.
+ *
+ * @return 0 on success
+ */
+static int
+parse_mix (const char *spec)
+{
+  char *dup = strdup (spec);
+  char *tok;
+
+  memset (mix_weight,
+	  0,
+	  sizeof (mix_weight));
+  mix_total = 0;
+  for (tok = strtok (dup, ","); NULL != tok; tok = strtok (NULL, ","))
+    {
+      char *colon = strchr (tok, ':');
+      unsigned int weight = 1;
+      enum Mix m;
+
+      if (NULL != colon)
+	{
+	  *colon = '\0';
+	  if (1 != sscanf (colon + 1,
+			   "%u",
+			   &weight))
+	    {
+	      fprintf (stderr,
+		       "Weight `%s' malformed\n",
+		       colon + 1);
+	      free (dup);
+	      return 1;
+	    }
+	}
+      for (m = 0; m < MIX_MAX; m++)
+	if (0 == strcasecmp (tok,
+			     mix_names[m]))
+	  break;
+      if (MIX_MAX == m)
+	{
+	  fprintf (stderr,
+		   "Unknown mix `%s'\n",
+		   tok);
+	  free (dup);
+	  return 1;
+	}
+      mix_weight[m] += weight;
+      mix_total += weight;
+    }
+  free (dup);
+  if (0 == mix_total)
+    {
+      fprintf (stderr,
+	       "Empty mix\n");
+      return 1;
+    }
+  return 0;
+}
+
+
+/**
+ * Look for "[IPV4:IP/LEN" in the interface argument @a arg of the
+ * program and initialize @a ifc accordingly.
+ */
+static void
+parse_ifc_arg (struct Interface *ifc,
+	       const char *arg)
+{
+  const char *net = strcasestr (arg,
+				"[IPV4:");
+  char ip[INET_ADDRSTRLEN];
+  unsigned int len;
+  uint32_t hosts;
+
+  if ( (NULL == net) ||
+       (2 != sscanf (net + strlen ("[IPV4:"),
+		     "%15[0-9.]/%u",
+		     ip,
+		     &len)) ||
+       (len > 30) ||
+       (1 != inet_pton (AF_INET,
+			ip,
+			&ifc->ip)) )
+    return;
+  ifc->have_ip = 1;
+  ifc->netmask.s_addr = (0 == len) ? 0 : htonl (~0U << (32 - len));
+  /* all addresses but network, broadcast and the program's own */
+  hosts = (len > 0) ? (1U << (32 - len)) - 3 : UINT32_MAX;
+  ifc->num_ip_hosts = (hosts < MAX_IP_HOSTS) ? hosts : MAX_IP_HOSTS;
+}
+
+
+static int
+cmp_u64 (const void *a,
+	 const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * Latency percentile @a p (in percent) of the (sorted) samples, in
+ * microseconds.
+ */
+static double
+percentile (double p)
+{
+  size_t idx;
+
+  if (0 == num_samples)
+    return 0.0;
+  idx = (size_t) (p / 100.0 * (num_samples - 1) + 0.5);
+  return samples[idx] / 1000.0;
+}
+
+
+/**
+ * Print what we measured.
+ */
+static void
+report ()
+{
+  double tx_secs = (last_send_time - start_time) / 1e9;
+  double rx_secs = (last_recv_time > start_time)
+    ? (last_recv_time - start_time) / 1e9
+    : 0.0;
+  uint64_t drops = sent_frames - delivered;
+
+  qsort (samples,
+	 num_samples,
+	 sizeof (uint64_t),
+	 &cmp_u64);
+  printf ("mix:       ");
+  for (enum Mix m = 0; m < MIX_MAX; m++)
+    if (mix_weight[m] > 0)
+      printf (" %s:%u",
+	      mix_names[m],
+	      mix_weight[m]);
+  printf ("\n");
+  printf ("sent:       %llu frames, %llu bytes in %.3f s\n",
+	  (unsigned long long) sent_frames,
+	  (unsigned long long) sent_bytes,
+	  tx_secs);
+  printf ("received:   %llu frames (%llu unstamped), %llu bytes, %llu control messages\n",
+	  (unsigned long long) recv_frames,
+	  (unsigned long long) recv_unstamped,
+	  (unsigned long long) recv_bytes,
+	  (unsigned long long) recv_control);
+  printf ("delivered:  %llu frames, %llu dropped (%.2f%%)\n",
+	  (unsigned long long) delivered,
+	  (unsigned long long) drops,
+	  sent_frames ? 100.0 * drops / sent_frames : 0.0);
+  if (recv_fragments > 0)
+    printf ("fragments:  %llu received, %llu frames complete\n",
+	    (unsigned long long) recv_fragments,
+	    (unsigned long long) frag_complete);
+  if (arp_replies + arp_dropped > 0)
+    printf ("arp:        %llu replies, %llu not queued\n",
+	    (unsigned long long) arp_replies,
+	    (unsigned long long) arp_dropped);
+  if (tx_secs > 0)
+    printf ("tx rate:    %.0f pps, %.2f Mbit/s\n",
+	    sent_frames / tx_secs,
+	    sent_bytes * 8 / tx_secs / 1e6);
+  if (rx_secs > 0)
+    printf ("rx rate:    %.0f pps, %.2f Mbit/s\n",
+	    recv_frames / rx_secs,
+	    recv_bytes * 8 / rx_secs / 1e6);
+  printf ("latency us: min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+	  percentile (0),
+	  percentile (50),
+	  percentile (90),
+	  percentile (99),
+	  percentile (99.9),
+	  percentile (100));
+}
+
+
+static void
+usage (const char *binary)
+{
+  fprintf (stderr,
+	   "Usage: %s [-m MIX] [-n COUNT] [-t SECONDS] [-r PPS] [-s SIZE] [-f MAXSIZE] [-S SEED] [-v] PROGRAM [ARGS...]\n"
+	   "MIX is a comma-separated list of NAME[:WEIGHT] with NAME one of\n"
+	   "unicast, broadcast, random, ipv4 and frag (default: unicast)\n",
+	   binary);
+}
+
+
+/**
+ * Launches the program given on the command line and drives traffic
+ * through it.
+ *
+ * @param argc number of arguments in @a argv
+ * @param argv options, followed by the program and its arguments
+ * @return 0 on success, 1 on usage errors, 2 if the program failed
+ */
+int
+main (int argc,
+      char **argv)
+{
+  unsigned long long count = 0;
+  double duration = 0;
+  double rate = 0;
+  uint64_t end_time;
+  int cin[2];
+  int cout[2];
+  pid_t chld;
+  int opt;
+  int failed = 0;
+
+  rng_state = (uint64_t) time (NULL) | 1;
+  if (0 != parse_mix ("unicast"))
+    return 1;
+  while (-1 != (opt = getopt (argc, argv, "+m:n:t:r:s:f:S:vh")))
+    {
+      switch (opt)
+	{
+	case 'm':
+	  if (0 != parse_mix (optarg))
+	    return 1;
+	  break;
+	case 'n':
+	  count = strtoull (optarg, NULL, 10);
+	  break;
+	case 't':
+	  duration = strtod (optarg, NULL);
+	  break;
+	case 'r':
+	  rate = strtod (optarg, NULL);
+	  break;
+	case 's':
+	  frame_size = strtoul (optarg, NULL, 10);
+	  break;
+	case 'f':
+	  frag_max = strtoul (optarg, NULL, 10);
+	  break;
+	case 'S':
+	  rng_state = strtoull (optarg, NULL, 10) | 1;
+	  break;
+	case 'v':
+	  verbose = 1;
+	  break;
+	default:
+	  usage (argv[0]);
+	  return 1;
+	}
+    }
+  if (optind >= argc)
+    {
+      usage (argv[0]);
+      return 1;
+    }
+  if ( (frame_size < sizeof (struct EthernetHeader) + sizeof (struct Stamp)) ||
+       (frame_size > UINT16_MAX - sizeof (struct GLAB_MessageHeader)) ||
+       (frag_max < 1515) ||
+       (frag_max > UINT16_MAX - sizeof (struct GLAB_MessageHeader)) )
+    {
+      fprintf (stderr,
+	       "Frame size out of range\n");
+      return 1;
+    }
+  if ( (0 == count) &&
+       (0 == duration) )
+    duration = 5;
+  num_ifc = argc - optind - 1;
+  if ( (num_ifc < 2) ||
+       (num_ifc > 255) )
+    {
+      fprintf (stderr,
+	       "PROGRAM needs between 2 and 255 interfaces\n");
+      return 1;
+    }
+  gifc = calloc (num_ifc,
+		 sizeof (struct Interface));
+  ip_ifcs = calloc (num_ifc,
+		    sizeof (unsigned int));
+  samples = malloc (MAX_SAMPLES * sizeof (uint64_t));
+  if ( (NULL == gifc) ||
+       (NULL == ip_ifcs) ||
+       (NULL == samples) )
+    abort ();
+  for (unsigned int i = 0; i < num_ifc; i++)
+    {
+      struct MacAddress mac = {
+	{ 0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t) (i + 1) }
+      };
+
+      gifc[i].mac = mac;
+      parse_ifc_arg (&gifc[i],
+		     argv[optind + 1 + i]);
+      if (gifc[i].num_ip_hosts > 0)
+	ip_ifcs[num_ip_ifcs++] = i + 1;
+    }
+  num_hosts = (num_ifc < MAX_HOSTS) ? MAX_HOSTS / num_ifc : 1;
+  for (unsigned int i = 0; i < num_ip_ifcs; i++)
+    {
+      struct Interface *ifc = &gifc[ip_ifcs[i] - 1];
+      unsigned int max = (num_ip_ifcs < MAX_IP_HOSTS) ? MAX_IP_HOSTS / num_ip_ifcs : 1;
+
+      if (ifc->num_ip_hosts > max)
+	ifc->num_ip_hosts = max;
+    }
+  if ( (mix_weight[MIX_IPV4] + mix_weight[MIX_FRAG] > 0) &&
+       (num_ip_ifcs < 2) )
+    {
+      fprintf (stderr,
+	       "ipv4 and frag mixes need at least two interfaces with IPV4:IP/LEN (LEN <= 30)\n");
+      return 1;
+    }
+
+  signal (SIGPIPE, SIG_IGN);
+  if ( (0 != pipe (cin)) ||
+       (0 != pipe (cout)) )
+    {
+      perror ("pipe");
+      return 2;
+    }
+  chld = fork ();
+  if (-1 == chld)
+    {
+      perror ("fork");
+      return 2;
+    }
+  if (0 == chld)
+    {
+      close (cin[1]);
+      close (cout[0]);
+      dup2 (cin[0], STDIN_FILENO);
+      dup2 (cout[1], STDOUT_FILENO);
+      execvp (argv[optind],
+	      &argv[optind]);
+      fprintf (stderr,
+	       "Failed to run binary `%s'\n",
+	       argv[optind]);
+      exit (1);
+    }
+  close (cin[0]);
+  close (cout[1]);
+  to_child = cin[1];
+  from_child = cout[0];
+
+  /* tell the program about its MAC addresses */
+  {
+    struct MacAddress macs[num_ifc];
+
+    for (unsigned int i = 0; i < num_ifc; i++)
+      macs[i] = gifc[i].mac;
+    queue_message (0,
+		   macs,
+		   sizeof (macs));
+  }
+  fcntl (to_child, F_SETFL, O_NONBLOCK);
+  fcntl (from_child, F_SETFL, O_NONBLOCK);
+
+  if (0 != warm_up ())
+    {
+      failed = 1;
+      goto done;
+    }
+  start_time = now_ns ();
+  last_send_time = start_time;
+  end_time = (duration > 0) ? start_time + (uint64_t) (duration * 1e9) : 0;
+  while (1)
+    {
+      uint64_t now = now_ns ();
+
+      if ( (count > 0) &&
+	   (sent_frames >= count) )
+	break;
+      if ( (0 != end_time) &&
+	   (now >= end_time) )
+	break;
+      while ( (sbuf_len - sbuf_off < SEND_WATERMARK) &&
+	      ( (0 == count) ||
+		(sent_frames < count) ) )
+	{
+	  if ( (rate > 0) &&
+	       (sent_frames >= (now - start_time) / 1e9 * rate) )
+	    break;
+	  if (0 != generate_frame ())
+	    break;
+	}
+      if (0 != flush_output ())
+	{
+	  failed = 1;
+	  break;
+	}
+      if (service ((rate > 0) ? 1 : 100) < 0)
+	{
+	  failed = 1;
+	  break;
+	}
+    }
+  /* deliver what is still pending and collect the responses */
+  if (! failed)
+    {
+      while (sbuf_off < sbuf_len)
+	if (service (DRAIN_MS) < 0)
+	  {
+	    failed = 1;
+	    break;
+	  }
+      if ( (! failed) &&
+	   (0 != drain ()) )
+	failed = 1;
+    }
+done:
+  if (failed)
+    fprintf (stderr,
+	     "Program `%s' terminated prematurely\n",
+	     argv[optind]);
+  kill (chld, SIGKILL);
+  waitpid (chld, NULL, 0);
+  report ();
+  free (samples);
+  free (seen);
+  free (ip_ifcs);
+  free (gifc);
+  return failed ? 2 : 0;
+}
+
+/* end of glab-pktgen.c */
@@ -0,0 +1,851 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file glab-replay.c
+ * @brief Replay pcap/pcapng captures through hub, switch, vswitch, arp
+ *        or router via the GLAB stdin/stdout protocol and record what
+ *        the program sends in one pcap file per interface.
+ *
+ * Usage: glab-replay -i [N=]FILE [-i ...] [-o PREFIX] [-m N=MAC]
+ *                    [-c COMMAND] [-l LOOPS] [-t] [-v] PROGRAM [ARGS...]
+ *
+ * Frames from a classic pcap FILE are given to the program on
+ * interface N (default: the interface after the one of the previous
+ * -i option, starting with 1).  For pcapng files, packets captured on
+ * interface K of the file are given to interface N+K, so a single
+ * pcapng file can carry the traffic of all interfaces.  Frames of all
+ * files are merged by capture time and written to the program as fast
+ * as it reads them.
+ *
+ * Frames the program sends on interface N are written to
+ * PREFIX-N.pcap.  Unless -t is given, the timestamp of each output
+ * frame is its position in the output of the program (in
+ * microseconds), so two runs with the same behavior produce identical
+ * files that can be compared with cmp(1).  Text output of the program
+ * (and of commands given with -c, which are sent after the last
+ * frame) goes to stdout, the summary to stderr.
+ */
+#include "glab.h"
+#include "pcap.c"
+#include <getopt.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+/**
+ * Queue more frames while fewer than this many bytes are pending for
+ * the program.
+ */
+#define SEND_WATERMARK 65536
+
+
+/**
+ * A capture given with -i.
+ */
+struct Input
+{
+  struct PcapReader reader;
+
+  /**
+   * Next packet of @e reader (if @e have_pkt).
+   */
+  struct PcapPacket pkt;
+
+  /**
+   * Interface of the program for packets on capture interface 0.
+   */
+  unsigned int base_ifc;
+
+  int have_pkt;
+};
+
+
+static struct Input *inputs;
+
+static unsigned int num_inputs;
+
+static unsigned int num_ifc;
+
+static struct PcapWriter *outputs;
+
+static int verbose;
+
+/**
+ * Stamp output with the time it was received instead of its position.
+ */
+static int real_time;
+
+/**
+ * Pipes to and from the program.
+ */
+static int to_child;
+
+static int from_child;
+
+/**
+ * Pending output for the program.
+ */
+static char sbuf[SEND_WATERMARK + 2 * (UINT16_MAX + 1)];
+
+static size_t sbuf_off;
+
+static size_t sbuf_len;
+
+static uint64_t sent_frames;
+
+static uint64_t sent_bytes;
+
+static uint64_t skipped_frames;
+
+static uint64_t recv_frames;
+
+static uint64_t recv_bytes;
+
+static uint64_t recv_invalid;
+
+static uint64_t start_time;
+
+static uint64_t last_recv_time;
+
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static uint64_t
+now_ns ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC,
+		 &ts);
+  return (uint64_t) ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+
+/**
+ * Append a message of @a type carrying @a size bytes of @a data to
+ * the output for the program.
+ *
+ * @return 0 on success, -1 if there is no space left
+ */
+static int
+queue_message (uint16_t type,
+	       const void *data,
+	       size_t size)
+{
+  struct GLAB_MessageHeader hdr;
+
+  if (sizeof (sbuf) - sbuf_len < sizeof (hdr) + size)
+    {
+      memmove (sbuf,
+	       &sbuf[sbuf_off],
+	       sbuf_len - sbuf_off);
+      sbuf_len -= sbuf_off;
+      sbuf_off = 0;
+      if (sizeof (sbuf) - sbuf_len < sizeof (hdr) + size)
+	return -1;
+    }
+  hdr.size = htons (sizeof (hdr) + size);
+  hdr.type = htons (type);
+  memcpy (&sbuf[sbuf_len],
+	  &hdr,
+	  sizeof (hdr));
+  memcpy (&sbuf[sbuf_len + sizeof (hdr)],
+	  data,
+	  size);
+  sbuf_len += sizeof (hdr) + size;
+  return 0;
+}
+
+
+/**
+ * Write as much pending output to the program as it accepts.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+flush_output ()
+{
+  while (sbuf_off < sbuf_len)
+    {
+      ssize_t ret = write (to_child,
+			   &sbuf[sbuf_off],
+			   sbuf_len - sbuf_off);
+
+      if (ret < 0)
+	{
+	  if ( (EAGAIN == errno) ||
+	       (EINTR == errno) )
+	    return 0;
+	  return -1;
+	}
+      sbuf_off += ret;
+    }
+  sbuf_off = 0;
+  sbuf_len = 0;
+  return 0;
+}
+
+
+static void
+handle_mac (uint16_t ifc_num,
+	    const struct MacAddress *mac)
+{
+  (void) ifc_num;
+  (void) mac;
+}
+
+
+/**
+ * Only drivers announce interfaces, the program never does.
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+		const struct MacAddress *mac,
+		const char *arg)
+{
+  (void) ifc_num;
+  (void) mac;
+  (void) arg;
+}
+
+
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+  (void) ifc_num;
+}
+
+
+/**
+ * Output of the program for the user.
+ */
+static void
+handle_control (char *cmd,
+		size_t cmd_len)
+{
+  fwrite (cmd,
+	  1,
+	  cmd_len,
+	  stdout);
+}
+
+
+/**
+ * The program sent @a frame on @a ifc_num, record it.
+ */
+static void
+handle_frame (uint16_t ifc_num,
+	      const void *frame,
+	      size_t size)
+{
+  uint64_t ts;
+
+  last_recv_time = now_ns ();
+  if ( (0 == ifc_num) ||
+       (ifc_num > num_ifc) )
+    {
+      recv_invalid++;
+      if (verbose)
+	fprintf (stderr,
+		 "Program sent frame on invalid interface %u\n",
+		 (unsigned int) ifc_num);
+      return;
+    }
+  recv_frames++;
+  recv_bytes += size;
+  if (NULL == outputs)
+    return;
+  if (real_time)
+    {
+      struct timespec now;
+
+      clock_gettime (CLOCK_REALTIME,
+		     &now);
+      ts = (uint64_t) now.tv_sec * 1000000000LLU + now.tv_nsec;
+    }
+  else
+    {
+      ts = recv_frames * 1000LLU;
+    }
+  if (0 != pcap_write (&outputs[ifc_num - 1],
+		       ts,
+		       frame,
+		       size))
+    {
+      fprintf (stderr,
+	       "Failed to write output for interface %u: %s\n",
+	       (unsigned int) ifc_num,
+	       strerror (errno));
+      exit (2);
+    }
+}
+
+
+/* we only need dispatch_messages() from loop.c */
+static void
+loop () __attribute__ ((unused));
+
+#include "loop.c"
+
+
+/**
+ * Read whatever the program has for us and process it.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+read_input ()
+{
+  static char rbuf[2 * UINT16_MAX];
+  static size_t roff;
+  static int have_mac = 1;
+  ssize_t ret;
+
+  ret = read (from_child,
+	      &rbuf[roff],
+	      sizeof (rbuf) - roff);
+  if (ret < 0)
+    {
+      if ( (EAGAIN == errno) ||
+	   (EINTR == errno) )
+	return 0;
+      return -1;
+    }
+  if (0 == ret)
+    return -1;
+  roff += ret;
+  dispatch_messages (rbuf,
+		     &roff,
+		     &have_mac);
+  return 0;
+}
+
+
+/**
+ * Wait until the program becomes readable or (if we have pending
+ * output) writable, and service it.
+ *
+ * @return -1 if the program is gone
+ */
+static int
+service ()
+{
+  fd_set rs;
+  fd_set ws;
+  int ret;
+
+  FD_ZERO (&rs);
+  FD_ZERO (&ws);
+  FD_SET (from_child, &rs);
+  if (sbuf_off < sbuf_len)
+    FD_SET (to_child, &ws);
+  ret = select (1 + (from_child > to_child ? from_child : to_child),
+		&rs,
+		&ws,
+		NULL,
+		NULL);
+  if (ret < 0)
+    return (EINTR == errno) ? 0 : -1;
+  if ( FD_ISSET (from_child, &rs) &&
+       (0 != read_input ()) )
+    return -1;
+  if ( FD_ISSET (to_child, &ws) &&
+       (0 != flush_output ()) )
+    return -1;
+  return 0;
+}
+
+
+/**
+ * Advance @a in to its next packet.
+ *
+ * @return 0 on success (including the end of the capture)
+ */
+static int
+advance (struct Input *in)
+{
+  int ret = pcap_read (&in->reader,
+		       &in->pkt);
+
+  if (ret < 0)
+    return -1;
+  in->have_pkt = ret;
+  return 0;
+}
+
+
+/**
+ * Open all captures (again) and read their first packet.
+ *
+ * @return 0 on success
+ */
+static int
+rewind_inputs ()
+{
+  for (unsigned int i = 0; i < num_inputs; i++)
+    {
+      const char *fn = inputs[i].reader.filename;
+
+      pcap_close_read (&inputs[i].reader);
+      if ( (0 != pcap_open_read (&inputs[i].reader,
+				 fn)) ||
+	   (0 != advance (&inputs[i])) )
+	return -1;
+    }
+  return 0;
+}
+
+
+/**
+ * Find the input with the earliest pending packet.  Ties are broken
+ * by the order of the -i options, keeping the replay deterministic.
+ *
+ * @return NULL if all inputs are exhausted
+ */
+static struct Input *
+next_input ()
+{
+  struct Input *best = NULL;
+
+  for (unsigned int i = 0; i < num_inputs; i++)
+    if ( inputs[i].have_pkt &&
+	 ( (NULL == best) ||
+	   (inputs[i].pkt.ts_ns < best->pkt.ts_ns) ) )
+      best = &inputs[i];
+  return best;
+}
+
+
+/**
+ * Queue the next frame of the merged captures for the program.
+ *
+ * @return 1 if a frame was queued or skipped, 0 if all captures are
+ *         exhausted or the buffer is full, -1 on errors
+ */
+static int
+queue_next_frame ()
+{
+  struct Input *in = next_input ();
+  unsigned int ifc;
+
+  if (NULL == in)
+    return 0;
+  ifc = in->base_ifc + in->pkt.ifc;
+  if ( (ifc > num_ifc) ||
+       (in->pkt.size > UINT16_MAX - sizeof (struct GLAB_MessageHeader)) )
+    {
+      if (verbose)
+	fprintf (stderr,
+		 "%s: skipping frame of %llu bytes for interface %u\n",
+		 in->reader.filename,
+		 (unsigned long long) in->pkt.size,
+		 ifc);
+      skipped_frames++;
+    }
+  else
+    {
+      if (0 != queue_message (ifc,
+			      in->pkt.data,
+			      in->pkt.size))
+	return 0;
+      sent_frames++;
+      sent_bytes += in->pkt.size;
+    }
+  if (0 != advance (in))
+    return -1;
+  return 1;
+}
+
+
+/**
+ * Parse "[N=]FILE" given to -i.
+ *
+ * @param arg the argument
+ * @param next_ifc[in,out] default interface, updated
+ * @return 0 on success
+ */
+static int
+add_input (const char *arg,
+	   unsigned int *next_ifc)
+{
+  struct Input *in;
+  unsigned int ifc = *next_ifc;
+  const char *fn = arg;
+  int n;
+
+  if ( (1 == sscanf (arg,
+		     "%u=%n",
+		     &ifc,
+		     &n)) &&
+       (n > 0) &&
+       ('=' == arg[n - 1]) )
+    fn = &arg[n];
+  if (0 == ifc)
+    {
+      fprintf (stderr,
+	       "Interfaces are numbered starting with 1\n");
+      return 1;
+    }
+  in = realloc (inputs,
+		(num_inputs + 1) * sizeof (struct Input));
+  if (NULL == in)
+    abort ();
+  inputs = in;
+  in = &inputs[num_inputs++];
+  memset (in,
+	  0,
+	  sizeof (*in));
+  in->base_ifc = ifc;
+  in->reader.filename = fn;
+  *next_ifc = ifc + 1;
+  return 0;
+}
+
+
+/**
+ * Parse "N=MAC" given to -m.
+ *
+ * @return 0 on success
+ */
+static int
+parse_mac_arg (const char *arg,
+	       struct MacAddress *macs,
+	       unsigned int max_ifc)
+{
+  unsigned int ifc;
+  unsigned int m[MAC_ADDR_SIZE];
+
+  if ( (7 != sscanf (arg,
+		     "%u=%x:%x:%x:%x:%x:%x",
+		     &ifc,
+		     &m[0], &m[1], &m[2], &m[3], &m[4], &m[5])) ||
+       (0 == ifc) ||
+       (ifc > max_ifc) )
+    {
+      fprintf (stderr,
+	       "MAC assignment `%s' malformed\n",
+	       arg);
+      return 1;
+    }
+  for (unsigned int i = 0; i < MAC_ADDR_SIZE; i++)
+    macs[ifc - 1].mac[i] = (uint8_t) m[i];
+  return 0;
+}
+
+
+static void
+usage (const char *binary)
+{
+  fprintf (stderr,
+	   "Usage: %s -i [N=]FILE [-i ...] [-o PREFIX] [-m N=MAC] [-c COMMAND] [-l LOOPS] [-t] [-v] PROGRAM [ARGS...]\n",
+	   binary);
+}
+
+
+/**
+ * Launches the program given on the command line and replays the
+ * captures through it.
+ *
+ * @param argc number of arguments in @a argv
+ * @param argv options, followed by the program and its arguments
+ * @return 0 on success, 1 on usage errors, 2 if the program failed
+ */
+int
+main (int argc,
+      char **argv)
+{
+  const char *prefix = NULL;
+  const char **commands = NULL;
+  const char **mac_args = NULL;
+  unsigned int num_commands = 0;
+  unsigned int num_mac_args = 0;
+  unsigned int next_ifc = 1;
+  unsigned long loops = 1;
+  uint64_t end_time;
+  int cin[2];
+  int cout[2];
+  pid_t chld;
+  int opt;
+  int failed = 0;
+  int status;
+
+  commands = calloc (argc, sizeof (char *));
+  mac_args = calloc (argc, sizeof (char *));
+  if ( (NULL == commands) ||
+       (NULL == mac_args) )
+    abort ();
+  while (-1 != (opt = getopt (argc, argv, "+i:o:m:c:l:tvh")))
+    {
+      switch (opt)
+	{
+	case 'i':
+	  if (0 != add_input (optarg,
+			      &next_ifc))
+	    return 1;
+	  break;
+	case 'o':
+	  prefix = optarg;
+	  break;
+	case 'm':
+	  mac_args[num_mac_args++] = optarg;
+	  break;
+	case 'c':
+	  commands[num_commands++] = optarg;
+	  break;
+	case 'l':
+	  loops = strtoul (optarg, NULL, 10);
+	  break;
+	case 't':
+	  real_time = 1;
+	  break;
+	case 'v':
+	  verbose = 1;
+	  break;
+	default:
+	  usage (argv[0]);
+	  return 1;
+	}
+    }
+  if ( (optind >= argc) ||
+       (0 == num_inputs) )
+    {
+      usage (argv[0]);
+      return 1;
+    }
+  num_ifc = argc - optind - 1;
+  if ( (num_ifc < 1) ||
+       (num_ifc > 255) )
+    {
+      fprintf (stderr,
+	       "PROGRAM needs between 1 and 255 interfaces\n");
+      return 1;
+    }
+  for (unsigned int i = 0; i < num_inputs; i++)
+    if (inputs[i].base_ifc > num_ifc)
+      {
+	fprintf (stderr,
+		 "%s: program only has %u interfaces\n",
+		 inputs[i].reader.filename,
+		 num_ifc);
+	return 1;
+      }
+  if (0 != rewind_inputs ())
+    return 1;
+  if (NULL != prefix)
+    {
+      outputs = calloc (num_ifc,
+			sizeof (struct PcapWriter));
+      if (NULL == outputs)
+	abort ();
+      for (unsigned int i = 0; i < num_ifc; i++)
+	{
+	  char fn[strlen (prefix) + 16];
+
+	  snprintf (fn,
+		    sizeof (fn),
+		    "%s-%u.pcap",
+		    prefix,
+		    i + 1);
+	  if (0 != pcap_open_write (&outputs[i],
+				    fn))
+	    return 1;
+	}
+    }
+
+  signal (SIGPIPE, SIG_IGN);
+  if ( (0 != pipe (cin)) ||
+       (0 != pipe (cout)) )
+    {
+      perror ("pipe");
+      return 2;
+    }
+  chld = fork ();
+  if (-1 == chld)
+    {
+      perror ("fork");
+      return 2;
+    }
+  if (0 == chld)
+    {
+      close (cin[1]);
+      close (cout[0]);
+      dup2 (cin[0], STDIN_FILENO);
+      dup2 (cout[1], STDOUT_FILENO);
+      execvp (argv[optind],
+	      &argv[optind]);
+      fprintf (stderr,
+	       "Failed to run binary `%s'\n",
+	       argv[optind]);
+      /* not exit(): that would flush our input files, moving the
+	 file offsets we share with the parent */
+      _exit (1);
+    }
+  close (cin[0]);
+  close (cout[1]);
+  to_child = cin[1];
+  from_child = cout[0];
+
+  /* tell the program about its MAC addresses */
+  {
+    struct MacAddress macs[num_ifc];
+
+    for (unsigned int i = 0; i < num_ifc; i++)
+      {
+	struct MacAddress mac = {
+	  { 0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t) (i + 1) }
+	};
+
+	macs[i] = mac;
+      }
+    for (unsigned int i = 0; i < num_mac_args; i++)
+      if (0 != parse_mac_arg (mac_args[i],
+			      macs,
+			      num_ifc))
+	{
+	  kill (chld, SIGKILL);
+	  waitpid (chld, NULL, 0);
+	  return 1;
+	}
+    queue_message (0,
+		   macs,
+		   sizeof (macs));
+  }
+  fcntl (to_child, F_SETFL, O_NONBLOCK);
+  fcntl (from_child, F_SETFL, O_NONBLOCK);
+
+  start_time = now_ns ();
+  for (unsigned long l = 0; (l < loops) && (! failed); l++)
+    {
+      int ret;
+
+      if ( (l > 0) &&
+	   (0 != rewind_inputs ()) )
+	{
+	  failed = 1;
+	  break;
+	}
+      while (1)
+	{
+	  ret = 0;
+	  while ( (sbuf_len - sbuf_off < SEND_WATERMARK) &&
+		  (1 == (ret = queue_next_frame ())) )
+	    ;
+	  if (ret < 0)
+	    {
+	      failed = 1;
+	      break;
+	    }
+	  if (NULL == next_input ())
+	    break;
+	  if (0 != service ())
+	    {
+	      failed = 1;
+	      break;
+	    }
+	}
+    }
+  for (unsigned int i = 0; (i < num_commands) && (! failed); i++)
+    {
+      char cmd[strlen (commands[i]) + 2];
+
+      snprintf (cmd,
+		sizeof (cmd),
+		"%s\n",
+		commands[i]);
+      while (0 != queue_message (0,
+				 cmd,
+				 strlen (cmd)))
+	if (0 != service ())
+	  {
+	    failed = 1;
+	    break;
+	  }
+    }
+  /* deliver what is still pending, then signal EOF and collect the
+     output until the program exits */
+  while ( (! failed) &&
+	  (sbuf_off < sbuf_len) )
+    if (0 != service ())
+      failed = 1;
+  end_time = now_ns ();
+  sbuf_off = sbuf_len = 0;
+  close (to_child);
+  while (0 == service ())
+    ;
+  if (last_recv_time > end_time)
+    end_time = last_recv_time;
+  waitpid (chld,
+	   &status,
+	   0);
+  if ( (! WIFEXITED (status)) ||
+       (0 != WEXITSTATUS (status)) )
+    {
+      fprintf (stderr,
+	       "Program `%s' terminated abnormally\n",
+	       argv[optind]);
+      failed = 1;
+    }
+  else if (failed)
+    {
+      fprintf (stderr,
+	       "Program `%s' terminated prematurely\n",
+	       argv[optind]);
+    }
+  fflush (stdout);
+  if (NULL != outputs)
+    for (unsigned int i = 0; i < num_ifc; i++)
+      if (0 != pcap_close_write (&outputs[i]))
+	{
+	  fprintf (stderr,
+		   "Failed to write output for interface %u\n",
+		   i + 1);
+	  failed = 1;
+	}
+
+  {
+    double secs = (end_time - start_time) / 1e9;
+
+    fprintf (stderr,
+	     "replayed:   %llu frames, %llu bytes (%llu skipped)\n",
+	     (unsigned long long) sent_frames,
+	     (unsigned long long) sent_bytes,
+	     (unsigned long long) skipped_frames);
+    fprintf (stderr,
+	     "received:   %llu frames, %llu bytes (%llu on invalid interfaces)\n",
+	     (unsigned long long) recv_frames,
+	     (unsigned long long) recv_bytes,
+	     (unsigned long long) recv_invalid);
+    if (secs > 0)
+      fprintf (stderr,
+	       "rate:       %.0f pps, %.2f Mbit/s in, %.0f pps out in %.3f s\n",
+	       sent_frames / secs,
+	       sent_bytes * 8 / secs / 1e6,
+	       recv_frames / secs,
+	       secs);
+  }
+  for (unsigned int i = 0; i < num_inputs; i++)
+    pcap_close_read (&inputs[i].reader);
+  free (inputs);
+  free (outputs);
+  free (commands);
+  free (mac_args);
+  return failed ? 2 : 0;
+}
+
+/* end of glab-replay.c */
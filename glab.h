@@ -34,11 +34,13 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <time.h>
 #include <byteswap.h>
@@ -69,8 +71,9 @@ struct GLAB_MessageHeader
    * The type of the message. 0 for 'control' (commands, feedback for
    * user), otherwise packets received from or to be sent to an
    * adapter. The first control message includes the list of all MAC
-   * addresses in the body. In all other cases, type is used to
-   * specify the number of the adapter (counting from 1).
+   * addresses in the body. #GLAB_TYPE_INTERFACE is used for
+   * interfaces added or removed at runtime. In all other cases, type
+   * is used to specify the number of the adapter (counting from 1).
    */
   uint16_t type;
 
@@ -92,7 +95,90 @@ struct MacAddress
 };
 
 
+/**
+ * Message type of a `struct GLAB_InterfaceEvent` (never a valid
+ * adapter number).
+ */
+#define GLAB_TYPE_INTERFACE UINT16_MAX
+
+/**
+ * Operations in a `struct GLAB_InterfaceEvent`.
+ */
+#define GLAB_INTERFACE_ADD 1
+#define GLAB_INTERFACE_DEL 2
+
+
+/**
+ * Sent by the driver to tell the program that an adapter was added
+ * (or removed) at runtime.  Adapter numbers of removed adapters may
+ * be reused by later additions.
+ */
+struct GLAB_InterfaceEvent
+{
+
+  /**
+   * Type is #GLAB_TYPE_INTERFACE.
+   */
+  struct GLAB_MessageHeader header;
+
+  /**
+   * Number of the adapter (counting from 1), in big-endian format.
+   */
+  uint16_t ifc_num;
+
+  /**
+   * #GLAB_INTERFACE_ADD or #GLAB_INTERFACE_DEL, in big-endian format.
+   */
+  uint16_t op;
+
+  /**
+   * MAC address of the added adapter.
+   */
+  struct MacAddress mac;
+
+  /* followed by the 0-terminated configuration of the adapter for the
+     program (same syntax as on its command line) */
+
+};
+
+
 _Pragma("pack(pop)")
 
 
+/**
+ * Make sure the array @a *arr of @a *len elements of @a elem_size
+ * bytes has room for at least @a min_len elements.  New elements are
+ * zeroed.  Existing elements may move, so pointers into the array
+ * must not be kept across calls.
+ *
+ * @param arr[in,out] pointer to the array, may point to NULL
+ * @param elem_size size of an element
+ * @param len[in,out] number of elements in @a *arr
+ * @param min_len number of elements needed
+ */
+static inline void
+grow_array (void *arr,
+	    size_t elem_size,
+	    unsigned int *len,
+	    unsigned int min_len)
+{
+  void **ap = arr;
+  unsigned int nlen;
+  char *na;
+
+  if (min_len <= *len)
+    return;
+  nlen = (*len > min_len / 2) ? 2 * *len : min_len;
+  na = realloc (*ap,
+		nlen * elem_size);
+  if (NULL == na)
+    abort ();
+  memset (&na[*len * elem_size],
+	  0,
+	  (nlen - *len) * elem_size);
+  *ap = na;
+  *len = nlen;
+}
+
+
 #endif
@@ -52,116 +52,94 @@ struct Interface
   struct MacAddress mac;
 
   /**
-   * Number of this interface.
+   * Number of this interface, 0 if this slot is unused.
    */
   uint16_t ifc_num;
 
+  /**
+   * GLAB header for frames to this interface, the type is set up
+   * once the interface is added.
+   */
+  struct GLAB_MessageHeader hdr;
+
+  /**
+   * Name of the interface (for the statistics).
+   */
+  char *name;
+
 };
 
 
 /**
- * Number of available contexts.
+ * Set to 1 to trace every frame on stderr.
+ */
+#ifndef DEBUG
+#define DEBUG 0
+#endif
+
+
+/**
+ * Length of @e gifc (some slots may be unused).
  */
 static unsigned int num_ifc;
 
 /**
- * All the contexts.
+ * All the contexts, indexed by interface number - 1.
  */
 static struct Interface *gifc;
 
+/**
+ * Gather list for fan-out: header of each destination followed by
+ * the (shared) frame; 2 * @e num_ifc + 1 entries.
+ */
+static struct iovec *iov;
+
 
 #include "print.c"
+#include "stats.c"
 
 
 /**
- * Forward @a frame to interface @a dst.
+ * Forward @a frame to all interfaces except @a src_ifc, using a
+ * single writev() that references @a frame once per destination.
  *
- * @param dst target interface to send the frame out on
+ * @param src_ifc interface we received the frame on
  * @param frame the frame to forward
  * @param frame_size number of bytes in @a frame
  */
-static void
-forward_to (struct Interface *dst,
-	    const void *frame,
-	    size_t frame_size)
-{
-
-  print("ForwardTo:\n");
-  char iob[frame_size + sizeof (struct GLAB_MessageHeader)];
-  struct GLAB_MessageHeader hdr;
-
-  hdr.size = htons (sizeof (iob));
-  hdr.type = htons (dst->ifc_num);
-  memcpy (iob,
-	  &hdr,
-	  sizeof (hdr));
-  memcpy (&iob[sizeof (hdr)],
-	  frame,
-	  frame_size);
-  write_all (STDOUT_FILENO,
-	     iob,
-	     sizeof (iob));
-}
-
-
 static void
 fwd_frame (struct Interface *src_ifc,
 	   const void *frame,
 	   size_t frame_size)
-
 {
-    print("ForwardFrame:\n");
-
-    const uint8_t *cframe = frame;
-    for (int i=1; i<=num_ifc; i++) {
-
-        print("\ni: %d\n", i);
-        print("dest: %s\n", gifc);
-        print("src: %x\n", src_ifc[i-1]);
-
-        const struct MacAddress *mac_src = src_ifc;
-        const struct MacAddress *mac_dst = gifc;
-
-        print("Framecontent:\n");
-        for (int i = 0; i<(frame_size-1); i++) {
-            print("%02x:", *(cframe + i));
-        }
-
-        if (gifc->ifc_num != src_ifc->ifc_num) {
-            /*print("src IFC-no: %d\n", src_ifc->ifc_num);
-            print("dst IFC-no: %d\n", gifc->ifc_num);
-            print("THEY ARE NOT EQUAL!!\n");
-            print("MAC-address src\n");
-            print ("%02X:%02X:%02X:%02X:%02X:%02X\n",
-                   mac_src->mac[0], mac_src->mac[1],
-                   mac_src->mac[2], mac_src->mac[3],
-                   mac_src->mac[4], mac_src->mac[5]);
-            print("MAC-address dst\n");
-            print ("%02X:%02X:%02X:%02X:%02X:%02X\n",
-                   mac_dst->mac[0], mac_dst->mac[1],
-                   mac_dst->mac[2], mac_dst->mac[3],
-                   mac_dst->mac[4], mac_dst->mac[5]);*/
-            forward_to(gifc, frame, frame_size);
-
-
-        } else {
-            /*print("src IFC-no: %d\n", src_ifc->ifc_num);
-            print("dst IFC-no: %d\n", gifc->ifc_num);
-            print("THEY ARE EQUAL!!\n");
-            print("MAC-address src\n");
-            print ("%02X:%02X:%02X:%02X:%02X:%02X\n",
-                       mac_src->mac[0], mac_src->mac[1],
-                       mac_src->mac[2], mac_src->mac[3],
-                       mac_src->mac[4], mac_src->mac[5]);
-            print("MAC-address dst\n");
-            print ("%02X:%02X:%02X:%02X:%02X:%02X\n",
-                   mac_dst->mac[0], mac_dst->mac[1],
-                   mac_dst->mac[2], mac_dst->mac[3],
-                   mac_dst->mac[4], mac_dst->mac[5]);*/
-        }
-
-        *(gifc + i);
-    }
+  uint16_t size = htons (frame_size + sizeof (struct GLAB_MessageHeader));
+  int n = 0;
+
+#if DEBUG
+  fprintf (stderr,
+	   "Frame of %u bytes from interface %u\n",
+	   (unsigned int) frame_size,
+	   (unsigned int) src_ifc->ifc_num);
+#endif
+  for (unsigned int i = 0; i < num_ifc; i++)
+  {
+    if ( (&gifc[i] == src_ifc) ||
+	 (0 == gifc[i].ifc_num) )
+      continue;
+    gifc[i].hdr.size = size;
+    iov[n].iov_base = &gifc[i].hdr;
+    iov[n].iov_len = sizeof (struct GLAB_MessageHeader);
+    n++;
+    iov[n].iov_base = (void *) frame;
+    iov[n].iov_len = frame_size;
+    n++;
+    stats_tx (i + 1,
+	      frame_size);
+  }
+  stats.floods++;
+  writev_all (STDOUT_FILENO,
+	      iov,
+	      n);
 }
 
 
@@ -177,9 +155,17 @@ handle_frame (uint16_t interface,
 	      const void *frame,
 	      size_t frame_size)
 {
-    print("HandleFrame:\n");
   if (interface > num_ifc)
     abort ();
+  if (0 == gifc[interface - 1].ifc_num)
+    return; /* removed */
+  stats_rx (interface,
+	    frame_size);
+  if (frame_size + sizeof (struct GLAB_MessageHeader) > UINT16_MAX)
+    {
+      stats_drop (DROP_TOO_LARGE);
+      return;
+    }
   fwd_frame (&gifc[interface - 1],
 	     frame,
 	     frame_size);
@@ -196,9 +182,19 @@ static void
 handle_control (char *cmd,
 		size_t cmd_len)
 {
+  const char *tok;
+
   cmd[cmd_len - 1] = '\0';
-  print ("Received command `%s' (ignored)\n",
-	 cmd);
+  tok = strtok (cmd,
+		" ");
+  if (NULL == tok)
+    return;
+  if (0 == strcasecmp (tok,
+		       "stats"))
+    stats_command ();
+  else
+    print ("Received command `%s' (ignored)\n",
+	   tok);
 }
 
 
@@ -215,11 +211,81 @@ handle_mac (uint16_t ifc_num,
   if (ifc_num > num_ifc)
     abort ();
   gifc[ifc_num - 1].mac = *mac;
+#if DEBUG
+  fprintf (stderr,
+	   "Interface %u has MAC %02X:%02X:%02X:%02X:%02X:%02X\n",
+	   (unsigned int) ifc_num,
+	   mac->mac[0], mac->mac[1],
+	   mac->mac[2], mac->mac[3],
+	   mac->mac[4], mac->mac[5]);
+#endif
+}
+
+
+/**
+ * Set up interface @a ifc_num called @a name, growing the
+ * interface table as needed.
+ */
+static void
+add_interface (uint16_t ifc_num,
+	       const char *name)
+{
+  struct Interface *ifc;
+
+  grow_array (&gifc,
+	      sizeof (struct Interface),
+	      &num_ifc,
+	      ifc_num);
+  iov = realloc (iov,
+		 (2 * num_ifc + 1) * sizeof (struct iovec));
+  if (NULL == iov)
+    abort ();
+  stats_init ("hub",
+	      num_ifc);
+  ifc = &gifc[ifc_num - 1];
+  free (ifc->name);
+  ifc->ifc_num = ifc_num;
+  ifc->hdr.type = htons (ifc_num);
+  ifc->name = strdup (name);
+  stats_set_name (ifc_num,
+		  ifc->name);
+}
+
+
+/**
+ * Handle interface @a ifc_num with @a mac and configuration @a arg
+ * added at runtime.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg configuration of the interface (its name)
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+		const struct MacAddress *mac,
+		const char *arg)
+{
+  add_interface (ifc_num,
+		 arg);
+  gifc[ifc_num - 1].mac = *mac;
+}
+
 
-    print ("%02X:%02X:%02X:%02X:%02X:%02X\n",
-           mac->mac[0], mac->mac[1],
-           mac->mac[2], mac->mac[3],
-           mac->mac[4], mac->mac[5]);
+/**
+ * Handle interface @a ifc_num being removed at runtime.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+  if (ifc_num > num_ifc)
+    return;
+  stats_clear (ifc_num);
+  free (gifc[ifc_num - 1].name);
+  memset (&gifc[ifc_num - 1],
+	  0,
+	  sizeof (struct Interface));
 }
 
 
@@ -229,16 +295,16 @@ int
 main (int argc,
       char **argv)
 {
-  struct Interface ifc[argc - 1];
-
-  memset (ifc,
-	  0,
-	  sizeof (ifc));
-  num_ifc = argc - 1;
-  gifc = ifc;
+  stats_init ("hub",
+	      argc - 1);
   for (unsigned int i=1;i<argc;i++)
-    ifc[i-1].ifc_num = i;
+    add_interface (i,
+		   argv[i]);
 
   loop ();
+  for (unsigned int i = 0; i < num_ifc; i++)
+    free (gifc[i].name);
+  free (gifc);
+  free (iov);
   return 0;
 }
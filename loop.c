@@ -23,15 +23,127 @@
  */
 
 
+/**
+ * Handle the `struct GLAB_InterfaceEvent` @a msg of @a size bytes by
+ * calling handle_ifc_add() or handle_ifc_del().
+ */
+static void
+dispatch_interface_event (const char *msg,
+			  size_t size)
+{
+  struct GLAB_InterfaceEvent ie;
+  const char *arg = &msg[sizeof (ie)];
+  uint16_t ifc_num;
+
+  if (size < sizeof (ie))
+    return;
+  memcpy (&ie,
+	  msg,
+	  sizeof (ie));
+  ifc_num = ntohs (ie.ifc_num);
+  if ( (0 == ifc_num) ||
+       (GLAB_TYPE_INTERFACE == ifc_num) )
+    return;
+  switch (ntohs (ie.op))
+    {
+    case GLAB_INTERFACE_ADD:
+      if ( (size == sizeof (ie)) ||
+	   ('\0' != msg[size - 1]) )
+	arg = "";
+      handle_ifc_add (ifc_num,
+		      &ie.mac,
+		      arg);
+      break;
+    case GLAB_INTERFACE_DEL:
+      handle_ifc_del (ifc_num);
+      break;
+    default:
+      break;
+    }
+}
+
+
+/**
+ * Process the complete messages at the beginning of @a buf and call
+ * handle_mac(), handle_control(), handle_ifc_add(), handle_ifc_del()
+ * or handle_frame() on each depending on the type.  Consumed messages
+ * are removed from @a buf.
+ *
+ * @param buf buffer with the messages
+ * @param off[in,out] number of bytes in @a buf
+ * @param have_mac[in,out] set once the list of MACs was received
+ */
+static void
+dispatch_messages (char *buf,
+		   size_t *off,
+		   int *have_mac)
+{
+  size_t pos = 0;
+
+  while (*off - pos > sizeof (struct GLAB_MessageHeader))
+    {
+      struct GLAB_MessageHeader hdr;
+      uint16_t size;
+      char *msg = &buf[pos];
+
+      memcpy (&hdr,
+	      msg,
+	      sizeof (hdr));
+      size = ntohs (hdr.size);
+      if (*off - pos < size)
+	break;
+      if (size < sizeof (struct GLAB_MessageHeader))
+	abort ();
+      switch (ntohs (hdr.type)) {
+      case 0: /* control */
+	if (0 == *have_mac)
+	  {
+	    for (unsigned int i=0;i<(size - sizeof (hdr)) / sizeof (struct MacAddress);i++)
+	      {
+		struct MacAddress mac;
+
+		memcpy (&mac,
+			&msg[sizeof (hdr) + i * sizeof (struct MacAddress)],
+			sizeof (struct MacAddress));
+		handle_mac (i + 1,
+			    &mac);
+	      }
+	    *have_mac = 1;
+	  }
+	else
+	  {
+	    handle_control (&msg[sizeof (hdr)],
+			    size - sizeof (hdr));
+	  }
+	break;
+      case GLAB_TYPE_INTERFACE:
+	dispatch_interface_event (msg,
+				  size);
+	break;
+      default:
+	handle_frame (ntohs (hdr.type),
+		      (const void *) &msg[sizeof (hdr)],
+		      size - sizeof (hdr));
+	break;
+      }
+      pos += size;
+    }
+  memmove (buf,
+	   &buf[pos],
+	   *off - pos);
+  *off -= pos;
+}
+
+
 /**
  * Sample main loop.  Reads packets from STDIN_FILENO
- * and calls handle_mac(), handle_control() or handle_frame()
- * on each depending on the type.
+ * and calls handle_mac(), handle_control(), handle_ifc_add(),
+ * handle_ifc_del() or handle_frame() on each depending on the type.
  */
 static void
 loop ()
 {
-  char buf[UINT16_MAX];
+  static char buf[UINT16_MAX]; /* keep the stack of the handlers small */
   size_t off;
   ssize_t ret;
   int have_mac;
@@ -42,56 +154,11 @@ loop ()
                             &buf[off],
                             sizeof (buf) - off)))
     {
-      struct GLAB_MessageHeader hdr;
-      uint16_t size;
-
       if (0 >= ret)
 	break;
       off += ret;
-      while (off > sizeof (struct GLAB_MessageHeader))
-	{
-	  memcpy (&hdr,
-		  buf,
-		  sizeof (hdr));
-	  size = ntohs (hdr.size);
-	  if (off < size)
-	    break;
-          if (size < sizeof (struct GLAB_MessageHeader))
-            abort ();
-	  switch (ntohs (hdr.type)) {
-	  case 0: /* control */
-	    if (0 == have_mac)
-	      {
-		for (unsigned int i=0;i<(size - sizeof (hdr)) / sizeof (struct MacAddress);i++)
-		  {
-		    struct MacAddress mac;
-            /* DO DELETE */
-            //print("HELLO I'M A TYPE 0!!!");
-            /* DO DELETE */
-		    memcpy (&mac,
-			    &buf[sizeof (hdr) + i * sizeof (struct MacAddress)],
-			    sizeof (struct MacAddress));
-		    handle_mac (i + 1,
-				&mac);
-		  }
-		have_mac = 1;
-	      }
-	    else
-	      {
-		handle_control (&buf[sizeof (hdr)],
-				size - sizeof (hdr));
-	      }
-	    break;
-	  default:
-	    handle_frame (ntohs (hdr.type),
-			  (const void *) &buf[sizeof (hdr)],
-			  size - sizeof (hdr));
-	    break;
-	  }
-	  memmove (buf,
-		   &buf[size],
-		   off - size);
-	  off -= size;
-	}
+      dispatch_messages (buf,
+			 &off,
+			 &have_mac);
     }
 }
@@ -31,18 +31,34 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <math.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <linux/if.h>
 #include <linux/llc.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
 #include <linux/if_packet.h>
+#include <linux/virtio_net.h>
 #include "glab.h"
+#include "crc.c"
+#include "pcap.c"
+
+/* AF_XDP needs the kernel headers, but no libbpf */
+#if defined(__has_include)
+#if __has_include(<linux/if_xdp.h>) && __has_include(<linux/bpf.h>)
+#define HAVE_AF_XDP 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#endif
+#endif
 
 
 /**
@@ -99,22 +115,123 @@ struct in6_ifreq
 
 #define MAX(a,b) ((a) > (b))?(a):(b)
 
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+
+struct Interface;
+
+struct XdpSocket;
+
+
+/**
+ * Functions implementing one kind of network interface.
+ */
+struct Backend
+{
+  /**
+   * Prefix of interface arguments selecting this backend
+   * (NULL for plain interface names).
+   */
+  const char *prefix;
+
+  /**
+   * Open the interface described by @a spec (without the prefix).
+   *
+   * @param spec interface argument after the prefix
+   * @param ifc_num number of the interface (starting at 1)
+   * @param ifc[out] interface to initialize, sets @e fd
+   * @return 0 on success
+   */
+  int (*init) (const char *spec,
+	       unsigned int ifc_num,
+	       struct Interface *ifc);
+
+  /**
+   * Receive a frame.  There is room for a VLAN tag beyond @a size.
+   *
+   * @param ifc interface to receive from
+   * @param buf where to store the frame
+   * @param size number of bytes available in @a buf
+   * @return size of the frame, 0 if there was no frame for us,
+   *         -1 on fatal errors
+   */
+  ssize_t (*recv) (struct Interface *ifc,
+		   unsigned char *buf,
+		   size_t size);
+
+  /**
+   * Transmit a frame.
+   *
+   * @return number of bytes written, -1 on fatal errors
+   */
+  ssize_t (*send) (struct Interface *ifc,
+		   const unsigned char *frame,
+		   size_t size);
+
+  /**
+   * Release the resources of @a ifc.
+   */
+  void (*done) (struct Interface *ifc);
+};
+
+
 /**
  * Information about an interface.
  */
 struct Interface
 {
 
+  /**
+   * Backend implementing the interface.
+   */
+  const struct Backend *backend;
+
   /**
    * Set to our MAC address.
    */
   uint8_t my_mac[MAC_ADDR_SIZE];
 
   /**
-   * File descriptor for the interface.
+   * File descriptor for the interface, -1 if the backend does not
+   * have one to wait on (see @e ready_at).
    */
   int fd;
 
+  /**
+   * If @e num_queues is not 0, all file descriptors to wait on for
+   * input (@e fd is the first).
+   */
+  int *queue_fds;
+
+  unsigned int num_queues;
+
+  /**
+   * Time (see latency_now()) at which a frame can be received without
+   * waiting for @e fd, UINT64_MAX if never.
+   */
+  uint64_t ready_at;
+
+  /**
+   * Set once the interface will not receive any more frames.
+   */
+  int eof;
+
+  /**
+   * Set once the interface was removed with "ifc del"; it is closed
+   * as soon as no frame from or to it is in flight.
+   */
+  int removing;
+
+  /**
+   * Index of (the first of) our file descriptors in the poll set of
+   * the current iteration of the main loop, -1 if not polled.
+   */
+  int poll_idx;
+
+  /**
+   * Interface argument we were opened with.
+   */
+  char *spec;
+
   /**
    * The buffer filled by reading from @e fd. Plus some extra
    * space for VLAN tag synthesis.
@@ -144,6 +261,76 @@ struct Interface
    */
   struct ifreq if_idx;
 
+  /**
+   * In latency mode, the slot for the frame in @e buftun.
+   */
+  struct LatencySlot *latency_slot;
+
+  /**
+   * In latency mode, when we received the frame in @e buftun.
+   */
+  uint64_t latency_t_rx;
+
+  /**
+   * pcap backend: capture with the ingress frames (NULL if none).
+   */
+  struct PcapReader *pcap_in;
+
+  /**
+   * pcap backend: next ingress frame (if @e pcap_have_pkt).
+   */
+  struct PcapPacket pcap_pkt;
+
+  int pcap_have_pkt;
+
+  /**
+   * pcap backend: capture for the egress frames (@e fh is NULL if
+   * none).
+   */
+  struct PcapWriter pcap_out;
+
+  /**
+   * pcap backend: replay with the original timing?
+   */
+  int pcap_timed;
+
+  /**
+   * pcap backend: number of frames read and written.
+   */
+  uint64_t pcap_rx;
+
+  uint64_t pcap_tx;
+
+  /**
+   * xdp backend: the AF_XDP socket and its rings.
+   */
+  struct XdpSocket *xsk;
+
+  /**
+   * tap backend: queue to read from first when refilling the batch.
+   */
+  unsigned int tap_next_queue;
+
+  /**
+   * Frames received but not yet returned by the backend (read ahead
+   * from a tap device or segments of a super-frame), each preceded
+   * by its size (a size_t).  NULL until needed.
+   */
+  unsigned char *batch;
+
+  /**
+   * Number of bytes in @e batch and offset of the next frame.
+   */
+  size_t batch_len;
+
+  size_t batch_off;
+
+  /**
+   * packet backend: are frames preceded by a `struct virtio_net_hdr`
+   * (offloads enabled)?
+   */
+  int vnet_hdr;
+
 };
 
 
@@ -160,202 +347,2775 @@ static int child_stdout;
 /**
  * Child PID
  */
-static pid_t chld;
+static pid_t chld;
+
+/**
+ * Disable segmentation offloads on raw socket interfaces (set with
+ * -O) instead of segmenting super-frames ourselves.
+ */
+static int disable_offloads;
+
+/**
+ * All interfaces, indexed by interface number - 1.  NULL for the
+ * numbers of interfaces that were removed at runtime.
+ */
+static struct Interface **gifc;
+
+/**
+ * Length of #gifc.
+ */
+static unsigned int gifc_len;
+
+/**
+ * `struct GLAB_InterfaceEvent`s not yet written to the child; like
+ * the command line, treated as a special 'network interface'.
+ */
+static struct Interface ifc_events;
+
+
+/**
+ * Number of in-flight frames we remember in latency mode
+ * (must be a power of two).
+ */
+#define LATENCY_SLOTS 4096
+
+/**
+ * How many bytes of the payload do we hash to correlate frames?
+ */
+#define LATENCY_HASH_BYTES 128
+
+/**
+ * Entries older than this (in ns) are no longer matched.
+ */
+#define LATENCY_MAX_AGE 1000000000LLU
+
+/**
+ * Sub-bucket bits of the latency histograms: each power of two is
+ * split into 2^LATENCY_SUB_BITS linear buckets (~3% precision).
+ */
+#define LATENCY_SUB_BITS 5
+
+/**
+ * Largest magnitude (power of two, in ns) the histograms track.
+ */
+#define LATENCY_MAX_BITS 40
+
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/**
+ * Stages we measure in latency mode.
+ */
+enum LatencyStage
+{
+  /**
+   * From recvmsg() until the frame was fully handed to the child.
+   */
+  LS_RX_TO_CHILD,
+
+  /**
+   * From handing the frame to the child until reading back a
+   * (matching) frame from the child.
+   */
+  LS_CHILD,
+
+  /**
+   * From reading the frame back from the child until sendto().
+   */
+  LS_CHILD_TO_TX,
+
+  /**
+   * From recvmsg() until sendto().
+   */
+  LS_TOTAL,
+
+  LS_MAX
+};
+
+
+static const char *latency_stage_names[LS_MAX] = {
+  "rx_to_child", "child", "child_to_tx", "total"
+};
+
+
+/**
+ * Log-linear histogram (in the spirit of HdrHistogram) of latencies
+ * in nanoseconds.
+ */
+struct LatencyHistogram
+{
+  uint64_t buckets[LATENCY_BUCKETS];
+
+  uint64_t count;
+
+  uint64_t min;
+
+  uint64_t max;
+
+  /**
+   * Sum of all values (for the mean).
+   */
+  double sum;
+
+  /**
+   * Sum of the squares of all values (for the standard deviation).
+   */
+  double sum_sq;
+};
+
+
+/**
+ * A frame we received from the network and may see again from the
+ * child.
+ */
+struct LatencySlot
+{
+  /**
+   * Hash of the payload, see latency_hash().
+   */
+  uint32_t hash;
+
+  /**
+   * Is this slot in use?
+   */
+  int used;
+
+  /**
+   * Did the child send (at least) one frame matching this one?
+   */
+  int matched;
+
+  /**
+   * When did recvmsg() return the frame?
+   */
+  uint64_t t_rx;
+
+  /**
+   * When did we finish writing the frame to the child (0 if not yet)?
+   */
+  uint64_t t_handoff;
+};
+
+
+/**
+ * Are we in latency mode (set with -L)?
+ */
+static int latency_mode;
+
+/**
+ * Where to write the histograms (NULL for stderr).
+ */
+static const char *latency_fn;
+
+/**
+ * Set by the SIGUSR1 handler to ask for the histograms.
+ */
+static volatile sig_atomic_t latency_dump_requested;
+
+static struct LatencySlot latency_slots[LATENCY_SLOTS];
+
+static struct LatencyHistogram latency_hist[LS_MAX];
+
+/**
+ * Frames from the child we could (not) correlate with a frame
+ * from the network, and frames from the network that displaced
+ * an earlier, not yet matched frame in the same slot.
+ */
+static uint64_t latency_matched;
+
+static uint64_t latency_unmatched;
+
+static uint64_t latency_displaced;
+
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static uint64_t
+latency_now ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC,
+		 &ts);
+  return (uint64_t) ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+
+/**
+ * Compute the hash we use to recognize a frame the child sends on
+ * for a frame we received.  Layer 2 headers (including VLAN tags) are
+ * skipped, as are the IPv4 header fields a router changes (TTL and
+ * checksum).
+ *
+ * @param frame the Ethernet frame
+ * @param size number of bytes in @a frame
+ * @return the hash
+ */
+static uint32_t
+latency_hash (const unsigned char *frame,
+	      size_t size)
+{
+  size_t off = VLAN_OFFSET;
+  uint16_t tag;
+  GNUNET_uLong crc = 0;
+
+  if (size < off + sizeof (tag))
+    return GNUNET_CRYPTO_crc32_n (frame,
+				  size);
+  memcpy (&tag,
+	  &frame[off],
+	  sizeof (tag));
+  if ( (ETH_P_8021Q == ntohs (tag)) &&
+       (size >= off + sizeof (struct vlan_tag) + sizeof (tag)) )
+    {
+      off += sizeof (struct vlan_tag);
+      memcpy (&tag,
+	      &frame[off],
+	      sizeof (tag));
+    }
+  off += sizeof (tag);
+  if ( (ETH_P_IP == ntohs (tag)) &&
+       (size >= off + 20) &&
+       (size >= off + 4 * (frame[off] & 0x0F)) )
+    {
+      const unsigned char *ip = &frame[off];
+
+      crc = crc32 (crc, (const char *) &ip[4], 2);  /* identification */
+      crc = crc32 (crc, (const char *) &ip[9], 1);  /* protocol */
+      crc = crc32 (crc, (const char *) &ip[12], 8); /* addresses */
+      off += 4 * (ip[0] & 0x0F);
+    }
+  if (size - off > LATENCY_HASH_BYTES)
+    size = off + LATENCY_HASH_BYTES;
+  return crc32 (crc,
+		(const char *) &frame[off],
+		size - off);
+}
+
+
+/**
+ * Bucket for @a value in the latency histograms.
+ */
+static unsigned int
+latency_bucket (uint64_t value)
+{
+  unsigned int msb;
+  unsigned int shift;
+
+  if (value < (1LLU << LATENCY_SUB_BITS))
+    return (unsigned int) value;
+  if (value >= (1LLU << LATENCY_MAX_BITS))
+    return LATENCY_BUCKETS - 1;
+  msb = 63 - __builtin_clzll (value);
+  shift = msb - LATENCY_SUB_BITS;
+  return ((shift + 1) << LATENCY_SUB_BITS)
+    + (unsigned int) ((value >> shift) - (1LLU << LATENCY_SUB_BITS));
+}
+
+
+/**
+ * Smallest value that falls into bucket @a b.
+ */
+static uint64_t
+latency_bucket_value (unsigned int b)
+{
+  unsigned int shift;
+
+  if (b < (1U << LATENCY_SUB_BITS))
+    return b;
+  shift = (b >> LATENCY_SUB_BITS) - 1;
+  return ((uint64_t) ((b & ((1U << LATENCY_SUB_BITS) - 1))
+		      + (1U << LATENCY_SUB_BITS))) << shift;
+}
+
+
+/**
+ * Add @a value (in ns) to histogram @a h.
+ */
+static void
+latency_record (struct LatencyHistogram *h,
+		uint64_t value)
+{
+  h->buckets[latency_bucket (value)]++;
+  if ( (0 == h->count) ||
+       (value < h->min) )
+    h->min = value;
+  if (value > h->max)
+    h->max = value;
+  h->count++;
+  h->sum += value;
+  h->sum_sq += (double) value * value;
+}
+
+
+/**
+ * Remember that we received a frame with @a hash at @a now.
+ *
+ * @return the slot used for the frame
+ */
+static struct LatencySlot *
+latency_rx (uint32_t hash,
+	    uint64_t now)
+{
+  struct LatencySlot *ls = &latency_slots[hash & (LATENCY_SLOTS - 1)];
+
+  if ( ls->used &&
+       (! ls->matched) &&
+       (now - ls->t_rx < LATENCY_MAX_AGE) )
+    latency_displaced++;
+  ls->hash = hash;
+  ls->used = 1;
+  ls->matched = 0;
+  ls->t_rx = now;
+  ls->t_handoff = 0;
+  return ls;
+}
+
+
+/**
+ * Find the frame we received for a frame the child sent with @a hash.
+ *
+ * @return NULL if we have no (recent) frame for @a hash
+ */
+static const struct LatencySlot *
+latency_lookup (uint32_t hash,
+		uint64_t now)
+{
+  struct LatencySlot *ls = &latency_slots[hash & (LATENCY_SLOTS - 1)];
+
+  if ( (! ls->used) ||
+       (ls->hash != hash) ||
+       (0 == ls->t_handoff) ||
+       (now - ls->t_rx >= LATENCY_MAX_AGE) )
+    return NULL;
+  ls->matched = 1;
+  return ls;
+}
+
+
+/**
+ * Write histogram @a h for @a stage to @a f in the percentile
+ * distribution format of HdrHistogram.
+ */
+static void
+latency_dump_histogram (FILE *f,
+			const char *stage,
+			const struct LatencyHistogram *h)
+{
+  uint64_t total = 0;
+  double mean = 0.0;
+  double stddev = 0.0;
+
+  fprintf (f,
+	   "# stage %s (latency in ns)\n"
+	   "%12s %14s %10s %14s\n\n",
+	   stage,
+	   "Value",
+	   "Percentile",
+	   "TotalCount",
+	   "1/(1-Percentile)");
+  for (unsigned int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+      double pct;
+
+      if (0 == h->buckets[b])
+	continue;
+      total += h->buckets[b];
+      pct = (double) total / h->count;
+      if (total < h->count)
+	fprintf (f,
+		 "%12llu %14.12f %10llu %14.2f\n",
+		 (unsigned long long) latency_bucket_value (b),
+		 pct,
+		 (unsigned long long) total,
+		 1.0 / (1.0 - pct));
+      else
+	fprintf (f,
+		 "%12llu %14.12f %10llu\n",
+		 (unsigned long long) h->max,
+		 pct,
+		 (unsigned long long) total);
+    }
+  if (h->count > 0)
+    {
+      mean = h->sum / h->count;
+      stddev = h->sum_sq / h->count - mean * mean;
+      stddev = (stddev > 0) ? sqrt (stddev) : 0.0;
+    }
+  fprintf (f,
+	   "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n"
+	   "#[Max     = %12llu, Total count    = %12llu]\n"
+	   "#[Min     = %12llu]\n\n",
+	   mean,
+	   stddev,
+	   (unsigned long long) h->max,
+	   (unsigned long long) h->count,
+	   (unsigned long long) h->min);
+}
+
+
+/**
+ * Write all latency histograms to #latency_fn (or stderr).
+ */
+static void
+latency_dump ()
+{
+  FILE *f = stderr;
+
+  latency_dump_requested = 0;
+  if (NULL != latency_fn)
+    {
+      f = fopen (latency_fn,
+		 "w");
+      if (NULL == f)
+	{
+	  fprintf (stderr,
+		   "Failed to open `%s': %s\n",
+		   latency_fn,
+		   strerror (errno));
+	  return;
+	}
+    }
+  fprintf (f,
+	   "# matched %llu, unmatched %llu, displaced %llu\n",
+	   (unsigned long long) latency_matched,
+	   (unsigned long long) latency_unmatched,
+	   (unsigned long long) latency_displaced);
+  for (enum LatencyStage st = 0; st < LS_MAX; st++)
+    latency_dump_histogram (f,
+			    latency_stage_names[st],
+			    &latency_hist[st]);
+  if (stderr != f)
+    fclose (f);
+  else
+    fflush (f);
+}
+
+
+/**
+ * Signal handler for SIGUSR1: dump the histograms from the main loop.
+ */
+static void
+latency_sighandler (int sig)
+{
+  (void) sig;
+  latency_dump_requested = 1;
+}
+
+
+/**
+ * Creates a tun-interface called dev;
+ *
+ * @param dev is asumed to point to a char[IFNAMSIZ]
+ *        if *dev == '\\0', uses the name supplied by the kernel;
+ * @param ifc[out] initialized interface struct
+ * @return 0 on success, or -1 on error
+ */
+static int
+init_tun (char *dev,
+          struct Interface *ifc)
+{
+  struct ifreq ifr;
+  int fd;
+  struct ifreq if_mac;
+  struct ifreq ifopts;
+  struct ifreq so;
+  struct ethtool_value ev;
+
+  if (NULL == dev)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (-1 == (fd = socket (AF_PACKET,
+                          SOCK_RAW,
+                          htons (ETH_P_ALL))))
+    {
+      fprintf (stderr,
+	       "Error opening socket: %s\n",
+	       strerror (errno));
+      return -1;
+    }
+
+  /* only take traffic of 'dev' */
+  if (0 !=
+      setsockopt (fd,
+		  SOL_SOCKET,
+		  SO_BINDTODEVICE,
+		  dev,
+		  strlen (dev) + 1))
+    {
+      fprintf (stderr,
+	       "Failed to limit myself to `%s' for inbound traffic: %s\n",
+	       dev,
+	       strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+
+  /* Enable grabbing auxiliary data, including VLAN information */
+  {
+    int val = 1;
+
+    if (0 != setsockopt (fd,
+                         SOL_PACKET,
+                         PACKET_AUXDATA,
+                         &val,
+                         sizeof(val)))
+      {
+        fprintf (stderr,
+                 "Failed to activate PACKET_AUXDATA: %s\n",
+                 strerror (errno));
+        (void) close (fd);
+        return -1;
+      }
+  }
+
+  memset (&ifr,
+	  0,
+	  sizeof (ifr));
+
+  /* Get the index of the interface to send on */
+  memset (&ifc->if_idx,
+	  0,
+	  sizeof (struct ifreq));
+  strncpy (ifc->if_idx.ifr_name,
+	   dev,
+	   IFNAMSIZ - 1);
+  if (ioctl (fd,
+	     SIOCGIFINDEX,
+	     &ifc->if_idx) < 0)
+    {
+      fprintf (stderr,
+	       "Could not use interface `%s': %s",
+	       dev,
+	       strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+  /* Get the MAC address of the interface to send on */
+  memset (&if_mac,
+	  0,
+	  sizeof(struct ifreq));
+  strncpy (if_mac.ifr_name,
+	   dev,
+	   IFNAMSIZ - 1);
+  if (0 > ioctl (fd,
+		 SIOCGIFHWADDR,
+		 &if_mac))
+    {
+      fprintf (stderr,
+	       "Could not obtain MAC of interface `%s': %s",
+	       dev,
+	       strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+  memcpy (&ifc->my_mac,
+	  &if_mac.ifr_hwaddr.sa_data,
+	  MAC_ADDR_SIZE);
+
+  strncpy(ifopts.ifr_name,
+	  dev,
+	  IFNAMSIZ-1);
+  if (0 > ioctl (fd,
+		 SIOCGIFFLAGS,
+		 &ifopts))
+    {
+      fprintf (stderr,
+	       "Could not obtain flags of interface `%s': %s",
+	       dev,
+	       strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+  ifopts.ifr_flags |= IFF_PROMISC;
+  if (0 > ioctl (fd,
+		 SIOCSIFFLAGS,
+		 &ifopts))
+    {
+      fprintf (stderr,
+	       "Could not set flags of interface `%s': %s",
+	       dev,
+	       strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+
+  /* Our clients must not be expected to deal with frames exceeding
+     the MTU.  Preferably, keep the offloads and have the kernel tell
+     us (in a virtio_net_hdr) how to segment super-frames; see
+     gso_segment(). */
+  if (! disable_offloads)
+  {
+    int val = 1;
+
+    if (0 == setsockopt (fd,
+                         SOL_PACKET,
+                         PACKET_VNET_HDR,
+                         &val,
+                         sizeof (val)))
+      {
+        ifc->vnet_hdr = 1;
+        ifc->fd = fd;
+        ifc->ready_at = UINT64_MAX;
+        return 0;
+      }
+    fprintf (stderr,
+             "Failed to activate PACKET_VNET_HDR, disabling offloads: %s\n",
+             strerror (errno));
+  }
+
+  /* Disable segmentation offloads:
+     - TSO TCP Segmentation Offload
+     - GSO Generic Segmentation Offload
+     - GRO Generic Receive Offload */
+  const uint32_t ethtool_cmd[] = { ETHTOOL_STSO, ETHTOOL_SGSO, ETHTOOL_SGRO };
+  for ( int i=0; i<sizeof(ethtool_cmd)/sizeof(uint32_t); i++)
+  {
+    ev.cmd = ethtool_cmd[i];
+    ev.data = 0;
+    memset (&so,
+  	  0,
+  	  sizeof (so));
+    strncpy (so.ifr_name,
+  	   dev,
+  	   IFNAMSIZ - 1);
+    so.ifr_data = (char*) &ev;
+    if (0 > ioctl (fd,
+  		 SIOCETHTOOL, 
+  		 &so))
+    {
+      fprintf (stderr,
+  	     "Could not disable offload %u on interface `%s': %s",
+	     ethtool_cmd[i],
+  	     dev,
+  	     strerror (errno));
+      (void) close (fd);
+      return -1;
+    }
+  }
+
+  ifc->fd = fd;
+  ifc->ready_at = UINT64_MAX;
+  return 0;
+}
+
+
+/**
+ * Size of the read-ahead buffer of an interface; large enough for the
+ * segments of the largest super-frame.  The tap backend stops reading
+ * ahead once fewer than MAX_SIZE bytes are left.
+ */
+#define BATCH_SIZE (4 * MAX_SIZE)
+
+#ifndef VIRTIO_NET_HDR_GSO_UDP_L4
+#define VIRTIO_NET_HDR_GSO_UDP_L4 5
+#endif
+
+
+/**
+ * Return the next frame from the read-ahead buffer of @a ifc.
+ *
+ * @param ifc interface with frames in its @e batch
+ * @param buf where to store the frame
+ * @param size number of bytes available in @a buf
+ * @return size of the frame, 0 if the buffer is empty
+ */
+static ssize_t
+batch_pop (struct Interface *ifc,
+	   unsigned char *buf,
+	   size_t size)
+{
+  size_t len;
+
+  if (ifc->batch_off == ifc->batch_len)
+    {
+      ifc->ready_at = UINT64_MAX;
+      return 0;
+    }
+  memcpy (&len,
+	  &ifc->batch[ifc->batch_off],
+	  sizeof (len));
+  memcpy (buf,
+	  &ifc->batch[ifc->batch_off + sizeof (size_t)],
+	  MIN (len, size));
+  ifc->batch_off += sizeof (size_t) + len;
+  /* more frames are ready without waiting for the file descriptor */
+  ifc->ready_at = (ifc->batch_off < ifc->batch_len) ? 0 : UINT64_MAX;
+  return MIN (len, size);
+}
+
+
+/**
+ * Append @a frame to the read-ahead buffer of @a ifc, inserting the
+ * VLAN @a tag (if not NULL) after the MAC addresses.
+ *
+ * @return 0 on success, -1 if there is no space left
+ */
+static int
+batch_append (struct Interface *ifc,
+	      const unsigned char *frame,
+	      size_t len,
+	      const struct vlan_tag *tag)
+{
+  size_t total = len + ( (NULL != tag) ? sizeof (*tag) : 0);
+  unsigned char *pos;
+
+  if (NULL == ifc->batch)
+    {
+      ifc->batch = malloc (BATCH_SIZE);
+      if (NULL == ifc->batch)
+	abort ();
+    }
+  if (BATCH_SIZE - ifc->batch_len < sizeof (size_t) + total)
+    return -1;
+  pos = &ifc->batch[ifc->batch_len];
+  memcpy (pos,
+	  &total,
+	  sizeof (total));
+  pos += sizeof (size_t);
+  if ( (NULL != tag) &&
+       (len >= VLAN_OFFSET) )
+    {
+      memcpy (pos,
+	      frame,
+	      VLAN_OFFSET);
+      memcpy (pos + VLAN_OFFSET,
+	      tag,
+	      sizeof (*tag));
+      memcpy (pos + VLAN_OFFSET + sizeof (*tag),
+	      frame + VLAN_OFFSET,
+	      len - VLAN_OFFSET);
+    }
+  else
+    {
+      memcpy (pos,
+	      frame,
+	      len);
+      total = len;
+      memcpy (pos - sizeof (size_t),
+	      &total,
+	      sizeof (total));
+    }
+  ifc->batch_len += sizeof (size_t) + total;
+  return 0;
+}
+
+
+static uint16_t
+get16 (const unsigned char *p)
+{
+  uint16_t v;
+
+  memcpy (&v, p, sizeof (v));
+  return ntohs (v);
+}
+
+
+static void
+put16 (unsigned char *p,
+       uint16_t v)
+{
+  v = htons (v);
+  memcpy (p, &v, sizeof (v));
+}
+
+
+/**
+ * Compute the TCP/UDP checksum of the segment at @a l4 in @a frame
+ * (IPv4 or IPv6 header at @a l3) and store it at @a csum_off.
+ */
+static void
+l4_checksum (unsigned char *frame,
+	     size_t len,
+	     size_t l3,
+	     size_t l4,
+	     uint8_t proto,
+	     size_t csum_off)
+{
+  uint32_t sum;
+  uint16_t csum;
+
+  if (4 == (frame[l3] >> 4))
+    {
+      unsigned char pseudo[12];
+
+      memcpy (pseudo, &frame[l3 + 12], 8);
+      pseudo[8] = 0;
+      pseudo[9] = proto;
+      put16 (&pseudo[10], len - l4);
+      sum = GNUNET_CRYPTO_crc16_step (0, pseudo, sizeof (pseudo));
+    }
+  else
+    {
+      unsigned char pseudo[40];
+
+      memcpy (pseudo, &frame[l3 + 8], 32);
+      put16 (&pseudo[32], 0);
+      put16 (&pseudo[34], len - l4);
+      memset (&pseudo[36], 0, 3);
+      pseudo[39] = proto;
+      sum = GNUNET_CRYPTO_crc16_step (0, pseudo, sizeof (pseudo));
+    }
+  memset (&frame[csum_off], 0, 2);
+  sum = GNUNET_CRYPTO_crc16_step (sum,
+				  &frame[l4],
+				  len - l4);
+  csum = GNUNET_CRYPTO_crc16_finish (sum);
+  if ( (IPPROTO_UDP == proto) &&
+       (0 == csum) )
+    csum = 0xFFFF;
+  memcpy (&frame[csum_off],
+	  &csum,
+	  sizeof (csum));
+}
+
+
+/**
+ * Split the TCP or UDP super-frame @a frame that the kernel
+ * coalesced (GRO) or did not segment (GSO) into MTU-sized frames
+ * as described by @a vh, and put them into the read-ahead buffer of
+ * @a ifc.  Headers are copied and fixed up (lengths, IPv4 ID and
+ * checksum, TCP sequence number and flags, L4 checksums).
+ *
+ * @param tag VLAN tag to insert into each segment, or NULL
+ * @return 0 on success, -1 if we do not know how to segment @a frame
+ */
+static int
+gso_segment (struct Interface *ifc,
+	     const struct virtio_net_hdr *vh,
+	     const unsigned char *frame,
+	     size_t len,
+	     const struct vlan_tag *tag)
+{
+  static unsigned char seg[MAX_SIZE];
+  unsigned int type = vh->gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+  size_t g = vh->gso_size;
+  size_t l3 = VLAN_OFFSET + sizeof (uint16_t);
+  size_t l4 = vh->csum_start;
+  size_t hlen;
+  uint16_t id;
+  uint32_t seq = 0;
+  int ipv4;
+
+  if (len < l3)
+    return -1;
+  if (ETH_P_8021Q == get16 (&frame[VLAN_OFFSET]))
+    l3 += sizeof (struct vlan_tag);
+  if ( (len < l3 + 20) ||
+       (0 == g) ||
+       (0 == (vh->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) ||
+       (l4 < l3 + 20) ||
+       (l4 + 8 > len) )
+    return -1;
+  ipv4 = (4 == (frame[l3] >> 4));
+  switch (type)
+    {
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+      if (l4 + 20 > len)
+	return -1;
+      hlen = l4 + 4 * (frame[l4 + 12] >> 4);
+      memcpy (&seq, &frame[l4 + 4], sizeof (seq));
+      seq = ntohl (seq);
+      break;
+    case VIRTIO_NET_HDR_GSO_UDP_L4:
+      hlen = l4 + 8;
+      break;
+    default:
+      /* UFO would require IP fragmentation */
+      return -1;
+    }
+  if ( (hlen > len) ||
+       (hlen + g > sizeof (seg)) )
+    return -1;
+  id = ipv4 ? get16 (&frame[l3 + 4]) : 0;
+  ifc->batch_len = 0;
+  ifc->batch_off = 0;
+  for (size_t off = hlen, i = 0; off < len; off += g, i++)
+    {
+      size_t chunk = MIN (g, len - off);
+      size_t slen = hlen + chunk;
+
+      memcpy (seg, frame, hlen);
+      memcpy (&seg[hlen], &frame[off], chunk);
+      if (ipv4)
+	{
+	  size_t ihl = 4 * (seg[l3] & 0x0F);
+	  uint16_t csum;
+
+	  put16 (&seg[l3 + 2], slen - l3);
+	  put16 (&seg[l3 + 4], id + i);
+	  memset (&seg[l3 + 10], 0, 2);
+	  csum = GNUNET_CRYPTO_crc16_n (&seg[l3], ihl);
+	  memcpy (&seg[l3 + 10], &csum, sizeof (csum));
+	}
+      else
+	{
+	  put16 (&seg[l3 + 4], slen - l3 - 40);
+	}
+      if (VIRTIO_NET_HDR_GSO_UDP_L4 == type)
+	{
+	  put16 (&seg[l4 + 4], slen - l4);
+	  l4_checksum (seg, slen, l3, l4, IPPROTO_UDP, l4 + 6);
+	}
+      else
+	{
+	  uint32_t sseq = htonl (seq + (off - hlen));
+
+	  memcpy (&seg[l4 + 4], &sseq, sizeof (sseq));
+	  if (off + chunk < len)
+	    seg[l4 + 13] &= ~0x09; /* FIN and PSH only on the last segment */
+	  if (0 != i)
+	    seg[l4 + 13] &= ~0x80; /* CWR only on the first */
+	  l4_checksum (seg, slen, l3, l4, IPPROTO_TCP, l4 + 16);
+	}
+      if (0 != batch_append (ifc, seg, slen, tag))
+	return -1;
+    }
+  return 0;
+}
+
+
+/**
+ * Open the network interface @a spec with a raw socket.
+ *
+ * @param spec name of the interface
+ * @param ifc_num number of the interface (unused)
+ * @param ifc[out] interface to initialize
+ * @return 0 on success
+ */
+static int
+packet_init (const char *spec,
+	     unsigned int ifc_num,
+	     struct Interface *ifc)
+{
+  char dev[IFNAMSIZ];
+
+  (void) ifc_num;
+  strncpy (dev,
+	   spec,
+	   IFNAMSIZ);
+  dev[IFNAMSIZ - 1] = '\0';
+  return init_tun (dev,
+		   ifc);
+}
+
+
+/**
+ * Receive a frame from the raw socket of @a ifc, re-inserting the
+ * VLAN tag the kernel stripped.
+ *
+ * @param ifc interface to receive from
+ * @param buf where to store the frame
+ * @param size number of bytes available in @a buf
+ * @return size of the frame, 0 if it was for another interface,
+ *         -1 on errors
+ */
+static ssize_t
+packet_recv (struct Interface *ifc,
+	     unsigned char *buf,
+	     size_t size)
+{
+  static unsigned char super[MAX_SIZE];
+  ssize_t ret;
+  struct sockaddr_ll sadr_ll;
+  struct cmsghdr *cmsg;
+  union {
+    struct cmsghdr cmsg;
+    char buf[CMSG_SPACE(sizeof (struct tpacket_auxdata))];
+  } cmsg_buf;
+  struct msghdr msg;
+  struct virtio_net_hdr vh;
+  struct vlan_tag vtag;
+  struct vlan_tag *tag = NULL;
+  struct iovec iov[2] = {
+    { .iov_base = &vh, .iov_len = sizeof (vh) },
+    { .iov_base = buf, .iov_len = size }
+  };
+
+  if (ifc->batch_off < ifc->batch_len)
+    return batch_pop (ifc,
+		      buf,
+		      size);
+  memset (&msg,
+	  0,
+	  sizeof (msg));
+  if (ifc->vnet_hdr)
+    {
+      /* super-frames may be much larger than @a buf */
+      iov[1].iov_base = super;
+      iov[1].iov_len = sizeof (super);
+      msg.msg_iov = iov;
+      msg.msg_iovlen = 2;
+    }
+  else
+    {
+      memset (buf,
+	      0,
+	      size);
+      msg.msg_iov = &iov[1];
+      msg.msg_iovlen = 1;
+    }
+  msg.msg_name = &sadr_ll;
+  msg.msg_namelen = sizeof (sadr_ll);
+  msg.msg_control = &cmsg_buf;
+  msg.msg_controllen = sizeof (cmsg_buf);
+  ret = recvmsg (ifc->fd,
+		 &msg,
+		 0 /* flags */);
+  if (-1 == ret)
+    {
+      fprintf (stderr,
+	       "read-error: %s\n",
+	       strerror (errno));
+      return -1;
+    }
+  if (sadr_ll.sll_ifindex != ifc->if_idx.ifr_ifindex)
+    {
+#if DEBUG
+      fprintf (stderr,
+	       "recvfrom for different interface, discarding\n");
+#endif
+      return 0;
+    }
+  if (0 == ret)
+    {
+      fprintf (stderr,
+	       "EOF on tun\n");
+      return -1;
+    }
+  if (ifc->vnet_hdr)
+    {
+      if (ret <= (ssize_t) sizeof (vh))
+	return 0;
+      ret -= sizeof (vh);
+    }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg);
+       NULL != cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    struct tpacket_auxdata *aux;
+
+    if (cmsg->cmsg_len < CMSG_LEN(sizeof(struct tpacket_auxdata)) ||
+	cmsg->cmsg_level != SOL_PACKET ||
+	cmsg->cmsg_type != PACKET_AUXDATA) {
+      /*
+       * This isn't a PACKET_AUXDATA auxiliary
+       * data item.
+       */
+      continue;
+    }
+
+    aux = (struct tpacket_auxdata *) CMSG_DATA(cmsg);
+    if (! VLAN_VALID (aux, aux)) {
+      /*
+       * There is no VLAN information in the
+       * auxiliary data.
+       */
+      continue;
+    }
+    vtag.vlan_tpid = htons(VLAN_TPID(aux, aux));
+    vtag.vlan_tci = htons(aux->tp_vlan_tci);
+    tag = &vtag;
+  }
+
+  if (ifc->vnet_hdr)
+    {
+      if (VIRTIO_NET_HDR_GSO_NONE !=
+	  (vh.gso_type & ~VIRTIO_NET_HDR_GSO_ECN))
+	{
+	  if (0 != gso_segment (ifc,
+				&vh,
+				super,
+				ret,
+				tag))
+	    {
+	      fprintf (stderr,
+		       "Dropping super-frame of %u bytes (GSO type %u)\n",
+		       (unsigned int) ret,
+		       (unsigned int) vh.gso_type);
+	      ifc->batch_len = 0;
+	      ifc->batch_off = 0;
+	      return 0;
+	    }
+	  return batch_pop (ifc,
+			    buf,
+			    size);
+	}
+      if ( (0 != (vh.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) &&
+	   (vh.csum_start + vh.csum_offset + sizeof (uint16_t) <= ret) )
+	{
+	  /* checksum offload: the kernel only summed the pseudo header */
+	  uint16_t csum;
+	  uint32_t sum;
+
+	  memcpy (&csum,
+		  &super[vh.csum_start + vh.csum_offset],
+		  sizeof (csum));
+	  memset (&super[vh.csum_start + vh.csum_offset],
+		  0,
+		  sizeof (csum));
+	  sum = GNUNET_CRYPTO_crc16_step (0,
+					  &super[vh.csum_start],
+					  ret - vh.csum_start);
+	  sum = GNUNET_CRYPTO_crc16_step (sum,
+					  &csum,
+					  sizeof (csum));
+	  csum = GNUNET_CRYPTO_crc16_finish (sum);
+	  memcpy (&super[vh.csum_start + vh.csum_offset],
+		  &csum,
+		  sizeof (csum));
+	}
+      if (ret > (ssize_t) size)
+	ret = size;
+      memcpy (buf,
+	      super,
+	      ret);
+    }
+  if (NULL != tag)
+    {
+      if (ret < (size_t) VLAN_OFFSET)
+	return ret; /* awkward... */
+      memmove (&buf[VLAN_OFFSET + sizeof (*tag)],
+	       &buf[VLAN_OFFSET],
+	       ret - VLAN_OFFSET);
+      memcpy (&buf[VLAN_OFFSET],
+	      tag,
+	      sizeof (*tag));
+      ret += sizeof (*tag);
+    }
+  return ret;
+}
+
+
+/**
+ * Transmit @a frame on the raw socket of @a ifc.
+ *
+ * @return number of bytes written, -1 on errors
+ */
+static ssize_t
+packet_send (struct Interface *ifc,
+	     const unsigned char *frame,
+	     size_t size)
+{
+  struct sockaddr_ll sadr_ll;
+
+  sadr_ll.sll_ifindex = ifc->if_idx.ifr_ifindex;
+  sadr_ll.sll_halen = MAC_ADDR_SIZE;
+  memcpy (&sadr_ll.sll_addr[0],
+	  frame,
+	  sizeof (struct MacAddress));
+  if (ifc->vnet_hdr)
+    {
+      struct virtio_net_hdr vh;
+      struct iovec iov[2] = {
+	{ .iov_base = &vh, .iov_len = sizeof (vh) },
+	{ .iov_base = (void *) frame, .iov_len = size }
+      };
+      struct msghdr msg = {
+	.msg_name = &sadr_ll,
+	.msg_namelen = sizeof (sadr_ll),
+	.msg_iov = iov,
+	.msg_iovlen = 2
+      };
+      ssize_t ret;
+
+      /* our frames are complete: no offloads requested */
+      memset (&vh,
+	      0,
+	      sizeof (vh));
+      ret = sendmsg (ifc->fd,
+		     &msg,
+		     0);
+      if (ret >= (ssize_t) sizeof (vh))
+	ret -= sizeof (vh);
+      return ret;
+    }
+  return sendto (ifc->fd,
+		 frame,
+		 size,
+		 0,
+		 (const struct sockaddr *) &sadr_ll,
+		 sizeof (struct sockaddr_ll));
+}
+
+
+static void
+packet_done (struct Interface *ifc)
+{
+  if (-1 != ifc->fd)
+    close (ifc->fd);
+  ifc->fd = -1;
+  free (ifc->batch);
+  ifc->batch = NULL;
+}
+
+
+/**
+ * Raw sockets on existing network interfaces (the default).
+ */
+static const struct Backend packet_backend = {
+  .prefix = NULL,
+  .init = &packet_init,
+  .recv = &packet_recv,
+  .send = &packet_send,
+  .done = &packet_done
+};
+
+
+/**
+ * Earliest capture time of the first frames of all timed pcap
+ * interfaces; replayed at #pcap_epoch.
+ */
+static uint64_t pcap_epoch_ts = UINT64_MAX;
+
+/**
+ * Time (see latency_now()) when the first frame was received from a
+ * pcap interface, 0 before.
+ */
+static uint64_t pcap_epoch;
+
+
+/**
+ * Open "IN:OUT[:timed]": frames are received from the capture IN
+ * and transmitted frames are appended to the capture OUT.  Either
+ * may be empty.  With "timed", frames are received with the timing
+ * of the capture (relative to the first frame of all timed
+ * interfaces), otherwise as fast as the child takes them.
+ *
+ * @param spec specification of the interface
+ * @param ifc_num number of the interface, determines the MAC
+ * @param ifc[out] interface to initialize
+ * @return 0 on success
+ */
+static int
+pcap_init (const char *spec,
+	   unsigned int ifc_num,
+	   struct Interface *ifc)
+{
+  char *dup = strdup (spec);
+  char *in = dup;
+  char *out;
+  char *mode;
+
+  if (NULL == dup)
+    abort ();
+  out = strchr (in, ':');
+  if (NULL == out)
+    goto malformed;
+  *out++ = '\0';
+  mode = strchr (out, ':');
+  if (NULL != mode)
+    {
+      *mode++ = '\0';
+      if (0 != strcmp (mode,
+		       "timed"))
+	goto malformed;
+      ifc->pcap_timed = 1;
+    }
+  ifc->fd = -1;
+  ifc->my_mac[0] = 0x02; /* locally administered */
+  ifc->my_mac[MAC_ADDR_SIZE - 1] = (uint8_t) ifc_num;
+  ifc->ready_at = UINT64_MAX;
+  ifc->eof = 1;
+  if ('\0' != *in)
+    {
+      int ret;
+
+      ifc->pcap_in = malloc (sizeof (struct PcapReader));
+      if (NULL == ifc->pcap_in)
+	abort ();
+      if (0 != pcap_open_read (ifc->pcap_in,
+			       in))
+	{
+	  free (ifc->pcap_in);
+	  ifc->pcap_in = NULL;
+	  free (dup);
+	  return -1;
+	}
+      ret = pcap_read (ifc->pcap_in,
+		       &ifc->pcap_pkt);
+      if (ret < 0)
+	{
+	  pcap_close_read (ifc->pcap_in);
+	  free (ifc->pcap_in);
+	  ifc->pcap_in = NULL;
+	  free (dup);
+	  return -1;
+	}
+      ifc->pcap_have_pkt = ret;
+      if (ret > 0)
+	{
+	  ifc->ready_at = 0;
+	  ifc->eof = 0;
+	  if ( ifc->pcap_timed &&
+	       (ifc->pcap_pkt.ts_ns < pcap_epoch_ts) )
+	    pcap_epoch_ts = ifc->pcap_pkt.ts_ns;
+	}
+    }
+  if ( ('\0' != *out) &&
+       (0 != pcap_open_write (&ifc->pcap_out,
+			      out)) )
+    {
+      if (NULL != ifc->pcap_in)
+	{
+	  pcap_close_read (ifc->pcap_in);
+	  free (ifc->pcap_in);
+	  ifc->pcap_in = NULL;
+	}
+      free (dup);
+      return -1;
+    }
+  free (dup);
+  return 0;
+malformed:
+  fprintf (stderr,
+	   "Expected `pcap:IN:OUT[:timed]', got `pcap:%s'\n",
+	   spec);
+  free (dup);
+  return -1;
+}
+
+
+/**
+ * Return the next frame of the ingress capture of @a ifc, unless
+ * it is not yet due in a timed replay.
+ *
+ * @return size of the frame, 0 if there was none (yet), -1 on errors
+ */
+static ssize_t
+pcap_recv (struct Interface *ifc,
+	   unsigned char *buf,
+	   size_t size)
+{
+  uint64_t now = latency_now ();
+  size_t len;
+  int ret;
+
+  if (! ifc->pcap_have_pkt)
+    {
+      ifc->ready_at = UINT64_MAX;
+      ifc->eof = 1;
+      return 0;
+    }
+  if (0 == pcap_epoch)
+    pcap_epoch = now;
+  if ( ifc->pcap_timed &&
+       (ifc->pcap_pkt.ts_ns > pcap_epoch_ts) &&
+       (pcap_epoch + (ifc->pcap_pkt.ts_ns - pcap_epoch_ts) > now) )
+    {
+      ifc->ready_at = pcap_epoch + (ifc->pcap_pkt.ts_ns - pcap_epoch_ts);
+      return 0;
+    }
+  len = (ifc->pcap_pkt.size < size) ? ifc->pcap_pkt.size : size;
+  memcpy (buf,
+	  ifc->pcap_pkt.data,
+	  len);
+  ifc->pcap_rx++;
+  ret = pcap_read (ifc->pcap_in,
+		   &ifc->pcap_pkt);
+  if (ret < 0)
+    return -1;
+  ifc->pcap_have_pkt = ret;
+  if (0 == ret)
+    {
+      ifc->ready_at = UINT64_MAX;
+      ifc->eof = 1;
+    }
+  else
+    {
+      ifc->ready_at = 0;
+    }
+  if (0 == len)
+    return pcap_recv (ifc,
+		      buf,
+		      size);
+  return len;
+}
+
+
+/**
+ * Append @a frame to the egress capture of @a ifc (if any).
+ *
+ * @return @a size, -1 on errors
+ */
+static ssize_t
+pcap_send (struct Interface *ifc,
+	   const unsigned char *frame,
+	   size_t size)
+{
+  struct timespec ts;
+
+  ifc->pcap_tx++;
+  if (NULL == ifc->pcap_out.fh)
+    return size;
+  clock_gettime (CLOCK_REALTIME,
+		 &ts);
+  if (0 != pcap_write (&ifc->pcap_out,
+		       (uint64_t) ts.tv_sec * 1000000000LLU + ts.tv_nsec,
+		       frame,
+		       size))
+    return -1;
+  return size;
+}
+
+
+static void
+pcap_done (struct Interface *ifc)
+{
+  fprintf (stderr,
+	   "pcap interface %02x:%02x:%02x:%02x:%02x:%02x: %llu frames received, %llu transmitted",
+	   ifc->my_mac[0], ifc->my_mac[1], ifc->my_mac[2],
+	   ifc->my_mac[3], ifc->my_mac[4], ifc->my_mac[5],
+	   (unsigned long long) ifc->pcap_rx,
+	   (unsigned long long) ifc->pcap_tx);
+  if (0 != pcap_epoch)
+    fprintf (stderr,
+	     " in %.3f s",
+	     (latency_now () - pcap_epoch) / 1e9);
+  fprintf (stderr,
+	   "\n");
+  if (NULL != ifc->pcap_in)
+    {
+      pcap_close_read (ifc->pcap_in);
+      free (ifc->pcap_in);
+      ifc->pcap_in = NULL;
+    }
+  if (0 != pcap_close_write (&ifc->pcap_out))
+    fprintf (stderr,
+	     "Failed to write egress capture: %s\n",
+	     strerror (errno));
+}
+
+
+/**
+ * Captures instead of network interfaces, for offline runs.
+ */
+static const struct Backend pcap_backend = {
+  .prefix = "pcap:",
+  .init = &pcap_init,
+  .recv = &pcap_recv,
+  .send = &pcap_send,
+  .done = &pcap_done
+};
+
+/**
+ * Maximum number of queues of a tap interface.
+ */
+#define TAP_MAX_QUEUES 16
+
+/**
+ * Maximum number of frames we read ahead from a tap interface.
+ */
+#define TAP_BATCH 64
+
+
+/**
+ * Open "NAME[:QUEUES]": create (or attach to) the tap device NAME
+ * with QUEUES queues (default: 1) and bring it up.  The kernel side
+ * of the device is a host on the link, so we use its MAC with the
+ * lowest bit flipped as our own.
+ *
+ * @param spec specification of the interface
+ * @param ifc_num number of the interface (unused)
+ * @param ifc[out] interface to initialize
+ * @return 0 on success
+ */
+static int
+tap_init (const char *spec,
+	  unsigned int ifc_num,
+	  struct Interface *ifc)
+{
+  char dev[IFNAMSIZ];
+  const char *colon = strchr (spec, ':');
+  unsigned int queues = 1;
+  struct ifreq ifr;
+  int sock;
+
+  (void) ifc_num;
+  if ( (NULL != colon) &&
+       ( (1 != sscanf (colon + 1,
+		       "%u",
+		       &queues)) ||
+	 (0 == queues) ||
+	 (queues > TAP_MAX_QUEUES) ) )
+    {
+      fprintf (stderr,
+	       "Expected `tap:NAME[:QUEUES]' with 1 to %u queues, got `tap:%s'\n",
+	       TAP_MAX_QUEUES,
+	       spec);
+      return -1;
+    }
+  memset (dev,
+	  0,
+	  sizeof (dev));
+  strncpy (dev,
+	   spec,
+	   (NULL != colon) ? MIN ((size_t) (colon - spec), IFNAMSIZ - 1) : IFNAMSIZ - 1);
+  ifc->queue_fds = malloc (queues * sizeof (int));
+  ifc->batch = malloc (BATCH_SIZE);
+  if ( (NULL == ifc->queue_fds) ||
+       (NULL == ifc->batch) )
+    abort ();
+  for (unsigned int i = 0; i < queues; i++)
+    {
+      int fd = open ("/dev/net/tun",
+		     O_RDWR | O_NONBLOCK);
+
+      if (-1 == fd)
+	{
+	  fprintf (stderr,
+		   "Failed to open /dev/net/tun: %s\n",
+		   strerror (errno));
+	  goto fail;
+	}
+      memset (&ifr,
+	      0,
+	      sizeof (ifr));
+      ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+      if (queues > 1)
+	ifr.ifr_flags |= IFF_MULTI_QUEUE;
+      strncpy (ifr.ifr_name,
+	       dev,
+	       IFNAMSIZ - 1);
+      if (0 != ioctl (fd,
+		      TUNSETIFF,
+		      &ifr))
+	{
+	  fprintf (stderr,
+		   "Failed to attach queue %u of tap device `%s': %s\n",
+		   i,
+		   dev,
+		   strerror (errno));
+	  close (fd);
+	  goto fail;
+	}
+      ifc->queue_fds[ifc->num_queues++] = fd;
+    }
+  ifc->fd = ifc->queue_fds[0];
+  ifc->ready_at = UINT64_MAX;
+
+  /* bring the device up and learn its MAC */
+  sock = socket (AF_INET,
+		 SOCK_DGRAM,
+		 0);
+  if (-1 == sock)
+    {
+      fprintf (stderr,
+	       "Error opening socket: %s\n",
+	       strerror (errno));
+      goto fail;
+    }
+  memset (&ifr,
+	  0,
+	  sizeof (ifr));
+  strncpy (ifr.ifr_name,
+	   dev,
+	   IFNAMSIZ - 1);
+  if ( (0 > ioctl (sock,
+		   SIOCGIFFLAGS,
+		   &ifr)) ||
+       ( (ifr.ifr_flags |= IFF_UP),
+	 (0 > ioctl (sock,
+		     SIOCSIFFLAGS,
+		     &ifr)) ) ||
+       (0 > ioctl (sock,
+		   SIOCGIFHWADDR,
+		   &ifr)) )
+    {
+      fprintf (stderr,
+	       "Could not configure tap device `%s': %s\n",
+	       dev,
+	       strerror (errno));
+      close (sock);
+      goto fail;
+    }
+  close (sock);
+  memcpy (ifc->my_mac,
+	  ifr.ifr_hwaddr.sa_data,
+	  MAC_ADDR_SIZE);
+  ifc->my_mac[MAC_ADDR_SIZE - 1] ^= 1;
+  return 0;
+fail:
+  for (unsigned int i = 0; i < ifc->num_queues; i++)
+    close (ifc->queue_fds[i]);
+  free (ifc->queue_fds);
+  free (ifc->batch);
+  ifc->queue_fds = NULL;
+  ifc->batch = NULL;
+  ifc->num_queues = 0;
+  ifc->fd = -1;
+  return -1;
+}
+
+
+/**
+ * Read up to #TAP_BATCH frames from the queues of @a ifc into its
+ * (empty) read-ahead buffer, starting with a different queue each
+ * time so that no queue starves.
+ *
+ * @return 0 on success (even if no frame was available), -1 on errors
+ */
+static int
+tap_fill_batch (struct Interface *ifc)
+{
+  unsigned int frames = 0;
+  unsigned int idle = 0;
+  unsigned int q = ifc->tap_next_queue;
+
+  ifc->batch_len = 0;
+  ifc->batch_off = 0;
+  while ( (frames < TAP_BATCH) &&
+	  (idle < ifc->num_queues) &&
+	  (BATCH_SIZE - ifc->batch_len >= sizeof (size_t) + MAX_SIZE) )
+    {
+      ssize_t ret = read (ifc->queue_fds[q],
+			  &ifc->batch[ifc->batch_len + sizeof (size_t)],
+			  MAX_SIZE);
+
+      if (ret > 0)
+	{
+	  size_t len = ret;
+
+	  memcpy (&ifc->batch[ifc->batch_len],
+		  &len,
+		  sizeof (len));
+	  ifc->batch_len += sizeof (size_t) + len;
+	  frames++;
+	  idle = 0;
+	  continue;
+	}
+      if ( (-1 == ret) &&
+	   (EAGAIN != errno) &&
+	   (EINTR != errno) )
+	{
+	  fprintf (stderr,
+		   "read-error: %s\n",
+		   strerror (errno));
+	  return -1;
+	}
+      /* this queue is empty, try the next one */
+      idle++;
+      q = (q + 1) % ifc->num_queues;
+    }
+  ifc->tap_next_queue = (q + 1) % ifc->num_queues;
+  return 0;
+}
+
+
+/**
+ * Return the next frame from the read-ahead buffer of @a ifc,
+ * refilling it if necessary.
+ *
+ * @return size of the frame, 0 if there was none, -1 on errors
+ */
+static ssize_t
+tap_recv (struct Interface *ifc,
+	  unsigned char *buf,
+	  size_t size)
+{
+  if ( (ifc->batch_off == ifc->batch_len) &&
+       (0 != tap_fill_batch (ifc)) )
+    return -1;
+  return batch_pop (ifc,
+		    buf,
+		    size);
+}
+
+
+/**
+ * Transmit @a frame on (the first queue of) the tap device of @a ifc.
+ *
+ * @return number of bytes written, -1 on errors
+ */
+static ssize_t
+tap_send (struct Interface *ifc,
+	  const unsigned char *frame,
+	  size_t size)
+{
+  ssize_t ret = write (ifc->fd,
+		       frame,
+		       size);
+
+  if ( (-1 == ret) &&
+       (EAGAIN == errno) )
+    return size; /* queue full, drop like a NIC would */
+  return ret;
+}
+
+
+static void
+tap_done (struct Interface *ifc)
+{
+  for (unsigned int i = 0; i < ifc->num_queues; i++)
+    close (ifc->queue_fds[i]);
+  free (ifc->queue_fds);
+  free (ifc->batch);
+  ifc->queue_fds = NULL;
+  ifc->batch = NULL;
+  ifc->num_queues = 0;
+  ifc->fd = -1;
+}
+
+
+/**
+ * tap devices (optionally multi-queue), for topologies built in a
+ * network namespace.
+ */
+static const struct Backend tap_backend = {
+  .prefix = "tap:",
+  .init = &tap_init,
+  .recv = &tap_recv,
+  .send = &tap_send,
+  .done = &tap_done
+};
+
+
+#if HAVE_AF_XDP
+
+/**
+ * Size of a UMEM frame; frames larger than this are dropped.
+ */
+#define XDP_FRAME_SIZE 2048
+
+/**
+ * Number of UMEM frames for receiving and (as many) for transmitting,
+ * also the size of each ring (must be a power of two).
+ */
+#define XDP_RING_SIZE 2048
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+
+/**
+ * A ring shared with the kernel.
+ */
+struct XdpRing
+{
+  uint32_t *producer;
+
+  uint32_t *consumer;
+
+  /**
+   * The entries, `struct xdp_desc` for RX/TX, `uint64_t` for
+   * fill/completion rings.
+   */
+  void *ring;
+
+  /**
+   * The mapping, for munmap().
+   */
+  void *map;
+
+  size_t map_size;
+};
+
+
+/**
+ * An AF_XDP socket bound to one queue of an interface.
+ */
+struct XdpSocket
+{
+  /**
+   * Frames shared with the kernel: the first #XDP_RING_SIZE for
+   * receiving, the others for transmitting.
+   */
+  unsigned char *umem;
+
+  struct XdpRing fill;
+
+  struct XdpRing comp;
+
+  struct XdpRing rx;
+
+  struct XdpRing tx;
+
+  /**
+   * UMEM addresses of transmit frames not owned by the kernel.
+   */
+  uint64_t tx_free[XDP_RING_SIZE];
+
+  unsigned int num_tx_free;
+
+  int map_fd;
+
+  int prog_fd;
+
+  int link_fd;
+};
+
+
+static int
+xdp_bpf (int cmd,
+	 union bpf_attr *attr)
+{
+  return syscall (SYS_bpf,
+		  cmd,
+		  attr,
+		  sizeof (*attr));
+}
+
+
+/**
+ * Map the ring at page offset @a pgoff of @a fd.
+ *
+ * @param off offsets of the ring within the mapping
+ * @param entry_size size of an entry of the ring
+ * @return 0 on success
+ */
+static int
+xdp_map_ring (int fd,
+	      struct XdpRing *ring,
+	      const struct xdp_ring_offset *off,
+	      size_t entry_size,
+	      off_t pgoff)
+{
+  unsigned char *map;
+
+  ring->map_size = off->desc + XDP_RING_SIZE * entry_size;
+  map = mmap (NULL,
+	      ring->map_size,
+	      PROT_READ | PROT_WRITE,
+	      MAP_SHARED | MAP_POPULATE,
+	      fd,
+	      pgoff);
+  if (MAP_FAILED == map)
+    return -1;
+  ring->map = map;
+  ring->producer = (uint32_t *) (map + off->producer);
+  ring->consumer = (uint32_t *) (map + off->consumer);
+  ring->ring = map + off->desc;
+  return 0;
+}
+
+
+/**
+ * Load an XDP program that redirects frames arriving on the queue of
+ * @a x to the socket @a fd (and passes all others to the kernel), and
+ * attach it to @a ifindex.  The program is detached when we exit.
+ *
+ * @return 0 on success
+ */
+static int
+xdp_attach (struct XdpSocket *x,
+	    int fd,
+	    int ifindex,
+	    unsigned int queue)
+{
+  union bpf_attr attr;
+  char log[4096];
+
+  memset (&attr,
+	  0,
+	  sizeof (attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof (uint32_t);
+  attr.value_size = sizeof (uint32_t);
+  attr.max_entries = queue + 1;
+  x->map_fd = xdp_bpf (BPF_MAP_CREATE,
+		       &attr);
+  if (-1 == x->map_fd)
+    {
+      fprintf (stderr,
+	       "Failed to create XSKMAP: %s\n",
+	       strerror (errno));
+      return -1;
+    }
+  {
+    uint32_t key = queue;
+    uint32_t value = fd;
+
+    memset (&attr,
+	    0,
+	    sizeof (attr));
+    attr.map_fd = x->map_fd;
+    attr.key = (uintptr_t) &key;
+    attr.value = (uintptr_t) &value;
+    if (0 != xdp_bpf (BPF_MAP_UPDATE_ELEM,
+		      &attr))
+      {
+	fprintf (stderr,
+		 "Failed to add socket to XSKMAP: %s\n",
+		 strerror (errno));
+	return -1;
+      }
+  }
+  {
+    /* return bpf_redirect_map (&map, ctx->rx_queue_index, XDP_PASS); */
+    struct bpf_insn prog[] = {
+      { .code = BPF_LDX | BPF_MEM | BPF_W,
+	.dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+	.off = offsetof (struct xdp_md, rx_queue_index) },
+      { .code = BPF_LD | BPF_DW | BPF_IMM,
+	.dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD,
+	.imm = x->map_fd },
+      { .code = 0 },
+      { .code = BPF_ALU64 | BPF_MOV | BPF_K,
+	.dst_reg = BPF_REG_3,
+	.imm = XDP_PASS },
+      { .code = BPF_JMP | BPF_CALL,
+	.imm = BPF_FUNC_redirect_map },
+      { .code = BPF_JMP | BPF_EXIT }
+    };
+
+    memset (&attr,
+	    0,
+	    sizeof (attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (uintptr_t) prog;
+    attr.insn_cnt = sizeof (prog) / sizeof (prog[0]);
+    attr.license = (uintptr_t) "GPL";
+    attr.log_buf = (uintptr_t) log;
+    attr.log_size = sizeof (log);
+    attr.log_level = 1;
+    log[0] = '\0';
+    x->prog_fd = xdp_bpf (BPF_PROG_LOAD,
+			  &attr);
+    if (-1 == x->prog_fd)
+      {
+	fprintf (stderr,
+		 "Failed to load XDP program: %s\n%s",
+		 strerror (errno),
+		 log);
+	return -1;
+      }
+  }
+  memset (&attr,
+	  0,
+	  sizeof (attr));
+  attr.link_create.prog_fd = x->prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  x->link_fd = xdp_bpf (BPF_LINK_CREATE,
+			&attr);
+  if (-1 == x->link_fd)
+    {
+      fprintf (stderr,
+	       "Failed to attach XDP program: %s\n",
+	       strerror (errno));
+      return -1;
+    }
+  return 0;
+}
+
+
+static void
+xdp_done (struct Interface *ifc)
+{
+  struct XdpSocket *x = ifc->xsk;
+
+  if (NULL == x)
+    return;
+  if (-1 != x->link_fd)
+    close (x->link_fd);
+  if (-1 != x->prog_fd)
+    close (x->prog_fd);
+  if (-1 != x->map_fd)
+    close (x->map_fd);
+  if (NULL != x->fill.map)
+    munmap (x->fill.map, x->fill.map_size);
+  if (NULL != x->comp.map)
+    munmap (x->comp.map, x->comp.map_size);
+  if (NULL != x->rx.map)
+    munmap (x->rx.map, x->rx.map_size);
+  if (NULL != x->tx.map)
+    munmap (x->tx.map, x->tx.map_size);
+  if (-1 != ifc->fd)
+    close (ifc->fd);
+  if (NULL != x->umem)
+    munmap (x->umem,
+	    2 * XDP_RING_SIZE * XDP_FRAME_SIZE);
+  free (x);
+  ifc->xsk = NULL;
+  ifc->fd = -1;
+}
+
+
+/**
+ * Open "NAME[:QUEUE][:MODE]": bind an AF_XDP socket to queue QUEUE
+ * (default: 0) of the network interface NAME.  MODE is "zc" to
+ * require zero-copy, "copy" to force copy mode; by default the kernel
+ * uses zero-copy where the NIC driver supports it.  Frames on other
+ * queues still go to the kernel, so configure the NIC to steer all
+ * traffic to QUEUE (e.g. "ethtool -L NAME combined 1").
+ *
+ * @param spec specification of the interface
+ * @param ifc_num number of the interface (unused)
+ * @param ifc[out] interface to initialize
+ * @return 0 on success
+ */
+static int
+xdp_init (const char *spec,
+	  unsigned int ifc_num,
+	  struct Interface *ifc)
+{
+  char *dup = strdup (spec);
+  char *tok;
+  char dev[IFNAMSIZ];
+  unsigned int queue = 0;
+  uint16_t bind_flags = 0;
+  struct XdpSocket *x;
+  struct ifreq ifr;
+  struct xdp_mmap_offsets off;
+  struct xdp_options opts;
+  socklen_t optlen;
+  int sock;
+  int fd;
+
+  (void) ifc_num;
+  if (NULL == dup)
+    abort ();
+  memset (dev,
+	  0,
+	  sizeof (dev));
+  tok = strtok (dup, ":");
+  if (NULL == tok)
+    {
+      fprintf (stderr,
+	       "Expected `xdp:NAME[:QUEUE][:zc|:copy]', got `xdp:%s'\n",
+	       spec);
+      free (dup);
+      return -1;
+    }
+  strncpy (dev,
+	   tok,
+	   IFNAMSIZ - 1);
+  while (NULL != (tok = strtok (NULL, ":")))
+    {
+      if (0 == strcmp (tok, "zc"))
+	bind_flags = XDP_ZEROCOPY;
+      else if (0 == strcmp (tok, "copy"))
+	bind_flags = XDP_COPY;
+      else if (1 != sscanf (tok, "%u", &queue))
+	{
+	  fprintf (stderr,
+		   "Expected `xdp:NAME[:QUEUE][:zc|:copy]', got `xdp:%s'\n",
+		   spec);
+	  free (dup);
+	  return -1;
+	}
+    }
+  free (dup);
+
+  /* interface index and MAC, promiscuous mode like the raw socket */
+  sock = socket (AF_INET,
+		 SOCK_DGRAM,
+		 0);
+  if (-1 == sock)
+    {
+      fprintf (stderr,
+	       "Error opening socket: %s\n",
+	       strerror (errno));
+      return -1;
+    }
+  memset (&ifr,
+	  0,
+	  sizeof (ifr));
+  strncpy (ifr.ifr_name,
+	   dev,
+	   IFNAMSIZ - 1);
+  if (0 > ioctl (sock,
+		 SIOCGIFINDEX,
+		 &ifr))
+    {
+      fprintf (stderr,
+	       "Could not use interface `%s': %s\n",
+	       dev,
+	       strerror (errno));
+      close (sock);
+      return -1;
+    }
+  ifc->if_idx = ifr;
+  if ( (0 > ioctl (sock,
+		   SIOCGIFFLAGS,
+		   &ifr)) ||
+       ( (ifr.ifr_flags |= IFF_PROMISC),
+	 (0 > ioctl (sock,
+		     SIOCSIFFLAGS,
+		     &ifr)) ) ||
+       (0 > ioctl (sock,
+		   SIOCGIFHWADDR,
+		   &ifr)) )
+    {
+      fprintf (stderr,
+	       "Could not configure interface `%s': %s\n",
+	       dev,
+	       strerror (errno));
+      close (sock);
+      return -1;
+    }
+  close (sock);
+
+  x = calloc (1,
+	      sizeof (struct XdpSocket));
+  if (NULL == x)
+    abort ();
+  x->map_fd = -1;
+  x->prog_fd = -1;
+  x->link_fd = -1;
+  ifc->xsk = x;
+  ifc->fd = -1;
+  x->umem = mmap (NULL,
+		  2 * XDP_RING_SIZE * XDP_FRAME_SIZE,
+		  PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS,
+		  -1,
+		  0);
+  if (MAP_FAILED == x->umem)
+    {
+      x->umem = NULL;
+      fprintf (stderr,
+	       "Failed to allocate UMEM: %s\n",
+	       strerror (errno));
+      goto fail;
+    }
+  fd = socket (AF_XDP,
+	       SOCK_RAW,
+	       0);
+  if (-1 == fd)
+    {
+      fprintf (stderr,
+	       "Error opening AF_XDP socket: %s\n",
+	       strerror (errno));
+      goto fail;
+    }
+  ifc->fd = fd;
+  {
+    struct xdp_umem_reg mr;
+    int ndescs = XDP_RING_SIZE;
+
+    memset (&mr,
+	    0,
+	    sizeof (mr));
+    mr.addr = (uintptr_t) x->umem;
+    mr.len = 2 * XDP_RING_SIZE * XDP_FRAME_SIZE;
+    mr.chunk_size = XDP_FRAME_SIZE;
+    if ( (0 != setsockopt (fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof (mr))) ||
+	 (0 != setsockopt (fd, SOL_XDP, XDP_UMEM_FILL_RING, &ndescs, sizeof (ndescs))) ||
+	 (0 != setsockopt (fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ndescs, sizeof (ndescs))) ||
+	 (0 != setsockopt (fd, SOL_XDP, XDP_RX_RING, &ndescs, sizeof (ndescs))) ||
+	 (0 != setsockopt (fd, SOL_XDP, XDP_TX_RING, &ndescs, sizeof (ndescs))) )
+      {
+	fprintf (stderr,
+		 "Failed to set up UMEM and rings: %s\n",
+		 strerror (errno));
+	goto fail;
+      }
+  }
+  optlen = sizeof (off);
+  if ( (0 != getsockopt (fd,
+			 SOL_XDP,
+			 XDP_MMAP_OFFSETS,
+			 &off,
+			 &optlen)) ||
+       (0 != xdp_map_ring (fd, &x->fill, &off.fr, sizeof (uint64_t), XDP_UMEM_PGOFF_FILL_RING)) ||
+       (0 != xdp_map_ring (fd, &x->comp, &off.cr, sizeof (uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING)) ||
+       (0 != xdp_map_ring (fd, &x->rx, &off.rx, sizeof (struct xdp_desc), XDP_PGOFF_RX_RING)) ||
+       (0 != xdp_map_ring (fd, &x->tx, &off.tx, sizeof (struct xdp_desc), XDP_PGOFF_TX_RING)) )
+    {
+      fprintf (stderr,
+	       "Failed to map rings: %s\n",
+	       strerror (errno));
+      goto fail;
+    }
+  /* hand all receive frames to the kernel */
+  for (unsigned int i = 0; i < XDP_RING_SIZE; i++)
+    ((uint64_t *) x->fill.ring)[i] = (uint64_t) i * XDP_FRAME_SIZE;
+  __atomic_store_n (x->fill.producer,
+		    XDP_RING_SIZE,
+		    __ATOMIC_RELEASE);
+  for (unsigned int i = 0; i < XDP_RING_SIZE; i++)
+    x->tx_free[x->num_tx_free++] = (uint64_t) (XDP_RING_SIZE + i) * XDP_FRAME_SIZE;
+  {
+    struct sockaddr_xdp sxdp;
+
+    memset (&sxdp,
+	    0,
+	    sizeof (sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifc->if_idx.ifr_ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = bind_flags;
+    if (0 != bind (fd,
+		   (const struct sockaddr *) &sxdp,
+		   sizeof (sxdp)))
+      {
+	fprintf (stderr,
+		 "Failed to bind AF_XDP socket to queue %u of `%s': %s\n",
+		 queue,
+		 dev,
+		 strerror (errno));
+	goto fail;
+      }
+  }
+  if (0 != xdp_attach (x,
+		       fd,
+		       ifc->if_idx.ifr_ifindex,
+		       queue))
+    goto fail;
+  memcpy (ifc->my_mac,
+	  ifr.ifr_hwaddr.sa_data,
+	  MAC_ADDR_SIZE);
+  optlen = sizeof (opts);
+  memset (&opts,
+	  0,
+	  sizeof (opts));
+  (void) getsockopt (fd,
+		     SOL_XDP,
+		     XDP_OPTIONS,
+		     &opts,
+		     &optlen);
+  fprintf (stderr,
+	   "AF_XDP socket on queue %u of `%s' in %s mode\n",
+	   queue,
+	   dev,
+	   (0 != (opts.flags & XDP_OPTIONS_ZEROCOPY)) ? "zero-copy" : "copy");
+  ifc->ready_at = UINT64_MAX;
+  return 0;
+fail:
+  xdp_done (ifc);
+  return -1;
+}
+
+
+/**
+ * Take the next frame from the RX ring of @a ifc and give its UMEM
+ * frame back to the kernel.
+ *
+ * @return size of the frame, 0 if there was none
+ */
+static ssize_t
+xdp_recv (struct Interface *ifc,
+	  unsigned char *buf,
+	  size_t size)
+{
+  struct XdpSocket *x = ifc->xsk;
+  uint32_t prod = __atomic_load_n (x->rx.producer,
+				   __ATOMIC_ACQUIRE);
+  uint32_t cons = *x->rx.consumer;
+  const struct xdp_desc *desc;
+  uint32_t fprod;
+  size_t len;
+
+  if (prod == cons)
+    {
+      ifc->ready_at = UINT64_MAX;
+      return 0;
+    }
+  desc = &((const struct xdp_desc *) x->rx.ring)[cons & (XDP_RING_SIZE - 1)];
+  len = MIN (desc->len, size);
+  memcpy (buf,
+	  &x->umem[desc->addr],
+	  len);
+  fprod = *x->fill.producer;
+  ((uint64_t *) x->fill.ring)[fprod & (XDP_RING_SIZE - 1)]
+    = desc->addr & ~((uint64_t) XDP_FRAME_SIZE - 1);
+  __atomic_store_n (x->rx.consumer,
+		    cons + 1,
+		    __ATOMIC_RELEASE);
+  __atomic_store_n (x->fill.producer,
+		    fprod + 1,
+		    __ATOMIC_RELEASE);
+  /* more frames are ready without waiting in select() */
+  ifc->ready_at = (prod != cons + 1) ? 0 : UINT64_MAX;
+  return len;
+}
+
+
+/**
+ * Copy @a frame into a free UMEM frame and put it on the TX ring.
+ * Frames are dropped if they are too large or all transmit frames
+ * are in use.
+ *
+ * @return @a size
+ */
+static ssize_t
+xdp_send (struct Interface *ifc,
+	  const unsigned char *frame,
+	  size_t size)
+{
+  struct XdpSocket *x = ifc->xsk;
+  uint32_t cprod = __atomic_load_n (x->comp.producer,
+				    __ATOMIC_ACQUIRE);
+  uint32_t ccons = *x->comp.consumer;
+  uint32_t tprod;
+  struct xdp_desc *desc;
+
+  /* reclaim frames the kernel is done with */
+  while (ccons != cprod)
+    x->tx_free[x->num_tx_free++]
+      = ((const uint64_t *) x->comp.ring)[ccons++ & (XDP_RING_SIZE - 1)];
+  __atomic_store_n (x->comp.consumer,
+		    ccons,
+		    __ATOMIC_RELEASE);
+  if ( (size > XDP_FRAME_SIZE) ||
+       (0 == x->num_tx_free) )
+    {
+#if DEBUG
+      fprintf (stderr,
+	       "Dropping frame of %u bytes on AF_XDP socket\n",
+	       (unsigned int) size);
+#endif
+      (void) sendto (ifc->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+      return size;
+    }
+  tprod = *x->tx.producer;
+  desc = &((struct xdp_desc *) x->tx.ring)[tprod & (XDP_RING_SIZE - 1)];
+  desc->addr = x->tx_free[--x->num_tx_free];
+  desc->len = size;
+  desc->options = 0;
+  memcpy (&x->umem[desc->addr],
+	  frame,
+	  size);
+  __atomic_store_n (x->tx.producer,
+		    tprod + 1,
+		    __ATOMIC_RELEASE);
+  /* kick the kernel; EAGAIN/EBUSY/ENOBUFS just mean it is busy */
+  (void) sendto (ifc->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+  return size;
+}
+
+#else
+
+static int
+xdp_init (const char *spec,
+	  unsigned int ifc_num,
+	  struct Interface *ifc)
+{
+  (void) ifc_num;
+  (void) ifc;
+  fprintf (stderr,
+	   "Cannot open `xdp:%s': compiled without AF_XDP support\n",
+	   spec);
+  return -1;
+}
+
+#define xdp_recv NULL
+#define xdp_send NULL
+#define xdp_done NULL
+
+#endif
+
+
+/**
+ * AF_XDP sockets, bypassing the kernel stack.
+ */
+static const struct Backend xdp_backend = {
+  .prefix = "xdp:",
+  .init = &xdp_init,
+  .recv = xdp_recv,
+  .send = xdp_send,
+  .done = xdp_done
+};
+
+
+/**
+ * All backends, the default last.
+ */
+static const struct Backend *backends[] = {
+  &pcap_backend,
+  &tap_backend,
+  &xdp_backend,
+  &packet_backend
+};
+
+
+/**
+ * File descriptors to poll() in one iteration of the main loop.
+ */
+struct PollSet
+{
+  struct pollfd *fds;
+
+  /**
+   * Number of entries used in @e fds.
+   */
+  unsigned int num;
+
+  /**
+   * Length of @e fds.
+   */
+  unsigned int len;
+};
+
+
+/**
+ * Add @a fd to @a ps, waiting for @a events.
+ *
+ * @return index of @a fd in @a ps
+ */
+static int
+poll_add (struct PollSet *ps,
+	  int fd,
+	  short events)
+{
+  grow_array (&ps->fds,
+	      sizeof (struct pollfd),
+	      &ps->len,
+	      ps->num + 1);
+  ps->fds[ps->num].fd = fd;
+  ps->fds[ps->num].events = events;
+  ps->fds[ps->num].revents = 0;
+  return ps->num++;
+}
+
+
+/**
+ * Is the file descriptor at @a idx in @a ps ready (or failed, so
+ * that the next operation reports the error)?
+ *
+ * @param idx index returned by poll_add(), or -1
+ */
+static int
+poll_ready (const struct PollSet *ps,
+	    int idx)
+{
+  return (-1 != idx) &&
+    (0 != ps->fds[idx].revents);
+}
+
+
+/**
+ * Add the file descriptors @a ifc receives on to @a ps.
+ */
+static void
+ifc_poll_add (struct Interface *ifc,
+	      struct PollSet *ps)
+{
+  if (0 == ifc->num_queues)
+    {
+      ifc->poll_idx = poll_add (ps,
+				ifc->fd,
+				POLLIN);
+      return;
+    }
+  ifc->poll_idx = ps->num;
+  for (unsigned int i = 0; i < ifc->num_queues; i++)
+    (void) poll_add (ps,
+		     ifc->queue_fds[i],
+		     POLLIN);
+}
+
+
+/**
+ * Is any of the file descriptors @a ifc receives on ready in @a ps?
+ */
+static int
+ifc_poll_ready (const struct Interface *ifc,
+		const struct PollSet *ps)
+{
+  unsigned int n = (0 == ifc->num_queues) ? 1 : ifc->num_queues;
+
+  if (-1 == ifc->poll_idx)
+    return 0;
+  for (unsigned int i = 0; i < n; i++)
+    if (poll_ready (ps,
+		    ifc->poll_idx + i))
+      return 1;
+  return 0;
+}
+
+
+/**
+ * Open the interface given as @a arg on the command line (or to
+ * "ifc add"), picking the backend by the prefix of @a arg.
+ *
+ * @param arg interface argument
+ * @param ifc_num number of the interface (starting at 1)
+ * @return NULL on failure
+ */
+static struct Interface *
+open_interface (const char *arg,
+		unsigned int ifc_num)
+{
+  struct Interface *ifc;
+  const struct Backend *be = NULL;
+  const char *spec = arg;
+
+  ifc = calloc (1,
+		sizeof (struct Interface));
+  if (NULL == ifc)
+    abort ();
+  ifc->fd = -1;
+  ifc->poll_idx = -1;
+  for (unsigned int j=0;j<sizeof (backends) / sizeof (backends[0]);j++)
+    {
+      be = backends[j];
+      if (NULL == be->prefix)
+	break;
+      if (0 == strncmp (spec,
+			be->prefix,
+			strlen (be->prefix)))
+	{
+	  spec += strlen (be->prefix);
+	  break;
+	}
+    }
+  if (-1 == be->init (spec,
+		      ifc_num,
+		      ifc))
+    {
+      free (ifc);
+      return NULL;
+    }
+  ifc->backend = be;
+  ifc->spec = strdup (arg);
+  return ifc;
+}
+
+
+/**
+ * Close @a ifc and release all its resources.
+ */
+static void
+close_interface (struct Interface *ifc)
+{
+  ifc->backend->done (ifc);
+  free (ifc->spec);
+  free (ifc);
+}
+
+
+/**
+ * Are all interfaces offline (without file descriptor)?
+ */
+static int
+all_offline ()
+{
+  for (unsigned int i=0;i<gifc_len;i++)
+    if ( (NULL != gifc[i]) &&
+	 (-1 != gifc[i]->fd) )
+      return 0;
+  return 1;
+}
 
 
 /**
- * Creates a tun-interface called dev;
+ * Queue a `struct GLAB_InterfaceEvent` for the child.
  *
- * @param dev is asumed to point to a char[IFNAMSIZ]
- *        if *dev == '\\0', uses the name supplied by the kernel;
- * @param ifc[out] initialized interface struct
- * @return 0 on success, or -1 on error
+ * @param ifc_num interface the event is about
+ * @param op #GLAB_INTERFACE_ADD or #GLAB_INTERFACE_DEL
+ * @param mac MAC of the interface, NULL for none
+ * @param arg configuration for the child, NULL for none
+ * @return 0 on success, -1 if too many events are pending
  */
 static int
-init_tun (char *dev,
-          struct Interface *ifc)
+queue_ifc_event (unsigned int ifc_num,
+		 uint16_t op,
+		 const uint8_t *mac,
+		 const char *arg)
 {
-  struct ifreq ifr;
-  int fd;
-  struct ifreq if_mac;
-  struct ifreq ifopts;
-  struct ifreq so;
-  struct ethtool_value ev;
+  struct GLAB_InterfaceEvent ie;
+  size_t alen = (NULL == arg) ? 0 : strlen (arg) + 1;
 
-  if (NULL == dev)
-    {
-      errno = EINVAL;
-      return -1;
-    }
+  if (sizeof (ie) + alen >
+      sizeof (ifc_events.buftun) - ifc_events.buftun_size)
+    return -1;
+  memset (&ie,
+	  0,
+	  sizeof (ie));
+  ie.header.size = htons (sizeof (ie) + alen);
+  ie.header.type = htons (GLAB_TYPE_INTERFACE);
+  ie.ifc_num = htons (ifc_num);
+  ie.op = htons (op);
+  if (NULL != mac)
+    memcpy (&ie.mac,
+	    mac,
+	    MAC_ADDR_SIZE);
+  memcpy (&ifc_events.buftun[ifc_events.buftun_size],
+	  &ie,
+	  sizeof (ie));
+  memcpy (&ifc_events.buftun[ifc_events.buftun_size + sizeof (ie)],
+	  arg,
+	  alen);
+  ifc_events.buftun_size += sizeof (ie) + alen;
+  return 0;
+}
 
-  if (-1 == (fd = socket (AF_PACKET,
-                          SOCK_RAW,
-                          htons (ETH_P_ALL))))
-    {
-      fprintf (stderr,
-	       "Error opening socket: %s\n",
-	       strerror (errno));
-      return -1;
-    }
 
-  if (fd >= FD_SETSIZE)
+/**
+ * Handle "ifc add SPEC [ARG]": open interface SPEC under the lowest
+ * free number and tell the child about it, passing ARG (default:
+ * SPEC) as the configuration of the interface.
+ */
+static void
+ifc_add (const char *spec,
+	 const char *arg)
+{
+  struct Interface *ifc;
+  unsigned int n;
+
+  if (NULL == spec)
     {
       fprintf (stderr,
-	       "File descriptor to large: %d",
-	       fd);
-      (void) close (fd);
-      return -1;
+	       "Usage: ifc add SPEC [ARG]\n");
+      return;
     }
-  /* only take traffic of 'dev' */
-  if (0 !=
-      setsockopt (fd,
-		  SOL_SOCKET,
-		  SO_BINDTODEVICE,
-		  dev,
-		  strlen (dev) + 1))
+  for (n = 0; n < gifc_len; n++)
+    if (NULL == gifc[n])
+      break;
+  if (n + 1 >= GLAB_TYPE_INTERFACE)
     {
       fprintf (stderr,
-	       "Failed to limit myself to `%s' for inbound traffic: %s\n",
-	       dev,
-	       strerror (errno));
-      (void) close (fd);
-      return -1;
+	       "Too many interfaces\n");
+      return;
     }
-
-  /* Enable grabbing auxiliary data, including VLAN information */
-  {
-    int val = 1;
-
-    if (0 != setsockopt (fd,
-                         SOL_PACKET,
-                         PACKET_AUXDATA,
-                         &val,
-                         sizeof(val)))
-      {
-        fprintf (stderr,
-                 "Failed to activate PACKET_AUXDATA: %s\n",
-                 strerror (errno));
-        (void) close (fd);
-        return -1;
-      }
-  }
-
-  memset (&ifr,
-	  0,
-	  sizeof (ifr));
-
-  /* Get the index of the interface to send on */
-  memset (&ifc->if_idx,
-	  0,
-	  sizeof (struct ifreq));
-  strncpy (ifc->if_idx.ifr_name,
-	   dev,
-	   IFNAMSIZ - 1);
-  if (ioctl (fd,
-	     SIOCGIFINDEX,
-	     &ifc->if_idx) < 0)
+  ifc = open_interface (spec,
+			n + 1);
+  if (NULL == ifc)
     {
       fprintf (stderr,
-	       "Could not use interface `%s': %s",
-	       dev,
-	       strerror (errno));
-      (void) close (fd);
-      return -1;
+	       "Could not initialize interface `%s'\n",
+	       spec);
+      return;
     }
-  /* Get the MAC address of the interface to send on */
-  memset (&if_mac,
-	  0,
-	  sizeof(struct ifreq));
-  strncpy (if_mac.ifr_name,
-	   dev,
-	   IFNAMSIZ - 1);
-  if (0 > ioctl (fd,
-		 SIOCGIFHWADDR,
-		 &if_mac))
+  if (0 != queue_ifc_event (n + 1,
+			    GLAB_INTERFACE_ADD,
+			    ifc->my_mac,
+			    (NULL != arg) ? arg : spec))
     {
       fprintf (stderr,
-	       "Could not obtain MAC of interface `%s': %s",
-	       dev,
-	       strerror (errno));
-      (void) close (fd);
-      return -1;
+	       "Too many pending interface changes\n");
+      close_interface (ifc);
+      return;
     }
-  memcpy (&ifc->my_mac,
-	  &if_mac.ifr_hwaddr.sa_data,
-	  MAC_ADDR_SIZE);
+  grow_array (&gifc,
+	      sizeof (struct Interface *),
+	      &gifc_len,
+	      n + 1);
+  gifc[n] = ifc;
+  fprintf (stderr,
+	   "Interface %u is `%s'\n",
+	   n + 1,
+	   spec);
+}
 
-  strncpy(ifopts.ifr_name,
-	  dev,
-	  IFNAMSIZ-1);
-  if (0 > ioctl (fd,
-		 SIOCGIFFLAGS,
-		 &ifopts))
+
+/**
+ * Handle "ifc del NUM": stop receiving on interface NUM, it is
+ * closed (and the child told) once no frame is in flight.
+ */
+static void
+ifc_del (const char *num)
+{
+  unsigned int n;
+  char dummy;
+
+  if ( (NULL == num) ||
+       (1 != sscanf (num,
+		     "%u%c",
+		     &n,
+		     &dummy)) ||
+       (0 == n) ||
+       (n > gifc_len) ||
+       (NULL == gifc[n - 1]) ||
+       (gifc[n - 1]->removing) )
     {
       fprintf (stderr,
-	       "Could not obtain flags of interface `%s': %s",
-	       dev,
-	       strerror (errno));
-      (void) close (fd);
-      return -1;
+	       "No interface `%s'\n",
+	       (NULL == num) ? "" : num);
+      return;
     }
-  ifopts.ifr_flags |= IFF_PROMISC;
-  if (0 > ioctl (fd,
-		 SIOCSIFFLAGS,
-		 &ifopts))
+  gifc[n - 1]->removing = 1;
+}
+
+
+/**
+ * Close the interfaces removed with "ifc del" (except @a busy_r and
+ * @a busy_w which still have a frame in flight) and tell the child.
+ */
+static void
+ifc_reap (const struct Interface *busy_r,
+	  const struct Interface *busy_w)
+{
+  for (unsigned int i=0;i<gifc_len;i++)
     {
+      struct Interface *ifc = gifc[i];
+
+      if ( (NULL == ifc) ||
+	   (! ifc->removing) ||
+	   (ifc == busy_r) ||
+	   (ifc == busy_w) )
+	continue;
+      if (0 != queue_ifc_event (i + 1,
+				GLAB_INTERFACE_DEL,
+				NULL,
+				NULL))
+	continue; /* try again later */
+      close_interface (ifc);
+      gifc[i] = NULL;
       fprintf (stderr,
-	       "Could not set flags of interface `%s': %s",
-	       dev,
-	       strerror (errno));
-      (void) close (fd);
-      return -1;
+	       "Interface %u removed\n",
+	       i + 1);
     }
+}
 
-  /* Disable segmentation offloads:
-     - TSO TCP Segmentation Offload
-     - GSO Generic Segmentation Offload
-     - GRO Generic Receive Offload
-     (as our clients must not be expected to deal with frames exceeding the MTU) */
-  const uint32_t ethtool_cmd[] = { ETHTOOL_STSO, ETHTOOL_SGSO, ETHTOOL_SGRO };
-  for ( int i=0; i<sizeof(ethtool_cmd)/sizeof(uint32_t); i++)
-  {
-    ev.cmd = ethtool_cmd[i];
-    ev.data = 0;
-    memset (&so,
-  	  0,
-  	  sizeof (so));
-    strncpy (so.ifr_name,
-  	   dev,
-  	   IFNAMSIZ - 1);
-    so.ifr_data = (char*) &ev;
-    if (0 > ioctl (fd,
-  		 SIOCETHTOOL, 
-  		 &so))
+
+/**
+ * Handle the "ifc" command @a cmd (0-terminated line), which we
+ * process ourselves instead of passing it to the child.
+ */
+static void
+ifc_command (char *cmd)
+{
+  const char *op;
+
+  (void) strtok (cmd,
+		 " ");
+  op = strtok (NULL,
+	       " ");
+  if ( (NULL == op) ||
+       (0 == strcasecmp (op,
+			 "list")) )
     {
-      fprintf (stderr,
-  	     "Could not disable offload %u on interface `%s': %s",
-	     ethtool_cmd[i],
-  	     dev,
-  	     strerror (errno));
-      (void) close (fd);
-      return -1;
+      for (unsigned int i=0;i<gifc_len;i++)
+	if (NULL != gifc[i])
+	  fprintf (stdout,
+		   "%u %s %02x:%02x:%02x:%02x:%02x:%02x%s\n",
+		   i + 1,
+		   gifc[i]->spec,
+		   gifc[i]->my_mac[0], gifc[i]->my_mac[1],
+		   gifc[i]->my_mac[2], gifc[i]->my_mac[3],
+		   gifc[i]->my_mac[4], gifc[i]->my_mac[5],
+		   gifc[i]->removing ? " (removing)" : "");
+      fflush (stdout);
     }
-  }
-
-  ifc->fd = fd;
-  return 0;
+  else if (0 == strcasecmp (op,
+			    "add"))
+    {
+      const char *spec = strtok (NULL,
+				 " ");
+      const char *arg = strtok (NULL,
+				"");
+
+      while ( (NULL != arg) &&
+	      (' ' == *arg) )
+	arg++;
+      ifc_add (spec,
+	       arg);
+    }
+  else if (0 == strcasecmp (op,
+			    "del"))
+    ifc_del (strtok (NULL,
+		     " "));
+  else
+    fprintf (stderr,
+	     "Usage: ifc [list|add SPEC [ARG]|del NUM]\n");
 }
 
 
 /**
- * Start forwarding to and from the tunnel.
- *
- * @param gifc array of interfaces
- * @param gifc_len length of @a gifc
+ * Start forwarding to and from the tunnel (the interfaces in #gifc).
  */
 static void
-run (struct Interface *gifc,
-     int gifc_len)
+run ()
 {
   /*
    * The buffer filled by reading from child's stdout, to be passed to some fd
@@ -369,14 +3129,26 @@ run (struct Interface *gifc,
   unsigned char *bufin_write_off = NULL;
   /* write refers to reading from child's stdout, writing to index 'current_write' */
   struct Interface *current_write = NULL;
-  fd_set fds_w;
-  fd_set fds_r;
-  int fmax;
+  static struct PollSet ps;
+  /* indices in 'ps' of child_stdin, current_write, child_stdout and
+     our stdin, -1 if not polled */
+  int child_w;
+  int tun_w;
+  int child_r;
+  int cmd_r;
   /* We treat command-line input as a special 'network interface' */
   struct Interface cmd_line;
 
   /* read refers to reading from fd, currently writing to child's stdin */
   struct Interface *current_read = NULL;
+  /* latency mode: when the frame we are writing to 'current_write' was
+     received (0 if unknown), handed to the child and read back */
+  uint64_t lat_rx = 0;
+  uint64_t lat_handoff = 0;
+  uint64_t lat_readback = 0;
+  /* with only offline interfaces, EOF on our stdin does not end the run */
+  int offline = all_offline ();
+  int stdin_eof = 0;
 
   memset (&cmd_line,
 	  0,
@@ -385,9 +3157,17 @@ run (struct Interface *gifc,
   cmd_line.buftun_size = sizeof (struct GLAB_MessageHeader);
   while (1)
   {
-    fmax = -1;
-    FD_ZERO (&fds_w);
-    FD_ZERO (&fds_r);
+    /* when we must look at interfaces without file descriptor */
+    uint64_t wake_at = UINT64_MAX;
+    int timeout = -1;
+
+    if (latency_dump_requested)
+      latency_dump ();
+    ps.num = 0;
+    child_w = -1;
+    tun_w = -1;
+    child_r = -1;
+    cmd_r = -1;
 
     /* try to write to child */
     if (NULL != current_read)
@@ -395,10 +3175,9 @@ run (struct Interface *gifc,
         /*
          * We have a job pending to write to Child's STDIN.
          */
-        FD_SET (child_stdin,
-                &fds_w);
-        fmax = MAX (fmax,
-                    child_stdin);
+        child_w = poll_add (&ps,
+                            child_stdin,
+                            POLLOUT);
       }
 
     /* try to write to TUN device */
@@ -407,26 +3186,37 @@ run (struct Interface *gifc,
         /*
          * We have a job pending to write to a TUN.
          */
-        FD_SET (current_write->fd,
-                &fds_w);
-        fmax = MAX (fmax,
-                    current_write->fd);
+        if (-1 == current_write->fd)
+          {
+            wake_at = 0;
+          }
+        else
+          {
+            tun_w = poll_add (&ps,
+                              current_write->fd,
+                              POLLOUT);
+          }
       }
 
     /* try to read from interfaces */
     for (unsigned int i=0;i<gifc_len;i++)
       {
-        struct Interface *ifc = &gifc[i];
+        struct Interface *ifc = gifc[i];
 
-        if (0 == ifc->buftun_size)
+        if (NULL == ifc)
+          continue;
+        ifc->poll_idx = -1;
+        if ( (0 == ifc->buftun_size) &&
+             (! ifc->removing) )
           {
             /*
              * We are able to read more into our read buffer.
              */
-            FD_SET (ifc->fd,
-                    &fds_r);
-            fmax = MAX (fmax,
-                        ifc->fd);
+            if (-1 != ifc->fd)
+              ifc_poll_add (ifc,
+                            &ps);
+            if (ifc->ready_at < wake_at)
+              wake_at = ifc->ready_at;
           }
       }
 
@@ -436,55 +3226,66 @@ run (struct Interface *gifc,
         /*
          * We are able to read more into our read buffer.
          */
-        FD_SET (child_stdout,
-                &fds_r);
-        fmax = MAX (fmax,
-                    child_stdout);
+        child_r = poll_add (&ps,
+                            child_stdout,
+                            POLLIN);
       }
 
     /* Also try to read from command-line */
-    if (cmd_line.buftun_size < MAX_SIZE - sizeof (struct GLAB_MessageHeader))
+    if ( (! stdin_eof) &&
+         (-1 != child_stdin) &&
+         (cmd_line.buftun_size < MAX_SIZE - sizeof (struct GLAB_MessageHeader)) )
       {
-	FD_SET (STDIN_FILENO,
-		&fds_r);
-	fmax = MAX (fmax,
-		    STDIN_FILENO);
+	cmd_r = poll_add (&ps,
+			  STDIN_FILENO,
+			  POLLIN);
       }
 
-    int r = select (fmax + 1,
-                    &fds_r,
-                    &fds_w,
-                    NULL,
-                    NULL);
+    if (UINT64_MAX != wake_at)
+      {
+        uint64_t now = latency_now ();
+        uint64_t delay = (wake_at > now) ? wake_at - now : 0;
+
+        /* round up, poll() takes milliseconds */
+        timeout = (int) MIN ((delay + 999999LLU) / 1000000LLU,
+                             (uint64_t) INT_MAX);
+      }
+    int r = poll (ps.fds,
+                  ps.num,
+                  timeout);
     if (-1 == r)
     {
       if (EINTR == errno)
         continue;
       fprintf (stderr,
-               "select failed: %s\n",
+               "poll failed: %s\n",
                strerror (errno));
       return;
     }
 
-    if (0 == r)
-      continue;
-
     /* Read from command-line */
-    if (FD_ISSET (STDIN_FILENO,
-		  &fds_r))
+    if (poll_ready (&ps,
+                    cmd_r))
       {
 	ssize_t ret = read (STDIN_FILENO,
 			    &cmd_line.buftun[cmd_line.buftun_size],
 			    MAX_SIZE - sizeof (struct GLAB_MessageHeader) - cmd_line.buftun_size);
 	if (0 >= ret)
-	  return;
-	cmd_line.buftun_size += ret;
+	  {
+	    if (! offline)
+	      return;
+	    stdin_eof = 1;
+	  }
+	else
+	  {
+	    cmd_line.buftun_size += ret;
+	  }
       }
 
     /* check if child is ready for reading (so we can write to it) */
-    if ( (FD_ISSET (child_stdin,
-                    &fds_w)) &&
-         (NULL != current_read) )
+    if ( (NULL != current_read) &&
+         (poll_ready (&ps,
+                      child_w)) )
       {
         ssize_t written = write (child_stdin,
 				 current_read->buftun_off,
@@ -515,6 +3316,10 @@ run (struct Interface *gifc,
 		total_w -= sizeof (struct GLAB_MessageHeader);
 		move_off += sizeof (struct GLAB_MessageHeader);
 	      }
+	    if ( (NULL != current_read->latency_slot) &&
+		 (current_read->latency_slot->t_rx == current_read->latency_t_rx) )
+	      current_read->latency_slot->t_handoff = latency_now ();
+	    current_read->latency_slot = NULL;
 	    memmove (&current_read->buftun[move_off],
 		     current_read->buftun_off,
 		     current_read->buftun_size - total_w);
@@ -526,23 +3331,13 @@ run (struct Interface *gifc,
 
     /* Forward child's stream to network interface, if possible */
     if ( (NULL != current_write) &&
-         (FD_ISSET (current_write->fd,
-                    &fds_w)) )
+         ( (-1 == current_write->fd) ||
+           (poll_ready (&ps,
+                        tun_w)) ) )
       {
-	struct sockaddr_ll sadr_ll;
-
-	sadr_ll.sll_ifindex = current_write->if_idx.ifr_ifindex;
-	sadr_ll.sll_halen = MAC_ADDR_SIZE;
-	memcpy (&sadr_ll.sll_addr[0],
-		bufin_write_off,
-		sizeof (struct MacAddress));
-
-        ssize_t written = sendto (current_write->fd,
-				  bufin_write_off,
-				  bufin_write_left,
-				  0,
-				  (const struct sockaddr *) &sadr_ll,
-				  sizeof (struct sockaddr_ll));
+        ssize_t written = current_write->backend->send (current_write,
+                                                        bufin_write_off,
+                                                        bufin_write_left);
 
         if (-1 == written)
           {
@@ -561,6 +3356,20 @@ run (struct Interface *gifc,
         bufin_write_off += written;
         if (0 == bufin_write_left)
           {
+	    if (0 != lat_rx)
+	      {
+		uint64_t now = latency_now ();
+
+		latency_record (&latency_hist[LS_RX_TO_CHILD],
+				lat_handoff - lat_rx);
+		latency_record (&latency_hist[LS_CHILD],
+				lat_readback - lat_handoff);
+		latency_record (&latency_hist[LS_CHILD_TO_TX],
+				now - lat_readback);
+		latency_record (&latency_hist[LS_TOTAL],
+				now - lat_rx);
+		lat_rx = 0;
+	      }
             memmove (bufin,
 		     bufin_write_off,
 		     bufin_rpos - (bufin_write_off - bufin));
@@ -570,15 +3379,43 @@ run (struct Interface *gifc,
           }
       }
 
-    if (NULL == current_read)
+    while ( (NULL == current_read) &&
+            (-1 != child_stdin) )
       {
 	unsigned char *nl;
 
+	if (0 != ifc_events.buftun_size)
+	  {
+	    /* interface changes go first, the child must learn about
+	       a new interface before its first frame */
+	    current_read = &ifc_events;
+	    current_read->buftun_end = ifc_events.buftun_size;
+	    current_read->buftun_off = ifc_events.buftun;
+	    break;
+	  }
 	nl = memchr (&cmd_line.buftun[sizeof (struct GLAB_MessageHeader)],
 		     '\n',
 		     cmd_line.buftun_size - sizeof (struct GLAB_MessageHeader));
-	if (NULL != nl)
+	if (NULL == nl)
+	  break;
+	if ( (nl - cmd_line.buftun >= sizeof (struct GLAB_MessageHeader) + 3) &&
+	     (0 == strncasecmp ((const char *) &cmd_line.buftun[sizeof (struct GLAB_MessageHeader)],
+				"ifc",
+				3)) &&
+	     ( (nl - cmd_line.buftun == sizeof (struct GLAB_MessageHeader) + 3) ||
+	       (' ' == cmd_line.buftun[sizeof (struct GLAB_MessageHeader) + 3]) ) )
 	  {
+	    /* we manage the interfaces, the child is only told */
+	    *nl = '\0';
+	    ifc_command ((char *) &cmd_line.buftun[sizeof (struct GLAB_MessageHeader)]);
+	    memmove (&cmd_line.buftun[sizeof (struct GLAB_MessageHeader)],
+		     nl + 1,
+		     cmd_line.buftun_size - (nl + 1 - cmd_line.buftun));
+	    cmd_line.buftun_size -= nl + 1 - &cmd_line.buftun[sizeof (struct GLAB_MessageHeader)];
+	    offline = all_offline ();
+	    continue;
+	  }
+	{
 	    struct GLAB_MessageHeader hd;
 
 	    hd.type = htons (0);
@@ -593,8 +3430,8 @@ run (struct Interface *gifc,
       }
 
     /* Read from child's stream for forwarding to network, if possible */
-    if (FD_ISSET (child_stdout,
-                  &fds_r))
+    if (poll_ready (&ps,
+                    child_r))
       {
         ssize_t ret;
 
@@ -653,109 +3490,69 @@ run (struct Interface *gifc,
                          (unsigned int) n);
                 return;
               }
+            if ( (NULL == gifc[n - 1]) ||
+                 (gifc[n - 1]->removing) )
+              {
+                /* interface is gone (or going), drop the frame */
+                memmove (bufin,
+                         &bufin[s],
+                         bufin_rpos - s);
+                bufin_rpos -= s;
+                goto rbuf_again;
+              }
             /* Got a complete message! */
-            current_write = &gifc[n - 1];
+            current_write = gifc[n - 1];
             bufin_write_left = s - sizeof (hd);
             bufin_write_off = &bufin[sizeof (hd)];
+	    if (latency_mode)
+	      {
+		const struct LatencySlot *ls;
+
+		lat_readback = latency_now ();
+		ls = latency_lookup (latency_hash (bufin_write_off,
+						   bufin_write_left),
+				     lat_readback);
+		if (NULL == ls)
+		  {
+		    latency_unmatched++;
+		    lat_rx = 0;
+		  }
+		else
+		  {
+		    latency_matched++;
+		    lat_rx = ls->t_rx;
+		    lat_handoff = ls->t_handoff;
+		  }
+	      }
           }
       }
 
     /* read from network interfaces, if possible */
     for (unsigned int i=0;i<gifc_len;i++)
       {
-        struct Interface *ifc = &gifc[i];
-
-        if (FD_ISSET (ifc->fd,
-                      &fds_r) &&
-            (0 == ifc->buftun_size))
+        struct Interface *ifc = gifc[i];
+
+        if ( (NULL == ifc) ||
+             (ifc->removing) )
+          continue;
+        if ( (0 == ifc->buftun_size) &&
+             ( ( (-1 != ifc->fd) &&
+                 ifc_poll_ready (ifc,
+                                 &ps) ) ||
+               (ifc->ready_at <= latency_now ()) ) )
           {
             struct GLAB_MessageHeader hdr;
             ssize_t ret;
-	    struct sockaddr_ll sadr_ll;
-            struct cmsghdr *cmsg;
-            union {
-              struct cmsghdr cmsg;
-              char buf[CMSG_SPACE(sizeof (struct tpacket_auxdata))];
-            } cmsg_buf;
-            struct msghdr msg;
-            struct iovec iov = {
-              .iov_base = ifc->buftun + sizeof (struct GLAB_MessageHeader),
-              .iov_len = MAX_SIZE
-            };
-
-            memset (&msg,
-                    0,
-                    sizeof (msg));
-            msg.msg_iov = &iov;
-            msg.msg_iovlen = 1;
-            msg.msg_name = &sadr_ll;
-            msg.msg_namelen = sizeof (sadr_ll);
-            msg.msg_control = &cmsg_buf;
-            msg.msg_controllen = sizeof (cmsg_buf);
-            memset (iov.iov_base,
-                    0,
-                    MAX_SIZE);
-            ret = recvmsg (ifc->fd,
-                           &msg,
-                           0 /* flags */);
+
+            ret = ifc->backend->recv (ifc,
+                                      ifc->buftun + sizeof (struct GLAB_MessageHeader),
+                                      MAX_SIZE);
+            if (latency_mode)
+              ifc->latency_t_rx = latency_now ();
             if (-1 == ret)
-              {
-                fprintf (stderr,
-                         "read-error: %s\n",
-                         strerror (errno));
-                return;
-              }
-	    if (sadr_ll.sll_ifindex != ifc->if_idx.ifr_ifindex)
-	      {
-#if DEBUG
-		fprintf (stderr,
-			 "recvfrom for different interface, discarding\n");
-#endif
-		continue;
-              }
+              return;
             if (0 == ret)
-              {
-                fprintf (stderr,
-                         "EOF on tun\n");
-                return;
-              }
-
-            for (cmsg = CMSG_FIRSTHDR(&msg);
-                 NULL != cmsg;
-                 cmsg = CMSG_NXTHDR(&msg, cmsg))
-            {
-              struct tpacket_auxdata *aux;
-              struct vlan_tag *tag;
-
-              if (cmsg->cmsg_len < CMSG_LEN(sizeof(struct tpacket_auxdata)) ||
-                  cmsg->cmsg_level != SOL_PACKET ||
-                  cmsg->cmsg_type != PACKET_AUXDATA) {
-                /*
-                 * This isn't a PACKET_AUXDATA auxiliary
-                 * data item.
-                 */
-                continue;
-              }
-
-              aux = (struct tpacket_auxdata *) CMSG_DATA(cmsg);
-              if (! VLAN_VALID (aux, aux)) {
-                /*
-                 * There is no VLAN information in the
-                 * auxiliary data.
-                 */
-                continue;
-              }
-
-              if (ret < (size_t) VLAN_OFFSET)
-                break; /* awkward... */
-              tag = iov.iov_base + VLAN_OFFSET;
-              memmove (&tag[1],
-                       tag,
-                       ret - VLAN_OFFSET);
-              tag->vlan_tpid = htons(VLAN_TPID(aux, aux));
-              tag->vlan_tci = htons(aux->tp_vlan_tci);
-              ret += sizeof (*tag);
-            }
+              continue;
 
             ifc->buftun_size = (size_t) ret + sizeof (struct GLAB_MessageHeader);
             hdr.type = htons (i + 1);
@@ -776,6 +3573,11 @@ run (struct Interface *gifc,
 	      {
 		/* read to send message */
 		ifc->buftun_end = ifc->buftun_size;
+		if (latency_mode)
+		  ifc->latency_slot
+		    = latency_rx (latency_hash (ifc->buftun + sizeof (struct GLAB_MessageHeader),
+						(size_t) ret),
+				  ifc->latency_t_rx);
 	      }
           }
 
@@ -788,6 +3590,35 @@ run (struct Interface *gifc,
             current_read->buftun_off = ifc->buftun;
           }
       } /* end for(ifc) */
+
+    ifc_reap (current_read,
+              current_write);
+
+    /* once no interface will receive anything anymore, tell the
+       child (which then exits) */
+    if ( (-1 != child_stdin) &&
+         (NULL == current_read) )
+      {
+        int done = (0 == ifc_events.buftun_size);
+        int have_ifc = 0;
+
+        for (unsigned int i=0;i<gifc_len;i++)
+          {
+            if (NULL == gifc[i])
+              continue;
+            have_ifc = 1;
+            if ( (! gifc[i]->eof) ||
+                 (0 != gifc[i]->buftun_size) )
+              done = 0;
+          }
+        if (! have_ifc)
+          done = 0;
+        if (done)
+          {
+            close (child_stdin);
+            child_stdin = -1;
+          }
+      }
   }
 }
 
@@ -797,23 +3628,59 @@ run (struct Interface *gifc,
  *
  * @param argc number of arguments in @a argv
  * @param argv 0: binary name (network-driver)
- *             1..n: network interface name (e.g. eth0)
+ *             options: "-L[FILE]" enables latency mode, the histograms
+ *                      are written to FILE (or stderr) on SIGUSR1 and
+ *                      on exit; "-O" disables segmentation offloads
+ *                      on raw socket interfaces instead of segmenting
+ *                      super-frames in software (see gso_segment())
+ *             1..n: network interface name (e.g. eth0), or
+ *                   "pcap:IN:OUT[:timed]" to receive the frames of the
+ *                   capture IN and write transmitted frames to the
+ *                   capture OUT (see pcap_init()), or
+ *                   "tap:NAME[:QUEUES]" for a tap device (see tap_init())
  *             n+1: "-"
  *             n+2: child program to launch
+ *
+ * While running, the lines "ifc add IFC [CONFIG]", "ifc del NUM" and
+ * "ifc list" on our stdin add and remove interfaces (see ifc_command()),
+ * all other lines are passed to the child.
  */
 int
 main (int argc,
       char **argv)
 {
-  struct Interface *gifc;
   int global_ret;
+  int first;
   int end;
+  int opt;
 
-  for (end=1;NULL != argv[end];end++)
+  while (-1 != (opt = getopt (argc,
+                              argv,
+                              "+L::O")))
+    {
+      switch (opt)
+        {
+        case 'L':
+          latency_mode = 1;
+          latency_fn = optarg;
+          break;
+        case 'O':
+          disable_offloads = 1;
+          break;
+        default:
+          fprintf (stderr,
+                   "Usage: %s [-L[FILE]] [-O] IFC... - PROGRAM [ARGS...]\n"
+                   "IFC is an interface name, pcap:IN:OUT[:timed] or tap:NAME[:QUEUES]\n",
+                   argv[0]);
+          return 1;
+        }
+    }
+  first = optind;
+  for (end=first;NULL != argv[end];end++)
     if (0 == strcmp ("-",
                      argv[end]))
       break;
-  if (2 > end)
+  if (first + 1 > end)
     {
       fprintf (stderr,
                "Fatal: must supply network interface names!\n");
@@ -876,27 +3743,19 @@ main (int argc,
     child_stdout = cout[0];
   } /* end launch child */
 
-  gifc = calloc (end - 1,
-                 sizeof (struct Interface));
-  if (NULL == gifc)
-    abort ();
-  for (unsigned int i=1;i<end;i++)
-    gifc[i-1].fd = -1;
-  for (unsigned int i=1;i<end;i++)
+  grow_array (&gifc,
+              sizeof (struct Interface *),
+              &gifc_len,
+              end - first);
+  for (unsigned int i=first;i<end;i++)
   {
-    struct Interface *ifc = &gifc[i-1];
-    char dev[IFNAMSIZ];
-
-    strncpy (dev,
-             argv[i],
-             IFNAMSIZ);
-    dev[IFNAMSIZ - 1] = '\0';
-    if (-1 == init_tun (dev,
-                        ifc))
+    gifc[i-first] = open_interface (argv[i],
+                                    i - first + 1);
+    if (NULL == gifc[i-first])
       {
         fprintf (stderr,
                  "Fatal: could not initialize interface `%s'\n",
-                 dev);
+                 argv[i]);
         global_ret = 4;
         goto cleanup;
       }
@@ -907,7 +3766,7 @@ main (int argc,
     char *mbuf;
     size_t size;
 
-    size = sizeof (struct GLAB_MessageHeader) + (end - 1) * MAC_ADDR_SIZE;
+    size = sizeof (struct GLAB_MessageHeader) + (end - first) * MAC_ADDR_SIZE;
     mbuf = malloc (size);
     if (NULL == mbuf)
       abort ();
@@ -916,9 +3775,9 @@ main (int argc,
     memcpy (mbuf,
             &gh,
             sizeof (gh));
-    for (unsigned int i=1;i<end;i++)
-      memcpy (&mbuf[sizeof (struct GLAB_MessageHeader) + (i-1) * MAC_ADDR_SIZE],
-              gifc[i - 1].my_mac,
+    for (unsigned int i=first;i<end;i++)
+      memcpy (&mbuf[sizeof (struct GLAB_MessageHeader) + (i-first) * MAC_ADDR_SIZE],
+              gifc[i - first]->my_mac,
               MAC_ADDR_SIZE);
     if (size !=
         write (child_stdin,
@@ -969,17 +3828,34 @@ main (int argc,
              strerror (errno));
     /* no exit, we might as well die with SIGPIPE should it ever happen */
   }
+  if (latency_mode)
+    {
+      struct sigaction sa;
+
+      memset (&sa,
+              0,
+              sizeof (sa));
+      sa.sa_handler = &latency_sighandler;
+      sigemptyset (&sa.sa_mask);
+      if (0 != sigaction (SIGUSR1,
+                          &sa,
+                          NULL))
+        fprintf (stderr,
+                 "Failed to install SIGUSR1 handler: %s\n",
+                 strerror (errno));
+    }
   fprintf (stderr,
 	   "Starting main loop\n");
-  run (gifc,
-       end - 1);
+  run ();
   kill (chld,
 	SIGKILL);
+  if (latency_mode)
+    latency_dump ();
   global_ret = 0;
  cleanup:
-  for (unsigned int i=1;i<end;i++)
-    if (-1 != gifc[i-1].fd)
-      close (gifc[i-1].fd);
+  for (unsigned int i=0;i<gifc_len;i++)
+    if (NULL != gifc[i])
+      close_interface (gifc[i]);
   free (gifc);
   return global_ret;
 }
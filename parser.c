@@ -104,6 +104,39 @@ handle_mac (uint16_t ifc_num,
 }
 
 
+/**
+ * Handle interface @a ifc_num with @a mac added at runtime.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg configuration of the interface
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+		const struct MacAddress *mac,
+		const char *arg)
+{
+    print ("Interface %u (%s) added: ",
+	   (unsigned int) ifc_num,
+	   arg);
+    handle_mac (ifc_num,
+		mac);
+}
+
+
+/**
+ * Handle interface @a ifc_num being removed at runtime.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+    print ("Interface %u removed\n",
+	   (unsigned int) ifc_num);
+}
+
+
 #include "loop.c"
 
 int
@@ -0,0 +1,645 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file pcap.c
+ * @brief minimal reader for pcap and pcapng captures of Ethernet
+ *        frames and writer for (classic) pcap files
+ *
+ * Only link type Ethernet is supported.  For pcapng, packets are
+ * reported together with the index of the interface they were
+ * captured on, so one file can carry the traffic of several
+ * interfaces.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <byteswap.h>
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+#define PCAP_MAGIC_USEC_SWAPPED 0xd4c3b2a1
+
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+
+#define PCAPNG_SECTION_HEADER 0x0A0D0D0A
+
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_INTERFACE_DESCRIPTION 1
+
+#define PCAPNG_OBSOLETE_PACKET 2
+
+#define PCAPNG_SIMPLE_PACKET 3
+
+#define PCAPNG_ENHANCED_PACKET 6
+
+#define PCAPNG_OPTION_IF_TSRESOL 9
+
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/**
+ * Largest block or packet we accept.
+ */
+#define PCAP_MAX_SIZE (16 * 1024 * 1024)
+
+
+/**
+ * Interface of a pcapng section.
+ */
+struct PcapInterface
+{
+  /**
+   * Link type of the interface.
+   */
+  uint16_t linktype;
+
+  /**
+   * Timestamp resolution: if bit 7 is set, ticks are 2^-(x & 0x7F)
+   * seconds, otherwise 10^-x seconds.
+   */
+  uint8_t tsresol;
+};
+
+
+/**
+ * Handle for reading a capture.
+ */
+struct PcapReader
+{
+  FILE *fh;
+
+  /**
+   * Name of the file, for error messages.
+   */
+  const char *filename;
+
+  /**
+   * Is this a pcapng file?
+   */
+  int ng;
+
+  /**
+   * Was the file written with the other byte order?
+   */
+  int swap;
+
+  /**
+   * Classic pcap: timestamp resolution like in `struct PcapInterface`.
+   */
+  uint8_t tsresol;
+
+  /**
+   * pcapng: interfaces of the current section.
+   */
+  struct PcapInterface *ifcs;
+
+  unsigned int num_ifcs;
+
+  /**
+   * Buffer for the current block or packet.
+   */
+  uint8_t *buf;
+
+  size_t buf_size;
+};
+
+
+/**
+ * A packet from a capture.
+ */
+struct PcapPacket
+{
+  /**
+   * Time of capture in nanoseconds since the epoch.
+   */
+  uint64_t ts_ns;
+
+  /**
+   * Interface the packet was captured on (pcapng interface index,
+   * always 0 for classic pcap).
+   */
+  unsigned int ifc;
+
+  /**
+   * Captured bytes, valid until the next call to pcap_read().
+   */
+  const void *data;
+
+  /**
+   * Number of bytes at @e data.
+   */
+  size_t size;
+
+  /**
+   * Size of the packet on the wire (may be larger than @e size).
+   */
+  size_t wire_size;
+};
+
+
+/**
+ * Handle for writing a classic pcap file.
+ */
+struct PcapWriter
+{
+  FILE *fh;
+};
+
+
+static uint32_t
+pcap_u32 (const struct PcapReader *r,
+	  const void *p)
+{
+  uint32_t v;
+
+  memcpy (&v,
+	  p,
+	  sizeof (v));
+  return r->swap ? bswap_32 (v) : v;
+}
+
+
+static uint16_t
+pcap_u16 (const struct PcapReader *r,
+	  const void *p)
+{
+  uint16_t v;
+
+  memcpy (&v,
+	  p,
+	  sizeof (v));
+  return r->swap ? bswap_16 (v) : v;
+}
+
+
+/**
+ * Convert @a ticks at resolution @a tsresol to nanoseconds.
+ */
+static uint64_t
+pcap_ticks_to_ns (uint64_t ticks,
+		  uint8_t tsresol)
+{
+  unsigned int exp = tsresol & 0x7F;
+  uint64_t div = 1;
+
+  if (0 != (tsresol & 0x80))
+    return (uint64_t) (((unsigned __int128) ticks * 1000000000LLU) >> exp);
+  if (exp <= 9)
+    {
+      for (unsigned int i = exp; i < 9; i++)
+	ticks *= 10;
+      return ticks;
+    }
+  for (unsigned int i = 9; i < exp; i++)
+    div *= 10;
+  return ticks / div;
+}
+
+
+/**
+ * Make sure @a r can hold @a size bytes in its buffer.
+ *
+ * @return 0 on success
+ */
+static int
+pcap_grow (struct PcapReader *r,
+	   size_t size)
+{
+  uint8_t *nbuf;
+
+  if (size <= r->buf_size)
+    return 0;
+  if (size > PCAP_MAX_SIZE)
+    {
+      fprintf (stderr,
+	       "%s: record of %llu bytes too large\n",
+	       r->filename,
+	       (unsigned long long) size);
+      return -1;
+    }
+  nbuf = realloc (r->buf,
+		  size);
+  if (NULL == nbuf)
+    return -1;
+  r->buf = nbuf;
+  r->buf_size = size;
+  return 0;
+}
+
+
+/**
+ * Open @a filename for reading and check its header.
+ *
+ * @param r[out] handle to initialize
+ * @param filename name of a pcap or pcapng file
+ * @return 0 on success
+ */
+static int
+pcap_open_read (struct PcapReader *r,
+		const char *filename)
+{
+  uint8_t hdr[24];
+  uint32_t magic;
+
+  memset (r,
+	  0,
+	  sizeof (*r));
+  r->filename = filename;
+  r->fh = fopen (filename,
+		 "rb");
+  if (NULL == r->fh)
+    {
+      fprintf (stderr,
+	       "Failed to open `%s': %s\n",
+	       filename,
+	       strerror (errno));
+      return -1;
+    }
+  if (1 != fread (hdr,
+		  sizeof (hdr),
+		  1,
+		  r->fh))
+    goto malformed;
+  memcpy (&magic,
+	  hdr,
+	  sizeof (magic));
+  if (PCAPNG_SECTION_HEADER == magic)
+    {
+      /* rewind; pcap_read() parses the section header like any block */
+      r->ng = 1;
+      if (0 != fseek (r->fh,
+		      0,
+		      SEEK_SET))
+	goto malformed;
+      return 0;
+    }
+  switch (magic)
+    {
+    case PCAP_MAGIC_USEC:
+      r->tsresol = 6;
+      break;
+    case PCAP_MAGIC_NSEC:
+      r->tsresol = 9;
+      break;
+    case PCAP_MAGIC_USEC_SWAPPED:
+      r->swap = 1;
+      r->tsresol = 6;
+      break;
+    case PCAP_MAGIC_NSEC_SWAPPED:
+      r->swap = 1;
+      r->tsresol = 9;
+      break;
+    default:
+      goto malformed;
+    }
+  if (PCAP_LINKTYPE_ETHERNET != (pcap_u32 (r, &hdr[20]) & 0xFFFF))
+    {
+      fprintf (stderr,
+	       "%s: only Ethernet captures are supported\n",
+	       filename);
+      fclose (r->fh);
+      return -1;
+    }
+  return 0;
+malformed:
+  fprintf (stderr,
+	   "%s: not a pcap or pcapng file\n",
+	   filename);
+  fclose (r->fh);
+  return -1;
+}
+
+
+/**
+ * Parse the pcapng interface description block in @a body.
+ *
+ * @return 0 on success
+ */
+static int
+pcap_add_interface (struct PcapReader *r,
+		    const uint8_t *body,
+		    size_t len)
+{
+  struct PcapInterface *ifc;
+  size_t off = 8;
+
+  if (len < 8)
+    return -1;
+  ifc = realloc (r->ifcs,
+		 (r->num_ifcs + 1) * sizeof (struct PcapInterface));
+  if (NULL == ifc)
+    return -1;
+  r->ifcs = ifc;
+  ifc = &r->ifcs[r->num_ifcs++];
+  ifc->linktype = pcap_u16 (r, body);
+  ifc->tsresol = 6;
+  while (off + 4 <= len)
+    {
+      uint16_t code = pcap_u16 (r, &body[off]);
+      uint16_t olen = pcap_u16 (r, &body[off + 2]);
+
+      if (0 == code)
+	break;
+      if (off + 4 + olen > len)
+	return -1;
+      if ( (PCAPNG_OPTION_IF_TSRESOL == code) &&
+	   (1 == olen) )
+	ifc->tsresol = body[off + 4];
+      off += 4 + ((olen + 3) & ~3);
+    }
+  return 0;
+}
+
+
+/**
+ * Read the next Ethernet packet from @a r.  Packets of other link
+ * types are skipped.
+ *
+ * @param r capture to read from
+ * @param pkt[out] set to the packet
+ * @return 1 on success, 0 at the end of the file, -1 on errors
+ */
+static int
+pcap_read (struct PcapReader *r,
+	   struct PcapPacket *pkt)
+{
+  if (! r->ng)
+    {
+      uint8_t rec[16];
+      uint32_t caplen;
+
+      if (1 != fread (rec,
+		      sizeof (rec),
+		      1,
+		      r->fh))
+	return feof (r->fh) ? 0 : -1;
+      caplen = pcap_u32 (r, &rec[8]);
+      if ( (0 != pcap_grow (r,
+			    caplen)) ||
+	   ( (caplen > 0) &&
+	     (1 != fread (r->buf,
+			  caplen,
+			  1,
+			  r->fh)) ) )
+	goto malformed;
+      pkt->ts_ns = (uint64_t) pcap_u32 (r, &rec[0]) * 1000000000LLU
+	+ pcap_ticks_to_ns (pcap_u32 (r, &rec[4]),
+			    r->tsresol);
+      pkt->ifc = 0;
+      pkt->data = r->buf;
+      pkt->size = caplen;
+      pkt->wire_size = pcap_u32 (r, &rec[12]);
+      return 1;
+    }
+  while (1)
+    {
+      uint8_t bh[8];
+      uint32_t type;
+      uint32_t len;
+      const uint8_t *body;
+      size_t body_len;
+      unsigned int ifc;
+      uint64_t ticks;
+
+      if (1 != fread (bh,
+		      sizeof (bh),
+		      1,
+		      r->fh))
+	return feof (r->fh) ? 0 : -1;
+      memcpy (&type,
+	      bh,
+	      sizeof (type));
+      if (PCAPNG_SECTION_HEADER == type)
+	{
+	  uint32_t bom;
+
+	  /* new section: byte order and interfaces may change */
+	  if (1 != fread (&bom,
+			  sizeof (bom),
+			  1,
+			  r->fh))
+	    goto malformed;
+	  if (PCAPNG_BYTE_ORDER_MAGIC == bom)
+	    r->swap = 0;
+	  else if (bswap_32 (PCAPNG_BYTE_ORDER_MAGIC) == bom)
+	    r->swap = 1;
+	  else
+	    goto malformed;
+	  r->num_ifcs = 0;
+	  len = pcap_u32 (r, &bh[4]);
+	  if ( (len < 28) ||
+	       (0 != pcap_grow (r,
+				len - 12)) ||
+	       (1 != fread (r->buf,
+			    len - 12,
+			    1,
+			    r->fh)) )
+	    goto malformed;
+	  continue;
+	}
+      type = pcap_u32 (r, bh);
+      len = pcap_u32 (r, &bh[4]);
+      if ( (len < 12) ||
+	   (0 != (len & 3)) ||
+	   (0 != pcap_grow (r,
+			    len - 8)) ||
+	   (1 != fread (r->buf,
+			len - 8,
+			1,
+			r->fh)) )
+	goto malformed;
+      body = r->buf;
+      body_len = len - 12;
+      switch (type)
+	{
+	case PCAPNG_INTERFACE_DESCRIPTION:
+	  if (0 != pcap_add_interface (r,
+				       body,
+				       body_len))
+	    goto malformed;
+	  continue;
+	case PCAPNG_ENHANCED_PACKET:
+	  if (body_len < 20)
+	    goto malformed;
+	  ifc = pcap_u32 (r, body);
+	  ticks = ((uint64_t) pcap_u32 (r, &body[4]) << 32)
+	    | pcap_u32 (r, &body[8]);
+	  pkt->size = pcap_u32 (r, &body[12]);
+	  pkt->wire_size = pcap_u32 (r, &body[16]);
+	  pkt->data = &body[20];
+	  if (pkt->size > body_len - 20)
+	    goto malformed;
+	  break;
+	case PCAPNG_OBSOLETE_PACKET:
+	  if (body_len < 20)
+	    goto malformed;
+	  ifc = pcap_u16 (r, body);
+	  ticks = ((uint64_t) pcap_u32 (r, &body[4]) << 32)
+	    | pcap_u32 (r, &body[8]);
+	  pkt->size = pcap_u32 (r, &body[12]);
+	  pkt->wire_size = pcap_u32 (r, &body[16]);
+	  pkt->data = &body[20];
+	  if (pkt->size > body_len - 20)
+	    goto malformed;
+	  break;
+	case PCAPNG_SIMPLE_PACKET:
+	  if (body_len < 4)
+	    goto malformed;
+	  ifc = 0;
+	  ticks = 0;
+	  pkt->wire_size = pcap_u32 (r, body);
+	  pkt->size = (pkt->wire_size < body_len - 4)
+	    ? pkt->wire_size
+	    : body_len - 4;
+	  pkt->data = &body[4];
+	  break;
+	default:
+	  /* statistics, name resolution, custom blocks, ... */
+	  continue;
+	}
+      if (ifc >= r->num_ifcs)
+	goto malformed;
+      if (PCAP_LINKTYPE_ETHERNET != r->ifcs[ifc].linktype)
+	continue;
+      pkt->ifc = ifc;
+      pkt->ts_ns = pcap_ticks_to_ns (ticks,
+				     r->ifcs[ifc].tsresol);
+      return 1;
+    }
+malformed:
+  fprintf (stderr,
+	   "%s: truncated or malformed capture\n",
+	   r->filename);
+  return -1;
+}
+
+
+/**
+ * Close @a r and release its resources.
+ */
+static void
+pcap_close_read (struct PcapReader *r)
+{
+  if (NULL != r->fh)
+    fclose (r->fh);
+  free (r->buf);
+  free (r->ifcs);
+  memset (r,
+	  0,
+	  sizeof (*r));
+}
+
+
+/**
+ * Create @a filename as a pcap file with nanosecond timestamps for
+ * Ethernet frames.
+ *
+ * @param w[out] handle to initialize
+ * @return 0 on success
+ */
+static int
+pcap_open_write (struct PcapWriter *w,
+		 const char *filename)
+{
+  uint32_t hdr[6];
+
+  w->fh = fopen (filename,
+		 "wb");
+  if (NULL == w->fh)
+    {
+      fprintf (stderr,
+	       "Failed to create `%s': %s\n",
+	       filename,
+	       strerror (errno));
+      return -1;
+    }
+  hdr[0] = PCAP_MAGIC_NSEC;
+  hdr[1] = 2 | (4 << 16); /* version 2.4 */
+  hdr[2] = 0; /* thiszone */
+  hdr[3] = 0; /* sigfigs */
+  hdr[4] = 65535; /* snaplen */
+  hdr[5] = PCAP_LINKTYPE_ETHERNET;
+  if (1 != fwrite (hdr,
+		   sizeof (hdr),
+		   1,
+		   w->fh))
+    {
+      fclose (w->fh);
+      w->fh = NULL;
+      return -1;
+    }
+  return 0;
+}
+
+
+/**
+ * Append @a size bytes of @a frame captured at @a ts_ns to @a w.
+ *
+ * @return 0 on success
+ */
+static int
+pcap_write (struct PcapWriter *w,
+	    uint64_t ts_ns,
+	    const void *frame,
+	    size_t size)
+{
+  uint32_t rec[4];
+
+  rec[0] = (uint32_t) (ts_ns / 1000000000LLU);
+  rec[1] = (uint32_t) (ts_ns % 1000000000LLU);
+  rec[2] = size;
+  rec[3] = size;
+  if ( (1 != fwrite (rec,
+		     sizeof (rec),
+		     1,
+		     w->fh)) ||
+       ( (size > 0) &&
+	 (1 != fwrite (frame,
+		       size,
+		       1,
+		       w->fh)) ) )
+    return -1;
+  return 0;
+}
+
+
+/**
+ * Flush and close @a w.
+ *
+ * @return 0 on success
+ */
+static int
+pcap_close_write (struct PcapWriter *w)
+{
+  int ret = 0;
+
+  if (NULL == w->fh)
+    return 0;
+  if (0 != fclose (w->fh))
+    ret = -1;
+  w->fh = NULL;
+  return ret;
+}
+
+/* end of pcap.c */
@@ -0,0 +1,370 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file pool.c
+ * @brief Slab allocator for table nodes and pool of packet buffers
+ *
+ * Both hand out memory from large chunks that are kept until the
+ * program exits, so once a program has seen its peak load, handling
+ * a frame no longer calls malloc().  All programs are single-threaded,
+ * so there is no locking.
+ *
+ * Packet buffers have a single owner: every program writes a frame
+ * out before it handles the next one, so nothing ever holds on to a
+ * buffer and there is nothing to count references for.  hub, switch
+ * and vswitch do not use the pool at all, as they send the frames
+ * they received (hub with writev(), the others from a static output
+ * buffer) without building new ones.
+ */
+#include <sys/mman.h>
+
+
+/**
+ * Bytes a slab allocates from the system at once.
+ */
+#ifndef SLAB_CHUNK_SIZE
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#endif
+
+
+/**
+ * Allocator for objects of one size.
+ */
+struct Slab
+{
+  /**
+   * Size of an object, rounded up to a multiple of the pointer size.
+   */
+  size_t elem_size;
+
+  /**
+   * Free objects, linked through their first bytes.
+   */
+  void *free_list;
+
+  /**
+   * Chunks the objects are carved from.
+   */
+  void **chunks;
+
+  /**
+   * Number of chunks in use.
+   */
+  unsigned int num_chunks;
+
+  /**
+   * Length of @e chunks.
+   */
+  unsigned int size_chunks;
+
+  /**
+   * Number of objects handed out.
+   */
+  unsigned long in_use;
+};
+
+
+/**
+ * Initializer for a `struct Slab` for objects of type @a type.
+ */
+#define SLAB_INIT(type) \
+  { .elem_size = (sizeof (type) + sizeof (void *) - 1) / sizeof (void *) * sizeof (void *) }
+
+
+/* not every program including this file keeps its tables in slabs */
+static void *
+slab_alloc (struct Slab *slab) __attribute__ ((unused));
+
+static void
+slab_free (struct Slab *slab,
+	   void *elem) __attribute__ ((unused));
+
+static void
+slab_destroy (struct Slab *slab) __attribute__ ((unused));
+
+
+/**
+ * Carve another chunk into free objects for @a slab.
+ *
+ * @param slab slab to grow
+ */
+static void
+slab_grow (struct Slab *slab)
+{
+  size_t chunk_size = SLAB_CHUNK_SIZE;
+  char *chunk;
+
+  if (chunk_size < slab->elem_size)
+    chunk_size = slab->elem_size;
+  chunk = malloc (chunk_size);
+  if (NULL == chunk)
+    abort ();
+  grow_array (&slab->chunks,
+	      sizeof (void *),
+	      &slab->size_chunks,
+	      slab->num_chunks + 1);
+  slab->chunks[slab->num_chunks++] = chunk;
+  for (size_t off = 0; off + slab->elem_size <= chunk_size; off += slab->elem_size)
+    {
+      *(void **) &chunk[off] = slab->free_list;
+      slab->free_list = &chunk[off];
+    }
+}
+
+
+/**
+ * Get an (uninitialized) object from @a slab.
+ *
+ * @param slab slab to allocate from
+ * @return the object, never NULL
+ */
+static void *
+slab_alloc (struct Slab *slab)
+{
+  void *elem;
+
+  if (NULL == slab->free_list)
+    slab_grow (slab);
+  elem = slab->free_list;
+  slab->free_list = *(void **) elem;
+  slab->in_use++;
+  return elem;
+}
+
+
+/**
+ * Return @a elem to @a slab.
+ *
+ * @param slab slab @a elem was allocated from
+ * @param elem object to free
+ */
+static void
+slab_free (struct Slab *slab,
+	   void *elem)
+{
+  *(void **) elem = slab->free_list;
+  slab->free_list = elem;
+  slab->in_use--;
+}
+
+
+/**
+ * Free all chunks of @a slab, invalidating all its objects.
+ *
+ * @param slab slab to clear
+ */
+static void
+slab_destroy (struct Slab *slab)
+{
+  for (unsigned int i = 0; i < slab->num_chunks; i++)
+    free (slab->chunks[i]);
+  free (slab->chunks);
+  slab->chunks = NULL;
+  slab->num_chunks = 0;
+  slab->size_chunks = 0;
+  slab->free_list = NULL;
+  slab->in_use = 0;
+}
+
+
+/**
+ * Bytes reserved in front of the data of a packet buffer, for headers
+ * prepended later (GLAB header, 802.1Q tag, ...).
+ */
+#ifndef POOL_HEADROOM
+#define POOL_HEADROOM 64
+#endif
+
+/**
+ * Bytes the pool maps at once, a huge page on x86.
+ */
+#ifndef POOL_BATCH_SIZE
+#define POOL_BATCH_SIZE (2 * 1024 * 1024)
+#endif
+
+/**
+ * Try to back the packet buffers with huge pages if not 0.  Falls
+ * back to normal pages if none are available.
+ */
+#ifndef POOL_HUGEPAGES
+#define POOL_HUGEPAGES 0
+#endif
+
+
+/**
+ * A packet buffer, large enough for any frame.
+ */
+struct PoolBuffer
+{
+  /**
+   * Next free buffer, while in the pool.
+   */
+  struct PoolBuffer *next;
+
+  /**
+   * Offset of the data in @e buf.
+   */
+  uint32_t head;
+
+  /**
+   * Number of bytes of data.
+   */
+  uint32_t size;
+
+  /**
+   * Headroom and data.
+   */
+  unsigned char buf[POOL_HEADROOM + UINT16_MAX];
+};
+
+
+/**
+ * Free buffers.
+ */
+static struct PoolBuffer *pool_free;
+
+/**
+ * Number of buffers mapped so far.
+ */
+static unsigned int pool_num_buffers;
+
+
+/* not every program including this file prepends headers */
+static unsigned char *
+pool_push (struct PoolBuffer *pb,
+	   size_t len) __attribute__ ((unused));
+
+
+/**
+ * Map another batch of buffers.
+ */
+static void
+pool_grow ()
+{
+  struct PoolBuffer *batch = MAP_FAILED;
+
+#if POOL_HUGEPAGES && defined (MAP_HUGETLB)
+  batch = mmap (NULL,
+		POOL_BATCH_SIZE,
+		PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+		-1,
+		0);
+#endif
+  if (MAP_FAILED == batch)
+    batch = mmap (NULL,
+		  POOL_BATCH_SIZE,
+		  PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS,
+		  -1,
+		  0);
+  if (MAP_FAILED == batch)
+    {
+      fprintf (stderr,
+	       "Failed to map packet buffers: %s\n",
+	       strerror (errno));
+      abort ();
+    }
+  for (unsigned int i = 0; i < POOL_BATCH_SIZE / sizeof (struct PoolBuffer); i++)
+    {
+      batch[i].next = pool_free;
+      pool_free = &batch[i];
+      pool_num_buffers++;
+    }
+}
+
+
+/**
+ * Get an empty buffer with #POOL_HEADROOM bytes of headroom.
+ *
+ * @return the buffer, never NULL
+ */
+static struct PoolBuffer *
+pool_get ()
+{
+  struct PoolBuffer *pb;
+
+  if (NULL == pool_free)
+    pool_grow ();
+  pb = pool_free;
+  pool_free = pb->next;
+  pb->head = POOL_HEADROOM;
+  pb->size = 0;
+  return pb;
+}
+
+
+/**
+ * Return @a pb to the pool.
+ */
+static void
+pool_release (struct PoolBuffer *pb)
+{
+  pb->next = pool_free;
+  pool_free = pb;
+}
+
+
+/**
+ * Data of @a pb.
+ */
+static unsigned char *
+pool_data (struct PoolBuffer *pb)
+{
+  return &pb->buf[pb->head];
+}
+
+
+/**
+ * Append @a len bytes to the data of @a pb.
+ *
+ * @param pb buffer
+ * @param len number of bytes to add at the end
+ * @return the first of the added bytes
+ */
+static unsigned char *
+pool_put (struct PoolBuffer *pb,
+	  size_t len)
+{
+  unsigned char *tail = &pb->buf[pb->head + pb->size];
+
+  if (len > sizeof (pb->buf) - pb->head - pb->size)
+    abort ();
+  pb->size += len;
+  return tail;
+}
+
+
+/**
+ * Prepend @a len bytes to the data of @a pb, using its headroom.
+ *
+ * @param pb buffer
+ * @param len number of bytes to add in front
+ * @return the new start of the data
+ */
+static unsigned char *
+pool_push (struct PoolBuffer *pb,
+	   size_t len)
+{
+  if (len > pb->head)
+    abort ();
+  pb->head -= len;
+  pb->size += len;
+  return pool_data (pb);
+}
@@ -61,6 +61,189 @@ write_all (int fd,
 }
 
 
+/* only hub sends gather lists */
+static void
+writev_all (int fd,
+	    struct iovec *iov,
+	    int iovcnt)  __attribute__ ((unused));
+
+
+/**
+ * Helper function to write a gather list, dealing with partial writes
+ * and with lists longer than IOV_MAX.  Fails hard (calls exit() on
+ * failures)!  Modifies @a iov.
+ *
+ * @param fd where to write to
+ * @param iov buffers to write
+ * @param iovcnt number of entries in @a iov
+ */
+static void
+writev_all (int fd,
+	    struct iovec *iov,
+	    int iovcnt)
+{
+  while (iovcnt > 0)
+    {
+      ssize_t ret;
+
+      ret = writev (fd,
+		    iov,
+		    (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt);
+      if (ret <= 0)
+	{
+	  fprintf (stderr,
+		   "Writing to %d failed: %s\n",
+		   fd,
+		   strerror (errno));
+	  exit (1);
+	}
+      while ( (iovcnt > 0) &&
+	      ((size_t) ret >= iov->iov_len) )
+	{
+	  ret -= iov->iov_len;
+	  iov++;
+	  iovcnt--;
+	}
+      if (ret > 0)
+	{
+	  iov->iov_base = (char *) iov->iov_base + ret;
+	  iov->iov_len -= ret;
+	}
+    }
+}
+
+
+/**
+ * Largest control message we send to the parent, including the header.
+ */
+#define PRINT_BUF_SIZE UINT16_MAX
+
+/**
+ * Control output not yet sent to the parent.  Starts with space for
+ * the message header, so a chunk goes out with a single write().
+ */
+static char print_buf[PRINT_BUF_SIZE];
+
+/**
+ * Number of bytes used in #print_buf, including the header.
+ */
+static size_t print_off = sizeof (struct GLAB_MessageHeader);
+
+
+/**
+ * Send the first @a len bytes of #print_buf (including the header) to
+ * the parent as one control message and keep the rest for the next one.
+ *
+ * @param len number of bytes to send, at most #print_off
+ */
+static void
+print_send (size_t len)
+{
+  struct GLAB_MessageHeader hdr = {
+    .size = htons (len),
+    .type = htons (0)
+  };
+
+  if (len <= sizeof (hdr))
+    return;
+  memcpy (print_buf,
+	  &hdr,
+	  sizeof (hdr));
+  write_all (STDOUT_FILENO,
+	     print_buf,
+	     len);
+  memmove (&print_buf[sizeof (hdr)],
+	   &print_buf[len],
+	   print_off - len);
+  print_off -= len - sizeof (hdr);
+}
+
+
+/**
+ * Send all output buffered by print_append() to the parent.
+ */
+static void
+print_flush ()
+{
+  print_send (print_off);
+}
+
+
+/**
+ * Append formatted output to #print_buf.  When the buffer is full,
+ * the complete lines in it are sent (so tables arrive in chunks of
+ * whole rows); output longer than a message is truncated.
+ *
+ * @param fmt format string
+ * @param ap arguments for @a fmt
+ */
+static void
+vprint_append (const char *fmt,
+	       va_list ap)
+{
+  while (1)
+    {
+      size_t avail = sizeof (print_buf) - print_off;
+      va_list aq;
+      int ret;
+      char *nl;
+
+      va_copy (aq,
+	       ap);
+      ret = vsnprintf (&print_buf[print_off],
+		       avail,
+		       fmt,
+		       aq);
+      va_end (aq);
+      if (ret < 0)
+	return;
+      if ((size_t) ret < avail)
+	{
+	  print_off += ret;
+	  return;
+	}
+      if (sizeof (struct GLAB_MessageHeader) == print_off)
+	{
+	  /* does not fit even into an empty message */
+	  print_off += avail - 1;
+	  return;
+	}
+      nl = memrchr (&print_buf[sizeof (struct GLAB_MessageHeader)],
+		    '\n',
+		    print_off - sizeof (struct GLAB_MessageHeader));
+      print_send ( (NULL == nl)
+		   ? print_off
+		   : (size_t) (nl + 1 - print_buf));
+    }
+}
+
+
+static void
+print_append (const char *fmt,
+	      ...)  __attribute__ ((format (gnu_printf, 1, 2), unused));
+
+
+/**
+ * Add output for the user to the buffer, without sending it yet.
+ * Use this for long listings, followed by print_flush().
+ *
+ * @param fmt format string
+ * @param ... arguments for @a fmt
+ */
+static void
+print_append (const char *fmt,
+	      ...)
+{
+  va_list ap;
+
+  va_start (ap,
+	    fmt);
+  vprint_append (fmt,
+		 ap);
+  va_end (ap);
+}
+
+
 /**
  * Print message to the user by sending to parent.
  *
@@ -69,7 +252,7 @@ write_all (int fd,
  */
 static void
 print (const char *fmt,
-       ...)  __attribute__ ((format (gnu_printf, 1, 2)));
+       ...)  __attribute__ ((format (gnu_printf, 1, 2), unused));
 
 
 /**
@@ -82,32 +265,12 @@ static void
 print (const char *fmt,
        ...)
 {
-  char *str;
   va_list ap;
 
   va_start (ap,
 	    fmt);
-  vasprintf (&str,
-	     fmt,
-	     ap);
+  vprint_append (fmt,
+		 ap);
   va_end (ap);
-  {
-    size_t slen = strlen (str);
-    struct GLAB_MessageHeader hdr = {
-      .size = htons (slen + sizeof (struct GLAB_MessageHeader)),
-      .type = htons (0)
-    };
-    char buf[sizeof (hdr) + slen];
-
-    memcpy (buf,
-	    &hdr,
-	    sizeof (hdr));
-    memcpy (&buf[sizeof(hdr)],
-	    str,
-	    slen);
-    write_all (STDOUT_FILENO,
-	       buf,
-	       sizeof (buf));
-  }
-  free (str);
+  print_flush ();
 }
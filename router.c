@@ -24,6 +24,8 @@
 #include "glab.h"
 #include "print.c"
 #include "crc.c"
+#include "stats.c"
+#include "pool.c"
 
 
 /* see http://www.iana.org/assignments/ethernet-numbers */
@@ -208,12 +210,15 @@ struct IPv4Header
 };
 
 
+#define ICMPTYPE_ECHO_REPLY 0
 #define ICMPTYPE_DESTINATION_UNREACHABLE 3
+#define ICMPTYPE_ECHO_REQUEST 8
 #define ICMPTYPE_TIME_EXCEEDED 11
 
 #define ICMPCODE_NETWORK_UNREACHABLE 0
 #define ICMPCODE_HOST_UNREACHABLE 1
 #define ICMPCODE_FRAGMENTATION_REQUIRED 4
+#define ICMPCODE_ADMINISTRATIVELY_PROHIBITED 13
 
 /**
  * ICMP header.
@@ -275,7 +280,7 @@ struct Interface
     char *name;
 
     /**
-     * Number of this interface.
+     * Number of this interface, 0 if this slot is unused.
      */
     uint16_t ifc_num;
 
@@ -283,16 +288,21 @@ struct Interface
      * MTU to enforce for this interface.
      */
     uint16_t mtu;
+
+    /**
+     * VRF (routing table instance) of this interface.
+     */
+    uint16_t vrf;
 };
 
 
 /**
- * Number of available contexts.
+ * Length of gifc (some slots may be unused).
  */
 static unsigned int num_ifc;
 
 /**
- * All the contexts.
+ * All the contexts, indexed by interface number - 1.
  */
 static struct Interface *gifc;
 
@@ -301,45 +311,184 @@ _Pragma("pack(push)") _Pragma("pack(1)")
 
 ////////////////////////////////////   added for work   ////////////////////////////////////
 #include <time.h>
+#ifndef ARP_CACHE_SIZE
 #define ARP_CACHE_SIZE 10
+#endif
 struct ArpEntry {
     struct in_addr ip;
     struct MacAddress mac;
     struct Interface ifc;
     time_t timestamp;
 };
-static struct ArpEntry arpCache[ARP_CACHE_SIZE];
-static size_t arpCacheSize = 0;
 
 struct in_addr ON_LINK_GATEWAY;
 struct in_addr STANDARD_GATEWAY;
 
-struct Routing_entry *routing_table;
-
 struct Routing_entry {
+    struct Routing_entry *next;
+    /**
+     * Equal-cost routes to the same network, NULL if this is the only one.
+     */
+    struct NextHopGroup *nhg;
     struct in_addr network_target;
     struct in_addr network_mask;
     struct in_addr gateway;
-    struct Interface ifc;
-    int undeleteable;
-    struct Routing_entry *next;
+    /**
+     * Number of the outgoing interface (see gifc), not a copy of it.
+     */
+    uint16_t ifc_num;
+    /**
+     * VRF whose routing table this entry is in (@e ifc_num may be in
+     * another VRF if the route leaks traffic into it).
+     */
+    uint16_t vrf;
+    uint8_t undeleteable;
 
 };
 
 
 _Pragma("pack(pop)")
 
+/**
+ * Whether fib_build() aggregates the routes (ORTC) by default.
+ */
+#ifndef FIB_AGGREGATE
+#define FIB_AGGREGATE 1
+#endif
+
+/**
+ * Next hop ID of a FIB node without a next hop of its own: the one of
+ * the closest ancestor that has one applies.
+ */
+#define FIB_INHERIT UINT32_MAX
+
+/**
+ * Node of the binary trie of a FIB.
+ */
+struct FibNode
+{
+    /**
+     * Children for the next address bit being 0 and 1, 0 if there is
+     * none (the root is node 0 and nobody's child).
+     */
+    uint32_t child[2];
+
+    /**
+     * Next hop ID for the destinations below this node, or #FIB_INHERIT.
+     */
+    uint32_t nh;
+};
+
+/**
+ * Forwarding table of a VRF, compiled from its routing table by
+ * fib_build(): a binary trie whose nodes refer to next hops by ID.
+ */
+struct Fib
+{
+    /**
+     * The trie, the root is at index 0.
+     */
+    struct FibNode *nodes;
+
+    /**
+     * Number of nodes in use.
+     */
+    unsigned int num_nodes;
+
+    /**
+     * Length of @e nodes.
+     */
+    unsigned int size_nodes;
+
+    /**
+     * Route to use for each next hop ID; it stands for all routes with
+     * the same next hop.  ID 0 is "no route" (NULL).
+     */
+    struct Routing_entry **nhs;
+
+    /**
+     * Number of next hop IDs in use.
+     */
+    unsigned int num_nhs;
+
+    /**
+     * Length of @e nhs.
+     */
+    unsigned int size_nhs;
+
+    /**
+     * Number of routes the FIB was built from.
+     */
+    unsigned int num_prefixes;
+
+    /**
+     * Number of nodes with a next hop of their own.
+     */
+    unsigned int num_entries;
+
+    /**
+     * Set when the routing table changed; the FIB is rebuilt on the
+     * next lookup.
+     */
+    int dirty;
+};
+
+/**
+ * Number of VRFs (routing table instances), numbered from 0.
+ */
+#ifndef NUM_VRFS
+#define NUM_VRFS 16
+#endif
+
+/**
+ * A VRF: routing table and neighbor (ARP) table for the interfaces
+ * assigned to it.  Interfaces without a VRF are in VRF 0.
+ */
+struct Vrf
+{
+    /**
+     * Routing table (list, ordered for "route list").
+     */
+    struct Routing_entry *routing_table;
+
+    /**
+     * Forwarding table compiled from @e routing_table, see lookup_rt().
+     */
+    struct Fib fib;
+
+    /**
+     * Number of valid entries in @e arp_cache.
+     */
+    size_t arp_cache_size;
+
+    /**
+     * Neighbors learned on the interfaces of this VRF.
+     */
+    struct ArpEntry arp_cache[ARP_CACHE_SIZE];
+};
+
+/**
+ * All VRFs, indexed by VRF number (no indirection on lookups).
+ */
+static struct Vrf vrfs[NUM_VRFS];
+
+/**
+ * Incremented whenever a route or ARP entry changes, invalidating
+ * the whole flow cache at once.
+ */
+static uint32_t fib_generation = 1;
+
 struct in_addr IP0;
 struct MacAddress NULL_ADDRESS = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 static struct Routing_entry* lookup_routing_entry_rt(struct Routing_entry looked_up_entry);
-static struct Routing_entry* lookup_rt(struct in_addr *ipv4);
+static struct Routing_entry* lookup_rt(uint16_t vrf, struct in_addr *ipv4);
 static void send_broadcast_APR(struct Interface *ifc, struct in_addr target_IP);
 static void learn_arp(struct in_addr ip, struct MacAddress mac, struct Interface ifc);
 static void handle_arp_request(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc);
 static void lookup_and_add_ARP(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc);
-static struct MacAddress lookup_ipv4_inARP (struct in_addr ip4);
-static int check_fragmentation(struct EthernetHeader *eh, struct IPv4Header *ip, struct Interface *ifc, void *payload, size_t payloadsize);
+static struct MacAddress lookup_ipv4_inARP (uint16_t vrf, struct in_addr ip4);
+static int check_fragmentation(const struct MacAddress *sender, struct IPv4Header *ip, struct Interface *ifc, uint16_t mtu, void *payload, size_t payloadsize);
 
 /**
  * compare method for 2 mac-addresses, taken from faq-sheet Prof. Grothoff & Prof. Wenger
@@ -360,10 +509,13 @@ int ipcomp (struct in_addr *ip1, struct in_addr *ip2 ){
     return memcmp(ip1, ip2, sizeof(struct in_addr));
 }
 
+/**
+ * Append @a mac to the output buffer (see print_flush()).
+ */
 static void
 print_mac (const struct MacAddress *mac)
 {
-    print ("%02x:%02x:%02x:%02x:%02x:%02x",
+    print_append ("%02x:%02x:%02x:%02x:%02x:%02x",
            mac->mac[0], mac->mac[1], mac->mac[2], mac->mac[3], mac->mac[4], mac->mac[5]);
 }
 
@@ -374,11 +526,14 @@ fprintf_mac (const struct MacAddress *mac)
            mac->mac[0], mac->mac[1], mac->mac[2], mac->mac[3], mac->mac[4], mac->mac[5]);
 }
 
+/**
+ * Append @a ip to the output buffer (see print_flush()).
+ */
 static void
 print_ip (const struct in_addr *ip)
 {
     char buf[INET_ADDRSTRLEN];
-    print("%s", inet_ntop(AF_INET, ip, buf, sizeof (buf)));
+    print_append ("%s", inet_ntop(AF_INET, ip, buf, sizeof (buf)));
 }
 
 static void
@@ -401,22 +556,22 @@ forward_to (struct Interface *dst,
             const void *frame,
             size_t frame_size)
 {
-    char iob[frame_size + sizeof (struct GLAB_MessageHeader)];
     struct GLAB_MessageHeader hdr;
+    struct iovec iov[2];
 
     if (frame_size > dst->mtu)
         abort ();
-    hdr.size = htons (sizeof (iob));
+    hdr.size = htons (frame_size + sizeof (hdr));
     hdr.type = htons (dst->ifc_num);
-    memcpy (iob,
-            &hdr,
-            sizeof (hdr));
-    memcpy (&iob[sizeof (hdr)],
-            frame,
-            frame_size);
-    write_all (STDOUT_FILENO,
-               iob,
-               sizeof (iob));
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof (hdr);
+    iov[1].iov_base = (void *) frame;
+    iov[1].iov_len = frame_size;
+    writev_all (STDOUT_FILENO,
+                iov,
+                2);
+    stats_tx (dst->ifc_num,
+              frame_size);
 }
 
 
@@ -436,8 +591,8 @@ forward_frame_payload_to (struct Interface *ifc,
                           const void *frame_payload,
                           size_t frame_payload_size)
 {
-
-    char frame[sizeof (struct EthernetHeader) + frame_payload_size];
+    struct PoolBuffer *pb = pool_get ();
+    unsigned char *frame;
     struct EthernetHeader eh;
 
     if (frame_payload_size + sizeof (struct EthernetHeader) > ifc->mtu)
@@ -445,6 +600,8 @@ forward_frame_payload_to (struct Interface *ifc,
     eh.dst = *target_ha;
     eh.src = ifc->mac;
     eh.tag = ntohs (tag);
+    frame = pool_put (pb,
+                      sizeof (eh) + frame_payload_size);
     memcpy (frame,
             &eh,
             sizeof (eh));
@@ -453,224 +610,2890 @@ forward_frame_payload_to (struct Interface *ifc,
             frame_payload_size);
     forward_to (ifc,
                 frame,
-                sizeof (frame));
+                pb->size);
+    pool_release (pb);
+}
+static int size_rt;
+
+
+/**
+ * Routing table entries.
+ */
+static struct Slab route_slab = SLAB_INIT (struct Routing_entry);
+
+
+struct Routing_entry* create_entry(struct Routing_entry *entry) {
+
+
+    struct Routing_entry* new_Routing_entry = slab_alloc(&route_slab);
+
+
+    if (NULL != new_Routing_entry){
+        new_Routing_entry->gateway = entry->gateway;
+        new_Routing_entry->network_target = entry->network_target;
+        new_Routing_entry->network_mask = entry->network_mask;
+        new_Routing_entry->ifc_num = entry->ifc_num;
+        new_Routing_entry->undeleteable = 0;
+        new_Routing_entry->next = NULL;
+        new_Routing_entry->nhg = NULL;
+        new_Routing_entry->vrf = entry->vrf;
+
+    }else {
+        exit(1);
+    }
+
+    return new_Routing_entry;
+}
+
+/**
+ * Hash buckets of a next-hop group; also the maximum number of
+ * equal-cost next hops per network.
+ */
+#ifndef ECMP_BUCKETS
+#define ECMP_BUCKETS 64
+#endif
+
+/**
+ * Equal-cost routes (one per next hop) to the same network.  Flows
+ * are hashed onto buckets, and each bucket is assigned to a member.
+ * When members join or leave only the buckets that have to move are
+ * reassigned (resilient hashing), so the other flows keep their path.
+ */
+struct NextHopGroup
+{
+    /**
+     * The routes of the group.
+     */
+    struct Routing_entry *members[ECMP_BUCKETS];
+
+    /**
+     * Number of valid entries in @e members.
+     */
+    unsigned int num_members;
+
+    /**
+     * Index into @e members for each bucket.
+     */
+    uint8_t buckets[ECMP_BUCKETS];
+};
+
+
+/**
+ * Next-hop groups.
+ */
+static struct Slab nhg_slab = SLAB_INIT (struct NextHopGroup);
+
+
+/**
+ * Add @a entry to the next hops of @a existing (a route to the same network).
+ *
+ * @param existing route already in the table
+ * @param entry new route
+ * @return 0 on success, -1 if the group is full
+ */
+static int
+nhg_join (struct Routing_entry *existing,
+          struct Routing_entry *entry)
+{
+    struct NextHopGroup *g = existing->nhg;
+    unsigned int load[ECMP_BUCKETS];
+    unsigned int share;
+    unsigned int taken = 0;
+
+    if (NULL == g) {
+        g = slab_alloc (&nhg_slab);
+        memset (g,
+                0,
+                sizeof (struct NextHopGroup));
+        g->members[0] = existing;
+        g->num_members = 1;
+        existing->nhg = g;
+    }
+    if (ECMP_BUCKETS == g->num_members)
+        return -1;
+    g->members[g->num_members++] = entry;
+    entry->nhg = g;
+    /* take a fair share of buckets from members above their share */
+    share = ECMP_BUCKETS / g->num_members;
+    memset (load,
+            0,
+            sizeof (load));
+    for (unsigned int b = 0; b < ECMP_BUCKETS; b++)
+        load[g->buckets[b]]++;
+    for (unsigned int b = 0; (b < ECMP_BUCKETS) && (taken < share); b++) {
+        uint8_t m = g->buckets[b];
+
+        if (load[m] > share) {
+            load[m]--;
+            g->buckets[b] = g->num_members - 1;
+            taken++;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Remove @a entry from its next-hop group (if any); its buckets go
+ * to the remaining members with the fewest buckets.
+ *
+ * @param entry route being removed from the table
+ */
+static void
+nhg_leave (struct Routing_entry *entry)
+{
+    struct NextHopGroup *g = entry->nhg;
+    unsigned int load[ECMP_BUCKETS];
+    unsigned int idx;
+    unsigned int last;
+
+    if (NULL == g)
+        return;
+    entry->nhg = NULL;
+    for (idx = 0; g->members[idx] != entry; idx++)
+        ;
+    last = g->num_members - 1;
+    memset (load,
+            0,
+            sizeof (load));
+    for (unsigned int b = 0; b < ECMP_BUCKETS; b++)
+        load[g->buckets[b]]++;
+    for (unsigned int b = 0; b < ECMP_BUCKETS; b++) {
+        unsigned int best = (0 == idx) ? 1 : 0;
+
+        if (g->buckets[b] != idx)
+            continue;
+        for (unsigned int m = 0; m <= last; m++)
+            if ( (m != idx) &&
+                 (load[m] < load[best]) )
+                best = m;
+        g->buckets[b] = best;
+        load[best]++;
+    }
+    /* move the last member into the free slot */
+    g->members[idx] = g->members[last];
+    for (unsigned int b = 0; b < ECMP_BUCKETS; b++)
+        if (g->buckets[b] == last)
+            g->buckets[b] = idx;
+    g->num_members--;
+    if (1 == g->num_members) {
+        g->members[0]->nhg = NULL;
+        slab_free (&nhg_slab,
+                   g);
+    }
+}
+
+
+/**
+ * Pick the next hop for a flow among the equal-cost routes of @a entry.
+ *
+ * @param entry route found for the destination
+ * @param hash flow hash, see flow_hash()
+ * @return route to use
+ */
+static struct Routing_entry *
+ecmp_select (struct Routing_entry *entry,
+             uint32_t hash)
+{
+    if (NULL == entry->nhg)
+        return entry;
+    return entry->nhg->members[entry->nhg->buckets[hash % ECMP_BUCKETS]];
+}
+
+
+/**
+ * Remove @a looked_up_entry from the routing table and free it.
+ *
+ * @param looked_up_entry entry to remove
+ */
+void delete_entry(struct Routing_entry *looked_up_entry) {
+
+    struct Routing_entry **pos;
+    for (pos = &vrfs[looked_up_entry->vrf].routing_table; NULL != *pos; pos = &(*pos)->next){
+        if (*pos == looked_up_entry) {
+            *pos = looked_up_entry->next;
+            nhg_leave(looked_up_entry);
+            vrfs[looked_up_entry->vrf].fib.dirty = 1;
+            slab_free(&route_slab, looked_up_entry);
+            fib_generation++;
+            return;
+        }
+
+    }
+}
+
+
+
+/**
+ * Adds a new entry to the routing table of VRF @a entry->vrf
+ * @param entry
+ * @return
+ */
+static struct Routing_entry*
+add_entry(struct Routing_entry *entry) {
+    struct Routing_entry *looked_up_entry = lookup_routing_entry_rt(*entry); //returns the value that is BEFORE the new entry in routing table
+    struct Routing_entry *new_entry = create_entry(entry); //create a new routing entry
+
+    fib_generation++;
+    vrfs[entry->vrf].fib.dirty = 1;
+    if (NULL == looked_up_entry) { //first entry of this VRF
+        vrfs[entry->vrf].routing_table = new_entry;
+    } else if(NULL == looked_up_entry->next) { //if there is only one entry so far, next entry is null
+            looked_up_entry->next = new_entry;
+    } else { //if there is so far more than 1 entry in routing table
+        new_entry->next = looked_up_entry->next;
+        looked_up_entry->next = new_entry;
+    }
+
+    /* another route to the same network: equal-cost multipath */
+    for (struct Routing_entry *iter = vrfs[entry->vrf].routing_table; NULL != iter; iter = iter->next) {
+        if ( (iter != new_entry) &&
+             (0 == ipcomp(&iter->network_target, &new_entry->network_target)) &&
+             (0 == ipcomp(&iter->network_mask, &new_entry->network_mask)) ) {
+            if (0 != nhg_join(iter, new_entry)) {
+                fprintf(stderr, "Too many next hops, ignoring route\n");
+                delete_entry(new_entry);
+                return NULL;
+            }
+            break;
+        }
+    }
+    return new_entry;
+}
+
+
+static int
+init_router() {
+
+    for(int i = 0; i<num_ifc; i++){
+        if (0 != gifc[i].ifc_num) {
+            struct Routing_entry entry;
+            entry.network_mask = gifc[i].netmask;
+            struct in_addr network_IP;
+            network_IP.s_addr = gifc[i].ip.s_addr & gifc[i].netmask.s_addr;
+            entry.network_target = network_IP;
+            entry.ifc_num = gifc[i].ifc_num;
+            entry.gateway = IP0;
+            entry.undeleteable=1;
+            entry.vrf = gifc[i].vrf;
+            add_entry(&entry);
+
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * ICMP errors one source may receive per second, and in a burst.
+ */
+#ifndef ICMP_SOURCE_RATE
+#define ICMP_SOURCE_RATE 10
+#endif
+#ifndef ICMP_SOURCE_BURST
+#define ICMP_SOURCE_BURST 10
+#endif
+
+/**
+ * ICMP errors the router sends per second (and in a burst) in total.
+ */
+#ifndef ICMP_GLOBAL_RATE
+#define ICMP_GLOBAL_RATE 100
+#endif
+#ifndef ICMP_GLOBAL_BURST
+#define ICMP_GLOBAL_BURST 100
+#endif
+
+/**
+ * Number of per-source token buckets; sources are hashed onto them,
+ * colliding sources share a bucket.
+ */
+#ifndef ICMP_SOURCE_BUCKETS
+#define ICMP_SOURCE_BUCKETS 256
+#endif
+
+/**
+ * Bytes of the original datagram's payload an ICMP error quotes
+ * after its IP header (RFC 792).
+ */
+#define ICMP_QUOTE_DATA 8
+
+/**
+ * Largest quote: IP header with the maximum of options, plus data.
+ */
+#define ICMP_QUOTE_MAX (15 * 4 + ICMP_QUOTE_DATA)
+
+_Pragma("pack(push)") _Pragma("pack(1)")
+
+/**
+ * Headers of an ICMP error frame, followed by the quote.
+ */
+struct IcmpErrorHeaders
+{
+    struct EthernetHeader eh;
+    struct IPv4Header ip;
+    struct IcmpHeader icmp;
+};
+
+_Pragma("pack(pop)")
+
+/**
+ * Prebuilt headers for the ICMP errors sent on one interface.
+ */
+struct IcmpTemplate
+{
+    /**
+     * Headers with everything but the destinations, lengths,
+     * ICMP type/code and checksums filled in.
+     */
+    struct IcmpErrorHeaders hdr;
+
+    /**
+     * Checksum sum over @e hdr.ip (with the fields left out as zero).
+     */
+    uint32_t ip_sum;
+};
+
+/**
+ * A token bucket; the tokens are kept as time credit in nanoseconds,
+ * one token costs 1s / rate.
+ */
+struct TokenBucket
+{
+    /**
+     * When did we last take from (or refill) this bucket.
+     */
+    uint64_t last;
+
+    /**
+     * Credit left at @e last.
+     */
+    uint64_t credit;
+};
+
+/**
+ * ICMP templates, indexed by interface number - 1.
+ */
+static struct IcmpTemplate *icmp_templates;
+
+/**
+ * Length of #icmp_templates.
+ */
+static unsigned int num_icmp_templates;
+
+/**
+ * Per-source buckets, see #ICMP_SOURCE_BUCKETS.
+ */
+static struct TokenBucket icmp_source_buckets[ICMP_SOURCE_BUCKETS];
+
+/**
+ * Bucket limiting all ICMP errors.
+ */
+static struct TokenBucket icmp_global_bucket;
+
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static uint64_t
+icmp_now ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC,
+                   &ts);
+    return ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+
+/**
+ * Take a token from @a tb, refilling it first.
+ *
+ * @param tb the bucket
+ * @param now current time (see icmp_now())
+ * @param rate tokens per second
+ * @param burst capacity of the bucket in tokens
+ * @return 0 on success, -1 if the bucket is empty
+ */
+static int
+token_bucket_take (struct TokenBucket *tb,
+                   uint64_t now,
+                   uint64_t rate,
+                   uint64_t burst)
+{
+    uint64_t cost = 1000000000LLU / rate;
+    uint64_t credit = tb->credit + (now - tb->last);
+
+    if (credit > cost * burst)
+        credit = cost * burst; /* also fills a new bucket */
+    tb->last = now;
+    if (credit < cost) {
+        tb->credit = credit;
+        return -1;
+    }
+    tb->credit = credit - cost;
+    return 0;
+}
+
+
+/**
+ * Hash an IPv4 address (for the ICMP buckets and the local addresses).
+ *
+ * @param ip the address
+ * @return hash value
+ */
+static uint32_t
+ipv4_hash (const struct in_addr *ip)
+{
+    const uint8_t *b = (const uint8_t *) &ip->s_addr;
+    uint32_t h = 2166136261u;
+
+    for (unsigned int i = 0; i < sizeof (ip->s_addr); i++)
+        h = (h ^ b[i]) * 16777619u;
+    return h ^ (h >> 16);
+}
+
+
+/**
+ * (Re)build the ICMP template of @a ifc, after its MAC or IP changed.
+ *
+ * @param ifc the interface
+ */
+static void
+icmp_template_init (const struct Interface *ifc)
+{
+    struct IcmpTemplate *t;
+
+    grow_array (&icmp_templates,
+                sizeof (struct IcmpTemplate),
+                &num_icmp_templates,
+                ifc->ifc_num);
+    t = &icmp_templates[ifc->ifc_num - 1];
+    memset (t,
+            0,
+            sizeof (*t));
+    t->hdr.eh.src = ifc->mac;
+    t->hdr.eh.tag = htons (ETH_P_IPV4);
+    t->hdr.ip.version = 4;
+    t->hdr.ip.header_length = sizeof (struct IPv4Header) / 4;
+    t->hdr.ip.ttl = 64; /* recommended initial value for ttl */
+    t->hdr.ip.protocol = IPPROTO_ICMP;
+    t->hdr.ip.source_address = ifc->ip;
+    t->ip_sum = GNUNET_CRYPTO_crc16_step (0,
+                                          &t->hdr.ip,
+                                          sizeof (t->hdr.ip));
+}
+
+
+/**
+ * Check if RFC 1812 (4.3.2.7) allows an ICMP error about a datagram.
+ *
+ * @param ip header of the datagram
+ * @param payload its payload (after the 20-byte header)
+ * @param payload_size number of bytes in @a payload
+ * @return 1 if allowed
+ */
+static int
+icmp_error_allowed (const struct IPv4Header *ip,
+                    const uint8_t *payload,
+                    size_t payload_size)
+{
+    size_t options = 4 * ip->header_length - sizeof (struct IPv4Header);
+    uint32_t src = ntohl (ip->source_address.s_addr);
+    uint32_t dst = ntohl (ip->destination_address.s_addr);
+
+    if (0 != (ntohs (ip->fragmentation_info) & 0x1FFF))
+        return 0; /* not the first fragment */
+    if ( (0 == src) ||
+         (0x7F == (src >> 24)) ||
+         (0xE0 <= (src >> 24)) ||
+         (0xE0 <= (dst >> 24) && 0xF0 > (dst >> 24)) ||
+         (UINT32_MAX == dst) )
+        return 0; /* not from a unicast host, or not to one */
+    if ( (IPPROTO_ICMP == ip->protocol) &&
+         (payload_size > options) )
+    {
+        switch (payload[options])
+        {
+        case 3: /* destination unreachable */
+        case 4: /* source quench */
+        case 5: /* redirect */
+        case 11: /* time exceeded */
+        case 12: /* parameter problem */
+            return 0; /* never answer an error with an error */
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Send an ICMP error about the datagram @a ip / @a payload back to its
+ * sender, unless it is rate limited.
+ *
+ * @param ifc interface we received the datagram on
+ * @param sender MAC address the datagram came from
+ * @param type ICMP type
+ * @param code ICMP code
+ * @param mtu next-hop MTU for #ICMPCODE_FRAGMENTATION_REQUIRED, otherwise 0
+ * @param ip header of the datagram
+ * @param payload its payload (after the 20-byte header)
+ * @param payload_size number of bytes in @a payload
+ */
+static void
+icmp_send_error (struct Interface *ifc,
+                 const struct MacAddress *sender,
+                 uint8_t type,
+                 uint8_t code,
+                 uint16_t mtu,
+                 const struct IPv4Header *ip,
+                 const void *payload,
+                 size_t payload_size)
+{
+    unsigned char frame[sizeof (struct IcmpErrorHeaders) + ICMP_QUOTE_MAX];
+    struct IcmpErrorHeaders *h = (struct IcmpErrorHeaders *) frame;
+    size_t quote = 4 * ip->header_length - sizeof (struct IPv4Header) + ICMP_QUOTE_DATA;
+    uint32_t sum;
+    uint64_t now;
+
+    if ( (ifc->ifc_num > num_icmp_templates) ||
+         (! icmp_error_allowed (ip,
+                                payload,
+                                payload_size)) ) {
+        stats.icmp_suppressed++;
+        return;
+    }
+    now = icmp_now ();
+    if ( (0 != token_bucket_take (&icmp_source_buckets[ipv4_hash (&ip->source_address) % ICMP_SOURCE_BUCKETS],
+                                  now,
+                                  ICMP_SOURCE_RATE,
+                                  ICMP_SOURCE_BURST)) ||
+         (0 != token_bucket_take (&icmp_global_bucket,
+                                  now,
+                                  ICMP_GLOBAL_RATE,
+                                  ICMP_GLOBAL_BURST)) ) {
+        stats.icmp_suppressed++;
+        return;
+    }
+    if (quote > payload_size)
+        quote = payload_size;
+    if (quote > ICMP_QUOTE_MAX - sizeof (struct IPv4Header))
+        quote = ICMP_QUOTE_MAX - sizeof (struct IPv4Header);
+
+    memcpy (h,
+            &icmp_templates[ifc->ifc_num - 1].hdr,
+            sizeof (*h));
+    h->eh.dst = *sender;
+    h->ip.total_length = htons (sizeof (h->ip) + sizeof (h->icmp) + sizeof (*ip) + quote);
+    h->ip.destination_address = ip->source_address;
+    sum = icmp_templates[ifc->ifc_num - 1].ip_sum;
+    sum = GNUNET_CRYPTO_crc16_step (sum,
+                                    &h->ip.total_length,
+                                    sizeof (h->ip.total_length));
+    sum = GNUNET_CRYPTO_crc16_step (sum,
+                                    &h->ip.destination_address,
+                                    sizeof (h->ip.destination_address));
+    h->ip.checksum = GNUNET_CRYPTO_crc16_finish (sum);
+
+    h->icmp.type = type;
+    h->icmp.code = code;
+    h->icmp.quench.destination_unreachable.next_hop_mtu = htons (mtu);
+    memcpy (&frame[sizeof (*h)],
+            ip,
+            sizeof (*ip));
+    memcpy (&frame[sizeof (*h) + sizeof (*ip)],
+            payload,
+            quote);
+    h->icmp.crc = GNUNET_CRYPTO_crc16_n (&h->icmp,
+                                         sizeof (h->icmp) + sizeof (*ip) + quote);
+
+    forward_to (ifc,
+                frame,
+                sizeof (*h) + sizeof (*ip) + quote);
+    stats.icmp_generated++;
+}
+
+/**
+ * Address of one of our interfaces, in the VRF of the interface.
+ */
+struct LocalAddr
+{
+    struct in_addr ip;
+    uint16_t vrf;
+};
+
+/**
+ * Set of the addresses of our interfaces (open addressing, linear
+ * probing), 0.0.0.0 marks a free slot.
+ */
+static struct LocalAddr *local_addrs;
+
+/**
+ * Number of slots in #local_addrs, a power of two (or 0).
+ */
+static unsigned int num_local_addrs;
+
+
+/**
+ * Rebuild #local_addrs from the interfaces, after an interface
+ * was configured, added or removed.
+ */
+static void
+local_addr_rebuild ()
+{
+    unsigned int size = 16;
+
+    while (size < 2 * num_ifc)
+        size *= 2;
+    free (local_addrs);
+    local_addrs = calloc (size,
+                          sizeof (struct LocalAddr));
+    if (NULL == local_addrs)
+        abort ();
+    num_local_addrs = size;
+    for (unsigned int i = 0; i < num_ifc; i++) {
+        uint32_t h;
+
+        if ( (0 == gifc[i].ifc_num) ||
+             (0 == gifc[i].ip.s_addr) )
+            continue;
+        h = ipv4_hash (&gifc[i].ip) + gifc[i].vrf;
+        while (0 != local_addrs[h & (size - 1)].ip.s_addr)
+            h++;
+        local_addrs[h & (size - 1)].ip = gifc[i].ip;
+        local_addrs[h & (size - 1)].vrf = gifc[i].vrf;
+    }
+}
+
+
+/**
+ * Is @a ip the address of one of our interfaces in @a vrf?
+ *
+ * @param vrf VRF the packet arrived in
+ * @param ip address to check
+ * @return 1 if so
+ */
+static int
+local_addr_lookup (uint16_t vrf,
+                   const struct in_addr *ip)
+{
+    uint32_t h;
+
+    if (0 == num_local_addrs)
+        return 0;
+    h = ipv4_hash (ip) + vrf;
+    while (1) {
+        const struct LocalAddr *pos = &local_addrs[h & (num_local_addrs - 1)];
+
+        if (0 == pos->ip.s_addr)
+            return 0;
+        if ( (ip->s_addr == pos->ip.s_addr) &&
+             (vrf == pos->vrf) )
+            return 1;
+        h++;
+    }
+}
+
+
+/**
+ * Turn the ICMP echo request in @a frame into the reply, in place:
+ * swap the addresses, reset the TTL, change the type and update both
+ * checksums incrementally (RFC 1624).  Checksum errors in the request
+ * carry over into the reply, so the sender still detects them.
+ *
+ * @param frame Ethernet frame with an IPv4 packet, modified
+ * @param frame_size number of bytes in @a frame
+ * @return size of the reply (without Ethernet padding), 0 if @a frame
+ *         is not a (well-formed) echo request
+ */
+static size_t
+icmp_echo_reply_in_place (void *frame,
+                          size_t frame_size)
+{
+    uint8_t *f = frame;
+    struct EthernetHeader *eh = (struct EthernetHeader *) f;
+    struct IPv4Header *ip = (struct IPv4Header *) &f[sizeof (struct EthernetHeader)];
+    struct IcmpHeader *icmp;
+    size_t hlen;
+    size_t tlen;
+    uint8_t old[2];
+    struct in_addr addr;
+    struct MacAddress mac;
+
+    if (frame_size < sizeof (*eh) + sizeof (*ip))
+        return 0;
+    hlen = 4 * ip->header_length;
+    tlen = ntohs (ip->total_length);
+    if ( (IPPROTO_ICMP != ip->protocol) ||
+         (hlen < sizeof (*ip)) ||
+         (tlen < hlen + sizeof (*icmp)) ||
+         (sizeof (*eh) + tlen > frame_size) ||
+         (0 != (ntohs (ip->fragmentation_info) & 0x3FFF)) )
+        return 0; /* not ICMP, malformed or fragmented */
+    icmp = (struct IcmpHeader *) &f[sizeof (*eh) + hlen];
+    if ( (ICMPTYPE_ECHO_REQUEST != icmp->type) ||
+         (0 != icmp->code) )
+        return 0;
+
+    mac = eh->dst;
+    eh->dst = eh->src;
+    eh->src = mac;
+    /* swapping does not change the sum */
+    addr = ip->source_address;
+    ip->source_address = ip->destination_address;
+    ip->destination_address = addr;
+    memcpy (old,
+            &ip->ttl,
+            sizeof (old));
+    ip->ttl = 64; /* recommended initial value for ttl */
+    ip->checksum = GNUNET_CRYPTO_crc16_update (ip->checksum,
+                                               old,
+                                               &ip->ttl,
+                                               sizeof (old));
+    memcpy (old,
+            &icmp->type,
+            sizeof (old));
+    icmp->type = ICMPTYPE_ECHO_REPLY;
+    icmp->crc = GNUNET_CRYPTO_crc16_update (icmp->crc,
+                                            old,
+                                            &icmp->type,
+                                            sizeof (old));
+    return sizeof (*eh) + tlen;
+}
+
+
+/**
+ * Handle a packet for one of our own addresses: answer pings, drop
+ * everything else.
+ *
+ * @param ifc interface we received @a frame on
+ * @param frame the frame, the reply is built in it
+ * @param frame_size number of bytes in @a frame
+ */
+static void
+deliver_local (struct Interface *ifc,
+               void *frame,
+               size_t frame_size)
+{
+    const struct IPv4Header *ip = (const struct IPv4Header *) &((uint8_t *) frame)[sizeof (struct EthernetHeader)];
+    size_t hlen = 4 * ip->header_length;
+    size_t reply_size;
+
+    if ( (hlen < sizeof (struct IPv4Header)) ||
+         (sizeof (struct EthernetHeader) + hlen > frame_size) ) {
+        stats_drop (DROP_MALFORMED);
+        return;
+    }
+    if (0 != GNUNET_CRYPTO_crc16_n (ip,
+                                    hlen)) {
+        stats_drop (DROP_CHECKSUM);
+        return;
+    }
+    reply_size = icmp_echo_reply_in_place (frame,
+                                           frame_size);
+    if (0 == reply_size) {
+        stats_drop (DROP_UNSUPPORTED);
+        return;
+    }
+    if (reply_size > ifc->mtu) {
+        stats_drop (DROP_TOO_LARGE);
+        return;
+    }
+    ((struct EthernetHeader *) frame)->src = ifc->mac;
+    forward_to (ifc,
+                frame,
+                reply_size);
+}
+
+/**
+ * checkup whether there are other entries with the same network target. These entries have to be ordered by the size of their networkmasks within
+ * their blocks with the same network targets. This function will return the entry that is before the new entry given as parameter
+ * @param looked_up_entry a new entry that will be added
+ * @return an entry that has to be placed before new entry according to an ascending order in terms of network mask
+ */
+static struct Routing_entry*
+lookup_routing_entry_rt(struct Routing_entry looked_up_entry) {
+    struct Routing_entry *iter = vrfs[looked_up_entry.vrf].routing_table;
+    struct Routing_entry *saved_value = iter;
+
+    for (iter; NULL != iter; iter = iter->next){
+        if (0 == ipcomp(&iter->network_target, &looked_up_entry.network_target)) { //has the entry the same network target
+            int val_looked_up = looked_up_entry.network_mask.s_addr;
+            int val_iter = iter->network_mask.s_addr;
+            if  (val_looked_up > val_iter) { //lookup whether the net mask of the new entry is smaller than the net mask of the entry currently looked at
+                return saved_value;
+            }
+            saved_value = iter; //save this entry of the same network target
+        }
+    }
+
+    return saved_value;
+}
+
+static struct Routing_entry*
+lookup_rt_for_del(uint16_t vrf, struct in_addr target_network, struct in_addr target_netmask, struct in_addr next_hop, struct Interface *ifc) {
+    struct Routing_entry *iter = vrfs[vrf].routing_table;
+    for (iter; NULL != iter; iter = iter->next){
+        if (0 == ipcomp(&iter->network_target, &target_network) && (0 == ipcomp(&iter->network_mask, &target_netmask))){
+            if ((0 == iter->undeleteable) && (0 == ipcomp(&iter->gateway, &next_hop))) {
+                return iter;
+            }
+        }
+    }
+    return NULL;
+
+}
+
+
+/**
+ * Aggregate routes with the same next hop when building a FIB.
+ */
+static int fib_aggregate = FIB_AGGREGATE;
+
+
+/**
+ * Append a node without children and next hop to @a fib.
+ *
+ * @param fib FIB to grow
+ * @return index of the new node
+ */
+static uint32_t
+fib_new_node (struct Fib *fib)
+{
+    struct FibNode *node;
+
+    grow_array (&fib->nodes,
+                sizeof (struct FibNode),
+                &fib->size_nodes,
+                fib->num_nodes + 1);
+    node = &fib->nodes[fib->num_nodes];
+    node->child[0] = 0;
+    node->child[1] = 0;
+    node->nh = FIB_INHERIT;
+    return fib->num_nodes++;
+}
+
+
+/**
+ * Do @a a and @a b forward the same way?  Equal-cost routes are only
+ * equal to the routes of the same group.
+ */
+static int
+fib_same_next_hop (const struct Routing_entry *a,
+                   const struct Routing_entry *b)
+{
+    if ( (NULL != a->nhg) ||
+         (NULL != b->nhg) )
+        return a->nhg == b->nhg;
+    return (a->gateway.s_addr == b->gateway.s_addr) &&
+        (a->ifc_num == b->ifc_num);
+}
+
+
+/**
+ * Find the next hop ID of @a re, adding it to @a fib if it is new.
+ *
+ * @param fib FIB being built
+ * @param slots hash table of next hop IDs (0 for free slots)
+ * @param num_slots length of @a slots, a power of 2
+ * @param re route
+ * @return next hop ID
+ */
+static uint32_t
+fib_next_hop (struct Fib *fib,
+              uint32_t *slots,
+              uint32_t num_slots,
+              struct Routing_entry *re)
+{
+    struct in_addr gateway = re->gateway; /* the route is packed */
+    uint32_t h;
+
+    if (NULL != re->nhg)
+        h = (uint32_t) ((uintptr_t) re->nhg >> 4) * 2654435761u;
+    else
+        h = ipv4_hash (&gateway) + re->ifc_num * 2654435761u;
+    for (h &= num_slots - 1; 0 != slots[h]; h = (h + 1) & (num_slots - 1))
+        if (fib_same_next_hop (fib->nhs[slots[h]],
+                               re))
+            return slots[h];
+    grow_array (&fib->nhs,
+                sizeof (struct Routing_entry *),
+                &fib->size_nhs,
+                fib->num_nhs + 1);
+    fib->nhs[fib->num_nhs] = re;
+    slots[h] = fib->num_nhs;
+    return fib->num_nhs++;
+}
+
+
+/**
+ * Add the prefix of @a re with next hop @a nh to the trie of @a fib.
+ */
+static void
+fib_insert (struct Fib *fib,
+            const struct Routing_entry *re,
+            uint32_t nh)
+{
+    uint32_t addr = ntohl (re->network_target.s_addr);
+    unsigned int len = __builtin_popcount (re->network_mask.s_addr);
+    uint32_t n = 0;
+
+    for (unsigned int bit = 0; bit < len; bit++) {
+        unsigned int b = (addr >> (31 - bit)) & 1;
+
+        if (0 == fib->nodes[n].child[b]) {
+            uint32_t c = fib_new_node (fib);
+
+            fib->nodes[n].child[b] = c;
+        }
+        n = fib->nodes[n].child[b];
+    }
+    if (FIB_INHERIT == fib->nodes[n].nh) /* the first of equal-cost routes, as in the list */
+        fib->nodes[n].nh = nh;
+}
+
+
+/**
+ * Next hop sets of the trie nodes during aggregation (ORTC).
+ */
+struct FibSets
+{
+    /**
+     * Sorted next hop IDs of all sets.
+     */
+    uint32_t *ids;
+
+    /**
+     * Number of IDs used in @e ids.
+     */
+    unsigned int num_ids;
+
+    /**
+     * Length of @e ids.
+     */
+    unsigned int size_ids;
+
+    /**
+     * Start of the set of each node in @e ids.
+     */
+    uint32_t *off;
+
+    /**
+     * Length of the set of each node.
+     */
+    uint32_t *len;
+};
+
+
+/**
+ * Give node @a n of @a fib either no children or two (ORTC pass 1):
+ * a missing child is added without a next hop, so it inherits.
+ */
+static void
+fib_ortc_complete (struct Fib *fib,
+                   uint32_t n)
+{
+    if ( (0 == fib->nodes[n].child[0]) &&
+         (0 == fib->nodes[n].child[1]) )
+        return;
+    for (unsigned int b = 0; b < 2; b++) {
+        if (0 == fib->nodes[n].child[b]) {
+            uint32_t c = fib_new_node (fib);
+
+            fib->nodes[n].child[b] = c;
+        }
+        fib_ortc_complete (fib,
+                           fib->nodes[n].child[b]);
+    }
+}
+
+
+/**
+ * Compute the next hop set of node @a n (ORTC pass 2): a leaf has the
+ * next hop that applies to it, an inner node the intersection of the
+ * sets of its children, or their union if they have nothing in common.
+ *
+ * @param fib FIB being aggregated
+ * @param sets where the sets go
+ * @param n node
+ * @param nh next hop applying at the parent of @a n
+ */
+static void
+fib_ortc_sets (const struct Fib *fib,
+               struct FibSets *sets,
+               uint32_t n,
+               uint32_t nh)
+{
+    const struct FibNode *node = &fib->nodes[n];
+    uint32_t c0 = node->child[0];
+    uint32_t c1 = node->child[1];
+    uint32_t i;
+    uint32_t j;
+    uint32_t k;
+
+    if (FIB_INHERIT != node->nh)
+        nh = node->nh;
+    if (0 == c0) {
+        grow_array (&sets->ids,
+                    sizeof (uint32_t),
+                    &sets->size_ids,
+                    sets->num_ids + 1);
+        sets->off[n] = sets->num_ids;
+        sets->len[n] = 1;
+        sets->ids[sets->num_ids++] = nh;
+        return;
+    }
+    fib_ortc_sets (fib, sets, c0, nh);
+    fib_ortc_sets (fib, sets, c1, nh);
+    grow_array (&sets->ids,
+                sizeof (uint32_t),
+                &sets->size_ids,
+                sets->num_ids + sets->len[c0] + sets->len[c1]);
+    const uint32_t *a = &sets->ids[sets->off[c0]];
+    const uint32_t *b = &sets->ids[sets->off[c1]];
+    uint32_t *r = &sets->ids[sets->num_ids];
+
+    /* intersection */
+    for (i = 0, j = 0, k = 0; (i < sets->len[c0]) && (j < sets->len[c1]); ) {
+        if (a[i] < b[j])
+            i++;
+        else if (a[i] > b[j])
+            j++;
+        else {
+            r[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    if (0 == k) {
+        /* union */
+        for (i = 0, j = 0; (i < sets->len[c0]) || (j < sets->len[c1]); ) {
+            if ( (j == sets->len[c1]) ||
+                 ( (i < sets->len[c0]) && (a[i] < b[j]) ) )
+                r[k++] = a[i++];
+            else if ( (i == sets->len[c0]) ||
+                      (b[j] < a[i]) )
+                r[k++] = b[j++];
+            else {
+                r[k++] = a[i];
+                i++;
+                j++;
+            }
+        }
+    }
+    sets->off[n] = sets->num_ids;
+    sets->len[n] = k;
+    sets->num_ids += k;
+}
+
+
+/**
+ * Choose the next hops (ORTC pass 3): node @a n needs one of its own
+ * only if the one inherited is not in its set.  Leaves left without a
+ * next hop are removed.
+ *
+ * @param fib FIB being aggregated
+ * @param sets the sets from fib_ortc_sets()
+ * @param n node
+ * @param nh next hop applying at the parent of @a n
+ */
+static void
+fib_ortc_assign (struct Fib *fib,
+                 const struct FibSets *sets,
+                 uint32_t n,
+                 uint32_t nh)
+{
+    struct FibNode *node = &fib->nodes[n];
+    const uint32_t *set = &sets->ids[sets->off[n]];
+
+    node->nh = set[0];
+    for (uint32_t i = 0; i < sets->len[n]; i++)
+        if (set[i] == nh)
+            node->nh = FIB_INHERIT;
+    if (FIB_INHERIT != node->nh)
+        nh = node->nh;
+    for (unsigned int b = 0; b < 2; b++) {
+        uint32_t c = node->child[b];
+
+        if (0 == c)
+            continue;
+        fib_ortc_assign (fib, sets, c, nh);
+        if ( (0 == fib->nodes[c].child[0]) &&
+             (0 == fib->nodes[c].child[1]) &&
+             (FIB_INHERIT == fib->nodes[c].nh) )
+            node->child[b] = 0;
+    }
+}
+
+
+/**
+ * Copy the nodes of @a from reachable from node @a n to @a to,
+ * counting those with a next hop.
+ *
+ * @return index of the copy of @a n in @a to
+ */
+static uint32_t
+fib_copy (struct Fib *to,
+          const struct Fib *from,
+          uint32_t n)
+{
+    uint32_t copy = fib_new_node (to);
+
+    to->nodes[copy].nh = from->nodes[n].nh;
+    if (FIB_INHERIT != from->nodes[n].nh)
+        to->num_entries++;
+    for (unsigned int b = 0; b < 2; b++) {
+        if (0 != from->nodes[n].child[b]) {
+            uint32_t c = fib_copy (to, from, from->nodes[n].child[b]);
+
+            to->nodes[copy].child[b] = c;
+        }
+    }
+    return copy;
+}
+
+
+/**
+ * Replace the trie of @a fib with an equivalent one with the fewest
+ * entries possible (Optimal Routing Table Constructor, Draves et al.,
+ * 1999): prefixes with the same next hop as the shorter prefix they
+ * are in are dropped, and siblings with the same next hop are merged.
+ *
+ * @param fib FIB to aggregate
+ */
+static void
+fib_ortc (struct Fib *fib)
+{
+    struct FibSets sets;
+    struct Fib compact;
+
+    fib_ortc_complete (fib,
+                       0);
+    memset (&sets,
+            0,
+            sizeof (sets));
+    sets.off = malloc (fib->num_nodes * sizeof (uint32_t));
+    sets.len = malloc (fib->num_nodes * sizeof (uint32_t));
+    if ( (NULL == sets.off) ||
+         (NULL == sets.len) )
+        abort ();
+    fib_ortc_sets (fib, &sets, 0, 0);
+    fib_ortc_assign (fib, &sets, 0, 0);
+    free (sets.ids);
+    free (sets.off);
+    free (sets.len);
+    /* the removed nodes are still in the array, copy the others */
+    memset (&compact,
+            0,
+            sizeof (compact));
+    fib_copy (&compact,
+              fib,
+              0);
+    free (fib->nodes);
+    fib->nodes = compact.nodes;
+    fib->num_nodes = compact.num_nodes;
+    fib->size_nodes = compact.size_nodes;
+    fib->num_entries = compact.num_entries;
+}
+
+
+/**
+ * Compile the routing table of VRF @a vrf into its FIB.
+ *
+ * @param vrf the VRF
+ */
+static void
+fib_build (uint16_t vrf)
+{
+    struct Fib *fib = &vrfs[vrf].fib;
+    uint32_t *slots;
+    uint32_t num_slots = 16;
+
+    fib->num_prefixes = 0;
+    for (struct Routing_entry *iter = vrfs[vrf].routing_table; NULL != iter; iter = iter->next)
+        fib->num_prefixes++;
+    while (num_slots < 2 * fib->num_prefixes)
+        num_slots *= 2;
+    slots = calloc (num_slots,
+                    sizeof (uint32_t));
+    if (NULL == slots)
+        abort ();
+    fib->num_nodes = 0;
+    fib->num_nhs = 0;
+    fib->num_entries = 0;
+    grow_array (&fib->nhs,
+                sizeof (struct Routing_entry *),
+                &fib->size_nhs,
+                1);
+    fib->nhs[fib->num_nhs++] = NULL; /* no route */
+    fib_new_node (fib);
+    for (struct Routing_entry *iter = vrfs[vrf].routing_table; NULL != iter; iter = iter->next) {
+        if ( (iter->network_target.s_addr & iter->network_mask.s_addr) != iter->network_target.s_addr)
+            continue; /* host bits set, never matches */
+        fib_insert (fib,
+                    iter,
+                    fib_next_hop (fib,
+                                  slots,
+                                  num_slots,
+                                  iter));
+    }
+    free (slots);
+    if (fib_aggregate) {
+        fib_ortc (fib);
+    } else {
+        for (unsigned int n = 0; n < fib->num_nodes; n++)
+            if (FIB_INHERIT != fib->nodes[n].nh)
+                fib->num_entries++;
+    }
+    fib->dirty = 0;
+}
+
+
+/**
+ * Memory used by the routes and the FIB of VRF @a vrf.
+ *
+ * @param vrf the VRF
+ * @param rib[out] set to the bytes of the routing table
+ * @param fib[out] set to the bytes of the FIB
+ */
+static void
+fib_memory (uint16_t vrf,
+            size_t *rib,
+            size_t *fib)
+{
+    const struct Fib *f = &vrfs[vrf].fib;
+
+    *rib = 0;
+    for (struct Routing_entry *iter = vrfs[vrf].routing_table; NULL != iter; iter = iter->next)
+        *rib += route_slab.elem_size;
+    *fib = f->num_nodes * sizeof (struct FibNode)
+        + f->num_nhs * sizeof (struct Routing_entry *);
+}
+
+
+/**
+ * Find the route with the longest prefix matching @a ipv4, rebuilding
+ * the FIB first if the routing table changed.  With aggregation the
+ * route found may be another one with the same next hop.
+ *
+ * @param vrf routing table instance to search
+ * @param ipv4 destination address
+ * @return NULL if no route matches (not even a default route)
+ */
+static struct Routing_entry*
+lookup_rt(uint16_t vrf, struct in_addr *ipv4) {
+    struct Fib *fib = &vrfs[vrf].fib;
+    uint32_t addr = ntohl(ipv4->s_addr);
+    uint32_t nh = 0;
+    uint32_t n = 0;
+
+    if (fib->dirty || (0 == fib->num_nodes))
+        fib_build(vrf);
+    for (unsigned int bit = 0; ; bit++) {
+        const struct FibNode *node = &fib->nodes[n];
+
+        if (FIB_INHERIT != node->nh)
+            nh = node->nh;
+        if (32 == bit)
+            break;
+        n = node->child[(addr >> (31 - bit)) & 1];
+        if (0 == n)
+            break;
+    }
+    return fib->nhs[nh];
+}
+
+
+/**
+ * Hash the flow of an IPv4 packet (addresses, protocol and for TCP
+ * and UDP the ports) to pick its next hop.  Fragments are hashed
+ * without ports, so that all fragments take the same path.
+ *
+ * @param ip IP header
+ * @param payload IP packet payload (after the 20-byte header)
+ * @param payload_size number of bytes in @a payload
+ * @return flow hash
+ */
+static uint32_t
+flow_hash (const struct IPv4Header *ip,
+           const uint8_t *payload,
+           size_t payload_size)
+{
+    struct {
+        struct in_addr src;
+        struct in_addr dst;
+        uint16_t sport;
+        uint16_t dport;
+        uint8_t protocol;
+    } __attribute__ ((packed)) key;
+    size_t options = 4 * ip->header_length - sizeof (struct IPv4Header);
+
+    memset (&key,
+            0,
+            sizeof (key));
+    key.src = ip->source_address;
+    key.dst = ip->destination_address;
+    key.protocol = ip->protocol;
+    if ( ( (IPPROTO_TCP == ip->protocol) ||
+           (IPPROTO_UDP == ip->protocol) ) &&
+         (0 == (ntohs (ip->fragmentation_info) & 0x3FFF)) &&
+         (payload_size >= options + 4) )
+        memcpy (&key.sport,
+                &payload[options],
+                4);
+    return GNUNET_CRYPTO_crc32c_n (&key,
+                                   sizeof (key));
+}
+
+
+/**
+ * Packet fields ACL rules match on, in network byte order.
+ */
+struct AclKey
+{
+    struct in_addr src;
+    struct in_addr dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t protocol;
+} __attribute__ ((packed));
+
+
+/**
+ * Rule of an ACL.  Rules are evaluated in the order of their sequence
+ * numbers, the first matching rule decides.
+ */
+struct AclRule
+{
+    /**
+     * Next rule of the ACL (by sequence number).
+     */
+    struct AclRule *next;
+
+    /**
+     * Next rule in the same hash bucket of its tuple (by sequence number).
+     */
+    struct AclRule *chain;
+
+    /**
+     * Fields to match, masked as in the tuple of the rule.
+     */
+    struct AclKey key;
+
+    /**
+     * Port ranges to match (host byte order, inclusive), 0-65535 for any.
+     */
+    uint16_t sport_lo;
+    uint16_t sport_hi;
+    uint16_t dport_lo;
+    uint16_t dport_hi;
+
+    /**
+     * Prefix lengths of @e key.src and @e key.dst.
+     */
+    uint8_t src_len;
+    uint8_t dst_len;
+
+    /**
+     * 1 to match any protocol, otherwise @e key.protocol must match.
+     */
+    uint8_t any_protocol;
+
+    /**
+     * 1 to allow matching packets, 0 to deny them.
+     */
+    uint8_t allow;
+
+    /**
+     * Sequence number, lower numbers are evaluated first.
+     */
+    uint32_t seq;
+
+    /**
+     * Number of packets this rule decided on.
+     */
+    uint64_t hits;
+};
+
+
+/**
+ * ACL rules of all interfaces.
+ */
+static struct Slab acl_rule_slab = SLAB_INIT (struct AclRule);
+
+
+/**
+ * Rules with the same prefix lengths and the same fields matched
+ * exactly, in a hash table over the masked fields (tuple space search).
+ */
+struct AclTuple
+{
+    /**
+     * Masks for the addresses.
+     */
+    struct in_addr src_mask;
+    struct in_addr dst_mask;
+
+    /**
+     * Prefix lengths.
+     */
+    uint8_t src_len;
+    uint8_t dst_len;
+
+    /**
+     * Whether the protocol and the (single) source / destination port
+     * are part of the hash key.  Port ranges are checked per rule.
+     */
+    uint8_t match_protocol;
+    uint8_t match_sport;
+    uint8_t match_dport;
+
+    /**
+     * Lowest sequence number of the rules in the tuple.
+     */
+    uint32_t min_seq;
+
+    /**
+     * Number of rules in the tuple.
+     */
+    unsigned int num_rules;
+
+    /**
+     * Number of hash buckets, a power of two.
+     */
+    unsigned int num_buckets;
+
+    /**
+     * Hash buckets, the chains are sorted by sequence number.
+     */
+    struct AclRule **buckets;
+};
+
+
+/**
+ * ACL of one interface in one direction.
+ */
+struct Acl
+{
+    /**
+     * All rules, sorted by sequence number.
+     */
+    struct AclRule *rules;
+
+    /**
+     * Last rule in @e rules, rules are usually appended.
+     */
+    struct AclRule *last;
+
+    /**
+     * Tuples, sorted by their lowest sequence number so the search
+     * can stop once no tuple can have a better match.
+     */
+    struct AclTuple *tuples;
+
+    unsigned int num_tuples;
+
+    unsigned int num_rules;
+};
+
+
+/**
+ * Direction of an ACL.
+ */
+enum AclDirection
+{
+    ACL_IN,
+    ACL_OUT,
+    ACL_DIRECTIONS
+};
+
+
+/**
+ * ACLs of an interface.
+ */
+struct AclSet
+{
+    struct Acl dir[ACL_DIRECTIONS];
+};
+
+/**
+ * ACLs, indexed by interface number - 1.
+ */
+static struct AclSet *acls;
+
+/**
+ * Length of #acls.
+ */
+static unsigned int num_acls;
+
+
+/**
+ * Does @a r constrain its source or destination port?
+ */
+static int
+acl_rule_has_ports (const struct AclRule *r)
+{
+    return (0 != r->sport_lo) || (UINT16_MAX != r->sport_hi) ||
+           (0 != r->dport_lo) || (UINT16_MAX != r->dport_hi);
+}
+
+
+/**
+ * Mask @a key with the fields matched by @a t.
+ *
+ * @param t tuple
+ * @param key packet fields
+ * @param[out] mk set to the masked fields
+ */
+static void
+acl_mask_key (const struct AclTuple *t,
+              const struct AclKey *key,
+              struct AclKey *mk)
+{
+    mk->src.s_addr = key->src.s_addr & t->src_mask.s_addr;
+    mk->dst.s_addr = key->dst.s_addr & t->dst_mask.s_addr;
+    mk->protocol = t->match_protocol ? key->protocol : 0;
+    mk->sport = t->match_sport ? key->sport : 0;
+    mk->dport = t->match_dport ? key->dport : 0;
+}
+
+
+/**
+ * Hash the masked fields @a mk.
+ */
+static uint32_t
+acl_key_hash (const struct AclKey *mk)
+{
+    return GNUNET_CRYPTO_crc32c_n (mk,
+                                   sizeof (*mk));
+}
+
+
+/**
+ * Initialize @a key from the packet in @a ip and @a payload.
+ *
+ * @param[out] key set to the fields of the packet
+ * @param ip IP header
+ * @param payload IP payload
+ * @param payload_size number of bytes in @a payload
+ * @return 1 if @a key has the ports (first fragment of TCP or UDP)
+ */
+static int
+acl_key_init (struct AclKey *key,
+              const struct IPv4Header *ip,
+              const uint8_t *payload,
+              size_t payload_size)
+{
+    size_t options = 4 * ip->header_length - sizeof (struct IPv4Header);
+
+    key->src = ip->source_address;
+    key->dst = ip->destination_address;
+    key->protocol = ip->protocol;
+    key->sport = 0;
+    key->dport = 0;
+    if ( ( (IPPROTO_TCP != ip->protocol) &&
+           (IPPROTO_UDP != ip->protocol) ) ||
+         (0 != (ntohs (ip->fragmentation_info) & 0x1FFF)) ||
+         (payload_size < options + 4) )
+        return 0;
+    memcpy (&key->sport,
+            &payload[options],
+            4);
+    return 1;
+}
+
+
+/**
+ * Find the first rule of @a acl matching @a key.
+ *
+ * @param acl the ACL
+ * @param key fields of the packet
+ * @param have_ports 0 if @a key has no ports, rules with ports do not match
+ * @return NULL if no rule matches
+ */
+static struct AclRule *
+acl_classify (const struct Acl *acl,
+              const struct AclKey *key,
+              int have_ports)
+{
+    struct AclRule *best = NULL;
+
+    for (unsigned int i = 0; i < acl->num_tuples; i++) {
+        const struct AclTuple *t = &acl->tuples[i];
+        struct AclKey mk;
+        uint16_t sport = ntohs (key->sport);
+        uint16_t dport = ntohs (key->dport);
+
+        if ( (NULL != best) &&
+             (t->min_seq > best->seq) )
+            break; /* tuples are sorted, no better match left */
+        acl_mask_key (t,
+                      key,
+                      &mk);
+        for (struct AclRule *r = t->buckets[acl_key_hash (&mk) & (t->num_buckets - 1)];
+             NULL != r;
+             r = r->chain) {
+            if ( (NULL != best) &&
+                 (r->seq > best->seq) )
+                break;
+            if ( (0 != memcmp (&r->key,
+                               &mk,
+                               sizeof (mk))) ||
+                 (sport < r->sport_lo) || (sport > r->sport_hi) ||
+                 (dport < r->dport_lo) || (dport > r->dport_hi) ||
+                 ( (! have_ports) && acl_rule_has_ports (r) ) )
+                continue;
+            best = r; /* first match in the chain is the best of this tuple */
+            break;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Check the ACL of interface @a ifc_num in direction @a dir for a packet.
+ * Packets no rule matches are allowed.
+ *
+ * @param ifc_num interface the packet arrived on or leaves from
+ * @param dir #ACL_IN or #ACL_OUT
+ * @param ip IP header
+ * @param payload IP payload
+ * @param payload_size number of bytes in @a payload
+ * @return 1 if the packet is allowed
+ */
+static int
+acl_permits (uint16_t ifc_num,
+             enum AclDirection dir,
+             const struct IPv4Header *ip,
+             const uint8_t *payload,
+             size_t payload_size)
+{
+    const struct Acl *acl;
+    struct AclKey key;
+    struct AclRule *r;
+    int have_ports;
+
+    if (ifc_num > num_acls)
+        return 1;
+    acl = &acls[ifc_num - 1].dir[dir];
+    if (0 == acl->num_rules)
+        return 1;
+    have_ports = acl_key_init (&key,
+                               ip,
+                               payload,
+                               payload_size);
+    r = acl_classify (acl,
+                      &key,
+                      have_ports);
+    if (NULL == r)
+        return 1;
+    r->hits++;
+    return r->allow;
+}
+
+
+/**
+ * Insert @a r into the hash chains of @a t, keeping them sorted.
+ */
+static void
+acl_tuple_link (struct AclTuple *t,
+                struct AclRule *r)
+{
+    struct AclRule **pos = &t->buckets[acl_key_hash (&r->key) & (t->num_buckets - 1)];
+
+    while ( (NULL != *pos) &&
+            ((*pos)->seq < r->seq) )
+        pos = &(*pos)->chain;
+    r->chain = *pos;
+    *pos = r;
+}
+
+
+/**
+ * Compare tuples by their lowest sequence number, for qsort().
+ */
+static int
+acl_tuple_cmp (const void *a,
+               const void *b)
+{
+    const struct AclTuple *ta = a;
+    const struct AclTuple *tb = b;
+
+    return (ta->min_seq > tb->min_seq) - (ta->min_seq < tb->min_seq);
+}
+
+
+/**
+ * Find the tuple of @a acl that @a r belongs in.
+ *
+ * @return NULL if there is none yet
+ */
+static struct AclTuple *
+acl_find_tuple (struct Acl *acl,
+                const struct AclRule *r)
+{
+    for (unsigned int i = 0; i < acl->num_tuples; i++) {
+        struct AclTuple *t = &acl->tuples[i];
+
+        if ( (t->src_len == r->src_len) &&
+             (t->dst_len == r->dst_len) &&
+             (t->match_protocol == ! r->any_protocol) &&
+             (t->match_sport == (r->sport_lo == r->sport_hi)) &&
+             (t->match_dport == (r->dport_lo == r->dport_hi)) )
+            return t;
+    }
+    return NULL;
+}
+
+
+/**
+ * Convert prefix length @a len to a netmask.
+ */
+static struct in_addr
+acl_prefix_mask (uint8_t len)
+{
+    struct in_addr mask;
+
+    mask.s_addr = htonl (~(uint32_t) ((1LLU << (32 - len)) - 1LLU));
+    return mask;
+}
+
+
+/**
+ * Add a copy of rule @a tmpl to @a acl.  The addresses, protocol and
+ * ports of @a tmpl need not be masked.
+ *
+ * @param acl ACL to add the rule to
+ * @param tmpl the rule
+ * @return 0 on success, -1 if a rule with the same sequence number exists
+ */
+static int
+acl_add (struct Acl *acl,
+         const struct AclRule *tmpl)
+{
+    struct AclRule **pos;
+    struct AclRule *r;
+    struct AclTuple *t;
+
+    if ( (NULL != acl->last) &&
+         (acl->last->seq < tmpl->seq) )
+        pos = &acl->last->next;
+    else
+        for (pos = &acl->rules; NULL != *pos; pos = &(*pos)->next)
+            if ((*pos)->seq >= tmpl->seq)
+                break;
+    if ( (NULL != *pos) &&
+         ((*pos)->seq == tmpl->seq) )
+        return -1;
+    r = slab_alloc (&acl_rule_slab);
+    *r = *tmpl;
+    r->hits = 0;
+    r->next = *pos;
+    *pos = r;
+    if (NULL == r->next)
+        acl->last = r;
+    acl->num_rules++;
+
+    t = acl_find_tuple (acl,
+                        r);
+    if (NULL == t) {
+        acl->tuples = realloc (acl->tuples,
+                               (acl->num_tuples + 1) * sizeof (struct AclTuple));
+        if (NULL == acl->tuples)
+            abort ();
+        t = &acl->tuples[acl->num_tuples++];
+        memset (t,
+                0,
+                sizeof (*t));
+        t->src_len = r->src_len;
+        t->dst_len = r->dst_len;
+        t->src_mask = acl_prefix_mask (r->src_len);
+        t->dst_mask = acl_prefix_mask (r->dst_len);
+        t->match_protocol = ! r->any_protocol;
+        t->match_sport = (r->sport_lo == r->sport_hi);
+        t->match_dport = (r->dport_lo == r->dport_hi);
+        t->min_seq = r->seq;
+        t->num_buckets = 16;
+        t->buckets = calloc (t->num_buckets,
+                             sizeof (struct AclRule *));
+        if (NULL == t->buckets)
+            abort ();
+    }
+    {
+        struct AclKey key = r->key;
+
+        key.sport = htons (r->sport_lo);
+        key.dport = htons (r->dport_lo);
+        acl_mask_key (t,
+                      &key,
+                      &r->key);
+    }
+    if (t->num_rules >= t->num_buckets) { /* keep the chains short */
+        struct AclRule **old = t->buckets;
+        unsigned int old_num = t->num_buckets;
+
+        t->num_buckets *= 2;
+        t->buckets = calloc (t->num_buckets,
+                             sizeof (struct AclRule *));
+        if (NULL == t->buckets)
+            abort ();
+        for (unsigned int i = 0; i < old_num; i++)
+            while (NULL != old[i]) {
+                struct AclRule *o = old[i];
+
+                old[i] = o->chain;
+                acl_tuple_link (t,
+                                o);
+            }
+        free (old);
+    }
+    acl_tuple_link (t,
+                    r);
+    t->num_rules++;
+    if (r->seq < t->min_seq)
+        t->min_seq = r->seq;
+    qsort (acl->tuples,
+           acl->num_tuples,
+           sizeof (struct AclTuple),
+           &acl_tuple_cmp);
+    return 0;
+}
+
+
+/**
+ * Remove the rule with sequence number @a seq from @a acl.
+ *
+ * @return 0 on success, -1 if there is no such rule
+ */
+static int
+acl_del (struct Acl *acl,
+         uint32_t seq)
+{
+    struct AclRule **pos;
+    struct AclRule *prev = NULL;
+    struct AclRule *r;
+    struct AclTuple *t;
+
+    for (pos = &acl->rules; NULL != *pos; pos = &(*pos)->next) {
+        if ((*pos)->seq == seq)
+            break;
+        prev = *pos;
+    }
+    r = *pos;
+    if (NULL == r)
+        return -1;
+    *pos = r->next;
+    if (acl->last == r)
+        acl->last = prev;
+    acl->num_rules--;
+
+    t = acl_find_tuple (acl,
+                        r);
+    for (pos = &t->buckets[acl_key_hash (&r->key) & (t->num_buckets - 1)];
+         r != *pos;
+         pos = &(*pos)->chain)
+        ;
+    *pos = r->chain;
+    slab_free (&acl_rule_slab,
+               r);
+    if (0 == --t->num_rules) {
+        free (t->buckets);
+        *t = acl->tuples[--acl->num_tuples];
+    } else if (seq == t->min_seq) {
+        t->min_seq = UINT32_MAX;
+        for (unsigned int i = 0; i < t->num_buckets; i++) /* chain heads are the lowest */
+            if ( (NULL != t->buckets[i]) &&
+                 (t->buckets[i]->seq < t->min_seq) )
+                t->min_seq = t->buckets[i]->seq;
+    }
+    qsort (acl->tuples,
+           acl->num_tuples,
+           sizeof (struct AclTuple),
+           &acl_tuple_cmp);
+    return 0;
+}
+
+
+/**
+ * Remove all rules from @a acl.
+ */
+static void
+acl_clear (struct Acl *acl)
+{
+    while (NULL != acl->rules) {
+        struct AclRule *r = acl->rules;
+
+        acl->rules = r->next;
+        slab_free (&acl_rule_slab,
+                   r);
+    }
+    for (unsigned int i = 0; i < acl->num_tuples; i++)
+        free (acl->tuples[i].buckets);
+    free (acl->tuples);
+    memset (acl,
+            0,
+            sizeof (*acl));
+}
+
+
+/**
+ * Maximum number of NAT sessions; the tables are allocated once, so
+ * memory stays bounded however many flows there are.
+ */
+#ifndef NAT_MAX_SESSIONS
+#define NAT_MAX_SESSIONS (1 << 20)
+#endif
+
+/**
+ * Idle timeouts in seconds (RFC 5382, RFC 4787, RFC 5508).
+ */
+#define NAT_TIMEOUT_TCP_ESTABLISHED 7440
+#define NAT_TIMEOUT_TCP_TRANSITORY 240
+#define NAT_TIMEOUT_UDP 300
+#define NAT_TIMEOUT_ICMP 60
+
+/**
+ * Slots (of one second) of the expiry timer wheel, a power of two
+ * larger than the longest timeout.
+ */
+#define NAT_WHEEL_SLOTS 8192
+
+/**
+ * Outside ports are allocated from NAT_PORT_MIN to 65535, trying
+ * at most NAT_PORT_TRIES ports per new session.
+ */
+#define NAT_PORT_MIN 1024
+#define NAT_PORT_TRIES 64
+
+/**
+ * End of a list of NAT sessions.  Session 0 is never used, so that
+ * zeroed tables are empty.
+ */
+#define NAT_NONE 0
+
+/**
+ * TCP flags ending a connection.
+ */
+#define TCP_FIN 0x01
+#define TCP_RST 0x04
+
+/**
+ * States of TCP sessions, for the timeouts.
+ */
+#define NAT_TCP_NEW 0
+#define NAT_TCP_ESTABLISHED 1
+#define NAT_TCP_CLOSING 2
+
+
+/**
+ * Translation of a flow from an inside host to a remote host.
+ * Ports are in network byte order, for ICMP echo the ports are the
+ * identifier and the remote port is 0.
+ */
+struct NatSession
+{
+    struct in_addr inside_ip;
+    struct in_addr remote_ip;
+    uint16_t inside_port;
+    uint16_t remote_port;
+    uint16_t outside_port;
+
+    /**
+     * IP protocol, 0 if the session is free.
+     */
+    uint8_t protocol;
+
+    /**
+     * For TCP: #NAT_TCP_ESTABLISHED once the connection saw traffic in
+     * both directions, #NAT_TCP_CLOSING after a FIN or RST.
+     */
+    uint8_t tcp_state;
+
+    /**
+     * When the session expires (seconds, see nat_now()).
+     */
+    uint32_t expires;
+
+    /**
+     * Next session in the hash chains of the inside and outside tables.
+     */
+    uint32_t next_inside;
+    uint32_t next_outside;
+
+    /**
+     * Next session in the same timer wheel slot (or the free list).
+     */
+    uint32_t next_timer;
+};
+
+
+/**
+ * Hash key of a session as seen from the inside.
+ */
+struct NatInsideKey
+{
+    struct in_addr inside_ip;
+    struct in_addr remote_ip;
+    uint16_t inside_port;
+    uint16_t remote_port;
+    uint8_t protocol;
+} __attribute__ ((packed));
+
+
+/**
+ * Hash key of a session as seen from the outside.
+ */
+struct NatOutsideKey
+{
+    struct in_addr remote_ip;
+    uint16_t outside_port;
+    uint16_t remote_port;
+    uint8_t protocol;
+} __attribute__ ((packed));
+
+
+/**
+ * Interface number of the outside interface, 0 if NAT is off.
+ */
+static uint16_t nat_ifc_num;
+
+/**
+ * All sessions, NAT_MAX_SESSIONS after the unused session 0.
+ */
+static struct NatSession *nat_sessions;
+
+/**
+ * Hash tables of the sessions, NAT_MAX_SESSIONS buckets each.
+ */
+static uint32_t *nat_inside_buckets;
+static uint32_t *nat_outside_buckets;
+
+/**
+ * Sessions expiring in each second, modulo NAT_WHEEL_SLOTS.  A session
+ * whose timeout was extended is moved when its old slot comes up.
+ */
+static uint32_t nat_wheel[NAT_WHEEL_SLOTS];
+
+/**
+ * Last second processed in #nat_wheel.
+ */
+static uint32_t nat_tick;
+
+/**
+ * Sessions that were released.
+ */
+static uint32_t nat_free;
+
+/**
+ * First session that was never used; it and all after it are free.
+ */
+static uint32_t nat_unused;
+
+/**
+ * Number of sessions in use.
+ */
+static uint32_t nat_num_sessions;
+
+
+/**
+ * Current time in seconds (monotonic).
+ */
+static uint32_t
+nat_now ()
+{
+    return (uint32_t) (icmp_now () / 1000000000LLU);
+}
+
+
+static uint32_t
+nat_inside_hash (const struct NatInsideKey *key)
+{
+    return GNUNET_CRYPTO_crc32c_n (key,
+                                   sizeof (*key)) & (NAT_MAX_SESSIONS - 1);
+}
+
+
+static uint32_t
+nat_outside_hash (const struct NatOutsideKey *key)
+{
+    return GNUNET_CRYPTO_crc32c_n (key,
+                                   sizeof (*key)) & (NAT_MAX_SESSIONS - 1);
+}
+
+
+/**
+ * Key of session @a s in the inside table.
+ */
+static void
+nat_inside_key (const struct NatSession *s,
+                struct NatInsideKey *key)
+{
+    key->inside_ip = s->inside_ip;
+    key->remote_ip = s->remote_ip;
+    key->inside_port = s->inside_port;
+    key->remote_port = s->remote_port;
+    key->protocol = s->protocol;
+}
+
+
+/**
+ * Key of session @a s in the outside table.
+ */
+static void
+nat_outside_key (const struct NatSession *s,
+                 struct NatOutsideKey *key)
+{
+    key->remote_ip = s->remote_ip;
+    key->outside_port = s->outside_port;
+    key->remote_port = s->remote_port;
+    key->protocol = s->protocol;
+}
+
+
+/**
+ * Turn NAT off, dropping all sessions.
+ */
+static void
+nat_disable ()
+{
+    free (nat_sessions);
+    free (nat_inside_buckets);
+    free (nat_outside_buckets);
+    nat_sessions = NULL;
+    nat_inside_buckets = NULL;
+    nat_outside_buckets = NULL;
+    nat_num_sessions = 0;
+    nat_ifc_num = 0;
+}
+
+
+/**
+ * Turn NAT on with @a ifc_num as the outside interface, dropping all
+ * sessions.
+ *
+ * @param ifc_num the outside interface
+ */
+static void
+nat_enable (uint16_t ifc_num)
+{
+    nat_disable ();
+    /* empty tables are all zero, so calloc() leaves their pages
+       untouched until sessions use them */
+    nat_sessions = calloc (NAT_MAX_SESSIONS + 1,
+                           sizeof (struct NatSession));
+    nat_inside_buckets = calloc (NAT_MAX_SESSIONS,
+                                 sizeof (uint32_t));
+    nat_outside_buckets = calloc (NAT_MAX_SESSIONS,
+                                  sizeof (uint32_t));
+    if ( (NULL == nat_sessions) ||
+         (NULL == nat_inside_buckets) ||
+         (NULL == nat_outside_buckets) )
+        abort ();
+    memset (nat_wheel,
+            0,
+            sizeof (nat_wheel));
+    nat_free = NAT_NONE;
+    nat_unused = 1;
+    nat_tick = nat_now ();
+    nat_ifc_num = ifc_num;
 }
-static int size_rt;
-
-
-
-struct Routing_entry* create_entry(struct Routing_entry *entry) {
 
 
-    struct Routing_entry* new_Routing_entry = malloc(sizeof(struct Routing_entry));
-
+/**
+ * Remove session @a idx from the hash tables and free it.
+ */
+static void
+nat_release (uint32_t idx)
+{
+    struct NatSession *s = &nat_sessions[idx];
+    struct NatInsideKey ik;
+    struct NatOutsideKey ok;
+    uint32_t *pos;
+
+    nat_inside_key (s,
+                    &ik);
+    for (pos = &nat_inside_buckets[nat_inside_hash (&ik)];
+         idx != *pos;
+         pos = &nat_sessions[*pos].next_inside)
+        ;
+    *pos = s->next_inside;
+    nat_outside_key (s,
+                     &ok);
+    for (pos = &nat_outside_buckets[nat_outside_hash (&ok)];
+         idx != *pos;
+         pos = &nat_sessions[*pos].next_outside)
+        ;
+    *pos = s->next_outside;
+    s->protocol = 0;
+    s->next_timer = nat_free;
+    nat_free = idx;
+    nat_num_sessions--;
+}
 
-    if (NULL != new_Routing_entry){
-        new_Routing_entry->gateway = entry->gateway;
-        new_Routing_entry->network_target = entry->network_target;
-        new_Routing_entry->network_mask = entry->network_mask;
-        new_Routing_entry->ifc = entry->ifc;
-        new_Routing_entry->undeleteable = 0;
-        new_Routing_entry->next = NULL;
 
-    }else {
-        exit(1);
-    }
+/**
+ * Put session @a idx into the timer wheel slot of its expiration.
+ */
+static void
+nat_schedule (uint32_t idx)
+{
+    uint32_t *slot = &nat_wheel[nat_sessions[idx].expires & (NAT_WHEEL_SLOTS - 1)];
 
-    return new_Routing_entry;
+    nat_sessions[idx].next_timer = *slot;
+    *slot = idx;
 }
 
-void delete_entry(struct Routing_entry *looked_up_entry) {
 
-    struct Routing_entry *iter = routing_table;
-    for (iter; NULL != iter; iter = iter->next){
-        if (iter->next == looked_up_entry) {
-            struct Routing_entry* current_entry = iter;
-            struct Routing_entry* freed_entry = iter->next;
-            current_entry->next = iter->next->next;
-            free(freed_entry);
-            return;
+/**
+ * Release the sessions that expired until @a now.
+ */
+static void
+nat_expire (uint32_t now)
+{
+    if (now - nat_tick > NAT_WHEEL_SLOTS)
+        nat_tick = now - NAT_WHEEL_SLOTS; /* every slot once is enough */
+    while (nat_tick != now) {
+        uint32_t idx;
+
+        nat_tick++;
+        idx = nat_wheel[nat_tick & (NAT_WHEEL_SLOTS - 1)];
+        nat_wheel[nat_tick & (NAT_WHEEL_SLOTS - 1)] = NAT_NONE;
+        while (NAT_NONE != idx) {
+            uint32_t next = nat_sessions[idx].next_timer;
+
+            if ((int32_t) (nat_sessions[idx].expires - nat_tick) <= 0)
+                nat_release (idx);
+            else
+                nat_schedule (idx); /* was refreshed, move to its new slot */
+            idx = next;
         }
-
     }
 }
 
 
-
 /**
- * Adds a new entry to the routing table
- * @param entry
- * @return
+ * Extend the lifetime of session @a s.
+ *
+ * @param s the session
+ * @param now current time
+ * @param tcp_flags flags of a TCP segment of the session
  */
-static struct Routing_entry*
-add_entry(struct Routing_entry *entry) {
-    struct Routing_entry *looked_up_entry = lookup_routing_entry_rt(*entry); //returns the value that is BEFORE the new entry in routing table
-    struct Routing_entry *new_entry = create_entry(entry); //create a new routing entry
-
-    if(NULL == looked_up_entry->next) { //if there is only one entry so far, next entry is null
-            looked_up_entry->next = new_entry;
-    } else { //if there is so far more than 1 entry in routing table
-        new_entry->next = looked_up_entry->next;
-        looked_up_entry->next = new_entry;
+static void
+nat_refresh (struct NatSession *s,
+             uint32_t now,
+             uint8_t tcp_flags)
+{
+    switch (s->protocol)
+    {
+    case IPPROTO_TCP:
+        if (0 != (tcp_flags & (TCP_FIN | TCP_RST)))
+            s->tcp_state = NAT_TCP_CLOSING;
+        s->expires = now + ((NAT_TCP_ESTABLISHED == s->tcp_state)
+                            ? NAT_TIMEOUT_TCP_ESTABLISHED
+                            : NAT_TIMEOUT_TCP_TRANSITORY);
+        break;
+    case IPPROTO_UDP:
+        s->expires = now + NAT_TIMEOUT_UDP;
+        break;
+    default:
+        s->expires = now + NAT_TIMEOUT_ICMP;
+        break;
     }
+}
 
-    return new_entry;
+
+static struct NatSession *
+nat_lookup_inside (const struct NatInsideKey *key)
+{
+    for (uint32_t idx = nat_inside_buckets[nat_inside_hash (key)];
+         NAT_NONE != idx;
+         idx = nat_sessions[idx].next_inside) {
+        struct NatSession *s = &nat_sessions[idx];
+
+        if ( (s->inside_ip.s_addr == key->inside_ip.s_addr) &&
+             (s->remote_ip.s_addr == key->remote_ip.s_addr) &&
+             (s->inside_port == key->inside_port) &&
+             (s->remote_port == key->remote_port) &&
+             (s->protocol == key->protocol) )
+            return s;
+    }
+    return NULL;
 }
 
 
-static int
-init_router() {
+static struct NatSession *
+nat_lookup_outside (const struct NatOutsideKey *key)
+{
+    for (uint32_t idx = nat_outside_buckets[nat_outside_hash (key)];
+         NAT_NONE != idx;
+         idx = nat_sessions[idx].next_outside) {
+        struct NatSession *s = &nat_sessions[idx];
+
+        if ( (s->remote_ip.s_addr == key->remote_ip.s_addr) &&
+             (s->outside_port == key->outside_port) &&
+             (s->remote_port == key->remote_port) &&
+             (s->protocol == key->protocol) )
+            return s;
+    }
+    return NULL;
+}
 
 
-    struct Routing_entry entry;
-    int netmask_val = gifc[0].netmask.s_addr;
-    int index = 0;
-    for(int j = 1; j<num_ifc; j++) {
-        int netmask_val2 = gifc[j].netmask.s_addr;
-        if (netmask_val2 < netmask_val) {
-            netmask_val = netmask_val2;
-            index = j;
-        }
+/**
+ * Create a session for the flow @a key, allocating an outside port.
+ * The port of the inside host is kept if it is free (and not below
+ * NAT_PORT_MIN, except for ICMP identifiers), otherwise ports
+ * are tried starting at a position given by the hash of @a key.
+ * Outside ports are only unique per remote host and port.
+ *
+ * @param key the flow, as seen from the inside
+ * @param now current time
+ * @return NULL if the table is full or no port is free
+ */
+static struct NatSession *
+nat_create (const struct NatInsideKey *key,
+            uint32_t now)
+{
+    struct NatOutsideKey ok;
+    struct NatSession *s;
+    uint32_t idx;
+    uint32_t h;
+    unsigned int i;
+
+    if ( (NAT_NONE == nat_free) &&
+         (NAT_MAX_SESSIONS < nat_unused) )
+        return NULL;
+    ok.remote_ip = key->remote_ip;
+    ok.remote_port = key->remote_port;
+    ok.protocol = key->protocol;
+    ok.outside_port = key->inside_port;
+    h = GNUNET_CRYPTO_crc32c_n (key,
+                                sizeof (*key));
+    for (i = 0; i < NAT_PORT_TRIES; i++) {
+        if ( ( (IPPROTO_ICMP == ok.protocol) || /* identifiers have no reserved range */
+               (ntohs (ok.outside_port) >= NAT_PORT_MIN) ) &&
+             (NULL == nat_lookup_outside (&ok)) )
+            break;
+        ok.outside_port = htons (NAT_PORT_MIN + (h + i) % (65536 - NAT_PORT_MIN));
     }
+    if (NAT_PORT_TRIES == i)
+        return NULL;
+    if (NAT_NONE != nat_free) {
+        idx = nat_free;
+        nat_free = nat_sessions[idx].next_timer;
+    } else {
+        idx = nat_unused++;
+    }
+    s = &nat_sessions[idx];
+    nat_num_sessions++;
+    s->inside_ip = key->inside_ip;
+    s->remote_ip = key->remote_ip;
+    s->inside_port = key->inside_port;
+    s->remote_port = key->remote_port;
+    s->outside_port = ok.outside_port;
+    s->protocol = key->protocol;
+    s->tcp_state = NAT_TCP_NEW;
+    s->next_inside = nat_inside_buckets[nat_inside_hash (key)];
+    nat_inside_buckets[nat_inside_hash (key)] = idx;
+    s->next_outside = nat_outside_buckets[nat_outside_hash (&ok)];
+    nat_outside_buckets[nat_outside_hash (&ok)] = idx;
+    nat_refresh (s,
+                 now,
+                 0);
+    nat_schedule (idx);
+    return s;
+}
+
 
+/**
+ * Transport header fields NAT rewrites, pointers into the packet
+ * (which may be unaligned).
+ */
+struct NatHeader
+{
+    /**
+     * Source and destination port; both point to the identifier for
+     * ICMP echo.
+     */
+    uint8_t *sport;
+    uint8_t *dport;
 
-    entry.network_mask = gifc[index].netmask;
-    struct in_addr network_IP;
-    network_IP.s_addr = gifc[index].ip.s_addr & gifc[index].netmask.s_addr;
-    entry.network_target = network_IP;
-    entry.ifc = gifc[index];
-    entry.gateway = IP0;
-    entry.undeleteable = 1;
+    /**
+     * Checksum over the transport header, NULL if there is none (UDP
+     * without checksum).
+     */
+    uint8_t *sum;
 
-    routing_table = create_entry(&entry);
+    /**
+     * 1 if @e sum covers the addresses (pseudo header).
+     */
+    int pseudo;
 
+    /**
+     * UDP, where a checksum of 0 means "none".
+     */
+    int udp;
 
+    /**
+     * TCP flags, 0 for other protocols.
+     */
+    uint8_t tcp_flags;
+};
 
-    for(int i = 0; i<num_ifc; i++){
-        if (i != index) {
-            struct Routing_entry entry;
-            entry.network_mask = gifc[i].netmask;
-            struct in_addr network_IP;
-            network_IP.s_addr = gifc[i].ip.s_addr & gifc[i].netmask.s_addr;
-            entry.network_target = network_IP;
-            entry.ifc = gifc[i];
-            entry.gateway = IP0;
-            entry.undeleteable=1;
-            add_entry(&entry);
 
+/**
+ * Locate the fields NAT rewrites in the transport header @a l4.
+ *
+ * @param protocol IP protocol
+ * @param l4 the transport header
+ * @param l4_size number of bytes at @a l4
+ * @param echo_type ICMP type to accept (echo request or reply)
+ * @param quoted 1 if @a l4 is quoted in an ICMP error, only the
+ *        ports are needed (and the first 8 bytes may be all there is)
+ * @param[out] nh set to the fields
+ * @return 0 on success, -1 if NAT does not support the packet
+ */
+static int
+nat_header (uint8_t protocol,
+            uint8_t *l4,
+            size_t l4_size,
+            uint8_t echo_type,
+            int quoted,
+            struct NatHeader *nh)
+{
+    memset (nh,
+            0,
+            sizeof (*nh));
+    switch (protocol)
+    {
+    case IPPROTO_TCP:
+        if (quoted && (l4_size >= 8)) {
+            nh->sport = &l4[0];
+            nh->dport = &l4[2];
+            return 0;
         }
+        if (l4_size < 20)
+            return -1;
+        nh->sport = &l4[0];
+        nh->dport = &l4[2];
+        nh->sum = &l4[16];
+        nh->pseudo = 1;
+        nh->tcp_flags = l4[13];
+        return 0;
+    case IPPROTO_UDP:
+        if (l4_size < 8)
+            return -1;
+        nh->sport = &l4[0];
+        nh->dport = &l4[2];
+        if ( (0 != l4[6]) ||
+             (0 != l4[7]) )
+            nh->sum = &l4[6];
+        nh->pseudo = 1;
+        nh->udp = 1;
+        return 0;
+    case IPPROTO_ICMP:
+        if ( (l4_size < 8) ||
+             (echo_type != l4[0]) )
+            return -1;
+        nh->sport = &l4[4];
+        nh->dport = &l4[4];
+        nh->sum = &l4[2];
+        return 0;
+    default:
+        return -1;
     }
-    return &entry;
 }
 
 
+/**
+ * Update the checksum at @a sum (possibly unaligned) for @a len bytes
+ * changing from @a old_data to @a new_data.
+ */
 static void
-send_ICMP_message(int ICMP_type, int ICMP_code, struct EthernetHeader eh, struct IPv4Header ipv4h, struct Interface *ifc, void *payload, size_t payload_size) {
+nat_sum_update (uint8_t *sum,
+                const void *old_data,
+                const void *new_data,
+                size_t len)
+{
+    uint16_t crc;
 
-    struct IcmpHeader icmp;
-    icmp.code = ICMP_code;
-    icmp.crc = 0;
+    memcpy (&crc,
+            sum,
+            sizeof (crc));
+    crc = GNUNET_CRYPTO_crc16_update (crc,
+                                      old_data,
+                                      new_data,
+                                      len);
+    memcpy (sum,
+            &crc,
+            sizeof (crc));
+}
 
 
-    if (3 == ICMP_type){ //ICMP Type 3
-        icmp.quench.destination_unreachable.empty = 0;
-        icmp.quench.destination_unreachable.next_hop_mtu = 0;
-        icmp.type = ICMP_type;
-    } else { //ICMP Type 11
-        icmp.quench.time_exceeded_unused = 0;
-        icmp.type = ICMP_type;
+/**
+ * Replace address @a addr and port @a port of a packet, updating the
+ * IP header checksum @a ip_sum and the transport checksum of @a nh.
+ *
+ * @param ip_sum IP header checksum
+ * @param addr address in the IP header
+ * @param new_addr new address
+ * @param nh transport header
+ * @param port port (or ICMP identifier) in the transport header
+ * @param new_port new port, in network byte order
+ */
+static void
+nat_rewrite (uint16_t *ip_sum,
+             struct in_addr *addr,
+             struct in_addr new_addr,
+             const struct NatHeader *nh,
+             uint8_t *port,
+             uint16_t new_port)
+{
+    if (NULL != nh->sum) {
+        if (nh->pseudo)
+            nat_sum_update (nh->sum,
+                            addr,
+                            &new_addr,
+                            sizeof (new_addr));
+        nat_sum_update (nh->sum,
+                        port,
+                        &new_port,
+                        sizeof (new_port));
+        if ( nh->udp &&
+             (0 == nh->sum[0]) &&
+             (0 == nh->sum[1]) )
+            memset (nh->sum,
+                    0xFF,
+                    2); /* 0 would mean "no checksum" (RFC 768) */
     }
+    *ip_sum = GNUNET_CRYPTO_crc16_update (*ip_sum,
+                                          addr,
+                                          &new_addr,
+                                          sizeof (new_addr));
+    *addr = new_addr;
+    memcpy (port,
+            &new_port,
+            sizeof (new_port));
+}
+
+
+/**
+ * Translate a packet from the inside leaving through the outside
+ * interface: the source becomes the outside address and port.
+ *
+ * @param ip IP header, modified
+ * @param payload IP payload, modified
+ * @param payload_size number of bytes in @a payload
+ * @return 0 if the packet must be dropped
+ */
+static int
+nat_outbound (struct IPv4Header *ip,
+              uint8_t *payload,
+              size_t payload_size)
+{
+    size_t options = 4 * ip->header_length - sizeof (struct IPv4Header);
+    uint32_t now = nat_now ();
+    struct NatInsideKey key;
+    struct NatHeader nh;
+    struct NatSession *s;
+
+    nat_expire (now);
+    if ( (0 != (ntohs (ip->fragmentation_info) & 0x1FFF)) || /* no ports to translate */
+         (payload_size < options) ||
+         (0 != nat_header (ip->protocol,
+                           &payload[options],
+                           payload_size - options,
+                           ICMPTYPE_ECHO_REQUEST,
+                           0,
+                           &nh)) )
+        return 0;
+    key.inside_ip = ip->source_address;
+    key.remote_ip = ip->destination_address;
+    memcpy (&key.inside_port,
+            nh.sport,
+            sizeof (key.inside_port));
+    key.remote_port = 0;
+    if (nh.sport != nh.dport)
+        memcpy (&key.remote_port,
+                nh.dport,
+                sizeof (key.remote_port));
+    key.protocol = ip->protocol;
+    s = nat_lookup_inside (&key);
+    if (NULL == s)
+        s = nat_create (&key,
+                        now);
+    if (NULL == s)
+        return 0;
+    nat_refresh (s,
+                 now,
+                 nh.tcp_flags);
+    nat_rewrite (&ip->checksum,
+                 &ip->source_address,
+                 gifc[nat_ifc_num - 1].ip,
+                 &nh,
+                 nh.sport,
+                 s->outside_port);
+    return 1;
+}
+
+
+/**
+ * Translate an ICMP error about a translated packet arriving at the
+ * outside address: the destination and the quoted packet's source
+ * become the inside host's again (RFC 5508).  The checksum of the
+ * quoted transport header is left alone, it may be truncated.
+ *
+ * @param ip IP header, modified
+ * @param icmp the ICMP message, modified
+ * @param icmp_size number of bytes at @a icmp
+ * @return 1 if the error was translated
+ */
+static int
+nat_inbound_error (struct IPv4Header *ip,
+                   uint8_t *icmp,
+                   size_t icmp_size)
+{
+    struct IPv4Header qip;
+    struct NatOutsideKey key;
+    struct NatHeader nh;
+    struct NatSession *s;
+    uint8_t *quote = &icmp[sizeof (struct IcmpHeader)];
+    size_t qoptions;
+    struct in_addr old_src;
+    uint16_t old_sum;
+
+    if (icmp_size < sizeof (struct IcmpHeader) + sizeof (qip))
+        return 0;
+    memcpy (&qip,
+            quote,
+            sizeof (qip));
+    qoptions = 4 * qip.header_length;
+    if ( (qoptions < sizeof (qip)) ||
+         (icmp_size < sizeof (struct IcmpHeader) + qoptions) ||
+         (qip.source_address.s_addr != ip->destination_address.s_addr) ||
+         (0 != nat_header (qip.protocol,
+                           &quote[qoptions],
+                           icmp_size - sizeof (struct IcmpHeader) - qoptions,
+                           ICMPTYPE_ECHO_REQUEST,
+                           1,
+                           &nh)) )
+        return 0;
+    key.remote_ip = qip.destination_address;
+    memcpy (&key.outside_port,
+            nh.sport,
+            sizeof (key.outside_port));
+    key.remote_port = 0;
+    if (nh.sport != nh.dport)
+        memcpy (&key.remote_port,
+                nh.dport,
+                sizeof (key.remote_port));
+    key.protocol = qip.protocol;
+    s = nat_lookup_outside (&key);
+    if (NULL == s)
+        return 0;
+    /* the ICMP checksum covers the quote: its source, checksum and port */
+    old_src = qip.source_address;
+    old_sum = qip.checksum;
+    qip.checksum = GNUNET_CRYPTO_crc16_update (qip.checksum,
+                                               &old_src,
+                                               &s->inside_ip,
+                                               sizeof (s->inside_ip));
+    qip.source_address = s->inside_ip;
+    nat_sum_update (&icmp[2],
+                    &old_src,
+                    &s->inside_ip,
+                    sizeof (s->inside_ip));
+    nat_sum_update (&icmp[2],
+                    &old_sum,
+                    &qip.checksum,
+                    sizeof (old_sum));
+    nat_sum_update (&icmp[2],
+                    nh.sport,
+                    &s->inside_port,
+                    sizeof (s->inside_port));
+    memcpy (nh.sport,
+            &s->inside_port,
+            sizeof (s->inside_port));
+    memcpy (quote,
+            &qip,
+            sizeof (qip));
+    ip->checksum = GNUNET_CRYPTO_crc16_update (ip->checksum,
+                                               &ip->destination_address,
+                                               &s->inside_ip,
+                                               sizeof (s->inside_ip));
+    ip->destination_address = s->inside_ip;
+    return 1;
+}
 
 
-    struct EthernetHeader etherneth;
-    etherneth.src = ifc->mac;
-    etherneth.dst = eh.src;
-    etherneth.tag = htons(ETH_P_IPV4);
+/**
+ * Translate a packet that arrived at the address of the outside
+ * interface back to the inside host of its session.
+ *
+ * @param ip IP header, modified
+ * @param payload IP payload, modified
+ * @param payload_size number of bytes in @a payload
+ * @return 1 if the packet was translated, 0 if it has no session (and
+ *         is for us)
+ */
+static int
+nat_inbound (struct IPv4Header *ip,
+             uint8_t *payload,
+             size_t payload_size)
+{
+    size_t options = 4 * ip->header_length - sizeof (struct IPv4Header);
+    uint32_t now = nat_now ();
+    struct NatOutsideKey key;
+    struct NatHeader nh;
+    struct NatSession *s;
+
+    nat_expire (now);
+    if ( (0 != (ntohs (ip->fragmentation_info) & 0x1FFF)) ||
+         (payload_size < options) )
+        return 0;
+    if ( (IPPROTO_ICMP == ip->protocol) &&
+         (payload_size - options >= 1) &&
+         ( (ICMPTYPE_DESTINATION_UNREACHABLE == payload[options]) ||
+           (ICMPTYPE_TIME_EXCEEDED == payload[options]) ) )
+        return nat_inbound_error (ip,
+                                  &payload[options],
+                                  payload_size - options);
+    if (0 != nat_header (ip->protocol,
+                         &payload[options],
+                         payload_size - options,
+                         ICMPTYPE_ECHO_REPLY,
+                         0,
+                         &nh))
+        return 0;
+    key.remote_ip = ip->source_address;
+    memcpy (&key.outside_port,
+            nh.dport,
+            sizeof (key.outside_port));
+    key.remote_port = 0;
+    if (nh.sport != nh.dport)
+        memcpy (&key.remote_port,
+                nh.sport,
+                sizeof (key.remote_port));
+    key.protocol = ip->protocol;
+    s = nat_lookup_outside (&key);
+    if (NULL == s)
+        return 0;
+    if (NAT_TCP_NEW == s->tcp_state)
+        s->tcp_state = NAT_TCP_ESTABLISHED; /* the remote host answered */
+    nat_refresh (s,
+                 now,
+                 nh.tcp_flags);
+    nat_rewrite (&ip->checksum,
+                 &ip->destination_address,
+                 s->inside_ip,
+                 &nh,
+                 nh.dport,
+                 s->inside_port);
+    return 1;
+}
 
-    size_t size_icmp_whole = sizeof(icmp) + sizeof(ipv4h) + payload_size;
 
-    struct IPv4Header ip_header;
-    ip_header.destination_address.s_addr = ipv4h.source_address.s_addr;
-    ip_header.source_address.s_addr = ifc->ip.s_addr;
-    ip_header.total_length = ip_header.header_length + sizeof(icmp) + size_icmp_whole;
-    ip_header.protocol = 1;
-    ip_header.version = 4;
-    ip_header.diff_serv = 0;
-    ip_header.fragmentation_info = 0;
-    ip_header.identification = 0;
-    ip_header.header_length = ipv4h.header_length;
-    ip_header.ttl = 64; //recommended initial value for ttl
+/**
+ * Number of entries of the flow cache, a power of two.  0 disables
+ * the cache.
+ */
+#ifndef FLOW_CACHE_SIZE
+#define FLOW_CACHE_SIZE 16384
+#endif
 
-    ip_header.checksum = 0;
-    ip_header.checksum = GNUNET_CRYPTO_crc16_n(&ip_header, sizeof(ip_header));
 
-    char frame_buff[UINT16_MAX];
-    void* frame = frame_buff;
-    size_t frame_size = sizeof(etherneth) + sizeof(ip_header) + sizeof(icmp) + sizeof(ipv4h) + payload_size;
+/**
+ * Resolved forwarding decision for packets to @e dst that arrived on
+ * interface @e ifc_num (which implies the VRF).
+ */
+struct FlowCacheEntry
+{
+    struct in_addr dst;
 
-    icmp.crc = GNUNET_CRYPTO_crc16_n(frame + sizeof(etherneth) + sizeof(ip_header), size_icmp_whole);
+    uint16_t ifc_num;
 
+    /**
+     * Next hop MAC, unused if @e route has equal-cost next hops (then
+     * the next hop depends on the flow).
+     */
+    struct MacAddress mac;
 
-    memcpy(frame, &etherneth, sizeof(etherneth));
-    memcpy(frame + sizeof(etherneth), &ip_header, sizeof(ip_header));
-    memcpy(frame + sizeof(etherneth) + sizeof(ip_header), &icmp, sizeof(icmp));
-    memcpy(frame + sizeof(etherneth) + sizeof(ip_header) + sizeof(icmp), &ipv4h, sizeof(ipv4h));
-    memcpy(frame + sizeof(etherneth) + sizeof(ip_header) + sizeof(icmp) + sizeof(ipv4h), payload, payload_size);
+    /**
+     * Value of #fib_generation when the entry was filled, the entry is
+     * stale if they differ.
+     */
+    uint32_t generation;
 
-    forward_to(ifc, frame, frame_size);
+    /**
+     * Route found for @e dst (before the equal-cost next hop selection).
+     */
+    struct Routing_entry *route;
+};
 
-}
 
 /**
- * checkup whether there are other entries with the same network target. These entries have to be ordered by the size of their networkmasks within
- * their blocks with the same network targets. This function will return the entry that is before the new entry given as parameter
- * @param looked_up_entry a new entry that will be added
- * @return an entry that has to be placed before new entry according to an ascending order in terms of network mask
+ * The flow cache, direct mapped.  The router is single-threaded, so
+ * this is its only (per-thread) cache.
  */
-static struct Routing_entry*
-lookup_routing_entry_rt(struct Routing_entry looked_up_entry) {
-    struct Routing_entry *iter = routing_table;
-    struct Routing_entry *saved_value = iter;
+static struct FlowCacheEntry flow_cache[FLOW_CACHE_SIZE ? FLOW_CACHE_SIZE : 1];
 
-    for (iter; NULL != iter; iter = iter->next){
-        if (0 == ipcomp(&iter->network_target, &looked_up_entry.network_target)) { //has the entry the same network target
-            int val_looked_up = looked_up_entry.network_mask.s_addr;
-            int val_iter = iter->network_mask.s_addr;
-            if  (val_looked_up > val_iter) { //lookup whether the net mask of the new entry is smaller than the net mask of the entry currently looked at
-                return saved_value;
-            }
-            saved_value = iter; //save this entry of the same network target
-        }
-    }
 
-    return saved_value;
+/**
+ * Find the flow cache entry for @a dst from @a ifc_num.
+ *
+ * @param dst destination address
+ * @param ifc_num ingress interface
+ * @return the slot, NULL if the cache is disabled
+ */
+static struct FlowCacheEntry *
+flow_cache_slot (const struct in_addr *dst,
+                 uint16_t ifc_num)
+{
+    if (0 == FLOW_CACHE_SIZE)
+        return NULL;
+    return &flow_cache[(ipv4_hash (dst) + ifc_num) & (FLOW_CACHE_SIZE - 1)];
 }
 
-static struct Routing_entry*
-lookup_rt_for_del(struct in_addr target_network, struct in_addr target_netmask, struct in_addr next_hop, struct Interface *ifc) {
-    struct Routing_entry *iter = routing_table;
-    for (iter; NULL != iter; iter = iter->next){
-        if (0 == ipcomp(&iter->network_target, &target_network) && (0 == ipcomp(&iter->network_mask, &target_netmask))){
-            if ((0 == iter->undeleteable) && (0 == ipcomp(&iter->gateway, &next_hop))) {
-                return iter;
-            }
-        }
-    }
-    return NULL;
 
+/**
+ * Is @a fce a valid entry for @a dst from @a ifc_num?
+ */
+static int
+flow_cache_hit (const struct FlowCacheEntry *fce,
+                const struct in_addr *dst,
+                uint16_t ifc_num)
+{
+    return (NULL != fce) &&
+           (fce->generation == fib_generation) &&
+           (fce->dst.s_addr == dst->s_addr) &&
+           (fce->ifc_num == ifc_num);
 }
 
 
-static struct Routing_entry*
-lookup_rt(struct in_addr *ipv4) {
-
-    struct Routing_entry *iter = routing_table;
-    for (iter; NULL != iter; iter = iter->next){
-        if (0 == ipcomp(&iter->network_target, ipv4)) {
-            return iter;
-        }
-    }
-    return NULL;
+/**
+ * Remember the forwarding decision for @a dst from @a ifc_num in @a fce.
+ *
+ * @param fce slot from flow_cache_slot(), may be NULL
+ * @param dst destination address
+ * @param ifc_num ingress interface
+ * @param route route found for @a dst
+ * @param mac next hop MAC
+ */
+static void
+flow_cache_put (struct FlowCacheEntry *fce,
+                const struct in_addr *dst,
+                uint16_t ifc_num,
+                struct Routing_entry *route,
+                const struct MacAddress *mac)
+{
+    if (NULL == fce)
+        return;
+    fce->dst = *dst;
+    fce->ifc_num = ifc_num;
+    fce->mac = *mac;
+    fce->generation = fib_generation;
+    fce->route = route;
 }
 
 
@@ -692,26 +3515,42 @@ route (struct IPv4Header ip,
 
     int checked = GNUNET_CRYPTO_crc16_n(&ip, sizeof(struct IPv4Header));
     struct Interface interface = *ifc;
+    const struct MacAddress sender = eh->src; /* for ICMP errors, eh is rewritten below */
 
     if(0!=checked){
         fprintf (stderr,"cyclic redundancy checksum ERROR!\n");
+        stats_drop(DROP_CHECKSUM);
         return;
     }
 
 
     if(1>ip.ttl) { //ttl is 0, the frame can not be processed. send ICMP Message "TTL exceeded" (type 11)
-        send_ICMP_message(ICMPTYPE_TIME_EXCEEDED, 0, *eh, ip, ifc, payload, payload_size);
+        stats_drop(DROP_TTL);
+        icmp_send_error(ifc, &sender, ICMPTYPE_TIME_EXCEEDED, 0, 0, &ip, payload, payload_size);
         return;
     }//else : ttl is >= 1, frame can be processed
 
-    // IPV4 address received AND netmask results in networkaddress
-    struct in_addr net; //network address
-    net.s_addr = ip.destination_address.s_addr & ifc->netmask.s_addr;
-
-    //look up the network address in routing
+    //look up the destination in routing (longest prefix match)
 
     struct in_addr gateway; //next hop / gateway
-    struct Routing_entry* looked_up_node = lookup_rt(&net); //The node where the gateway can be found in routing table
+    struct FlowCacheEntry *fce = flow_cache_slot(&ip.destination_address, ifc->ifc_num);
+    int cached = flow_cache_hit(fce, &ip.destination_address, ifc->ifc_num); //route and next hop MAC known already
+    struct Routing_entry* looked_up_node; //The node where the gateway can be found in routing table
+
+    if (cached) {
+        stats.cache_hits++;
+        looked_up_node = fce->route;
+    } else {
+        stats.cache_misses++;
+        looked_up_node = lookup_rt(ifc->vrf, &ip.destination_address);
+    }
+    struct Routing_entry *route_node = looked_up_node; //before choosing one of several equal-cost next hops
+
+    if ( (NULL != looked_up_node) &&
+         (NULL != looked_up_node->nhg) ) { //several equal-cost next hops, keep the flow on one of them
+        looked_up_node = ecmp_select(looked_up_node,
+                                     flow_hash(&ip, payload, payload_size));
+    }
 
     struct Interface routing_ifc; //the destination Interface
 
@@ -719,8 +3558,11 @@ route (struct IPv4Header ip,
     eh->tag = htons(ETH_P_IPV4);
 
     if (NULL != looked_up_node) { //network address was found in table, gateway address is known
+        if (! cached) {
+            stats.table_hits++;
+        }
 
-        routing_ifc = looked_up_node->ifc;
+        routing_ifc = gifc[looked_up_node->ifc_num - 1];
         eh->src = routing_ifc.mac;
 
         gateway = looked_up_node->gateway; //save the gateway found in routingtable
@@ -730,102 +3572,113 @@ route (struct IPv4Header ip,
         } //if the gateway address is not 0.0.0.0 / not in our own network. Therefore we use the gateway saved before
 
 
+        if ( (0 != nat_ifc_num) &&
+             (routing_ifc.ifc_num == nat_ifc_num) &&
+             (ifc->ifc_num != nat_ifc_num) &&
+             (0 == nat_outbound(&ip, payload, payload_size)) ) { //leaving through the outside interface, but cannot be translated
+            stats_drop(DROP_NAT);
+            return;
+        }
+        if (0 == acl_permits(routing_ifc.ifc_num, ACL_OUT, &ip, payload, payload_size)) { //denied by the egress ACL of the outgoing interface
+            stats_drop(DROP_ACL);
+            icmp_send_error(ifc, &sender, ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_ADMINISTRATIVELY_PROHIBITED, 0, &ip, payload, payload_size);
+            return;
+        }
+
     }else { //no network address was found in table
+        stats.table_misses++;
+        //no route, not even a default route (0.0.0.0/0 matches every destination)
+        stats_drop(DROP_NO_ROUTE);
+        icmp_send_error(ifc, &sender, ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_NETWORK_UNREACHABLE, 0, &ip, payload, payload_size);
+        fprintf(stderr, "Dropping ICMP packet: no route to network\n");
+        return;
 
-        struct Routing_entry* looked_up_node2 = lookup_rt(&IP0); // is there a standard gateway?
+    }
 
-        if (NULL != looked_up_node2) { //if a standard gateway was found in routing table
 
-            eh->src = looked_up_node2->ifc.mac;
+    if (cached && (NULL == route_node->nhg)) { //the next hop of the route is known, too
+        eh->dst = fce->mac;
+    } else {
+        struct MacAddress new_MAC = lookup_ipv4_inARP(routing_ifc.vrf, gateway); //lookup the address in "gateway" in ARP to find fitting MAC-address
 
-            gateway = looked_up_node2->gateway; //save the standard gateway found in routingtable
-            routing_ifc = looked_up_node2->ifc;
+        if(0 == maccomp(&new_MAC, &NULL_ADDRESS)) { //if the IP has NOT been found in ARP-table, the received MAC is the NULL_ADDRESS (00:00:00:00:00:00)
 
-            fprintf_ip(&looked_up_node2->gateway);
+            send_broadcast_APR(ifc, gateway); //it has to be sent as ARP broadcast
 
+            struct MacAddress new_MAC2 = lookup_ipv4_inARP(routing_ifc.vrf, gateway); //new Mac Address to be used as destination is new_MAC2
+            if(0 == maccomp(&new_MAC, &NULL_ADDRESS)) { //broadcast was unsuccessful, ARP entry not found!
+                stats_drop(DROP_NO_ARP);
+                icmp_send_error(ifc, &sender, ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_HOST_UNREACHABLE, 0, &ip, payload, payload_size);
+                fprintf(stderr, "Dropping ICMP packet: no route to host\n");
+                return;
+            } else {
+                eh->dst = new_MAC2; // save the found MAC-address as new destination in Ethernet Header if it is NOT null
+            }
+        } else { //the IP has been found in ARP-table. the MAC-address was saved
 
-        } else { //if no standard gateway was found in routing table
+            eh->dst = new_MAC;
+            if (NULL == route_node->nhg) {
+                flow_cache_put(fce, &ip.destination_address, ifc->ifc_num, route_node, &new_MAC); //the next packets to this destination skip both lookups
+            } else if (! cached) {
+                flow_cache_put(fce, &ip.destination_address, ifc->ifc_num, route_node, &NULL_ADDRESS); //the next hop depends on the flow, cache only the route
+            }
 
-            send_ICMP_message(ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_NETWORK_UNREACHABLE, *eh, ip, ifc, payload, payload_size);
-            fprintf(stderr, "Dropping ICMP packet: next hop MAC unknown\n");
-            return;
         }
 
     }
 
+    int bit = check_fragmentation(&sender, &ip, ifc, routing_ifc.mtu, payload, payload_size);
 
-    struct MacAddress new_MAC = lookup_ipv4_inARP(gateway); //lookup the address in "gateway" in ARP to find fitting MAC-address
-
-    if(0 == maccomp(&new_MAC, &NULL_ADDRESS)) { //if the IP has NOT been found in ARP-table, the received MAC is the NULL_ADDRESS (00:00:00:00:00:00)
-
-        send_broadcast_APR(ifc, gateway); //it has to be sent as ARP broadcast
-
-        struct MacAddress new_MAC2 = lookup_ipv4_inARP(gateway); //new Mac Address to be used as destination is new_MAC2
-        if(0 == maccomp(&new_MAC, &NULL_ADDRESS)) { //broadcast was unsuccessful, ARP entry not found!
-            send_ICMP_message(ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_HOST_UNREACHABLE, *eh, ip, ifc, payload, payload_size);
-            fprintf(stderr, "Dropping ICMP packet: no route to host\n");
-            return;
-        } else {
-            eh->dst = new_MAC2; // save the found MAC-address as new destination in Ethernet Header if it is NOT null
-        }
-    } else { //the IP has been found in ARP-table. the MAC-address was saved
-
-        eh->dst = new_MAC;
-
+    if (-1 == bit) { //too large for the outgoing interface and must not be fragmented
+        return;
     }
 
-    int bit = check_fragmentation(eh, &ip, ifc, payload, payload_size);
+    //reduce TTL by 1, once for all fragments
+    ip.ttl--;
 
     /**
      * Case: Payload has to be fragmented
      */
     if (0 == bit) { //it's fragmented (payload size is > MTU) and fragmentation is allowed (fragmentation flag is 0)
-        int fragmentsize = (ifc->mtu)-14-20; //From Maximum Transmission Unit the size of Ethernet header (14) and size of IPv4 Header must be subtracted
-        int modulo = payload_size%fragmentsize;
-        int no_fragments = payload_size/fragmentsize;
-
-        if (0 != modulo){
-            no_fragments++;
+        int fragmentsize = ((routing_ifc.mtu)-14-20) & ~7; //From Maximum Transmission Unit of the outgoing interface the size of Ethernet header (14) and size of IPv4 Header must be subtracted; offsets count 8 byte units
+        uint16_t frag_info = ntohs(ip.fragmentation_info); //the packet may be a fragment already
+        uint16_t frag_offset = frag_info & 0x1FFF;
 
+        if (fragmentsize <= 0) {
+            stats_drop(DROP_TOO_LARGE);
+            return;
         }
-
-        uint16_t frag_big_endian; //set fragmentation info to big endian, so that
-        // first bit = reserved bit, second bit = fragmentation bit, third bit = more fragments; other 13 bits: Fragment offset
+        int no_fragments = (payload_size + fragmentsize - 1) / fragmentsize;
 
         /**
          * Iterate through framents if framentation is necessary and allowed
          */
         for(int j = 0; j < no_fragments; j++) { //iterate through all fragments. j = packetnumber
-            int offset = j*(fragmentsize/8);
-            ip.identification++;
-            if (j==no_fragments-1) {
-                frag_big_endian &= ~(1UL << 13); //set 3rd bit to 0: last fragment
+            size_t size = (j == no_fragments - 1) ? payload_size - j * fragmentsize : fragmentsize; //the last one carries the remainder
+            // first bit = reserved bit, second bit = fragmentation bit, third bit = more fragments; other 13 bits: Fragment offset
+            uint16_t frag_big_endian = (frag_info & 0xC000) | (frag_offset + j * fragmentsize / 8);
+
+            if (j != no_fragments-1) {
+                frag_big_endian |= 1U << 13; //set 3rd bit to 1: there are more fragments following
             } else {
-                frag_big_endian |= 1UL << 13; //set 3rd bit to 1: there are more fragments following
+                frag_big_endian |= frag_info & (1U << 13); //last fragment: more follow only if the packet was not the last fragment itself
             }
-            frag_big_endian = frag_big_endian+offset;
             ip.fragmentation_info = htons(frag_big_endian);
+            ip.total_length = htons(sizeof(struct IPv4Header) + size);
 
-
-            //reduce TTL by 1
-            ip.ttl--;
             //create new checksum in IPv4-header
             ip.checksum = 0;
             int checksum_renewed = GNUNET_CRYPTO_crc16_n(&ip, sizeof(struct IPv4Header));
             ip.checksum = checksum_renewed;
 
 
-            uint8_t sendBuff[sizeof(struct EthernetHeader) + sizeof(ip) + fragmentsize];
-            memcpy(&sendBuff, &eh, sizeof(eh));
-            memcpy(&sendBuff[sizeof(struct EthernetHeader)], &ip, sizeof(ip));
-
-            if (0 !=modulo && j==no_fragments-1) { //check, if it is the last packet & if there was a remainder from payload_size%fragmentsize (= "modulo")
-                //if this is the case, do not use full fragment size, but only remainder
-                memcpy(&sendBuff[sizeof(struct EthernetHeader)+ sizeof(ip)], &payload+offset, modulo);
-            } else {
-                memcpy(&sendBuff[sizeof(struct EthernetHeader) + sizeof(ip)], &payload + offset, fragmentsize);
-            }
-            forward_to(&routing_ifc, &sendBuff, sizeof(sendBuff));
+            struct PoolBuffer *pb = pool_get();
+            memcpy(pool_put(pb, sizeof(struct EthernetHeader)), eh, sizeof(struct EthernetHeader));
+            memcpy(pool_put(pb, sizeof(ip)), &ip, sizeof(ip));
+            memcpy(pool_put(pb, size), (const char *) payload + j * fragmentsize, size);
+            forward_to(&routing_ifc, pool_data(pb), pb->size);
+            pool_release(pb);
+            stats.fragments++;
         }
 
     /**
@@ -833,50 +3686,63 @@ route (struct IPv4Header ip,
      */
     } else { //if it's not fragmented
 
-        //reduce TTL by 1
-        ip.ttl--;
         //create new checksum in IPv4-header
         ip.checksum = 0;
         int checksum_renewed = GNUNET_CRYPTO_crc16_n(&ip, sizeof(struct IPv4Header));
         ip.checksum = checksum_renewed;
 
 
-        char bufferFrame[sizeof(struct EthernetHeader) + sizeof(struct IPv4Header) + payload_size];
-        memcpy(&bufferFrame, eh, sizeof(struct EthernetHeader));
-        memcpy(&bufferFrame[sizeof(struct EthernetHeader)], &ip, sizeof(struct IPv4Header));
-        memcpy(&bufferFrame[sizeof(struct EthernetHeader) + sizeof(struct IPv4Header)], payload, payload_size);
+        struct PoolBuffer *pb = pool_get(); //no allocation once the pool has a free buffer
+        memcpy(pool_put(pb, sizeof(struct EthernetHeader)), eh, sizeof(struct EthernetHeader));
+        memcpy(pool_put(pb, sizeof(struct IPv4Header)), &ip, sizeof(struct IPv4Header));
+        memcpy(pool_put(pb, payload_size), payload, payload_size);
 
-      forward_to(&routing_ifc, &bufferFrame, (sizeof(struct EthernetHeader) + sizeof(struct IPv4Header) + payload_size));
+      forward_to(&routing_ifc, pool_data(pb), pb->size);
+      pool_release(pb);
 
     }
 
 
 }
 
+/**
+ * Check whether the packet fits the MTU of the outgoing interface.
+ *
+ * @param sender MAC the packet came from, for the ICMP error
+ * @param ip IP header
+ * @param ifc interface the packet came from
+ * @param mtu MTU (including the Ethernet header) of the outgoing interface
+ * @param payload IP packet payload
+ * @param payloadsize number of bytes in @a payload
+ * @return 0 if the packet must be fragmented, 1 if it fits, -1 if it
+ *         was dropped (too large, but "do not fragment" is set)
+ */
 static int
-check_fragmentation(struct EthernetHeader *eh, struct IPv4Header *ip, struct Interface *ifc, void *payload, size_t payloadsize) {
+check_fragmentation(const struct MacAddress *sender, struct IPv4Header *ip, struct Interface *ifc, uint16_t mtu, void *payload, size_t payloadsize) {
 
 
 
-    if(ifc->mtu-14-20 < payloadsize) { //From Maximum Transmission Unit the size of Ethernet header (14) and IPv4 Header must be subtracted
+    if(mtu-14-20 < payloadsize) { //From Maximum Transmission Unit the size of Ethernet header (14) and IPv4 Header must be subtracted
         int bit = (ip->fragmentation_info >> 6) & 1U; //check 2nd bit
         if (0 == bit) { //fragmentation allowed
             return 0;
         }
-        if (1 == bit) { //fragmentation not allowed
-            send_ICMP_message(ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_FRAGMENTATION_REQUIRED, *eh, *ip, ifc, payload, payloadsize);
-        }
+        //fragmentation not allowed, tell the sender the IP MTU of the next hop
+        stats_drop(DROP_TOO_LARGE);
+        icmp_send_error(ifc, sender, ICMPTYPE_DESTINATION_UNREACHABLE, ICMPCODE_FRAGMENTATION_REQUIRED, mtu - sizeof (struct EthernetHeader), ip, payload, payloadsize);
+        return -1;
     }
     return 1;
 
 }
 
 static struct MacAddress
-lookup_ipv4_inARP (struct in_addr ip4){
+lookup_ipv4_inARP (uint16_t vrf, struct in_addr ip4){
+    struct Vrf *v = &vrfs[vrf];
 
-    for (int i = 0; i < arpCacheSize; i++) {
-        if (0== ipcomp(&ip4, &arpCache[i].ip)) {
-            return arpCache[i].mac;
+    for (int i = 0; i < v->arp_cache_size; i++) {
+        if (0== ipcomp(&ip4, &v->arp_cache[i].ip)) {
+            return v->arp_cache[i].mac;
         }
     }
     return NULL_ADDRESS;
@@ -886,7 +3752,7 @@ lookup_ipv4_inARP (struct in_addr ip4){
 // same as send_response in arp.c //added by Mac
 static void handle_arp_request(struct ArpHeaderEthernetIPv4 arpRequest, struct Interface ifc) {
     for (int i = 0; i < num_ifc; i++) {
-        if (0 == ipcomp(&arpRequest.target_pa, &gifc[i].ip)) {
+        if (0 != gifc[i].ifc_num && gifc[i].vrf == ifc.vrf && 0 == ipcomp(&arpRequest.target_pa, &gifc[i].ip)) {
 
             struct EthernetHeader ethHeader;
             ethHeader.src = ifc.mac;
@@ -916,13 +3782,14 @@ static void handle_arp_request(struct ArpHeaderEthernetIPv4 arpRequest, struct I
 // from arp.c //added by Mac
 /**
  * In cache of arp table search for the entry with the oldest timestamp (= the least recently used entry)
+ * @param v VRF whose neighbor table to search
  * @return the index of the entry to be overwritten
  */
-static int search_oldest_entry() {
-    time_t timestamp_persisted = arpCache[0].timestamp; //persist timestamp of first entry
+static int search_oldest_entry(const struct Vrf *v) {
+    time_t timestamp_persisted = v->arp_cache[0].timestamp; //persist timestamp of first entry
     int override_index = 0;
-    for (int i=1; i<arpCacheSize; i++) {
-        if (timestamp_persisted > arpCache[i].timestamp) { //compare this entrys timestamp with the one persisted. if it is smaller, persist it.
+    for (int i=1; i<v->arp_cache_size; i++) {
+        if (timestamp_persisted > v->arp_cache[i].timestamp) { //compare this entrys timestamp with the one persisted. if it is smaller, persist it.
             override_index = i;
         }
     }
@@ -930,49 +3797,58 @@ static int search_oldest_entry() {
 };
 
 static void learn_arp(struct in_addr ip, struct MacAddress mac, struct Interface ifc) {
+    struct Vrf *v = &vrfs[ifc.vrf];
     int MAC_inCache = -1;
     int IP_inCache = -1;
-    for (int j = 0; j < arpCacheSize; j++) {
-        if (0 == maccomp(&arpCache[j].mac, &mac)) {
+    for (int j = 0; j < v->arp_cache_size; j++) {
+        if (0 == maccomp(&v->arp_cache[j].mac, &mac)) {
             MAC_inCache = j;
             continue;
         }
-        if (0 == ipcomp(&arpCache[j].ip, &ip)) {
+        if (0 == ipcomp(&v->arp_cache[j].ip, &ip)) {
             IP_inCache = j;
         }
     }
     if (0 <= MAC_inCache && 0 <= IP_inCache) { //there is an entry for the mac and the IP!
-        arpCache[MAC_inCache].ip = ip;
-        arpCache[MAC_inCache].ifc = ifc;
-        arpCache[MAC_inCache].timestamp = time(NULL);
+        fib_generation++;
+        v->arp_cache[MAC_inCache].ip = ip;
+        v->arp_cache[MAC_inCache].ifc = ifc;
+        v->arp_cache[MAC_inCache].timestamp = time(NULL);
 
-        for (int j = IP_inCache; j < arpCacheSize; j++) { //fill up gap
-            arpCache[j] = arpCache[j + 1];
+        for (int j = IP_inCache; j < v->arp_cache_size; j++) { //fill up gap
+            v->arp_cache[j] = v->arp_cache[j + 1];
         }
-        arpCacheSize--;
+        v->arp_cache_size--;
     } else if (0 <= MAC_inCache) { //there is an entry for the mac
-        arpCache[MAC_inCache].ip = ip;
-        arpCache[MAC_inCache].ifc = ifc;
-        arpCache[MAC_inCache].timestamp = time(NULL);
+        if ( (0 != ipcomp(&v->arp_cache[MAC_inCache].ip, &ip)) ||
+             (v->arp_cache[MAC_inCache].ifc.ifc_num != ifc.ifc_num) ) {
+            fib_generation++; //refreshing an unchanged entry keeps the cached flows
+        }
+        v->arp_cache[MAC_inCache].ip = ip;
+        v->arp_cache[MAC_inCache].ifc = ifc;
+        v->arp_cache[MAC_inCache].timestamp = time(NULL);
     } else if (0 <= IP_inCache) { //there is an entry for the IP
 /*       TODO: // Korrektur update mac statt ip???     */
-        arpCache[IP_inCache].mac = mac;
-        arpCache[IP_inCache].ifc = ifc;
-        arpCache[IP_inCache].timestamp = time(NULL);
+        fib_generation++;
+        v->arp_cache[IP_inCache].mac = mac;
+        v->arp_cache[IP_inCache].ifc = ifc;
+        v->arp_cache[IP_inCache].timestamp = time(NULL);
     } else { //or add a new entry
         size_t addPosition = 0;
-        if (ARP_CACHE_SIZE > arpCacheSize) {
-            addPosition = arpCacheSize;
+        if (ARP_CACHE_SIZE > v->arp_cache_size) { //nothing cached can refer to a new entry
+            addPosition = v->arp_cache_size;
+            v->arp_cache_size++;
         } else {
-            addPosition = (size_t) search_oldest_entry();
+            fib_generation++;
+            addPosition = (size_t) search_oldest_entry(v);
+            stats.table_evictions++;
         }
         struct ArpEntry newEntry;
         newEntry.ip = ip;
         newEntry.mac = mac;
         newEntry.ifc = ifc;
         newEntry.timestamp = time(NULL);
-        arpCache[addPosition] = newEntry;
-        arpCacheSize++;
+        v->arp_cache[addPosition] = newEntry;
     }
 }
 
@@ -1065,6 +3941,7 @@ parse_frame (struct Interface *ifc,
     {
         fprintf (stderr,
                  "Malformed frame\n");
+        stats_drop (DROP_MALFORMED);
         return;
     }
     memcpy (&eh,
@@ -1083,12 +3960,53 @@ parse_frame (struct Interface *ifc,
             {
                 fprintf (stderr,
                          "Malformed frame\n");
+                stats_drop (DROP_MALFORMED);
+                return;
+            }
+            memcpy (&ip,
+                    &cframe[sizeof (struct EthernetHeader)],
+                    sizeof (struct IPv4Header));
+            if ( (ip.header_length < sizeof (struct IPv4Header) / 4) ||
+                 (4 * ip.header_length > frame_size - sizeof (struct EthernetHeader)) )
+            {
+                /* ICMP errors, flow hashing and ACLs rely on IHL */
+                fprintf (stderr,
+                         "Malformed IPv4 header\n");
+                stats_drop (DROP_MALFORMED);
                 return;
             }
-            memcpy (&ip,
-                    &cframe[sizeof (struct EthernetHeader)],
-                    sizeof (struct IPv4Header));
 
+            if (0 == acl_permits (ifc->ifc_num,
+                                  ACL_IN,
+                                  &ip,
+                                  (const uint8_t *) &cframe[sizeof (struct EthernetHeader) + sizeof (struct IPv4Header)],
+                                  frame_size - sizeof (struct EthernetHeader) - sizeof (struct IPv4Header)))
+            {
+                stats_drop (DROP_ACL);
+                icmp_send_error (ifc,
+                                 &eh.src,
+                                 ICMPTYPE_DESTINATION_UNREACHABLE,
+                                 ICMPCODE_ADMINISTRATIVELY_PROHIBITED,
+                                 0,
+                                 &ip,
+                                 &cframe[sizeof (struct EthernetHeader) + sizeof (struct IPv4Header)],
+                                 frame_size - sizeof (struct EthernetHeader) - sizeof (struct IPv4Header));
+                break;
+            }
+            if ( (0 != nat_ifc_num) &&
+                 (ifc->ifc_num == nat_ifc_num) &&
+                 (ip.destination_address.s_addr == ifc->ip.s_addr) )
+                /* the frame is in loop()'s buffer, we may translate it in place */
+                nat_inbound (&ip,
+                             (uint8_t *) &cframe[sizeof (struct EthernetHeader) + sizeof (struct IPv4Header)],
+                             frame_size - sizeof (struct EthernetHeader) - sizeof (struct IPv4Header));
+            if (local_addr_lookup (ifc->vrf, &ip.destination_address)) {
+                /* the frame is in loop()'s buffer, we may reuse it for the reply */
+                deliver_local (ifc,
+                               (void *) frame,
+                               frame_size);
+                break;
+            }
             route (ip, ifc, &eh, &cframe[sizeof (struct EthernetHeader) + sizeof (struct IPv4Header)],
                    frame_size - sizeof (struct EthernetHeader) - sizeof (struct IPv4Header));
 
@@ -1107,6 +4025,7 @@ parse_frame (struct Interface *ifc,
                 fprintf (stderr,
                  "Unsupported ARP frame\n");
 #endif
+                stats_drop (DROP_MALFORMED);
                 return;
             }
             memcpy (&ah,
@@ -1125,6 +4044,7 @@ parse_frame (struct Interface *ifc,
              "Unsupported Ethernet tag %04X\n",
              ntohs (eh.tag));
 #endif
+            stats_drop (DROP_UNSUPPORTED);
             return;
     }
 
@@ -1145,6 +4065,10 @@ handle_frame (uint16_t interface,
 {
     if (interface > num_ifc)
         abort ();
+    if (0 == gifc[interface - 1].ifc_num)
+        return; /* removed, or its configuration was rejected */
+    stats_rx (interface,
+              frame_size);
     parse_frame (&gifc[interface - 1],
                  frame,
                  frame_size);
@@ -1161,30 +4085,36 @@ static struct Interface *
 find_interface (const char *name)
 {
     for (unsigned int i = 0; i<num_ifc; i++)
-        if (0 == strcasecmp (name,
-                             gifc[i].name))
+        if ( (0 != gifc[i].ifc_num) &&
+             (0 == strcasecmp (name,
+                               gifc[i].name)) )
             return &gifc[i];
     return NULL;
 }
 
 // copy von arp.c // Mac
 static void print_arp_cache(){
-    for (int i=0; i < arpCacheSize; i++) {
-        print_ip(&arpCache[i].ip);
-        print(" -> ");
-        print_mac(&arpCache[i].mac);
-        print(" (");
-        char *name = arpCache[i].ifc.name;
-        for (int j = 0; arpCache[i].ifc.name[j] != NULL; j++) {
-            print("%c", name[j]);
+    for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++) {
+        const struct Vrf *v = &vrfs[vrf];
+
+        for (int i=0; i < v->arp_cache_size; i++) {
+            print_ip(&v->arp_cache[i].ip);
+            print_append(" -> ");
+            print_mac(&v->arp_cache[i].mac);
+            print_append(" (%s)", v->arp_cache[i].ifc.name);
+            if (0 != vrf)
+                print_append(" vrf %u", vrf);
+            print_append("\n");
         }
-        print(")\n");
     }
+    print_flush();
 }
 
-static int ipv4_lookup(struct in_addr ip4){
-    for (int i = 0; i < arpCacheSize; i++) {
-        if (0== ipcomp(&ip4, &arpCache[i].ip)) {
+static int ipv4_lookup(uint16_t vrf, struct in_addr ip4){
+    struct Vrf *v = &vrfs[vrf];
+
+    for (int i = 0; i < v->arp_cache_size; i++) {
+        if (0== ipcomp(&ip4, &v->arp_cache[i].ip)) {
             return 0;
         }
     }
@@ -1233,7 +4163,7 @@ process_cmd_arp ()
                  tok);
         return;
     }
-    if (-1 == ipv4_lookup(v4)) {
+    if (-1 == ipv4_lookup(ifc->vrf, v4)) {
         send_broadcast_APR(ifc, v4);
     }
 }
@@ -1301,18 +4231,60 @@ parse_network (struct in_addr *network,
 
 
 /**
- * Parse route from arguments in strtok() buffer.
+ * Parse VRF number in @a arg.
+ *
+ * @param vrf[out] set to the VRF
+ * @param arg VRF number as text
+ * @return 0 on success
+ */
+static int
+parse_vrf (uint16_t *vrf,
+           const char *arg)
+{
+    unsigned int num;
+    char dummy;
+
+    if ( (NULL == arg) ||
+         (1 != sscanf (arg,
+                       "%u%c",
+                       &num,
+                       &dummy)) )
+    {
+        fprintf (stderr,
+                 "Expected VRF number, not `%s'\n",
+                 arg);
+        return 1;
+    }
+    if (num >= NUM_VRFS)
+    {
+        fprintf (stderr,
+                 "VRF %u invalid (only %u VRFs)\n",
+                 num,
+                 (unsigned int) NUM_VRFS);
+        return 1;
+    }
+    *vrf = (uint16_t) num;
+    return 0;
+}
+
+
+/**
+ * Parse route from arguments in strtok() buffer.  Format is
+ * "NETWORK via NEXT_HOP dev IFC [vrf N]"; without "vrf" the route is
+ * added to the VRF of IFC.
  *
  * @param target_network[out] set to target network
  * @param target_netmask[out] set to target netmask
  * @param next_hop[out] set to next hop
  * @param ifc[out] set to target interface
+ * @param vrf[out] set to the VRF whose table the route is for
  */
 static int
 parse_route (struct in_addr *target_network,
              struct in_addr *target_netmask,
              struct in_addr *next_hop,
-             struct Interface **ifc)
+             struct Interface **ifc,
+             uint16_t *vrf)
 {
     char *tok;
 
@@ -1367,7 +4339,20 @@ parse_route (struct in_addr *target_network,
                  tok);
         return 1;
     }
-    return 0;
+    *vrf = (*ifc)->vrf;
+    tok = strtok (NULL, " ");
+    if (NULL == tok)
+        return 0;
+    if (0 != strcasecmp ("vrf",
+                         tok))
+    {
+        fprintf (stderr,
+                 "Expected `vrf', not `%s'\n",
+                 tok);
+        return 1;
+    }
+    return parse_vrf (vrf,
+                      strtok (NULL, " "));
 }
 
 
@@ -1381,8 +4366,9 @@ process_cmd_route_add ()
     struct in_addr target_netmask;
     struct in_addr next_hop;
     struct Interface *ifc;
+    uint16_t vrf;
 
-    if (0 != parse_route (&target_network, &target_netmask, &next_hop, &ifc)) {
+    if (0 != parse_route (&target_network, &target_netmask, &next_hop, &ifc, &vrf)) {
         return;
     } else {
         struct in_addr network_IP;
@@ -1390,12 +4376,17 @@ process_cmd_route_add ()
         new_entry.network_target = target_network;
         new_entry.network_mask = target_netmask;
         new_entry.gateway = next_hop;
-        new_entry.ifc = *ifc;
-        struct MacAddress mac = lookup_ipv4_inARP(new_entry.gateway); //lookup Mac address of gateway in ARP table
+        new_entry.ifc_num = ifc->ifc_num;
+        new_entry.vrf = vrf; //may differ from ifc->vrf to leak traffic into another VRF
+        struct MacAddress mac = lookup_ipv4_inARP(ifc->vrf, new_entry.gateway); //lookup Mac address of gateway in ARP table of the outgoing interface
 
         if (0 == maccomp(&NULL_ADDRESS, &mac)) { //if the mac address is NOT found in ARP-table, it can not be used for routing, abort
             return;
         }
+        if (NULL != lookup_rt_for_del(vrf, target_network, target_netmask, next_hop, ifc)) { //same next hop twice would get twice the traffic
+            fprintf(stderr, "Route exists already\n");
+            return;
+        }
         add_entry(&new_entry);
     }
 
@@ -1412,11 +4403,12 @@ process_cmd_route_del ()
     struct in_addr target_netmask;
     struct in_addr next_hop;
     struct Interface *ifc;
+    uint16_t vrf;
 
-    if (0 != parse_route (&target_network, &target_netmask, &next_hop, &ifc)) {
+    if (0 != parse_route (&target_network, &target_netmask, &next_hop, &ifc, &vrf)) {
         return;
     } else {
-        struct Routing_entry* deletable_entry = lookup_rt_for_del(target_network, target_netmask, next_hop, ifc);
+        struct Routing_entry* deletable_entry = lookup_rt_for_del(vrf, target_network, target_netmask, next_hop, ifc);
         if(NULL != deletable_entry) {
             delete_entry(deletable_entry);
         }
@@ -1426,28 +4418,497 @@ process_cmd_route_del ()
 
 
 /**
- * Print out the routing table.
+ * Print out the routing tables of all VRFs.
  */
 static void
 process_cmd_route_list ()
 {
     struct Routing_entry *iter;
-   for (iter = routing_table; NULL != iter; iter = iter->next){
+   for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++)
+   for (iter = vrfs[vrf].routing_table; NULL != iter; iter = iter->next){
 
         print_ip(&iter->network_target);
-        print("/");
+        print_append("/");
         print_ip(&iter->network_mask);
-        print(" -> ");
+        print_append(" -> ");
         print_ip(&iter->gateway);
-        print(" (");
-        print("%s", iter->ifc.name);
-        print(")\n");
+        print_append(" (%s)", gifc[iter->ifc_num - 1].name);
+        if (0 != vrf)
+            print_append(" vrf %u", vrf);
+        print_append("\n");
 
    }
+   print_flush();
 
  }
 
 
+/**
+ * Print the size of the FIB of each VRF with routes, and its memory
+ * per prefix.  "route fib on|off" switches aggregation on or off.
+ */
+static void
+process_cmd_route_fib ()
+{
+    char *arg = strtok (NULL, " ");
+
+    if (NULL != arg) {
+        if (0 == strcasecmp ("on", arg))
+            fib_aggregate = 1;
+        else if (0 == strcasecmp ("off", arg))
+            fib_aggregate = 0;
+        else {
+            fprintf (stderr,
+                     "Expected `on' or `off'\n");
+            return;
+        }
+        for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++)
+            vrfs[vrf].fib.dirty = 1;
+    }
+    for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++) {
+        const struct Fib *fib = &vrfs[vrf].fib;
+        size_t rib_bytes;
+        size_t fib_bytes;
+
+        if (NULL == vrfs[vrf].routing_table)
+            continue;
+        if (fib->dirty || (0 == fib->num_nodes))
+            fib_build (vrf);
+        fib_memory (vrf,
+                    &rib_bytes,
+                    &fib_bytes);
+        print_append ("vrf %u: %u prefixes, %u entries%s, %u nodes, %u next hops, %zu bytes FIB + %zu bytes routes (%.1f bytes/prefix)\n",
+                      vrf,
+                      fib->num_prefixes,
+                      fib->num_entries,
+                      fib_aggregate ? " aggregated" : "",
+                      fib->num_nodes,
+                      fib->num_nhs - 1,
+                      fib_bytes,
+                      rib_bytes,
+                      (double) (fib_bytes + rib_bytes) / fib->num_prefixes);
+    }
+    print_flush ();
+}
+
+
+/**
+ * Parse port range "PORT" or "LOW-HIGH" in @a arg.
+ *
+ * @param lo[out] set to the lowest port
+ * @param hi[out] set to the highest port
+ * @param arg text to parse
+ * @return 0 on success
+ */
+static int
+parse_port_range (uint16_t *lo,
+                  uint16_t *hi,
+                  const char *arg)
+{
+    unsigned int l;
+    unsigned int h;
+    char dummy;
+
+    if (NULL == arg)
+        arg = "";
+    if (1 == sscanf (arg,
+                     "%u%c",
+                     &l,
+                     &dummy))
+        h = l;
+    else if (2 != sscanf (arg,
+                          "%u-%u%c",
+                          &l,
+                          &h,
+                          &dummy))
+    {
+        fprintf (stderr,
+                 "Expected port or port range, not `%s'\n",
+                 arg);
+        return 1;
+    }
+    if ( (l > h) ||
+         (h > UINT16_MAX) )
+    {
+        fprintf (stderr,
+                 "Port range `%s' invalid\n",
+                 arg);
+        return 1;
+    }
+    *lo = (uint16_t) l;
+    *hi = (uint16_t) h;
+    return 0;
+}
+
+
+/**
+ * Parse ACL rule from arguments in strtok() buffer.  Format is
+ * "allow|deny [src NETWORK] [dst NETWORK] [proto tcp|udp|icmp|NUMBER]
+ * [sport PORTS] [dport PORTS]", ports need "proto tcp" or "proto udp".
+ *
+ * @param r[out] rule to initialize (except for the sequence number)
+ * @param tok first token of the rule
+ * @return 0 on success
+ */
+static int
+parse_acl_rule (struct AclRule *r,
+                const char *tok)
+{
+    memset (r,
+            0,
+            sizeof (*r));
+    r->any_protocol = 1;
+    r->sport_hi = UINT16_MAX;
+    r->dport_hi = UINT16_MAX;
+    if ( (NULL != tok) &&
+         (0 == strcasecmp ("allow",
+                           tok)) )
+        r->allow = 1;
+    else if ( (NULL == tok) ||
+              (0 != strcasecmp ("deny",
+                                tok)) )
+    {
+        fprintf (stderr,
+                 "Expected `allow' or `deny', not `%s'\n",
+                 tok);
+        return 1;
+    }
+    while (NULL != (tok = strtok (NULL, " ")))
+    {
+        const char *arg = strtok (NULL, " ");
+
+        if (NULL == arg)
+        {
+            fprintf (stderr,
+                     "`%s' lacks an argument\n",
+                     tok);
+            return 1;
+        }
+        if ( (0 == strcasecmp ("src",
+                               tok)) ||
+             (0 == strcasecmp ("dst",
+                               tok)) )
+        {
+            int src = (0 == strcasecmp ("src",
+                                        tok));
+            struct in_addr network;
+            struct in_addr netmask;
+
+            if (0 != parse_network (&network,
+                                    &netmask,
+                                    arg))
+                return 1;
+            if (src)
+            {
+                r->key.src = network;
+                r->src_len = __builtin_popcount (netmask.s_addr);
+            }
+            else
+            {
+                r->key.dst = network;
+                r->dst_len = __builtin_popcount (netmask.s_addr);
+            }
+        }
+        else if (0 == strcasecmp ("proto",
+                                  tok))
+        {
+            unsigned int proto;
+            char dummy;
+
+            if (0 == strcasecmp ("tcp",
+                                 arg))
+                proto = IPPROTO_TCP;
+            else if (0 == strcasecmp ("udp",
+                                      arg))
+                proto = IPPROTO_UDP;
+            else if (0 == strcasecmp ("icmp",
+                                      arg))
+                proto = IPPROTO_ICMP;
+            else if ( (1 != sscanf (arg,
+                                    "%u%c",
+                                    &proto,
+                                    &dummy)) ||
+                      (proto > UINT8_MAX) )
+            {
+                fprintf (stderr,
+                         "Protocol `%s' unknown\n",
+                         arg);
+                return 1;
+            }
+            r->any_protocol = 0;
+            r->key.protocol = (uint8_t) proto;
+        }
+        else if (0 == strcasecmp ("sport",
+                                  tok))
+        {
+            if (0 != parse_port_range (&r->sport_lo,
+                                       &r->sport_hi,
+                                       arg))
+                return 1;
+        }
+        else if (0 == strcasecmp ("dport",
+                                  tok))
+        {
+            if (0 != parse_port_range (&r->dport_lo,
+                                       &r->dport_hi,
+                                       arg))
+                return 1;
+        }
+        else
+        {
+            fprintf (stderr,
+                     "Unexpected `%s' in ACL rule\n",
+                     tok);
+            return 1;
+        }
+    }
+    if ( acl_rule_has_ports (r) &&
+         ( r->any_protocol ||
+           ( (IPPROTO_TCP != r->key.protocol) &&
+             (IPPROTO_UDP != r->key.protocol) ) ) )
+    {
+        fprintf (stderr,
+                 "Ports require `proto tcp' or `proto udp'\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Print the rules of @a acl with their hit counters.
+ *
+ * @param ifc interface of the ACL
+ * @param dir direction of the ACL
+ * @param acl the ACL
+ */
+static void
+print_acl (const struct Interface *ifc,
+           enum AclDirection dir,
+           const struct Acl *acl)
+{
+    for (const struct AclRule *r = acl->rules; NULL != r; r = r->next)
+    {
+        struct in_addr src = r->key.src; /* key is packed */
+        struct in_addr dst = r->key.dst;
+
+        print_append ("%s %s %u %s",
+                      ifc->name,
+                      (ACL_IN == dir) ? "in" : "out",
+                      (unsigned int) r->seq,
+                      r->allow ? "allow" : "deny");
+        if (0 != r->src_len)
+        {
+            print_append (" src ");
+            print_ip (&src);
+            print_append ("/%u",
+                          (unsigned int) r->src_len);
+        }
+        if (0 != r->dst_len)
+        {
+            print_append (" dst ");
+            print_ip (&dst);
+            print_append ("/%u",
+                          (unsigned int) r->dst_len);
+        }
+        if (! r->any_protocol)
+            print_append (" proto %u",
+                          (unsigned int) r->key.protocol);
+        if ( (0 != r->sport_lo) || (UINT16_MAX != r->sport_hi) )
+            print_append (" sport %u-%u",
+                          (unsigned int) r->sport_lo,
+                          (unsigned int) r->sport_hi);
+        if ( (0 != r->dport_lo) || (UINT16_MAX != r->dport_hi) )
+            print_append (" dport %u-%u",
+                          (unsigned int) r->dport_lo,
+                          (unsigned int) r->dport_hi);
+        print_append (" hits %llu\n",
+                      (unsigned long long) r->hits);
+    }
+}
+
+
+/**
+ * The user entered an "acl" command.  The remaining arguments can be
+ * obtained via 'strtok()'.  Format is "acl [IFC]" to list the rules,
+ * "acl IFC in|out add [SEQ] RULE" (see parse_acl_rule()) and
+ * "acl IFC in|out del SEQ".
+ */
+static void
+process_cmd_acl ()
+{
+    const char *tok = strtok (NULL, " ");
+    struct Interface *ifc = NULL;
+    enum AclDirection dir;
+    struct Acl *acl;
+    struct AclRule r;
+    unsigned int seq;
+    char dummy;
+
+    if (NULL != tok)
+    {
+        ifc = find_interface (tok);
+        if (NULL == ifc)
+        {
+            fprintf (stderr,
+                     "Interface `%s' unknown\n",
+                     tok);
+            return;
+        }
+        tok = strtok (NULL, " ");
+    }
+    if (NULL == tok)
+    {
+        for (unsigned int i = 0; (i < num_acls) && (i < num_ifc); i++)
+            if ( (0 != gifc[i].ifc_num) &&
+                 ( (NULL == ifc) ||
+                   (ifc == &gifc[i]) ) )
+                for (unsigned int d = 0; d < ACL_DIRECTIONS; d++)
+                    print_acl (&gifc[i],
+                               d,
+                               &acls[i].dir[d]);
+        print_flush ();
+        return;
+    }
+    if (0 == strcasecmp ("in",
+                         tok))
+        dir = ACL_IN;
+    else if (0 == strcasecmp ("out",
+                              tok))
+        dir = ACL_OUT;
+    else
+    {
+        fprintf (stderr,
+                 "Expected `in' or `out', not `%s'\n",
+                 tok);
+        return;
+    }
+    grow_array (&acls,
+                sizeof (struct AclSet),
+                &num_acls,
+                ifc->ifc_num);
+    acl = &acls[ifc->ifc_num - 1].dir[dir];
+    tok = strtok (NULL, " ");
+    if ( (NULL != tok) &&
+         (0 == strcasecmp ("del",
+                           tok)) )
+    {
+        tok = strtok (NULL, " ");
+        if ( (NULL == tok) ||
+             (1 != sscanf (tok,
+                           "%u%c",
+                           &seq,
+                           &dummy)) ||
+             (0 != acl_del (acl,
+                            seq)) )
+            fprintf (stderr,
+                     "No ACL rule `%s'\n",
+                     tok);
+        return;
+    }
+    if ( (NULL == tok) ||
+         (0 != strcasecmp ("add",
+                           tok)) )
+    {
+        fprintf (stderr,
+                 "Expected `add' or `del', not `%s'\n",
+                 tok);
+        return;
+    }
+    tok = strtok (NULL, " ");
+    if ( (NULL != tok) &&
+         (1 == sscanf (tok,
+                       "%u%c",
+                       &seq,
+                       &dummy)) )
+    {
+        tok = strtok (NULL, " ");
+    }
+    else
+    {
+        const struct AclRule *last = acl->last;
+
+        seq = (NULL == last) ? 10 : last->seq + 10; /* leave room for inserting rules */
+        if ( (NULL != last) &&
+             (seq < last->seq) )
+        {
+            fprintf (stderr,
+                     "ACL sequence numbers exhausted\n");
+            return;
+        }
+    }
+    if (0 != parse_acl_rule (&r,
+                             tok))
+        return;
+    r.seq = seq;
+    if (0 != acl_add (acl,
+                      &r))
+        fprintf (stderr,
+                 "ACL rule %u exists already\n",
+                 seq);
+}
+
+
+/**
+ * The user entered a "nat" command.  The remaining arguments can be
+ * obtained via 'strtok()'.  "nat IFC" translates everything leaving
+ * through IFC to the address of IFC, "nat off" turns that off and
+ * "nat" lists the sessions.
+ */
+static void
+process_cmd_nat ()
+{
+    const char *tok = strtok (NULL, " ");
+    struct Interface *ifc;
+
+    if (NULL == tok)
+    {
+        uint32_t now = nat_now ();
+
+        if (0 == nat_ifc_num)
+            return;
+        nat_expire (now);
+        for (uint32_t i = 1; i < nat_unused; i++)
+        {
+            const struct NatSession *s = &nat_sessions[i];
+
+            if (0 == s->protocol)
+                continue;
+            print_append ("%u ",
+                          (unsigned int) s->protocol);
+            print_ip (&s->inside_ip);
+            print_append (":%u -> %u -> ",
+                          (unsigned int) ntohs (s->inside_port),
+                          (unsigned int) ntohs (s->outside_port));
+            print_ip (&s->remote_ip);
+            print_append (":%u (%us)\n",
+                          (unsigned int) ntohs (s->remote_port),
+                          (unsigned int) (s->expires - now));
+        }
+        print_append ("%u sessions on %s\n",
+                      (unsigned int) nat_num_sessions,
+                      gifc[nat_ifc_num - 1].name);
+        print_flush ();
+        return;
+    }
+    if (0 == strcasecmp ("off",
+                         tok))
+    {
+        nat_disable ();
+        return;
+    }
+    ifc = find_interface (tok);
+    if (NULL == ifc)
+    {
+        fprintf (stderr,
+                 "Interface `%s' unknown\n",
+                 tok);
+        return;
+    }
+    nat_enable (ifc->ifc_num);
+}
+
+
 /**
  * The user entered a "route" command.  The remaining
  * arguments can be obtained via 'strtok()'.
@@ -1468,6 +4929,9 @@ process_cmd_route ()
     else if (0 == strcasecmp ("list",
                               subcommand))
         process_cmd_route_list ();
+    else if (0 == strcasecmp ("fib",
+                              subcommand))
+        process_cmd_route_fib ();
     else
         fprintf (stderr,
                  "Subcommand `%s' not understood\n",
@@ -1477,7 +4941,7 @@ process_cmd_route ()
 
 /**
  * Parse network specification in @a net, initializing @a ifc.
- * Format of @a net is "IPV4:IP/NETMASK".
+ * Format of @a net is "IPV4:IP/NETMASK" or "IPV4:IP/NETMASK,VRF:N".
  *
  * @param ifc[out] interface specification to initialize
  * @param arg interface specification to parse
@@ -1487,6 +4951,9 @@ static int
 parse_network_arg (struct Interface *ifc,
                    const char *net)
 {
+    const char *vrf;
+    char *addr;
+    int ret;
 
     if (0 !=
         strncasecmp (net,
@@ -1499,15 +4966,39 @@ parse_network_arg (struct Interface *ifc,
         return 1;
     }
     net += strlen ("IPV4:");
-    return parse_network (&ifc->ip,
-                          &ifc->netmask,
-                          net);
+    vrf = strchr (net, ',');
+    if (NULL == vrf)
+        return parse_network (&ifc->ip,
+                              &ifc->netmask,
+                              net);
+    if (0 !=
+        strncasecmp (vrf + 1,
+                     "VRF:",
+                     strlen ("VRF:")))
+    {
+        fprintf (stderr,
+                 "Expected `VRF:' after network, not `%s'\n",
+                 vrf + 1);
+        return 1;
+    }
+    if (0 !=
+        parse_vrf (&ifc->vrf,
+                   vrf + 1 + strlen ("VRF:")))
+        return 1;
+    addr = strndup (net,
+                    vrf - net);
+    ret = parse_network (&ifc->ip,
+                         &ifc->netmask,
+                         addr);
+    free (addr);
+    return ret;
 }
 
 
 /**
  * Parse interface specification @a arg and update @a ifc.  Format is
- * "IFCNAME[IPV4:IP/NETMASK]=MTU".  The "=MTU" is optional.
+ * "IFCNAME[IPV4:IP/NETMASK,VRF:N]=MTU".  The ",VRF:N" (default: VRF 0)
+ * and the "=MTU" are optional.
  *
  * @param ifc[out] interface specification to initialize
  * @param arg interface specification to parse
@@ -1521,6 +5012,7 @@ parse_cmd_arg (struct Interface *ifc,
     char *nspec;
 
     ifc->mtu = 1500 + sizeof (struct EthernetHeader); /* default in case unspecified */
+    ifc->vrf = 0;
     tok = strchr (arg, '[');
     if (NULL == tok)
     {
@@ -1608,6 +5100,15 @@ handle_control (char *cmd,
     else if (0 == strcasecmp (tok,
                               "route"))
         process_cmd_route ();
+    else if (0 == strcasecmp (tok,
+                              "acl"))
+        process_cmd_acl ();
+    else if (0 == strcasecmp (tok,
+                              "nat"))
+        process_cmd_nat ();
+    else if (0 == strcasecmp (tok,
+                              "stats"))
+        stats_command ();
     else
         fprintf (stderr,
                  "Unsupported command `%s'\n",
@@ -1628,6 +5129,114 @@ handle_mac (uint16_t ifc_num,
     if (ifc_num > num_ifc)
         abort ();
     gifc[ifc_num - 1].mac = *mac;
+    if (0 != gifc[ifc_num - 1].ifc_num)
+        icmp_template_init (&gifc[ifc_num - 1]);
+}
+
+
+/**
+ * Handle interface @a ifc_num with @a mac and configuration @a arg
+ * added at runtime; adds the route to its network.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg interface specification (as on the command line)
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+                const struct MacAddress *mac,
+                const char *arg)
+{
+    struct Interface ifc;
+
+    memset (&ifc,
+            0,
+            sizeof (ifc));
+    if (0 !=
+        parse_cmd_arg (&ifc,
+                       arg))
+    {
+        fprintf (stderr,
+                 "Ignoring interface %u\n",
+                 (unsigned int) ifc_num);
+        free (ifc.name);
+        return;
+    }
+    ifc.ifc_num = ifc_num;
+    ifc.mac = *mac;
+    grow_array (&gifc,
+                sizeof (struct Interface),
+                &num_ifc,
+                ifc_num);
+    stats_init ("router",
+                num_ifc);
+    free (gifc[ifc_num - 1].name);
+    gifc[ifc_num - 1] = ifc;
+    stats_set_name (ifc_num,
+                    gifc[ifc_num - 1].name);
+    icmp_template_init (&gifc[ifc_num - 1]);
+    local_addr_rebuild ();
+    if (0 != timer) { //routing table exists already, add the connected network
+        struct Routing_entry entry;
+
+        entry.network_mask = ifc.netmask;
+        entry.network_target.s_addr = ifc.ip.s_addr & ifc.netmask.s_addr;
+        entry.ifc_num = ifc_num;
+        entry.gateway = IP0;
+        entry.undeleteable = 1;
+        entry.vrf = ifc.vrf;
+        add_entry(&entry);
+    }
+}
+
+
+/**
+ * Handle interface @a ifc_num being removed at runtime: drop the
+ * routes and ARP cache entries using it.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+    if (ifc_num > num_ifc)
+        return;
+    for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++) { //routes leaking into other VRFs may use the interface, too
+        struct Routing_entry **pos = &vrfs[vrf].routing_table;
+
+        while (NULL != *pos) {
+            struct Routing_entry *e = *pos;
+
+            if (e->ifc_num == ifc_num) {
+                *pos = e->next;
+                nhg_leave(e);
+                slab_free(&route_slab, e);
+                vrfs[vrf].fib.dirty = 1;
+                fib_generation++;
+            } else {
+                pos = &e->next;
+            }
+        }
+    }
+    struct Vrf *v = &vrfs[gifc[ifc_num - 1].vrf];
+    for (int i = v->arp_cache_size - 1; i >= 0; i--) {
+        if (v->arp_cache[i].ifc.ifc_num == ifc_num) {
+            fib_generation++;
+            v->arp_cache[i] = v->arp_cache[v->arp_cache_size - 1];
+            v->arp_cache_size--;
+        }
+    }
+    if (ifc_num <= num_acls)
+        for (unsigned int d = 0; d < ACL_DIRECTIONS; d++)
+            acl_clear (&acls[ifc_num - 1].dir[d]);
+    if (nat_ifc_num == ifc_num)
+        nat_disable ();
+    stats_clear (ifc_num);
+    free (gifc[ifc_num - 1].name);
+    memset (&gifc[ifc_num - 1],
+            0,
+            sizeof (struct Interface));
+    local_addr_rebuild ();
 }
 
 
@@ -1645,30 +5254,47 @@ int
 main (int argc,
       char **argv)
 {
-    struct Interface ifc[argc];
-
-    memset (ifc,
-            0,
-            sizeof (ifc));
-    num_ifc = argc - 1;
-    gifc = ifc;
+    grow_array (&gifc,
+                sizeof (struct Interface),
+                &num_ifc,
+                argc - 1);
+    stats_init ("router",
+                num_ifc);
 
 
     for (unsigned int i = 1; i<argc; i++)
     {
-        struct Interface *p = &ifc[i - 1];
+        struct Interface *p = &gifc[i - 1];
 
-        ifc[i - 1].ifc_num = i;
+        p->ifc_num = i;
         if (0 !=
             parse_cmd_arg (p,
                            argv[i]))
             abort ();
+        stats_set_name (i,
+                        p->name);
     }
 
 
     inet_pton(AF_INET, "0.0.0.0", &IP0);
+    local_addr_rebuild ();
     loop ();
-    for (unsigned int i = 1; i<argc; i++)
-        free (ifc[i - 1].name);
+    for (unsigned int i = 0; i<num_ifc; i++)
+        free (gifc[i].name);
+    free (gifc);
+    free (icmp_templates);
+    free (local_addrs);
+    for (unsigned int i = 0; i < num_acls; i++)
+        for (unsigned int d = 0; d < ACL_DIRECTIONS; d++)
+            acl_clear (&acls[i].dir[d]);
+    free (acls);
+    nat_disable ();
+    for (unsigned int vrf = 0; vrf < NUM_VRFS; vrf++) {
+        free (vrfs[vrf].fib.nodes);
+        free (vrfs[vrf].fib.nhs);
+    }
+    slab_destroy (&route_slab);
+    slab_destroy (&nhg_slab);
+    slab_destroy (&acl_rule_slab);
     return 0;
 }
\ No newline at end of file
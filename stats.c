@@ -0,0 +1,574 @@
+/*
+     This file is part of the BTI3021 networking project.
+     Copyright (C) 2026 the BTI3021 project contributors
+
+     This program is free software: you can redistribute it and/or modify it
+     under the terms of the GNU Affero General Public License as published
+     by the Free Software Foundation, either version 3 of the License,
+     or (at your option) any later version.
+
+     This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Affero General Public License for more details.
+
+     You should have received a copy of the GNU Affero General Public License
+     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file stats.c
+ * @brief Hot-path counters and the "stats" command shared by all programs
+ *
+ * Must be included after print.c.  The counters are plain integers
+ * (all programs are single-threaded); per-interface counters and the
+ * global counters live on their own cache lines so that updating them
+ * never touches data the forwarding path reads.
+ */
+
+/**
+ * Size of a cache line on the platforms we care about.
+ */
+#define STATS_CACHE_LINE 64
+
+
+/**
+ * Reasons for dropping a frame.
+ */
+enum StatsDropReason
+{
+  /**
+   * Frame too short or otherwise not parseable.
+   */
+  DROP_MALFORMED,
+
+  /**
+   * Protocol we do not handle.
+   */
+  DROP_UNSUPPORTED,
+
+  /**
+   * Frame claims to come from one of our own MACs.
+   */
+  DROP_OWN_SOURCE,
+
+  /**
+   * Destination is on the port the frame came from.
+   */
+  DROP_SAME_PORT,
+
+  /**
+   * Ingress port is not a member of the frame's VLAN.
+   */
+  DROP_VLAN,
+
+  /**
+   * Frame does not fit into a message (or the MTU, and must
+   * not be fragmented).
+   */
+  DROP_TOO_LARGE,
+
+  /**
+   * IPv4 header checksum is wrong.
+   */
+  DROP_CHECKSUM,
+
+  /**
+   * TTL expired.
+   */
+  DROP_TTL,
+
+  /**
+   * No route to the destination.
+   */
+  DROP_NO_ROUTE,
+
+  /**
+   * Next hop did not resolve via ARP.
+   */
+  DROP_NO_ARP,
+
+  /**
+   * Denied by an access control list.
+   */
+  DROP_ACL,
+
+  /**
+   * Cannot be translated by NAT (unsupported protocol, fragment,
+   * or no free session or port).
+   */
+  DROP_NAT,
+
+  DROP_MAX
+};
+
+
+static const char *stats_drop_names[DROP_MAX] = {
+  "malformed",
+  "unsupported",
+  "own_source",
+  "same_port",
+  "vlan",
+  "too_large",
+  "checksum",
+  "ttl",
+  "no_route",
+  "no_arp",
+  "acl",
+  "nat"
+};
+
+
+/**
+ * Counters of one interface, on their own cache line.
+ */
+struct StatsInterface
+{
+  uint64_t rx_packets;
+
+  uint64_t rx_bytes;
+
+  uint64_t tx_packets;
+
+  uint64_t tx_bytes;
+
+} __attribute__ ((aligned (STATS_CACHE_LINE)));
+
+
+/**
+ * Counters of the program (not per interface).
+ */
+struct Stats
+{
+  /**
+   * Frames sent to all (eligible) interfaces.
+   */
+  uint64_t floods;
+
+  /**
+   * Lookups in the program's main table (MAC table, FDB, ARP cache or
+   * routing table) that found / did not find an entry.
+   */
+  uint64_t table_hits;
+
+  uint64_t table_misses;
+
+  /**
+   * Entries replaced because the table was full.
+   */
+  uint64_t table_evictions;
+
+  /**
+   * Lookups in a cache in front of the main table (the router's flow
+   * cache) that found / did not find a valid entry.
+   */
+  uint64_t cache_hits;
+
+  uint64_t cache_misses;
+
+  /**
+   * ICMP messages we sent / decided not to send.
+   */
+  uint64_t icmp_generated;
+
+  uint64_t icmp_suppressed;
+
+  /**
+   * Fragments we created.
+   */
+  uint64_t fragments;
+
+  uint64_t drops[DROP_MAX];
+
+} __attribute__ ((aligned (STATS_CACHE_LINE)));
+
+
+/**
+ * Global counters.
+ */
+static struct Stats stats;
+
+/**
+ * Per-interface counters, indexed by interface number - 1.
+ */
+static struct StatsInterface *stats_ifc;
+
+/**
+ * Length of @e stats_ifc.
+ */
+static unsigned int stats_num_ifc;
+
+/**
+ * Name of the program, for the Prometheus dump.
+ */
+static const char *stats_program;
+
+/**
+ * Names of the interfaces (NULL to use the number).
+ */
+static const char **stats_ifc_names;
+
+
+/**
+ * Set up the counters for @a num_ifc interfaces.  May be called again
+ * with a larger @a num_ifc, existing counters are preserved.
+ *
+ * @param program name of the program
+ * @param num_ifc number of interfaces
+ */
+static void
+stats_init (const char *program,
+	    unsigned int num_ifc)
+{
+  struct StatsInterface *si;
+  const char **names;
+
+  stats_program = program;
+  if (num_ifc <= stats_num_ifc)
+    return;
+  si = aligned_alloc (STATS_CACHE_LINE,
+		      num_ifc * sizeof (struct StatsInterface));
+  names = calloc (num_ifc,
+		  sizeof (const char *));
+  if ( (NULL == si) ||
+       (NULL == names) )
+    abort ();
+  memset (si,
+	  0,
+	  num_ifc * sizeof (struct StatsInterface));
+  if (NULL != stats_ifc)
+    {
+      memcpy (si,
+	      stats_ifc,
+	      stats_num_ifc * sizeof (struct StatsInterface));
+      memcpy (names,
+	      stats_ifc_names,
+	      stats_num_ifc * sizeof (const char *));
+    }
+  free (stats_ifc);
+  free (stats_ifc_names);
+  stats_ifc = si;
+  stats_ifc_names = names;
+  stats_num_ifc = num_ifc;
+}
+
+
+/**
+ * Give interface @a ifc_num the name @a name in the output.
+ */
+static void
+stats_set_name (uint16_t ifc_num,
+		const char *name)
+{
+  if ( (0 == ifc_num) ||
+       (ifc_num > stats_num_ifc) )
+    return;
+  stats_ifc_names[ifc_num - 1] = name;
+}
+
+
+/**
+ * Reset the counters and name of interface @a ifc_num (which was
+ * removed, its number may be reused).
+ */
+static void
+stats_clear (uint16_t ifc_num)
+{
+  if ( (0 == ifc_num) ||
+       (ifc_num > stats_num_ifc) )
+    return;
+  memset (&stats_ifc[ifc_num - 1],
+	  0,
+	  sizeof (struct StatsInterface));
+  stats_ifc_names[ifc_num - 1] = NULL;
+}
+
+
+/**
+ * Count a frame of @a size bytes received on interface @a ifc_num.
+ */
+static inline void
+stats_rx (uint16_t ifc_num,
+	  size_t size)
+{
+  if ( (0 == ifc_num) ||
+       (ifc_num > stats_num_ifc) )
+    return;
+  stats_ifc[ifc_num - 1].rx_packets++;
+  stats_ifc[ifc_num - 1].rx_bytes += size;
+}
+
+
+/**
+ * Count a frame of @a size bytes sent on interface @a ifc_num.
+ */
+static inline void
+stats_tx (uint16_t ifc_num,
+	  size_t size)
+{
+  if ( (0 == ifc_num) ||
+       (ifc_num > stats_num_ifc) )
+    return;
+  stats_ifc[ifc_num - 1].tx_packets++;
+  stats_ifc[ifc_num - 1].tx_bytes += size;
+}
+
+
+/**
+ * Count a frame dropped for @a reason.
+ */
+static inline void
+stats_drop (enum StatsDropReason reason)
+{
+  stats.drops[reason]++;
+}
+
+
+/**
+ * Is slot @a i of the counters unused (no name and nothing counted,
+ * e.g. an interface that was removed)?
+ */
+static int
+stats_ifc_unused (unsigned int i)
+{
+  const struct StatsInterface *si = &stats_ifc[i];
+
+  return (NULL == stats_ifc_names[i]) &&
+    (0 == si->rx_packets) &&
+    (0 == si->tx_packets);
+}
+
+
+/**
+ * Print the counters for the user.
+ */
+static void
+stats_print ()
+{
+  print_append ("%-12s %12s %14s %12s %14s\n",
+		"interface",
+		"rx_packets",
+		"rx_bytes",
+		"tx_packets",
+		"tx_bytes");
+  for (unsigned int i = 0; i < stats_num_ifc; i++)
+    {
+      const struct StatsInterface *si = &stats_ifc[i];
+
+      if (stats_ifc_unused (i))
+	continue;
+      if (NULL != stats_ifc_names[i])
+	print_append ("%-12s",
+		      stats_ifc_names[i]);
+      else
+	print_append ("%-12u",
+		      i + 1);
+      print_append (" %12llu %14llu %12llu %14llu\n",
+		    (unsigned long long) si->rx_packets,
+		    (unsigned long long) si->rx_bytes,
+		    (unsigned long long) si->tx_packets,
+		    (unsigned long long) si->tx_bytes);
+    }
+  print_append ("floods %llu\n"
+		"table hits %llu misses %llu evictions %llu\n"
+		"cache hits %llu misses %llu\n"
+		"icmp generated %llu suppressed %llu\n"
+		"fragments %llu\n",
+		(unsigned long long) stats.floods,
+		(unsigned long long) stats.table_hits,
+		(unsigned long long) stats.table_misses,
+		(unsigned long long) stats.table_evictions,
+		(unsigned long long) stats.cache_hits,
+		(unsigned long long) stats.cache_misses,
+		(unsigned long long) stats.icmp_generated,
+		(unsigned long long) stats.icmp_suppressed,
+		(unsigned long long) stats.fragments);
+  print_append ("drops");
+  for (unsigned int d = 0; d < DROP_MAX; d++)
+    print_append (" %s %llu",
+		  stats_drop_names[d],
+		  (unsigned long long) stats.drops[d]);
+  print_append ("\n");
+  print_flush ();
+}
+
+
+/**
+ * Write a Prometheus counter @a name with value @a val and an
+ * optional label.
+ */
+static void
+stats_prom_counter (FILE *f,
+		    const char *name,
+		    const char *label,
+		    const char *label_value,
+		    uint64_t val)
+{
+  if (NULL == label)
+    fprintf (f,
+	     "glab_%s{program=\"%s\"} %llu\n",
+	     name,
+	     stats_program,
+	     (unsigned long long) val);
+  else
+    fprintf (f,
+	     "glab_%s{program=\"%s\",%s=\"%s\"} %llu\n",
+	     name,
+	     stats_program,
+	     label,
+	     label_value,
+	     (unsigned long long) val);
+}
+
+
+/**
+ * Write the counters in the Prometheus text format to @a fn.  The
+ * file is replaced atomically so that scrapers never see a partial
+ * dump.
+ *
+ * @return 0 on success
+ */
+static int
+stats_write_prometheus (const char *fn)
+{
+  static const char *ifc_counters[] = {
+    "rx_packets_total", "rx_bytes_total", "tx_packets_total", "tx_bytes_total"
+  };
+  char tmp[PATH_MAX];
+  FILE *f;
+
+  if (sizeof (tmp) <= (size_t) snprintf (tmp,
+					 sizeof (tmp),
+					 "%s.tmp",
+					 fn))
+    return -1;
+  f = fopen (tmp,
+	     "w");
+  if (NULL == f)
+    return -1;
+  for (unsigned int c = 0; c < 4; c++)
+    {
+      fprintf (f,
+	       "# TYPE glab_%s counter\n",
+	       ifc_counters[c]);
+      for (unsigned int i = 0; i < stats_num_ifc; i++)
+	{
+	  const struct StatsInterface *si = &stats_ifc[i];
+	  const uint64_t vals[] = {
+	    si->rx_packets, si->rx_bytes, si->tx_packets, si->tx_bytes
+	  };
+	  char num[sizeof ("4294967295")];
+	  const char *name = stats_ifc_names[i];
+
+	  if (stats_ifc_unused (i))
+	    continue;
+	  if (NULL == name)
+	    {
+	      snprintf (num,
+			sizeof (num),
+			"%u",
+			i + 1);
+	      name = num;
+	    }
+	  stats_prom_counter (f,
+			      ifc_counters[c],
+			      "interface",
+			      name,
+			      vals[c]);
+	}
+    }
+  fprintf (f,
+	   "# TYPE glab_floods_total counter\n");
+  stats_prom_counter (f, "floods_total", NULL, NULL, stats.floods);
+  fprintf (f,
+	   "# TYPE glab_table_lookups_total counter\n");
+  stats_prom_counter (f, "table_lookups_total", "result", "hit", stats.table_hits);
+  stats_prom_counter (f, "table_lookups_total", "result", "miss", stats.table_misses);
+  fprintf (f,
+	   "# TYPE glab_table_evictions_total counter\n");
+  stats_prom_counter (f, "table_evictions_total", NULL, NULL, stats.table_evictions);
+  fprintf (f,
+	   "# TYPE glab_cache_lookups_total counter\n");
+  stats_prom_counter (f, "cache_lookups_total", "result", "hit", stats.cache_hits);
+  stats_prom_counter (f, "cache_lookups_total", "result", "miss", stats.cache_misses);
+  fprintf (f,
+	   "# TYPE glab_icmp_total counter\n");
+  stats_prom_counter (f, "icmp_total", "result", "generated", stats.icmp_generated);
+  stats_prom_counter (f, "icmp_total", "result", "suppressed", stats.icmp_suppressed);
+  fprintf (f,
+	   "# TYPE glab_fragments_total counter\n");
+  stats_prom_counter (f, "fragments_total", NULL, NULL, stats.fragments);
+  fprintf (f,
+	   "# TYPE glab_drops_total counter\n");
+  for (unsigned int d = 0; d < DROP_MAX; d++)
+    stats_prom_counter (f,
+			"drops_total",
+			"reason",
+			stats_drop_names[d],
+			stats.drops[d]);
+  if (0 != fclose (f))
+    {
+      unlink (tmp);
+      return -1;
+    }
+  if (0 != rename (tmp,
+		   fn))
+    {
+      unlink (tmp);
+      return -1;
+    }
+  return 0;
+}
+
+
+/**
+ * The user entered a "stats" command.  The remaining arguments can
+ * be obtained via 'strtok()'.  Supported are "stats" (print the
+ * counters), "stats reset" and "stats prometheus FILENAME".
+ */
+static void
+stats_command ()
+{
+  const char *tok = strtok (NULL,
+			    " ");
+
+  if (NULL == tok)
+    {
+      stats_print ();
+      return;
+    }
+  if (0 == strcasecmp (tok,
+		       "reset"))
+    {
+      memset (&stats,
+	      0,
+	      sizeof (stats));
+      memset (stats_ifc,
+	      0,
+	      stats_num_ifc * sizeof (struct StatsInterface));
+      return;
+    }
+  if (0 == strcasecmp (tok,
+		       "prometheus"))
+    {
+      const char *fn = strtok (NULL,
+			       " ");
+
+      if (NULL == fn)
+	{
+	  fprintf (stderr,
+		   "stats prometheus: FILENAME missing\n");
+	  return;
+	}
+      if (0 != stats_write_prometheus (fn))
+	fprintf (stderr,
+		 "Failed to write `%s': %s\n",
+		 fn,
+		 strerror (errno));
+      return;
+    }
+  fprintf (stderr,
+	   "Usage: stats [reset|prometheus FILENAME]\n");
+}
+
+/* end of stats.c */
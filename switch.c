@@ -23,6 +23,7 @@
  */
 #include "glab.h"
 #include "print.c"
+#include "stats.c"
 
 
 /**
@@ -53,10 +54,15 @@ struct Interface
     struct MacAddress mac;
 
     /**
-    * Number of this interface.
+    * Number of this interface, 0 if this slot is unused.
     */
     uint16_t ifc_num;
 
+    /**
+    * Name of this interface (from the command line).
+    */
+    char *name;
+
 };
 
 #include <time.h>
@@ -71,9 +77,56 @@ struct Switching_connection {
     time_t timestamp;
 };
 
+#ifndef SWITCHING_TABLE_SIZE
 #define SWITCHING_TABLE_SIZE 16 //can vary, we set the table size to 16
+#endif
 #define MAC_ADDR_SIZE 6
 
+#define MAX_MIRROR_SESSIONS 8 //how many port mirroring sessions can be configured at the same time
+#define MIRROR_RX 1 //mirror frames received on the source port
+#define MIRROR_TX 2 //mirror frames sent out on the source port
+#define MIRROR_DEFAULT_RATE 10000 //default limit for mirrored frames per second per session
+
+/**
+ * A port mirroring (SPAN) session: copies frames received and/or sent on @e src to @e monitor.
+ * Copies are sampled (one out of @e sample) and limited by a token bucket to @e rate frames
+ * per second, so that a busy source port cannot starve forwarding towards the monitor port.
+ */
+struct Mirror_session {
+    uint16_t src; //interface number
+    uint16_t monitor; //interface number
+    int directions; //bitmask of MIRROR_RX and MIRROR_TX
+    unsigned int sample; //mirror one out of sample frames
+    unsigned int sample_counter;
+    uint64_t rate; //frames per second
+    uint64_t tokens; //available tokens, in frames * 10^9
+    uint64_t last_refill; //monotonic time of last refill in ns
+    uint64_t mirrored; //number of frames copied to the monitor port
+    uint64_t suppressed; //number of frames not copied due to the rate limit
+};
+
+/**
+ * All configured mirroring sessions
+ */
+static struct Mirror_session mirror_sessions[MAX_MIRROR_SESSIONS];
+
+/**
+ * Number of configured mirroring sessions
+ */
+static unsigned int num_mirror_sessions = 0;
+
+/**
+ * Output buffer: GLAB header followed by the frame that is currently being forwarded.
+ * The frame is copied in once and sent to every destination (including monitor ports)
+ * by only rewriting the interface number in the header.
+ */
+static char obuf[UINT16_MAX];
+
+/**
+ * Number of bytes used in obuf
+ */
+static size_t obuf_size = 0;
+
 /**
  * All the switching connections in an array
  */
@@ -87,42 +140,140 @@ static struct Switching_connection switching_table[SWITCHING_TABLE_SIZE];
 static unsigned int num_table_entries = 0;
 
 /**
- * Number of available contexts/interfaces
+ * Length of gifc (some slots may be unused)
  */
 static unsigned int num_ifc;
 
 /**
- * All the contexts/interfaces
+ * All the contexts/interfaces, indexed by interface number - 1
  */
 static struct Interface *gifc;
 
 
 /**
- * Forward @a frame to interface @a dst.
+ * Copy @a frame into the output buffer, behind a GLAB header.
  *
- * @param dst target interface to send the frame out on
  * @param frame the frame to forward
  * @param frame_size number of bytes in @a frame
  */
 static void
-forward_to (struct Interface *dst,
-	    const void *frame,
-	    size_t frame_size)
+load_frame (const void *frame,
+            size_t frame_size)
 {
-  char iob[frame_size + sizeof (struct GLAB_MessageHeader)];
   struct GLAB_MessageHeader hdr;
 
-  hdr.size = htons (sizeof (iob));
-  hdr.type = htons (dst->ifc_num);
-  memcpy (iob,
+  obuf_size = frame_size + sizeof (hdr);
+  hdr.size = htons (obuf_size);
+  hdr.type = htons (0);
+  memcpy (obuf,
 	  &hdr,
 	  sizeof (hdr));
-  memcpy (&iob[sizeof (hdr)],
+  memcpy (&obuf[sizeof (hdr)],
 	  frame,
 	  frame_size);
+}
+
+/**
+ * Send the frame in the output buffer to interface @a dst.
+ *
+ * @param dst target interface to send the frame out on
+ */
+static void
+send_obuf (const struct Interface *dst)
+{
+  struct GLAB_MessageHeader hdr;
+
+  memcpy (&hdr,
+	  obuf,
+	  sizeof (hdr));
+  hdr.type = htons (dst->ifc_num);
+  memcpy (obuf,
+	  &hdr,
+	  sizeof (hdr));
   write_all (STDOUT_FILENO,
-	     iob,
-	     sizeof (iob));
+	     obuf,
+	     obuf_size);
+  stats_tx (dst->ifc_num,
+	    obuf_size - sizeof (hdr));
+}
+
+/**
+ * Check the sampling rate and the token bucket of mirroring session @a ms.
+ *
+ * @param ms the mirroring session
+ * @return 1 if the frame may be mirrored, 0 if not
+ */
+static int
+mirror_admit (struct Mirror_session *ms) {
+    struct timespec ts;
+    uint64_t now;
+    uint64_t elapsed;
+    const uint64_t capacity = ms->rate * 1000000000LLU; //burst of one second
+
+    if (++ms->sample_counter < ms->sample) {
+        return 0;
+    }
+    ms->sample_counter = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+    elapsed = now - ms->last_refill;
+    if (elapsed > 1000000000LLU) {
+        elapsed = 1000000000LLU;
+    }
+    ms->last_refill = now;
+    ms->tokens += elapsed * ms->rate;
+    if (ms->tokens > capacity) {
+        ms->tokens = capacity;
+    }
+    if (ms->tokens < 1000000000LLU) {
+        ms->suppressed++;
+        return 0;
+    }
+    ms->tokens -= 1000000000LLU;
+    return 1;
+};
+
+/**
+ * Copy the frame in the output buffer to the monitor ports of all sessions
+ * that mirror @a ifc in direction @a direction.
+ *
+ * @param ifc the interface the frame was received or sent on
+ * @param direction #MIRROR_RX or #MIRROR_TX
+ * @param ingress interface the frame was received on (never mirrored back to)
+ */
+static void
+mirror_frame (const struct Interface *ifc,
+              int direction,
+              const struct Interface *ingress) {
+    for (int i=0; i<num_mirror_sessions; i++) {
+        struct Mirror_session *ms = &mirror_sessions[i];
+
+        if (ms->src != ifc->ifc_num || 0 == (ms->directions & direction) || ms->monitor == ingress->ifc_num) {
+            continue;
+        }
+        if (1 == mirror_admit(ms)) {
+            send_obuf(&gifc[ms->monitor - 1]);
+            ms->mirrored++;
+        }
+    }
+};
+
+/**
+ * Forward the frame in the output buffer to interface @a dst, and to the monitor ports
+ * of mirroring sessions for @a dst.
+ *
+ * @param dst target interface to send the frame out on
+ * @param ingress interface the frame was received on
+ */
+static void
+forward_to (struct Interface *dst,
+            const struct Interface *ingress)
+{
+  send_obuf (dst);
+  if (0 != num_mirror_sessions)
+    mirror_frame (dst,
+                  MIRROR_TX,
+                  ingress);
 }
 
 /**
@@ -146,7 +297,7 @@ static int
 src_is_switch(struct MacAddress *mac_addr_search) {
   for(int i = 0; i < num_ifc; i++) {
       struct Interface *ifc = gifc+i;
-      if (0==maccomp(&ifc->mac, mac_addr_search)) {
+      if (0 != ifc->ifc_num && 0==maccomp(&ifc->mac, mac_addr_search)) {
           return 1;
       }
   }
@@ -222,6 +373,7 @@ add_table_entry(struct Interface *ifc, struct MacAddress *src_address) {
 static void
 override_table_entry(struct Interface *ifc, struct MacAddress *src_address) {
     int override_index = search_oldest_entry(); //search for oldest timestamp
+    stats.table_evictions++;
     struct Switching_connection sc; //create a new entry for switching table
     sc.switch_ifc = *ifc;
     sc.device_mac = *src_address;
@@ -269,16 +421,15 @@ get_dst_ifc(struct MacAddress *mac_addr_search) {
 };
 
 /**
- * Send a frame to all available interfaces by referencing *gifc, a pointer to all detected interfaces
+ * Send the frame in the output buffer to all available interfaces by referencing *gifc, a pointer to all detected interfaces
  * @param src_interface the interface where the frame came from
- * @param frame the frame to be passed
- * @param frame_size the size of the frame to be passed
  */
 static void
-send_broadcast(struct Interface *src_interface, const void *frame, size_t frame_size) {
+send_broadcast(struct Interface *src_interface) {
+    stats.floods++;
     for (int i=0; i<num_ifc; i++) {
-        if (src_interface!=&gifc[i]) {
-            forward_to(&gifc[i], frame, frame_size);
+        if (src_interface!=&gifc[i] && 0 != gifc[i].ifc_num) {
+            forward_to(&gifc[i], src_interface);
         }
     }
 };
@@ -299,6 +450,7 @@ parse_frame (struct Interface *ifc,
     if (frame_size < sizeof(eh)) {
         fprintf(stderr,
                 "Malformed frame\n");
+        stats_drop(DROP_MALFORMED);
         return;
     }
     memcpy(&eh,
@@ -320,18 +472,28 @@ parse_frame (struct Interface *ifc,
        add_table_entry(ifc, src_address);
     }
 
+    /**
+     * Copy the frame once into the output buffer; it is reused for all destinations and mirror copies
+     */
+    load_frame(frame, frame_size);
+    if (0 != num_mirror_sessions) {
+        mirror_frame(ifc, MIRROR_RX, ifc);
+    }
+
     /**
      * Check here, if the destination is multicast/broadcast (for this task the same) or unicast
      */
 
     if (1==check_broadcast(dest_address)) {
-        send_broadcast(ifc, frame, frame_size);
+        send_broadcast(ifc);
     } else {
         struct Interface *dest_ifc = get_dst_ifc(dest_address);
         if (dest_ifc != 0) { //Check, if the destination mac-address can be found in the switching table
-            forward_to(dest_ifc, frame, frame_size);
+            stats.table_hits++;
+            forward_to(&gifc[dest_ifc->ifc_num - 1], ifc);
         } else { //if the destination is not in the switching table, send this frame to broadcast!
-            send_broadcast(ifc, frame, frame_size);
+            stats.table_misses++;
+            send_broadcast(ifc);
         }
     }
 
@@ -352,12 +514,180 @@ handle_frame (uint16_t interface,
 {
   if (interface > num_ifc)
     abort ();
+  if (0 == gifc[interface - 1].ifc_num)
+    return; /* removed */
+  stats_rx (interface,
+            frame_size);
   parse_frame (&gifc[interface - 1],
 	       frame,
 	       frame_size);
 };
 
 
+/**
+ * Find network interface by @a name or by its number.
+ *
+ * @param name name or number to look up by
+ * @return NULL if @a name was not found
+ */
+static struct Interface *
+find_interface (const char *name)
+{
+  char *end;
+  unsigned long num;
+
+  if (NULL == name)
+    return NULL;
+  for (unsigned int i = 0; i<num_ifc; i++)
+    if ( (0 != gifc[i].ifc_num) &&
+         (NULL != gifc[i].name) &&
+         (0 == strcasecmp (name,
+                           gifc[i].name)) )
+      return &gifc[i];
+  num = strtoul (name, &end, 10);
+  if ( ('\0' != *end) ||
+       (0 == num) ||
+       (num > num_ifc) ||
+       (0 == gifc[num - 1].ifc_num) )
+    return NULL;
+  return &gifc[num - 1];
+}
+
+/**
+ * Add a mirroring session.  Syntax:
+ * "mirror add SRC MONITOR [rx|tx|both] [sample N] [rate PPS]".
+ */
+static void
+process_cmd_mirror_add () {
+    struct Mirror_session ms;
+    struct Interface *src;
+    struct Interface *monitor;
+    const char *tok;
+
+    memset(&ms, 0, sizeof(ms));
+    ms.directions = MIRROR_RX | MIRROR_TX;
+    ms.sample = 1;
+    ms.rate = MIRROR_DEFAULT_RATE;
+    tok = strtok(NULL, " ");
+    src = find_interface(tok);
+    if (NULL == src) {
+        print("Source interface `%s' unknown\n", (NULL == tok) ? "" : tok);
+        return;
+    }
+    ms.src = src->ifc_num;
+    tok = strtok(NULL, " ");
+    monitor = find_interface(tok);
+    if (NULL == monitor || monitor == src) {
+        print("Monitor interface `%s' unknown or same as source\n", (NULL == tok) ? "" : tok);
+        return;
+    }
+    ms.monitor = monitor->ifc_num;
+    while (NULL != (tok = strtok(NULL, " "))) {
+        unsigned long val;
+
+        if (0 == strcasecmp(tok, "rx")) {
+            ms.directions = MIRROR_RX;
+        } else if (0 == strcasecmp(tok, "tx")) {
+            ms.directions = MIRROR_TX;
+        } else if (0 == strcasecmp(tok, "both")) {
+            ms.directions = MIRROR_RX | MIRROR_TX;
+        } else if ((0 == strcasecmp(tok, "sample") || 0 == strcasecmp(tok, "rate"))) {
+            int is_sample = (0 == strcasecmp(tok, "sample"));
+            const char *arg = strtok(NULL, " ");
+
+            if (NULL == arg || 1 != sscanf(arg, "%lu", &val) || 0 == val || val > 100000000) {
+                print("Expected positive number after `%s'\n", tok);
+                return;
+            }
+            if (is_sample) {
+                ms.sample = val;
+            } else {
+                ms.rate = val;
+            }
+        } else {
+            print("Unexpected `%s' in mirror definition\n", tok);
+            return;
+        }
+    }
+    for (int i=0; i<num_mirror_sessions; i++) {
+        if (mirror_sessions[i].src == ms.src && mirror_sessions[i].monitor == ms.monitor) {
+            mirror_sessions[i] = ms; //replace existing session
+            return;
+        }
+    }
+    if (MAX_MIRROR_SESSIONS == num_mirror_sessions) {
+        print("Too many mirroring sessions\n");
+        return;
+    }
+    mirror_sessions[num_mirror_sessions] = ms;
+    num_mirror_sessions++;
+}
+
+/**
+ * Delete a mirroring session.  Syntax: "mirror del SRC MONITOR".
+ */
+static void
+process_cmd_mirror_del () {
+    struct Interface *src = find_interface(strtok(NULL, " "));
+    struct Interface *monitor = find_interface(strtok(NULL, " "));
+
+    if (NULL == src || NULL == monitor) {
+        print("No such mirroring session\n");
+        return;
+    }
+    for (int i=0; i<num_mirror_sessions; i++) {
+        if (mirror_sessions[i].src == src->ifc_num && mirror_sessions[i].monitor == monitor->ifc_num) {
+            mirror_sessions[i] = mirror_sessions[num_mirror_sessions - 1];
+            num_mirror_sessions--;
+            return;
+        }
+    }
+    print("No such mirroring session\n");
+}
+
+/**
+ * Print all mirroring sessions.
+ */
+static void
+process_cmd_mirror_list () {
+    for (int i=0; i<num_mirror_sessions; i++) {
+        const struct Mirror_session *ms = &mirror_sessions[i];
+
+        print("%u -> %u (%s%s) sample 1/%u rate %llu: %llu mirrored, %llu suppressed\n",
+              (unsigned int) ms->src,
+              (unsigned int) ms->monitor,
+              (0 != (ms->directions & MIRROR_RX)) ? "rx" : "",
+              (0 != (ms->directions & MIRROR_TX)) ? "tx" : "",
+              ms->sample,
+              (unsigned long long) ms->rate,
+              (unsigned long long) ms->mirrored,
+              (unsigned long long) ms->suppressed);
+    }
+}
+
+/**
+ * The user entered a "mirror" command.  The remaining
+ * arguments can be obtained via 'strtok()'.
+ */
+static void
+process_cmd_mirror () {
+    char *subcommand = strtok(NULL, " ");
+
+    if (NULL == subcommand) {
+        subcommand = "list";
+    }
+    if (0 == strcasecmp("add", subcommand)) {
+        process_cmd_mirror_add();
+    } else if (0 == strcasecmp("del", subcommand)) {
+        process_cmd_mirror_del();
+    } else if (0 == strcasecmp("list", subcommand)) {
+        process_cmd_mirror_list();
+    } else {
+        print("Subcommand `%s' not understood\n", subcommand);
+    }
+}
+
+
 /**
  * Handle control message @a cmd.
  *
@@ -368,9 +698,22 @@ static void
 handle_control (char *cmd,
 		size_t cmd_len)
 {
+  const char *tok;
+
   cmd[cmd_len - 1] = '\0';
-  print ("Received command `%s' (ignored)\n",
-	 cmd);
+  tok = strtok (cmd,
+                " ");
+  if (NULL == tok)
+    return;
+  if (0 == strcasecmp (tok,
+                       "mirror"))
+    process_cmd_mirror ();
+  else if (0 == strcasecmp (tok,
+                            "stats"))
+    stats_command ();
+  else
+    print ("Received command `%s' (ignored)\n",
+           cmd);
 }
 
 
@@ -390,6 +733,81 @@ handle_mac (uint16_t ifc_num,
 }
 
 
+/**
+ * Set up interface @a ifc_num called @a name, growing the interface
+ * table as needed.
+ */
+static void
+add_interface (uint16_t ifc_num,
+               const char *name)
+{
+  struct Interface *ifc;
+
+  grow_array (&gifc,
+              sizeof (struct Interface),
+              &num_ifc,
+              ifc_num);
+  stats_init ("switch",
+              num_ifc);
+  ifc = &gifc[ifc_num - 1];
+  free (ifc->name);
+  ifc->ifc_num = ifc_num;
+  ifc->name = strdup (name);
+  stats_set_name (ifc_num,
+                  ifc->name);
+}
+
+
+/**
+ * Handle interface @a ifc_num with @a mac and configuration @a arg
+ * added at runtime.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg configuration of the interface (its name)
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+                const struct MacAddress *mac,
+                const char *arg)
+{
+  add_interface (ifc_num,
+                 arg);
+  gifc[ifc_num - 1].mac = *mac;
+}
+
+
+/**
+ * Handle interface @a ifc_num being removed at runtime: forget the
+ * switching table entries and mirroring sessions that use it.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+  if (ifc_num > num_ifc)
+    return;
+  for (int i=num_table_entries - 1; i>=0; i--) {
+      if (switching_table[i].switch_ifc.ifc_num == ifc_num) {
+          switching_table[i] = switching_table[num_table_entries - 1];
+          num_table_entries--;
+      }
+  }
+  for (int i=num_mirror_sessions - 1; i>=0; i--) {
+      if (mirror_sessions[i].src == ifc_num || mirror_sessions[i].monitor == ifc_num) {
+          mirror_sessions[i] = mirror_sessions[num_mirror_sessions - 1];
+          num_mirror_sessions--;
+      }
+  }
+  stats_clear (ifc_num);
+  free (gifc[ifc_num - 1].name);
+  memset (&gifc[ifc_num - 1],
+          0,
+          sizeof (struct Interface));
+}
+
+
 #include "loop.c"
 
 
@@ -404,16 +822,15 @@ int
 main (int argc,
       char **argv)
 {
-  struct Interface ifc[argc - 1];
-
-  memset (ifc,
-	  0,
-	  sizeof (ifc));
-  num_ifc = argc - 1;
-  gifc = ifc;
+  stats_init ("switch",
+              argc - 1);
   for (unsigned int i=1;i<argc;i++)
-    ifc[i-1].ifc_num = i;
+    add_interface (i,
+                   argv[i]);
 
   loop ();
+  for (unsigned int i = 0; i < num_ifc; i++)
+    free (gifc[i].name);
+  free (gifc);
   return 0;
 }
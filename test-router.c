@@ -4,6 +4,8 @@
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
 #include "crc.c"
 
 #ifndef ETH_P_IPV4
@@ -235,6 +237,7 @@ size_t FRAME_0_SIZE = sizeof(struct GLAB_MessageHeader) + 3 * MAC_ADDR_SIZE;
 struct MacAddress eth1mac = {0x00, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa};
 struct MacAddress eth2mac = {0x00, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb};
 struct MacAddress eth3mac = {0x00, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc};
+struct MacAddress eth4mac = {0x00, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd};
 struct in_addr eth1ip; char ip1[] = "192.168.1.1"; //ip will be created by init in main
 struct in_addr eth2ip; char ip2[] = "192.168.2.1";
 struct in_addr eth3ip; char ip3[] = "192.168.3.1";
@@ -245,10 +248,20 @@ struct MacAddress multicast = {0xff, 0xff, 0xff, 0xaa, 0xbb, 0xcc};
 struct MacAddress client1 = {0x00, 0x11, 0x11, 0x11, 0x11, 0x11};
 struct MacAddress client2 = {0x00, 0x22, 0x22, 0x22, 0x22, 0x22};
 struct MacAddress client3 = {0x00, 0x33, 0x33, 0x33, 0x33, 0x33};
+struct MacAddress gateway1 = {0x00, 0x44, 0x44, 0x44, 0x44, 0x44};
+struct MacAddress gateway2 = {0x00, 0x55, 0x55, 0x55, 0x55, 0x55};
 
 int testA1(int child_stdin, int child_stdout);
 int testA2(int child_stdin, int child_stdout);
 int testA3(int child_stdin, int child_stdout);
+int testA4(const char *binary);
+int testA5(const char *binary);
+int testA6(const char *binary);
+int testA7(const char *binary);
+int testA8(const char *binary);
+int testA9(const char *binary);
+int testA10(const char *binary);
+int testA11(const char *binary);
 
 /**
  * Compare to MAC-addresses. From FAQ-slides Prof. Grothoff
@@ -293,6 +306,351 @@ print_ip(const struct in_addr *ip) {
     printf("%s", inet_ntop(AF_INET, ip, buf, sizeof(buf)));
 }
 
+/**
+ * How long (in ms) to wait for the router to send a frame.
+ */
+#define READ_TIMEOUT_MS 500
+
+/**
+ * Offset of the IPv4 header and of the ICMP/UDP header in the frames
+ * built by build_ipv4().
+ */
+#define IP_OFF ETHERNET_HEADER_SIZE
+#define L4_OFF (ETHERNET_HEADER_SIZE + IPV4_HEADER_SIZE)
+
+/**
+ * UDP header.
+ */
+struct UdpHeader {
+    uint16_t source_port;
+    uint16_t destination_port;
+    uint16_t length;
+    uint16_t checksum;
+};
+
+/**
+ * Start a router for a test, like main() does.
+ *
+ * @param binary the router to run
+ * @param ifcs NULL-terminated interface specifications, at most 4
+ * @param child_stdin[out] where to write to the router
+ * @param child_stdout[out] where to read from the router
+ * @return pid of the router
+ */
+static pid_t
+start_router(const char *binary, const char **ifcs, int *child_stdin, int *child_stdout) {
+    const struct MacAddress *macs[] = { &eth1mac, &eth2mac, &eth3mac, &eth4mac };
+    uint8_t writeBuf[GLAB_HEADER_SIZE + MAC_ADDR_SIZE * 4];
+    struct GLAB_MessageHeader header;
+    char *argv[6];
+    unsigned int n = 0;
+    int cin[2], cout[2];
+    pid_t chld;
+
+    argv[0] = (char *) binary;
+    while (NULL != ifcs[n]) {
+        argv[n + 1] = (char *) ifcs[n];
+        n++;
+    }
+    argv[n + 1] = NULL;
+    pipe(cin);
+    pipe(cout);
+    chld = fork();
+    if (0 == chld) {
+        close(cin[1]);
+        close(cout[0]);
+        dup2(cin[0], STDIN_FILENO);
+        dup2(cout[1], STDOUT_FILENO);
+        execvp(binary, argv);
+        fprintf(stderr, "Failed to run binary `%s'\n", binary);
+        exit(1);
+    }
+    close(cin[0]);
+    close(cout[1]);
+    *child_stdin = cin[1];
+    *child_stdout = cout[0];
+
+    header.type = htons(0);
+    header.size = htons(GLAB_HEADER_SIZE + MAC_ADDR_SIZE * n);
+    memcpy(writeBuf, &header, sizeof(header));
+    for (unsigned int i = 0; i < n; i++)
+        memcpy(&writeBuf[GLAB_HEADER_SIZE + MAC_ADDR_SIZE * i], macs[i], MAC_ADDR_SIZE);
+    write_all(*child_stdin, writeBuf, GLAB_HEADER_SIZE + MAC_ADDR_SIZE * n);
+    return chld;
+}
+
+/**
+ * Stop a router started with start_router().
+ */
+static void
+stop_router(pid_t chld, int child_stdin, int child_stdout) {
+    kill(chld, SIGKILL);
+    waitpid(chld, NULL, 0);
+    close(child_stdin);
+    close(child_stdout);
+}
+
+/**
+ * Send a command (without the newline) to the router.
+ */
+static void
+send_command(int child_stdin, const char *cmd) {
+    char writeBuf[GLAB_HEADER_SIZE + 256];
+    struct GLAB_MessageHeader header;
+    size_t len = strlen(cmd) + 1; //the router replaces the last character with 0
+
+    header.type = htons(0);
+    header.size = htons(GLAB_HEADER_SIZE + len);
+    memcpy(writeBuf, &header, sizeof(header));
+    memcpy(&writeBuf[GLAB_HEADER_SIZE], cmd, len - 1);
+    writeBuf[GLAB_HEADER_SIZE + len - 1] = '\n';
+    write_all(child_stdin, writeBuf, GLAB_HEADER_SIZE + len);
+}
+
+/**
+ * Send @a frame to the router as received on interface @a ifc.
+ */
+static void
+send_frame(int child_stdin, uint16_t ifc, const void *frame, size_t size) {
+    char writeBuf[MAX_SIZE];
+    struct GLAB_MessageHeader header;
+
+    header.type = htons(ifc);
+    header.size = htons(GLAB_HEADER_SIZE + size);
+    memcpy(writeBuf, &header, sizeof(header));
+    memcpy(&writeBuf[GLAB_HEADER_SIZE], frame, size);
+    write_all(child_stdin, writeBuf, GLAB_HEADER_SIZE + size);
+}
+
+/**
+ * Read exactly @a size bytes, waiting at most #READ_TIMEOUT_MS for each part.
+ *
+ * @return 0 on success, -1 on timeout or error
+ */
+static int
+read_exact(int fd, void *buf, size_t size) {
+    char *cbuf = buf;
+    size_t off = 0;
+
+    while (off < size) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ssize_t ret;
+
+        if (1 != poll(&pfd, 1, READ_TIMEOUT_MS))
+            return -1;
+        ret = read(fd, &cbuf[off], size - off);
+        if (ret <= 0)
+            return -1;
+        off += ret;
+    }
+    return 0;
+}
+
+/**
+ * Read the next frame the router sends, skipping its output for the user.
+ *
+ * @param ifc[out] interface the frame is sent on
+ * @param frame[out] where to store the frame, #MAX_SIZE bytes
+ * @return size of the frame, -1 if the router sent none
+ */
+static ssize_t
+read_frame(int child_stdout, uint16_t *ifc, void *frame) {
+    struct GLAB_MessageHeader header;
+
+    while (1) {
+        size_t size;
+
+        if (0 != read_exact(child_stdout, &header, sizeof(header)))
+            return -1;
+        size = ntohs(header.size);
+        if (size < GLAB_HEADER_SIZE)
+            return -1;
+        size -= GLAB_HEADER_SIZE;
+        if (0 != read_exact(child_stdout, frame, size))
+            return -1;
+        if (0 != ntohs(header.type)) {
+            *ifc = ntohs(header.type);
+            return size;
+        }
+    }
+}
+
+/**
+ * Tell the router that @a host_ip has @a host_mac, with an ARP reply
+ * received on interface @a ifc.
+ */
+static void
+send_arp_reply(int child_stdin, uint16_t ifc, const struct MacAddress *ifc_mac, const char *ifc_ip,
+               const struct MacAddress *host_mac, const char *host_ip) {
+    char frame[ETHERNET_HEADER_SIZE + ARP_HEADER_SIZE];
+    struct EthernetHeader ethHeader;
+    struct ArpHeaderEthernetIPv4 arpHeader;
+
+    ethHeader.src = *host_mac;
+    ethHeader.dst = *ifc_mac;
+    ethHeader.tag = htons(ETH_P_ARP);
+    arpHeader.htype = htons(1);
+    arpHeader.ptype = htons(ETH_P_IPV4);
+    arpHeader.hlen = MAC_ADDR_SIZE;
+    arpHeader.plen = 4;
+    arpHeader.oper = htons(2);
+    arpHeader.sender_ha = *host_mac;
+    inet_pton(AF_INET, host_ip, &arpHeader.sender_pa);
+    arpHeader.target_ha = *ifc_mac;
+    inet_pton(AF_INET, ifc_ip, &arpHeader.target_pa);
+    memcpy(frame, &ethHeader, ETHERNET_HEADER_SIZE);
+    memcpy(&frame[ETHERNET_HEADER_SIZE], &arpHeader, ARP_HEADER_SIZE);
+    send_frame(child_stdin, ifc, frame, sizeof(frame));
+}
+
+/**
+ * Build an IPv4 frame (TTL 64, no options) around @a l4.
+ *
+ * @return size of the frame
+ */
+static size_t
+build_ipv4(uint8_t *frame, const struct MacAddress *src_mac, const struct MacAddress *dst_mac,
+           const char *src, const char *dst, uint8_t protocol, const void *l4, size_t l4_size) {
+    struct EthernetHeader ethHeader;
+    struct IPv4Header iPv4Header;
+
+    ethHeader.src = *src_mac;
+    ethHeader.dst = *dst_mac;
+    ethHeader.tag = htons(ETH_P_IPV4);
+    memset(&iPv4Header, 0, sizeof(iPv4Header));
+    iPv4Header.version = 4;
+    iPv4Header.header_length = 5;
+    iPv4Header.total_length = htons(IPV4_HEADER_SIZE + l4_size);
+    iPv4Header.identification = htons(1);
+    iPv4Header.ttl = 64;
+    iPv4Header.protocol = protocol;
+    inet_pton(AF_INET, src, &iPv4Header.source_address);
+    inet_pton(AF_INET, dst, &iPv4Header.destination_address);
+    iPv4Header.checksum = GNUNET_CRYPTO_crc16_n(&iPv4Header, sizeof(iPv4Header));
+    memcpy(frame, &ethHeader, ETHERNET_HEADER_SIZE);
+    memcpy(&frame[IP_OFF], &iPv4Header, IPV4_HEADER_SIZE);
+    memcpy(&frame[L4_OFF], l4, l4_size);
+    return L4_OFF + l4_size;
+}
+
+/**
+ * UDP checksum of the datagram in @a frame (0 if it is correct).
+ */
+static uint16_t
+udp_checksum(const uint8_t *frame, size_t size) {
+    struct IPv4Header iPv4Header;
+    uint8_t pseudo[12];
+    uint16_t len = htons(size - L4_OFF);
+    uint32_t sum;
+
+    memcpy(&iPv4Header, &frame[IP_OFF], IPV4_HEADER_SIZE);
+    memcpy(pseudo, &iPv4Header.source_address, 4);
+    memcpy(&pseudo[4], &iPv4Header.destination_address, 4);
+    pseudo[8] = 0;
+    pseudo[9] = IPPROTO_UDP;
+    memcpy(&pseudo[10], &len, 2);
+    sum = GNUNET_CRYPTO_crc16_step(0, pseudo, sizeof(pseudo));
+    sum = GNUNET_CRYPTO_crc16_step(sum, &frame[L4_OFF], size - L4_OFF);
+    return GNUNET_CRYPTO_crc16_finish(sum);
+}
+
+/**
+ * Build a UDP datagram with 8 bytes of data and a valid checksum.
+ *
+ * @return size of the frame
+ */
+static size_t
+build_udp(uint8_t *frame, const struct MacAddress *src_mac, const struct MacAddress *dst_mac,
+          const char *src, const char *dst, uint16_t sport, uint16_t dport) {
+    uint8_t l4[sizeof(struct UdpHeader) + 8];
+    struct UdpHeader udp;
+    size_t size;
+    uint16_t checksum;
+
+    udp.source_port = htons(sport);
+    udp.destination_port = htons(dport);
+    udp.length = htons(sizeof(l4));
+    udp.checksum = 0;
+    memcpy(l4, &udp, sizeof(udp));
+    memcpy(&l4[sizeof(udp)], "testdata", 8);
+    size = build_ipv4(frame, src_mac, dst_mac, src, dst, IPPROTO_UDP, l4, sizeof(l4));
+    checksum = udp_checksum(frame, size);
+    memcpy(&frame[L4_OFF + offsetof(struct UdpHeader, checksum)], &checksum, sizeof(checksum));
+    return size;
+}
+
+/**
+ * Build an ICMP echo request (@a type 8) or reply (@a type 0) with 8
+ * bytes of data.
+ *
+ * @return size of the frame
+ */
+static size_t
+build_echo(uint8_t *frame, const struct MacAddress *src_mac, const struct MacAddress *dst_mac,
+           const char *src, const char *dst, uint8_t type, uint16_t id) {
+    uint8_t l4[8 + 8];
+    uint16_t seq = htons(1);
+
+    id = htons(id);
+    memset(l4, 0, sizeof(l4));
+    l4[0] = type;
+    memcpy(&l4[4], &id, 2);
+    memcpy(&l4[6], &seq, 2);
+    memcpy(&l4[8], "pingdata", 8);
+    uint16_t checksum = GNUNET_CRYPTO_crc16_n(l4, sizeof(l4));
+    memcpy(&l4[2], &checksum, 2);
+    return build_ipv4(frame, src_mac, dst_mac, src, dst, IPPROTO_ICMP, l4, sizeof(l4));
+}
+
+/**
+ * Check the IPv4 header of @a frame: version, checksum, addresses.
+ *
+ * @return 1 if it has a valid checksum and the given addresses
+ */
+static int
+check_ipv4(const uint8_t *frame, ssize_t size, const char *src, const char *dst) {
+    struct IPv4Header iPv4Header;
+    struct in_addr ip;
+
+    if (size < (ssize_t) L4_OFF)
+        return 0;
+    memcpy(&iPv4Header, &frame[IP_OFF], IPV4_HEADER_SIZE);
+    if ( (4 != iPv4Header.version) ||
+         (0 != GNUNET_CRYPTO_crc16_n(&iPv4Header, IPV4_HEADER_SIZE)) )
+        return 0;
+    inet_pton(AF_INET, src, &ip);
+    if (0 != ipcomp(&ip, &iPv4Header.source_address))
+        return 0;
+    inet_pton(AF_INET, dst, &ip);
+    return 0 == ipcomp(&ip, &iPv4Header.destination_address);
+}
+
+/**
+ * Forward a UDP datagram from @a src to @a dst through the router and
+ * see where it comes out.
+ *
+ * @param ifc interface to send it on
+ * @param out_mac[out] destination MAC of the forwarded frame
+ * @return interface it was forwarded on, 0 if it was not forwarded
+ */
+static uint16_t
+forward_udp(int child_stdin, int child_stdout, uint16_t ifc, const struct MacAddress *ifc_mac,
+            const char *src, const char *dst, uint16_t sport, struct MacAddress *out_mac) {
+    uint8_t frame[MAX_SIZE];
+    uint16_t out_ifc;
+    ssize_t ret;
+
+    send_frame(child_stdin, ifc, frame,
+               build_udp(frame, &client1, ifc_mac, src, dst, sport, 9));
+    ret = read_frame(child_stdout, &out_ifc, frame);
+    if ( (ret < (ssize_t) (L4_OFF + sizeof(struct UdpHeader))) ||
+         (ETH_P_IPV4 != ntohs(((struct EthernetHeader *) frame)->tag)) ||
+         (IPPROTO_UDP != frame[IP_OFF + offsetof(struct IPv4Header, protocol)]) )
+        return 0;
+    memcpy(out_mac, frame, MAC_ADDR_SIZE);
+    return out_ifc;
+}
+
 int main(int argc, char **argv) {
 
     // Test starting point from Kickoff
@@ -364,7 +722,25 @@ int main(int argc, char **argv) {
     sleep(2);
     kill(chld, SIGKILL);
 
-    if (1 != resultA3) {
+    // the other tests start their own router
+    int resultA4 = testA4(argv[1]);
+    int resultA5 = testA5(argv[1]);
+    int resultA6 = testA6(argv[1]);
+    int resultA7 = testA7(argv[1]);
+    int resultA8 = testA8(argv[1]);
+    int resultA9 = testA9(argv[1]);
+    int resultA10 = testA10(argv[1]);
+    int resultA11 = testA11(argv[1]);
+
+    if ( (1 != resultA3) ||
+         (1 != resultA4) ||
+         (1 != resultA5) ||
+         (1 != resultA6) ||
+         (1 != resultA7) ||
+         (1 != resultA8) ||
+         (1 != resultA9) ||
+         (1 != resultA10) ||
+         (1 != resultA11) ) {
         fprintf(stderr, "test failed\n");
         return -1;
      }else {
@@ -771,7 +1147,11 @@ int testA3(int child_stdin, int child_stdout) {
     memcpy(&icmp, &readBuff_08[GLAB_HEADER_SIZE + ETHERNET_HEADER_SIZE + IPV4_HEADER_SIZE], sizeof(icmp));
     printf("Icmp type %d code %d crc %d\n",icmp.type, icmp.code, icmp.crc);
 
-    if (icmp.crc == 8183 || icmp.crc == 0){
+    // fragmentation required, quoting the IP header plus 8 bytes, valid checksum
+    size_t icmp_size = ret - GLAB_HEADER_SIZE - ETHERNET_HEADER_SIZE - IPV4_HEADER_SIZE;
+    if (3 == icmp.type && 4 == icmp.code &&
+        icmp_size == sizeof(icmp) + IPV4_HEADER_SIZE + 8 &&
+        0 == GNUNET_CRYPTO_crc16_n(&readBuff_08[GLAB_HEADER_SIZE + ETHERNET_HEADER_SIZE + IPV4_HEADER_SIZE], icmp_size)){
         printf("TestID A3: passed.\n");
         return 1;
     }
@@ -781,15 +1161,592 @@ int testA3(int child_stdin, int child_stdout) {
     return -1;
 }
 
+/**
+ * Echo requests to an address of the router are answered on the
+ * interface they came from, with the addresses swapped and valid
+ * (incrementally updated) checksums.
+ */
+int testA4(const char *binary) {
+    const char *ifcs[] = { "eth1[IPV4:192.168.1.1/24]", "eth2[IPV4:192.168.2.1/24]", NULL };
+    const char *targets[] = { "192.168.1.1", "192.168.2.1" };
+    int child_stdin, child_stdout;
+    pid_t chld = start_router(binary, ifcs, &child_stdin, &child_stdout);
+    uint8_t request[MAX_SIZE];
+    uint8_t reply[MAX_SIZE];
+    int result = 1;
+
+    for (unsigned int i = 0; i < 2; i++) {
+        size_t size = build_echo(request, &client1, &eth1mac, "192.168.1.2", targets[i], 8, 0x1234);
+        struct EthernetHeader ethHeader;
+        uint16_t ifc;
+
+        send_frame(child_stdin, 1, request, size);
+        ssize_t ret = read_frame(child_stdout, &ifc, reply);
+        memcpy(&ethHeader, reply, ETHERNET_HEADER_SIZE);
+        if ( (ret != (ssize_t) size) ||
+             (1 != ifc) ||
+             (0 != maccomp(&ethHeader.dst, &client1)) ||
+             (0 != maccomp(&ethHeader.src, &eth1mac)) ||
+             (! check_ipv4(reply, ret, targets[i], "192.168.1.2")) ||
+             (0 != reply[L4_OFF]) || //echo reply
+             (0 != reply[L4_OFF + 1]) ||
+             (0 != memcmp(&reply[L4_OFF + 4], &request[L4_OFF + 4], size - L4_OFF - 4)) || //id, sequence number, data
+             (0 != GNUNET_CRYPTO_crc16_n(&reply[L4_OFF], size - L4_OFF)) ) {
+            fprintf(stderr, "wrong echo reply from %s\n", targets[i]);
+            result = -1;
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A4: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
 
 
+/**
+ * Start a router with three interfaces and a gateway on each of the
+ * first two, for the routing tests.
+ */
+static pid_t
+start_router_with_gateways(const char *binary, int *child_stdin, int *child_stdout) {
+    const char *ifcs[] = { "eth1[IPV4:192.168.1.1/24]", "eth2[IPV4:192.168.2.1/24]", "eth3[IPV4:192.168.3.1/24]", NULL };
+    pid_t chld = start_router(binary, ifcs, child_stdin, child_stdout);
+
+    send_arp_reply(*child_stdin, 1, &eth1mac, "192.168.1.1", &gateway1, "192.168.1.254");
+    send_arp_reply(*child_stdin, 2, &eth2mac, "192.168.2.1", &gateway2, "192.168.2.254");
+    return chld;
+}
 
+/**
+ * Routes are looked up by longest prefix, whatever order they were
+ * added in.
+ */
+int testA5(const char *binary) {
+    int child_stdin, child_stdout;
+    pid_t chld = start_router_with_gateways(binary, &child_stdin, &child_stdout);
+    struct {
+        const char *dst;
+        uint16_t ifc;
+        const struct MacAddress *mac;
+    } expected[] = {
+        { "10.9.1.5", 2, &gateway2 },
+        { "10.9.2.5", 1, &gateway1 },
+        { "10.8.1.5", 2, &gateway2 },
+        { "10.8.2.5", 1, &gateway1 },
+        { "10.8.1.200", 1, &gateway1 },
+    };
+    int result = 1;
+
+    send_command(child_stdin, "route add 10.9.0.0/16 via 192.168.1.254 dev eth1");
+    send_command(child_stdin, "route add 10.9.1.0/24 via 192.168.2.254 dev eth2");
+    send_command(child_stdin, "route add 10.8.1.0/24 via 192.168.2.254 dev eth2");
+    send_command(child_stdin, "route add 10.8.0.0/16 via 192.168.1.254 dev eth1");
+    send_command(child_stdin, "route add 10.8.1.128/25 via 192.168.1.254 dev eth1");
+    for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        struct MacAddress mac;
+        uint16_t ifc = forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", expected[i].dst, 1000, &mac);
+
+        if ( (ifc != expected[i].ifc) ||
+             (0 != maccomp(&mac, expected[i].mac)) ) {
+            fprintf(stderr, "%s routed to interface %u, expected %u\n", expected[i].dst, ifc, expected[i].ifc);
+            result = -1;
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A5: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
 
+/**
+ * Flows to a route with two next hops use both and stick to theirs;
+ * after one next hop is deleted all flows use the other one.
+ */
+int testA6(const char *binary) {
+    int child_stdin, child_stdout;
+    pid_t chld = start_router_with_gateways(binary, &child_stdin, &child_stdout);
+    uint16_t first[32];
+    unsigned int used[3] = { 0, 0, 0 };
+    int result = 1;
+
+    send_command(child_stdin, "route add 10.7.0.0/16 via 192.168.1.254 dev eth1");
+    send_command(child_stdin, "route add 10.7.0.0/16 via 192.168.2.254 dev eth2");
+    for (unsigned int i = 0; i < 32; i++) {
+        struct MacAddress mac;
+
+        first[i] = forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", "10.7.0.5", 1000 + i, &mac);
+        if (first[i] > 2) {
+            fprintf(stderr, "ECMP flow %u lost\n", i);
+            result = -1;
+            continue;
+        }
+        used[first[i]]++;
+    }
+    if ( (0 != used[0]) ||
+         (0 == used[1]) ||
+         (0 == used[2]) ) {
+        fprintf(stderr, "ECMP used eth1 for %u and eth2 for %u flows, %u lost\n", used[1], used[2], used[0]);
+        result = -1;
+    }
+    for (unsigned int i = 0; i < 32; i++) {
+        struct MacAddress mac;
 
+        if (first[i] != forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", "10.7.0.5", 1000 + i, &mac)) {
+            fprintf(stderr, "ECMP flow %u changed its next hop\n", i);
+            result = -1;
+        }
+    }
+    send_command(child_stdin, "route del 10.7.0.0/16 via 192.168.1.254 dev eth1");
+    for (unsigned int i = 0; i < 32; i++) {
+        struct MacAddress mac;
+
+        if ( (2 != forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", "10.7.0.5", 1000 + i, &mac)) ||
+             (0 != maccomp(&mac, &gateway2)) ) {
+            fprintf(stderr, "ECMP flow %u not moved to the remaining next hop\n", i);
+            result = -1;
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A6: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
 
 
+/**
+ * Interfaces in different VRFs may use the same networks; frames are
+ * only routed with the routes and neighbors of their VRF.
+ */
+int testA7(const char *binary) {
+    const char *ifcs[] = { "eth1[IPV4:192.168.1.1/24]", "eth2[IPV4:192.168.1.1/24,VRF:1]",
+                           "eth3[IPV4:192.168.3.1/24]", "eth4[IPV4:192.168.3.1/24,VRF:1]", NULL };
+    int child_stdin, child_stdout;
+    pid_t chld = start_router(binary, ifcs, &child_stdin, &child_stdout);
+    struct {
+        uint16_t ifc;
+        const struct MacAddress *ifc_mac;
+        const char *dst;
+        uint16_t out_ifc;
+        const struct MacAddress *mac;
+    } expected[] = {
+        { 1, &eth1mac, "192.168.3.9", 3, &client2 },
+        { 2, &eth2mac, "192.168.3.9", 4, &client3 },
+        { 2, &eth2mac, "10.7.0.1", 4, &gateway1 },
+        { 1, &eth1mac, "10.7.0.1", 0, NULL }, //only VRF 1 has the route
+    };
+    int result = 1;
+
+    send_arp_reply(child_stdin, 3, &eth3mac, "192.168.3.1", &client2, "192.168.3.9");
+    send_arp_reply(child_stdin, 4, &eth4mac, "192.168.3.1", &client3, "192.168.3.9");
+    send_arp_reply(child_stdin, 4, &eth4mac, "192.168.3.1", &gateway1, "192.168.3.254");
+    send_command(child_stdin, "route add 10.7.0.0/16 via 192.168.3.254 dev eth4 vrf 1");
+    for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        struct MacAddress mac;
+        uint16_t ifc = forward_udp(child_stdin, child_stdout, expected[i].ifc, expected[i].ifc_mac,
+                                   "192.168.1.2", expected[i].dst, 1000, &mac);
+
+        if ( (ifc != expected[i].out_ifc) ||
+             ( (0 != ifc) &&
+               (0 != maccomp(&mac, expected[i].mac)) ) ) {
+            fprintf(stderr, "%s from eth%u routed to interface %u, expected %u\n",
+                    expected[i].dst, expected[i].ifc, ifc, expected[i].out_ifc);
+            result = -1;
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A7: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
 
+/**
+ * Send a UDP datagram from @a src on eth1 that the ACL of eth1 denies
+ * and check the ICMP "administratively prohibited" error sent back.
+ *
+ * @return 1 if the error came back, quoting the datagram
+ */
+static int
+expect_prohibited(int child_stdin, int child_stdout, const char *src) {
+    uint8_t request[MAX_SIZE];
+    uint8_t reply[MAX_SIZE];
+    size_t size = build_udp(request, &client1, &eth1mac, src, "192.168.3.9", 1000, 9);
+    uint16_t ifc;
+    ssize_t ret;
+
+    send_frame(child_stdin, 1, request, size);
+    ret = read_frame(child_stdout, &ifc, reply);
+    return (1 == ifc) &&
+           (ret >= (ssize_t) (L4_OFF + 8 + IPV4_HEADER_SIZE + 8)) &&
+           (0 == maccomp((const struct MacAddress *) reply, &client1)) &&
+           check_ipv4(reply, ret, "192.168.1.1", src) &&
+           (IPPROTO_ICMP == reply[IP_OFF + offsetof(struct IPv4Header, protocol)]) &&
+           (3 == reply[L4_OFF]) && //destination unreachable
+           (13 == reply[L4_OFF + 1]) && //administratively prohibited
+           (0 == GNUNET_CRYPTO_crc16_n(&reply[L4_OFF], ret - L4_OFF)) &&
+           (0 == memcmp(&reply[L4_OFF + 8], &request[IP_OFF], IPV4_HEADER_SIZE + 8)); //quoted header, TTL not yet decremented
+}
 
+/**
+ * ACL rules are matched in sequence order, not in the order they were
+ * added; packets no rule matches pass, denied packets are answered
+ * with ICMP destination unreachable, code 13, and deleted rules no
+ * longer match.
+ */
+int testA8(const char *binary) {
+    int child_stdin, child_stdout;
+    pid_t chld = start_router_with_gateways(binary, &child_stdin, &child_stdout);
+    struct MacAddress mac;
+    int result = 1;
+
+    send_arp_reply(child_stdin, 3, &eth3mac, "192.168.3.1", &client3, "192.168.3.9");
+    send_command(child_stdin, "acl eth1 in add deny src 192.168.1.0/28 proto udp dport 9");
+    send_command(child_stdin, "acl eth1 in add 5 allow src 192.168.1.5/32");
+    if (3 != forward_udp(child_stdin, child_stdout, 1, &eth1mac, "192.168.1.5", "192.168.3.9", 1000, &mac)) {
+        fprintf(stderr, "rule 5 did not allow 192.168.1.5 before rule 10\n");
+        result = -1;
+    }
+    if (! expect_prohibited(child_stdin, child_stdout, "192.168.1.6")) {
+        fprintf(stderr, "no ICMP 3/13 for 192.168.1.6 denied by rule 10\n");
+        result = -1;
+    }
+    if (3 != forward_udp(child_stdin, child_stdout, 1, &eth1mac, "192.168.1.66", "192.168.3.9", 1000, &mac)) {
+        fprintf(stderr, "192.168.1.66 matches no rule but was not forwarded\n");
+        result = -1;
+    }
+    send_command(child_stdin, "acl eth1 in del 5");
+    if (! expect_prohibited(child_stdin, child_stdout, "192.168.1.5")) {
+        fprintf(stderr, "no ICMP 3/13 for 192.168.1.5 after rule 5 was deleted\n");
+        result = -1;
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A8: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
+
+/**
+ * Check that @a frame is a UDP datagram with valid checksums and the
+ * given addresses and destination port.
+ *
+ * @param sport[out] source port of the datagram
+ * @return 1 if it is
+ */
+static int
+check_udp(const uint8_t *frame, ssize_t size, const char *src, const char *dst,
+          uint16_t dport, uint16_t *sport) {
+    struct UdpHeader udp;
+
+    if ( (size != (ssize_t) (L4_OFF + sizeof(udp) + 8)) ||
+         (IPPROTO_UDP != frame[IP_OFF + offsetof(struct IPv4Header, protocol)]) ||
+         (! check_ipv4(frame, size, src, dst)) ||
+         (0 != udp_checksum(frame, size)) )
+        return 0;
+    memcpy(&udp, &frame[L4_OFF], sizeof(udp));
+    *sport = ntohs(udp.source_port);
+    return dport == ntohs(udp.destination_port);
+}
+
+/**
+ * Check that @a frame is an ICMP echo message of @a type with a valid
+ * checksum and the given addresses.
+ *
+ * @param id[out] identifier of the echo message
+ * @return 1 if it is
+ */
+static int
+check_echo(const uint8_t *frame, ssize_t size, const char *src, const char *dst,
+           uint8_t type, uint16_t *id) {
+    if ( (size != (ssize_t) (L4_OFF + 8 + 8)) ||
+         (IPPROTO_ICMP != frame[IP_OFF + offsetof(struct IPv4Header, protocol)]) ||
+         (! check_ipv4(frame, size, src, dst)) ||
+         (type != frame[L4_OFF]) ||
+         (0 != GNUNET_CRYPTO_crc16_n(&frame[L4_OFF], size - L4_OFF)) )
+        return 0;
+    memcpy(id, &frame[L4_OFF + 4], sizeof(*id));
+    *id = ntohs(*id);
+    return 1;
+}
+
+/**
+ * With NAT on eth2, UDP and echo messages of two inside hosts using the
+ * same port and identifier leave with the address of eth2 and distinct
+ * ports, and the answers are translated back.  ICMP errors about
+ * translated datagrams reach the inside host with the quoted datagram
+ * translated back (RFC 5508); packets without a session are not
+ * forwarded.  Session timeouts take minutes and are not tested.
+ */
+int testA9(const char *binary) {
+    const char *ifcs[] = { "eth1[IPV4:192.168.1.1/24]", "eth2[IPV4:192.168.2.1/24]", NULL };
+    const char *hosts[] = { "192.168.1.5", "192.168.1.6" };
+    const struct MacAddress *host_macs[] = { &client1, &client2 };
+    int child_stdin, child_stdout;
+    pid_t chld = start_router(binary, ifcs, &child_stdin, &child_stdout);
+    uint8_t frame[MAX_SIZE];
+    uint8_t sent[2][MAX_SIZE];
+    uint16_t ports[2];
+    uint16_t ids[2];
+    uint16_t ifc;
+    ssize_t ret;
+    int result = 1;
+
+    send_arp_reply(child_stdin, 1, &eth1mac, "192.168.1.1", &client1, hosts[0]);
+    send_arp_reply(child_stdin, 1, &eth1mac, "192.168.1.1", &client2, hosts[1]);
+    send_arp_reply(child_stdin, 2, &eth2mac, "192.168.2.1", &client3, "192.168.2.9");
+    send_command(child_stdin, "nat eth2");
+
+    // outbound: the source becomes 192.168.2.1, the second host gets another port
+    for (unsigned int i = 0; i < 2; i++) {
+        send_frame(child_stdin, 1, frame,
+                   build_udp(frame, host_macs[i], &eth1mac, hosts[i], "192.168.2.9", 4000, 53));
+        ret = read_frame(child_stdout, &ifc, sent[i]);
+        if ( (2 != ifc) ||
+             (! check_udp(sent[i], ret, "192.168.2.1", "192.168.2.9", 53, &ports[i])) ) {
+            fprintf(stderr, "UDP from %s not translated\n", hosts[i]);
+            result = -1;
+        }
+        send_frame(child_stdin, 1, frame,
+                   build_echo(frame, host_macs[i], &eth1mac, hosts[i], "192.168.2.9", 8, 0x1234));
+        ret = read_frame(child_stdout, &ifc, frame);
+        if ( (2 != ifc) ||
+             (! check_echo(frame, ret, "192.168.2.1", "192.168.2.9", 8, &ids[i])) ) {
+            fprintf(stderr, "echo request from %s not translated\n", hosts[i]);
+            result = -1;
+        }
+    }
+    if ( (4000 != ports[0]) ||
+         (ports[0] == ports[1]) ||
+         (0x1234 != ids[0]) ||
+         (ids[0] == ids[1]) ) {
+        fprintf(stderr, "NAT used ports %u and %u, identifiers %u and %u\n", ports[0], ports[1], ids[0], ids[1]);
+        result = -1;
+    }
+
+    // inbound: answers go back to the host of their session
+    for (unsigned int i = 0; i < 2; i++) {
+        uint16_t port;
+        uint16_t id;
+
+        send_frame(child_stdin, 2, frame,
+                   build_udp(frame, &client3, &eth2mac, "192.168.2.9", "192.168.2.1", 53, ports[i]));
+        ret = read_frame(child_stdout, &ifc, frame);
+        if ( (1 != ifc) ||
+             (0 != maccomp((const struct MacAddress *) frame, host_macs[i])) ||
+             (! check_udp(frame, ret, "192.168.2.9", hosts[i], 4000, &port)) ||
+             (53 != port) ) {
+            fprintf(stderr, "UDP answer to port %u not translated to %s\n", ports[i], hosts[i]);
+            result = -1;
+        }
+        send_frame(child_stdin, 2, frame,
+                   build_echo(frame, &client3, &eth2mac, "192.168.2.9", "192.168.2.1", 0, ids[i]));
+        ret = read_frame(child_stdout, &ifc, frame);
+        if ( (1 != ifc) ||
+             (! check_echo(frame, ret, "192.168.2.9", hosts[i], 0, &id)) ||
+             (0x1234 != id) ) {
+            fprintf(stderr, "echo reply with identifier %u not translated to %s\n", ids[i], hosts[i]);
+            result = -1;
+        }
+    }
+
+    // an error quoting the second host's datagram, as it left the router
+    {
+        uint8_t icmp[8 + IPV4_HEADER_SIZE + 8];
+        struct UdpHeader udp;
+        uint16_t checksum;
+
+        memset(icmp, 0, sizeof(icmp));
+        icmp[0] = 3; //destination unreachable
+        icmp[1] = 3; //port unreachable
+        memcpy(&icmp[8], &sent[1][IP_OFF], IPV4_HEADER_SIZE + 8);
+        checksum = GNUNET_CRYPTO_crc16_n(icmp, sizeof(icmp));
+        memcpy(&icmp[2], &checksum, sizeof(checksum));
+        send_frame(child_stdin, 2, frame,
+                   build_ipv4(frame, &client3, &eth2mac, "192.168.2.9", "192.168.2.1", IPPROTO_ICMP, icmp, sizeof(icmp)));
+        ret = read_frame(child_stdout, &ifc, frame);
+        memcpy(&udp, &frame[L4_OFF + 8 + IPV4_HEADER_SIZE], sizeof(udp));
+        if ( (1 != ifc) ||
+             (ret != (ssize_t) (L4_OFF + sizeof(icmp))) ||
+             (! check_ipv4(frame, ret, "192.168.2.9", hosts[1])) ||
+             (3 != frame[L4_OFF]) ||
+             (0 != GNUNET_CRYPTO_crc16_n(&frame[L4_OFF], sizeof(icmp))) ||
+             (! check_ipv4(&frame[L4_OFF + 8 - IP_OFF], L4_OFF, hosts[1], "192.168.2.9")) || //the quoted header
+             (4000 != ntohs(udp.source_port)) ||
+             (53 != ntohs(udp.destination_port)) ) {
+            fprintf(stderr, "ICMP error not translated to %s\n", hosts[1]);
+            result = -1;
+        }
+    }
+
+    // no session: the router may answer, but must not forward it inside
+    send_frame(child_stdin, 2, frame,
+               build_udp(frame, &client3, &eth2mac, "192.168.2.9", "192.168.2.1", 53, 5000));
+    while (read_frame(child_stdout, &ifc, frame) >= 0) {
+        if (1 == ifc) {
+            fprintf(stderr, "unsolicited datagram forwarded inside\n");
+            result = -1;
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A9: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
+
+/**
+ * Tell the router that interface @a ifc_num was added (with MAC
+ * @a mac and configuration @a spec) or removed (@a spec NULL).
+ */
+static void
+send_ifc_event(int child_stdin, uint16_t ifc_num, const struct MacAddress *mac, const char *spec) {
+    uint8_t writeBuf[sizeof(struct GLAB_InterfaceEvent) + 64];
+    struct GLAB_InterfaceEvent ie;
+    size_t alen = (NULL == spec) ? 0 : strlen(spec) + 1;
+
+    memset(&ie, 0, sizeof(ie));
+    ie.header.type = htons(GLAB_TYPE_INTERFACE);
+    ie.header.size = htons(sizeof(ie) + alen);
+    ie.ifc_num = htons(ifc_num);
+    ie.op = htons((NULL == spec) ? GLAB_INTERFACE_DEL : GLAB_INTERFACE_ADD);
+    if (NULL != mac)
+        ie.mac = *mac;
+    memcpy(writeBuf, &ie, sizeof(ie));
+    memcpy(&writeBuf[sizeof(ie)], spec, alen);
+    write_all(child_stdin, writeBuf, sizeof(ie) + alen);
+}
+
+/**
+ * A destination that is in the flow cache follows changes of the ARP
+ * cache, added and deleted routes and removed and added interfaces.
+ */
+int testA10(const char *binary) {
+    int child_stdin, child_stdout;
+    pid_t chld = start_router_with_gateways(binary, &child_stdin, &child_stdout);
+    struct {
+        const char *change;
+        uint16_t ifc;
+        const struct MacAddress *mac;
+    } expected[] = {
+        { "route add 10.6.0.0/16 via 192.168.1.254 dev eth1", 1, &gateway1 },
+        { "arp", 1, &client1 }, //192.168.1.254 moved to another MAC
+        { "route add 10.6.0.5/32 via 192.168.2.254 dev eth2", 2, &gateway2 },
+        { "route del 10.6.0.5/32 via 192.168.2.254 dev eth2", 1, &client1 },
+        { "ifc del", 0, NULL }, //removing eth1 removed the route
+        { "ifc add", 1, &gateway1 },
+    };
+    int result = 1;
+
+    for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        if (0 == strcmp(expected[i].change, "arp")) {
+            send_arp_reply(child_stdin, 1, &eth1mac, "192.168.1.1", &client1, "192.168.1.254");
+        } else if (0 == strcmp(expected[i].change, "ifc del")) {
+            send_ifc_event(child_stdin, 1, NULL, NULL);
+        } else if (0 == strcmp(expected[i].change, "ifc add")) {
+            send_ifc_event(child_stdin, 1, &eth1mac, "eth1[IPV4:192.168.1.1/24]");
+            send_arp_reply(child_stdin, 1, &eth1mac, "192.168.1.1", &gateway1, "192.168.1.254");
+            send_command(child_stdin, "route add 10.6.0.0/16 via 192.168.1.254 dev eth1");
+        } else {
+            send_command(child_stdin, expected[i].change);
+        }
+        for (unsigned int j = 0; j < 2; j++) { //the second datagram uses the cached route
+            struct MacAddress mac;
+            uint16_t ifc = forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", "10.6.0.5", 1000, &mac);
+
+            if ( (ifc != expected[i].ifc) ||
+                 ( (0 != ifc) &&
+                   (0 != maccomp(&mac, expected[i].mac)) ) ) {
+                fprintf(stderr, "after %s 10.6.0.5 routed to interface %u, expected %u\n",
+                        expected[i].change, ifc, expected[i].ifc);
+                result = -1;
+            }
+        }
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A10: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
 
+/**
+ * Read the next output of the router (skipping frames) into @a text.
+ *
+ * @param text buffer of #MAX_SIZE bytes, 0-terminated on success
+ * @return 0 on success, -1 if the router printed nothing
+ */
+static int
+read_output(int child_stdout, char *text) {
+    struct GLAB_MessageHeader header;
 
+    while (1) {
+        size_t size;
+
+        if (0 != read_exact(child_stdout, &header, sizeof(header)))
+            return -1;
+        size = ntohs(header.size);
+        if ( (size < GLAB_HEADER_SIZE) ||
+             (size - GLAB_HEADER_SIZE >= MAX_SIZE) )
+            return -1;
+        size -= GLAB_HEADER_SIZE;
+        if (0 != read_exact(child_stdout, text, size))
+            return -1;
+        if (0 == ntohs(header.type)) {
+            text[size] = '\0';
+            return 0;
+        }
+    }
+}
 
+/**
+ * The trie FIB forwards like the routing table with and without
+ * aggregation, also where a more specific route splits an aggregated
+ * prefix and where aggregation could cover a hole; aggregation needs
+ * fewer entries.
+ */
+int testA11(const char *binary) {
+    int child_stdin, child_stdout;
+    pid_t chld = start_router_with_gateways(binary, &child_stdin, &child_stdout);
+    struct {
+        const char *dst;
+        uint16_t ifc;
+        const struct MacAddress *mac;
+    } expected[] = {
+        { "10.10.0.5", 1, &gateway1 },
+        { "10.10.1.5", 1, &gateway1 },
+        { "10.10.1.127", 1, &gateway1 },
+        { "10.10.1.200", 2, &gateway2 },
+        { "10.10.2.5", 0, NULL }, //no route
+        { "10.10.3.5", 1, &gateway1 },
+    };
+    const char *modes[] = { "off", "on" };
+    unsigned int entries[2] = { 0, 0 };
+    int result = 1;
+
+    send_command(child_stdin, "route add 10.10.0.0/24 via 192.168.1.254 dev eth1");
+    send_command(child_stdin, "route add 10.10.1.0/24 via 192.168.1.254 dev eth1");
+    send_command(child_stdin, "route add 10.10.1.128/25 via 192.168.2.254 dev eth2");
+    send_command(child_stdin, "route add 10.10.3.0/24 via 192.168.1.254 dev eth1");
+    for (unsigned int m = 0; m < 2; m++) {
+        char command[32];
+        char text[MAX_SIZE];
+        const char *line;
+
+        snprintf(command, sizeof(command), "route fib %s", modes[m]);
+        send_command(child_stdin, command);
+        if ( (0 != read_output(child_stdout, text)) ||
+             (NULL == (line = strstr(text, "vrf 0: "))) ||
+             (1 != sscanf(line, "vrf 0: %*u prefixes, %u entries", &entries[m])) ) {
+            fprintf(stderr, "no FIB size for `%s'\n", command);
+            result = -1;
+        }
+        for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+            struct MacAddress mac;
+            uint16_t ifc = forward_udp(child_stdin, child_stdout, 3, &eth3mac, "192.168.3.2", expected[i].dst, 1000, &mac);
+
+            if ( (ifc != expected[i].ifc) ||
+                 ( (0 != ifc) &&
+                   (0 != maccomp(&mac, expected[i].mac)) ) ) {
+                fprintf(stderr, "with aggregation %s %s routed to interface %u, expected %u\n",
+                        modes[m], expected[i].dst, ifc, expected[i].ifc);
+                result = -1;
+            }
+        }
+    }
+    if (entries[1] >= entries[0]) {
+        fprintf(stderr, "aggregation did not reduce the FIB from %u entries\n", entries[0]);
+        result = -1;
+    }
+    stop_router(chld, child_stdin, child_stdout);
+    printf("TestID A11: %s.\n", (1 == result) ? "passed" : "failed");
+    return result;
+}
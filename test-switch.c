@@ -96,16 +96,19 @@ int main(int argc, char **argv) {
     /////////   Test06: Device that is already known is plugged into another port (broadcast and sending another frame)  /////////
     int result06 = test06(child_stdin,child_stdout);
 
+    /////////   Test07: Port mirroring: frames received on interface 2 are copied to interface 3  /////////
+    int result07 = test07(child_stdin,child_stdout);
+
     ///////// test results ////////////
-    int result = result01+result02+result03+result04+result05+result06;
-    printf("\nResult: %d/6 passed\n", result);
+    int result = result01+result02+result03+result04+result05+result06+result07;
+    printf("\nResult: %d/7 passed\n", result);
 
 
     // stop child process
     kill(chld, SIGKILL);
     printf("Test procedure complete!\n");
 
-    if (6 == result) {
+    if (7 == result) {
         return 0;
     }else {
         return -1;
@@ -575,4 +578,86 @@ int test06(int child_stdin, int child_stdout){
     } else {printf("Test06: failed\n");
     }
     return passed;
-}
\ No newline at end of file
+}
+
+/**
+ *  ***** TEST 07  ******
+ *  Port mirroring: a mirroring session copies frames received on interface 2 to interface 3.
+ *  A broadcast from a new device on interface 2 must arrive once on interface 1 and twice on
+ *  interface 3 (flooded copy and mirrored copy).
+ *@param child_stdin standard input number of switch
+ * @param child_stdout standard output number of switch
+ * @return 1 on success, 0 on fail
+ */
+int test07(int child_stdin, int child_stdout){
+    printf("Test07: Port mirroring of received frames\n");
+    struct MacAddress newMac = {0x00, 0x77, 0x77, 0x77, 0x77, 0x77};
+
+    // configure mirroring session
+    const char cmd[] = "mirror add 2 3 rx\n";
+    char writeBufC[GLAB_HEADER_SIZE + sizeof(cmd) - 1];
+    struct GLAB_MessageHeader cmdHeader;
+    cmdHeader.type = htons(0);
+    cmdHeader.size = htons(sizeof(writeBufC));
+    memcpy(writeBufC, &cmdHeader, sizeof(cmdHeader));
+    memcpy(&writeBufC[sizeof(cmdHeader)], cmd, sizeof(cmd) - 1);
+    write_all(child_stdin, writeBufC, sizeof(writeBufC));
+
+    // send broadcast on interface 2
+    char writeBuf1[GLAB_HEADER_SIZE + ETHERNET_HEADER_SIZE];
+    struct GLAB_MessageHeader msgHeader;
+    msgHeader.type = htons(2);
+    msgHeader.size = htons(sizeof(writeBuf1));
+
+    struct EthernetHeader ethHeader;
+    ethHeader.src = newMac;
+    ethHeader.dst = broadcast;
+
+    memcpy(writeBuf1, &msgHeader, sizeof(msgHeader));
+    memcpy(&writeBuf1[sizeof(msgHeader)], &ethHeader, sizeof(ethHeader));
+    write_all(child_stdin, writeBuf1, sizeof(writeBuf1));
+
+    // read
+    char readBuf[MAX_SIZE];
+    struct GLAB_MessageHeader readGHeader;
+    size_t off = 0;    ssize_t ret;     uint16_t size;
+    sleep(1); // wait for switch
+    ret = read(child_stdout, &readBuf[off], sizeof(readBuf) - off);
+    if (0 >= ret) {
+        printf("Test07: failed: no frame received\n");
+        return 0;
+    }
+    off += ret;
+
+    int framesOn1 = 0;
+    int framesOn3 = 0;
+    while (off > GLAB_HEADER_SIZE) {
+        memcpy(&readGHeader, readBuf, GLAB_HEADER_SIZE);
+        size = ntohs(readGHeader.size);
+        if (off < size) break;
+        if (size < GLAB_HEADER_SIZE) abort();
+
+        struct EthernetHeader readEHeader;
+        memcpy(&readEHeader, &readBuf[GLAB_HEADER_SIZE], ETHERNET_HEADER_SIZE);
+        if (0 != maccomp(&newMac, &readEHeader.src)) {
+            printf("Test07: failed: Received an unexpected frame by interface nr. %d.\n", ntohs(readGHeader.type));
+            return 0;
+        }
+        if (1 == ntohs(readGHeader.type)) {
+            framesOn1++;
+        } else if (3 == ntohs(readGHeader.type)) {
+            framesOn3++;
+        } else {
+            printf("Test07: failed: Received an unexpected frame by interface nr. %d.\n", ntohs(readGHeader.type));
+            return 0;
+        }
+        memmove(readBuf, &readBuf[size], off - size);
+        off -= size;
+    }
+    if (1 != framesOn1 || 2 != framesOn3) {
+        printf("Test07: failed: Expect 1 frame on interface 1 and 2 on interface 3, but got %d and %d\n", framesOn1, framesOn3);
+        return 0;
+    }
+    printf("Test07: succeeded\n");
+    return 1;
+}
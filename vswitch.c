@@ -23,6 +23,7 @@
  */
 #include "glab.h"
 #include "print.c"
+#include "stats.c"
 
 
 /**
@@ -36,12 +37,43 @@
  */
 #define NO_VLAN (-1)
 
+/**
+ * Number of 64-bit words in a bitmap with one bit per 802.1Q VLAN ID.
+ */
+#define VLAN_BITMAP_WORDS (4096 / 64)
+
 /**
  * Which VLAN should we assume for untagged frames on
  * interfaces without any specified tag?
  */
 #define DEFAULT_VLAN 0
 
+/**
+ * TPID of an IEEE 802.1Q tag.
+ */
+#define ETH_802_1Q_TAG 0x8100
+
+/**
+ * Bits of the TCI that contain the VLAN ID.
+ */
+#define VLAN_ID_MASK 0x0FFF
+
+/**
+ * Number of buckets in the forwarding database (must be a power of 2).
+ */
+#define FDB_SIZE 4096
+
+/**
+ * How many buckets do we probe for a (VLAN, MAC) key before we
+ * evict the oldest entry in the probe window?
+ */
+#define FDB_PROBES 8
+
+/**
+ * After how many seconds do we forget a learned MAC?
+ */
+#define FDB_MAX_AGE 300
+
 /**
  * gcc 4.x-ism to pack structures (to be used before structs);
  * Using this still causes structs to be unaligned on the stack on Sparc
@@ -80,7 +112,7 @@ struct Interface
   struct MacAddress mac;
 
   /**
-   * Number of this interface.
+   * Number of this interface, 0 if this slot is unused.
    */
   uint16_t ifc_num;
 
@@ -91,9 +123,9 @@ struct Interface
 
   /**
    * Which tagged VLANs does this interface participate in?
-   * Array terminated by #NO_VLAN entry.
+   * Bitmap indexed by VLAN ID.
    */
-  int16_t tagged_vlans[MAX_VLANS + 1];
+  uint64_t tagged_vlans[VLAN_BITMAP_WORDS];
 
   /**
    * Which untagged VLAN does this interface participate in?
@@ -105,15 +137,334 @@ struct Interface
 
 
 /**
- * Number of available contexts.
+ * Entry in the forwarding database, keyed by (VLAN, MAC).
+ */
+struct FdbEntry
+{
+  /**
+   * MAC address that was learned.
+   */
+  struct MacAddress mac;
+
+  /**
+   * VLAN the MAC was learned on.
+   */
+  int16_t vlan;
+
+  /**
+   * Interface the MAC was learned on, 0 if the entry is unused.
+   */
+  uint16_t ifc_num;
+
+  /**
+   * When did we last see a frame from @e mac?
+   */
+  time_t timestamp;
+};
+
+
+/**
+ * Length of #gifc (some slots may be unused).
  */
 static unsigned int num_ifc;
 
 /**
- * All the contexts.
+ * All the contexts, indexed by interface number - 1.
  */
 static struct Interface *gifc;
 
+/**
+ * Forwarding database, open addressing with linear probing.
+ */
+static struct FdbEntry fdb[FDB_SIZE];
+
+/**
+ * Number of 64-bit words in a bitmap with one bit per interface.
+ */
+static unsigned int ifc_words;
+
+/**
+ * For each VLAN, bitmap of the interfaces participating in it
+ * (#ifc_words per VLAN).  Recomputed by rebuild_vlan_ports().
+ */
+static uint64_t *vlan_ports;
+
+/**
+ * For each VLAN, bitmap of the interfaces carrying it tagged
+ * (#ifc_words per VLAN).  Recomputed by rebuild_vlan_ports().
+ */
+static uint64_t *vlan_tagged_ports;
+
+/**
+ * Output buffer.  The frame is copied in once, behind enough headroom
+ * to prepend a GLAB header and an 802.1Q tag; tags are pushed and
+ * popped in place by moving the 12 bytes of MAC addresses.
+ */
+static uint8_t obuf[sizeof (struct GLAB_MessageHeader)
+                    + sizeof (struct Q)
+                    + UINT16_MAX];
+
+/**
+ * Does #obuf currently hold the frame with an 802.1Q tag?
+ */
+static int obuf_tagged;
+
+/**
+ * Offset in #obuf where the frame payload (starting with the
+ * Ethernet type) is placed.
+ */
+#define OBUF_PAYLOAD (sizeof (struct GLAB_MessageHeader) \
+                      + 2 * sizeof (struct MacAddress)    \
+                      + sizeof (struct Q))
+
+
+/**
+ * Compute the FDB bucket for a (VLAN, MAC) key.
+ *
+ * @param vlan the VLAN
+ * @param mac the MAC address
+ * @return bucket index
+ */
+static unsigned int
+fdb_hash (int16_t vlan,
+	  const struct MacAddress *mac)
+{
+  uint32_t h = 2166136261u;
+
+  for (unsigned int i = 0; i < MAC_ADDR_SIZE; i++)
+    h = (h ^ mac->mac[i]) * 16777619u;
+  h = (h ^ (uint16_t) vlan) * 16777619u;
+  return (h ^ (h >> 16)) & (FDB_SIZE - 1);
+}
+
+
+/**
+ * Find the interface on which @a mac was last seen in @a vlan.
+ *
+ * @param vlan the VLAN
+ * @param mac the MAC address
+ * @param now current time
+ * @return interface number, 0 if unknown
+ */
+static uint16_t
+fdb_lookup (int16_t vlan,
+	    const struct MacAddress *mac,
+	    time_t now)
+{
+  unsigned int h = fdb_hash (vlan,
+			     mac);
+
+  for (unsigned int i = 0; i < FDB_PROBES; i++)
+  {
+    struct FdbEntry *e = &fdb[(h + i) & (FDB_SIZE - 1)];
+
+    if ( (0 != e->ifc_num) &&
+	 (e->vlan == vlan) &&
+	 (0 == memcmp (&e->mac,
+		       mac,
+		       sizeof (*mac))) )
+    {
+      if (now - e->timestamp > FDB_MAX_AGE)
+	return 0;
+      return e->ifc_num;
+    }
+  }
+  return 0;
+}
+
+
+/**
+ * Learn that @a mac lives on @a ifc_num in @a vlan.
+ *
+ * @param vlan the VLAN
+ * @param mac the source MAC address
+ * @param ifc_num interface the frame came from
+ * @param now current time
+ */
+static void
+fdb_learn (int16_t vlan,
+	   const struct MacAddress *mac,
+	   uint16_t ifc_num,
+	   time_t now)
+{
+  unsigned int h = fdb_hash (vlan,
+			     mac);
+  struct FdbEntry *victim = NULL;
+
+  for (unsigned int i = 0; i < FDB_PROBES; i++)
+  {
+    struct FdbEntry *e = &fdb[(h + i) & (FDB_SIZE - 1)];
+
+    if ( (0 != e->ifc_num) &&
+	 (e->vlan == vlan) &&
+	 (0 == memcmp (&e->mac,
+		       mac,
+		       sizeof (*mac))) )
+    {
+      victim = e;
+      break;
+    }
+    if ( (NULL == victim) ||
+	 ( (0 != victim->ifc_num) &&
+	   ( (0 == e->ifc_num) ||
+	     (e->timestamp < victim->timestamp) ) ) )
+      victim = e;
+  }
+  if ( (0 != victim->ifc_num) &&
+       ( (victim->vlan != vlan) ||
+	 (0 != memcmp (&victim->mac,
+		       mac,
+		       sizeof (*mac))) ) )
+    stats.table_evictions++;
+  victim->mac = *mac;
+  victim->vlan = vlan;
+  victim->ifc_num = ifc_num;
+  victim->timestamp = now;
+}
+
+
+/**
+ * Check if @a ifc carries @a vlan tagged.
+ *
+ * @param ifc interface to check
+ * @param vlan the VLAN
+ * @return non-zero if @a vlan is in the tagged VLANs of @a ifc
+ */
+static int
+is_tagged_member (const struct Interface *ifc,
+		  int16_t vlan)
+{
+  return 0 != (ifc->tagged_vlans[vlan / 64] & (1LLU << (vlan % 64)));
+}
+
+
+/**
+ * Recompute the per-VLAN port bitmaps from the interface
+ * membership.  Must be called whenever the membership changes.
+ *
+ * @return 0 on success
+ */
+static int
+rebuild_vlan_ports ()
+{
+  size_t size;
+
+  ifc_words = (num_ifc + 63) / 64;
+  size = (size_t) (MAX_VLANS + 1) * ifc_words * sizeof (uint64_t);
+  free (vlan_ports);
+  free (vlan_tagged_ports);
+  vlan_ports = calloc (1, size);
+  vlan_tagged_ports = calloc (1, size);
+  if ( (NULL == vlan_ports) ||
+       (NULL == vlan_tagged_ports) )
+  {
+    perror ("calloc");
+    return 1;
+  }
+  for (unsigned int i = 0; i < num_ifc; i++)
+  {
+    const struct Interface *ifc = &gifc[i];
+    uint64_t bit = 1LLU << (i % 64);
+
+    if (0 == ifc->ifc_num)
+      continue;
+    if (NO_VLAN != ifc->untagged_vlan)
+      vlan_ports[ifc->untagged_vlan * ifc_words + i / 64] |= bit;
+    for (unsigned int w = 0; w < VLAN_BITMAP_WORDS; w++)
+    {
+      uint64_t tv = ifc->tagged_vlans[w];
+
+      while (0 != tv)
+      {
+	unsigned int v = w * 64 + __builtin_ctzll (tv);
+
+	tv &= tv - 1;
+	if (v > MAX_VLANS)
+	  break;
+	vlan_ports[v * ifc_words + i / 64] |= bit;
+	vlan_tagged_ports[v * ifc_words + i / 64] |= bit;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/**
+ * Arrange the frame in #obuf with or without 802.1Q tag by moving the
+ * MAC addresses in front of the payload.
+ *
+ * @param tagged should the frame carry a tag?
+ * @param tci tag control information to use if @a tagged
+ * @return offset of the GLAB header in #obuf
+ */
+static size_t
+obuf_set_tagged (int tagged,
+		 uint16_t tci)
+{
+  const size_t macs = 2 * sizeof (struct MacAddress);
+  const size_t tagged_off = OBUF_PAYLOAD - sizeof (struct Q) - macs;
+  const size_t untagged_off = OBUF_PAYLOAD - macs;
+
+  if (tagged)
+  {
+    struct Q q = {
+      .tpid = htons (ETH_802_1Q_TAG),
+      .tci = htons (tci)
+    };
+
+    if (! obuf_tagged)
+      memmove (&obuf[tagged_off],
+	       &obuf[untagged_off],
+	       macs);
+    memcpy (&obuf[tagged_off + macs],
+	    &q,
+	    sizeof (q));
+    obuf_tagged = 1;
+    return tagged_off - sizeof (struct GLAB_MessageHeader);
+  }
+  if (obuf_tagged)
+    memmove (&obuf[untagged_off],
+	     &obuf[tagged_off],
+	     macs);
+  obuf_tagged = 0;
+  return untagged_off - sizeof (struct GLAB_MessageHeader);
+}
+
+
+/**
+ * Send the frame currently in #obuf to @a dst.
+ *
+ * @param dst interface to send to
+ * @param off offset of the GLAB header in #obuf
+ * @param payload_size number of bytes at #OBUF_PAYLOAD
+ */
+static void
+obuf_send (const struct Interface *dst,
+	   size_t off,
+	   size_t payload_size)
+{
+  size_t size = OBUF_PAYLOAD + payload_size - off;
+  struct GLAB_MessageHeader hdr = {
+    .size = htons (size),
+    .type = htons (dst->ifc_num)
+  };
+
+  if (size > UINT16_MAX)
+  {
+    stats_drop (DROP_TOO_LARGE);
+    return; /* no room for the tag */
+  }
+  memcpy (&obuf[off],
+	  &hdr,
+	  sizeof (hdr));
+  write_all (STDOUT_FILENO,
+	     &obuf[off],
+	     size);
+  stats_tx (dst->ifc_num,
+	    size - sizeof (hdr));
+}
+
 
 /**
  * Parse and process frame received on @a ifc.
@@ -129,17 +480,137 @@ parse_frame (struct Interface *ifc,
 {
   const uint8_t *framec = frame;
   struct EthernetHeader eh;
+  const uint8_t *payload;
+  size_t payload_size;
+  uint16_t tci;
+  int16_t vlan;
+  uint16_t dst_num;
+  time_t now;
 
   if (frame_size < sizeof (eh))
   {
     fprintf (stderr,
 	     "Malformed frame\n");
+    stats_drop (DROP_MALFORMED);
     return;
   }
   memcpy (&eh,
 	  frame,
 	  sizeof (eh));
-  /* DO work here! */
+  if (ETH_802_1Q_TAG == ntohs (eh.tag))
+  {
+    struct Q q;
+
+    if (frame_size < 2 * sizeof (struct MacAddress) + sizeof (q) + sizeof (uint16_t))
+    {
+      fprintf (stderr,
+	       "Malformed frame\n");
+      stats_drop (DROP_MALFORMED);
+      return;
+    }
+    memcpy (&q,
+	    &framec[2 * sizeof (struct MacAddress)],
+	    sizeof (q));
+    tci = ntohs (q.tci);
+    payload = &framec[2 * sizeof (struct MacAddress) + sizeof (q)];
+    vlan = (int16_t) (tci & VLAN_ID_MASK);
+    if (0 == vlan)
+    {
+      /* priority tag only */
+      vlan = ifc->untagged_vlan;
+    }
+    else if ( (vlan > MAX_VLANS) ||
+	      (! is_tagged_member (ifc,
+				   vlan)) )
+    {
+      stats_drop (DROP_VLAN);
+      return; /* not a member of this VLAN, drop */
+    }
+  }
+  else
+  {
+    tci = 0;
+    payload = &framec[2 * sizeof (struct MacAddress)];
+    vlan = ifc->untagged_vlan;
+  }
+  if (NO_VLAN == vlan)
+  {
+    stats_drop (DROP_VLAN);
+    return; /* untagged traffic not allowed here */
+  }
+  tci = (tci & ~VLAN_ID_MASK) | (uint16_t) vlan;
+  payload_size = frame_size - (payload - framec);
+
+  now = time (NULL);
+  if (0 == (eh.src.mac[0] & 1))
+    fdb_learn (vlan,
+	       &eh.src,
+	       ifc->ifc_num,
+	       now);
+
+  /* copy the frame once, untagged, into the output buffer */
+  memcpy (&obuf[OBUF_PAYLOAD - 2 * sizeof (struct MacAddress)],
+	  framec,
+	  2 * sizeof (struct MacAddress));
+  memcpy (&obuf[OBUF_PAYLOAD],
+	  payload,
+	  payload_size);
+  obuf_tagged = 0;
+
+  dst_num = (0 == (eh.dst.mac[0] & 1))
+    ? fdb_lookup (vlan,
+		  &eh.dst,
+		  now)
+    : 0;
+  if (0 != dst_num)
+  {
+    struct Interface *dst = &gifc[dst_num - 1];
+
+    stats.table_hits++;
+    if (dst == ifc)
+    {
+      stats_drop (DROP_SAME_PORT);
+      return; /* destination is on the segment the frame came from */
+    }
+    obuf_send (dst,
+	       obuf_set_tagged (dst->untagged_vlan != vlan,
+				tci),
+	       payload_size);
+    return;
+  }
+
+  if (0 == (eh.dst.mac[0] & 1))
+    stats.table_misses++;
+  stats.floods++;
+  {
+    const uint64_t *ports = &vlan_ports[vlan * ifc_words];
+    const uint64_t *tagged = &vlan_tagged_ports[vlan * ifc_words];
+    unsigned int in = ifc->ifc_num - 1;
+
+    /* untagged members first, so that a flood needs at most one tag push */
+    for (int want_tagged = 0; want_tagged <= 1; want_tagged++)
+    {
+      size_t off = obuf_set_tagged (want_tagged,
+				    tci);
+
+      for (unsigned int w = 0; w < ifc_words; w++)
+      {
+	uint64_t set = ports[w] & (want_tagged ? tagged[w] : ~tagged[w]);
+
+	if (w == in / 64)
+	  set &= ~(1LLU << (in % 64));
+	while (0 != set)
+	{
+	  unsigned int i = w * 64 + __builtin_ctzll (set);
+
+	  set &= set - 1;
+	  obuf_send (&gifc[i],
+		     off,
+		     payload_size);
+	}
+      }
+    }
+  }
 }
 
 
@@ -157,6 +628,10 @@ handle_frame (uint16_t interface,
 {
   if (interface > num_ifc)
     abort ();
+  if (0 == gifc[interface - 1].ifc_num)
+    return; /* removed, or its configuration was rejected */
+  stats_rx (interface,
+	    frame_size);
   parse_frame (&gifc[interface - 1],
 	       frame,
 	       frame_size);
@@ -173,10 +648,20 @@ static void
 handle_control (char *cmd,
 		size_t cmd_len)
 {
+  const char *tok;
+
   cmd[cmd_len - 1] = '\0';
-  fprintf (stderr,
-           "Received command `%s' (ignored)\n",
-           cmd);
+  tok = strtok (cmd,
+		" ");
+  if (NULL == tok)
+    return;
+  if (0 == strcasecmp (tok,
+		       "stats"))
+    stats_command ();
+  else
+    fprintf (stderr,
+	     "Received command `%s' (ignored)\n",
+	     tok);
 }
 
 
@@ -213,7 +698,6 @@ parse_tagged (const char *start,
 	      struct Interface *ifc)
 {
   char *spec;
-  unsigned int pos;
 
   if (':' != *start)
   {
@@ -230,7 +714,6 @@ parse_tagged (const char *start,
     perror ("strndup");
     return 1;
   }
-  pos = 0;
   for (const char *tok = strtok (spec,
 				 ",");
        NULL != tok;
@@ -239,14 +722,6 @@ parse_tagged (const char *start,
   {
     unsigned int tag;
 
-    if (pos == MAX_VLANS)
-    {
-      fprintf (stderr,
-	       "Too many VLANs specified for interface #%d\n",
-	       off);
-      free (spec);
-      return 1;
-    }
     if (1 != sscanf (tok,
 		     "%u",
 		     &tag))
@@ -266,9 +741,8 @@ parse_tagged (const char *start,
       free (spec);
       return 1;
     }
-    ifc->tagged_vlans[pos++] = (int16_t) tag;
+    ifc->tagged_vlans[tag / 64] |= 1LLU << (tag % 64);
   }
-  ifc->tagged_vlans[pos] = NO_VLAN;
   free (spec);
   return 0;
 }
@@ -349,7 +823,9 @@ parse_vlan_args (const char *arg,
   const char *openbracket;
   const char *closebracket;
 
-  ifc->tagged_vlans[0] = NO_VLAN;
+  memset (ifc->tagged_vlans,
+	  0,
+	  sizeof (ifc->tagged_vlans));
   ifc->untagged_vlan = NO_VLAN;
   openbracket = strchr (arg,
 			(unsigned char) '[');
@@ -405,6 +881,73 @@ parse_vlan_args (const char *arg,
 }
 
 
+/**
+ * Handle interface @a ifc_num with @a mac and configuration @a arg
+ * added at runtime.
+ *
+ * @param ifc_num number of the new interface
+ * @param mac the MAC address of the interface
+ * @param arg interface specification (as on the command line)
+ */
+static void
+handle_ifc_add (uint16_t ifc_num,
+		const struct MacAddress *mac,
+		const char *arg)
+{
+  struct Interface ifc;
+
+  memset (&ifc,
+	  0,
+	  sizeof (ifc));
+  if (0 !=
+      parse_vlan_args (arg,
+		       ifc_num,
+		       &ifc))
+  {
+    free (ifc.ifc_name);
+    return;
+  }
+  ifc.ifc_num = ifc_num;
+  ifc.mac = *mac;
+  grow_array (&gifc,
+	      sizeof (struct Interface),
+	      &num_ifc,
+	      ifc_num);
+  stats_init ("vswitch",
+	      num_ifc);
+  free (gifc[ifc_num - 1].ifc_name);
+  gifc[ifc_num - 1] = ifc;
+  stats_set_name (ifc_num,
+		  gifc[ifc_num - 1].ifc_name);
+  if (0 != rebuild_vlan_ports ())
+    abort ();
+}
+
+
+/**
+ * Handle interface @a ifc_num being removed at runtime: forget what
+ * we learned about it.
+ *
+ * @param ifc_num number of the removed interface
+ */
+static void
+handle_ifc_del (uint16_t ifc_num)
+{
+  if (ifc_num > num_ifc)
+    return;
+  for (unsigned int i = 0; i < FDB_SIZE; i++)
+    if (fdb[i].ifc_num == ifc_num)
+      fdb[i].ifc_num = 0;
+  stats_clear (ifc_num);
+  free (gifc[ifc_num - 1].ifc_name);
+  memset (&gifc[ifc_num - 1],
+	  0,
+	  sizeof (struct Interface));
+  if (0 != rebuild_vlan_ports ())
+    abort ();
+}
+
+
 #include "loop.c"
 
 
@@ -419,23 +962,29 @@ int
 main (int argc,
       char **argv)
 {
-  struct Interface ifc[argc-1];
-
   (void) print;
-  memset (ifc,
-	  0,
-	  sizeof (ifc));
-  num_ifc = argc - 1;
-  gifc = ifc;
+  grow_array (&gifc,
+	      sizeof (struct Interface),
+	      &num_ifc,
+	      argc - 1);
+  stats_init ("vswitch",
+	      num_ifc);
   for (unsigned int i=1;i<argc;i++)
   {
-    ifc[i-1].ifc_num = i;
+    gifc[i-1].ifc_num = i;
     if (0 !=
 	parse_vlan_args (argv[i],
 			 i,
-			 &ifc[i-1]))
+			 &gifc[i-1]))
       return 1;
+    stats_set_name (i,
+		    gifc[i-1].ifc_name);
   }
+  if (0 != rebuild_vlan_ports ())
+    return 1;
   loop ();
+  for (unsigned int i = 0; i < num_ifc; i++)
+    free (gifc[i].ifc_name);
+  free (gifc);
   return 0;
 }